@@ -0,0 +1,343 @@
+/*************************************************************************
+
+   Program:    QTree
+   File:       animate.c
+
+   Version:    V3.18
+   Date:       19.10.26
+   Function:   Keyframe animations of one structure
+
+   Copyright:  (c) SciTech Software 2026
+   Author:     Prof. Andrew C. R. Martin
+   EMail:      andrew@bioinf.org.uk
+
+**************************************************************************
+
+   This program is not in the public domain.
+
+   It may not be copied or made available to third parties, but may be
+   freely used by non-profit-making organisations who have obtained it
+   directly from the author or by FTP.
+
+   You are requested to send EMail to the author to say that you are
+   using this code so that you may be informed of future updates.
+
+   The code may not be made available on other FTP sites without express
+   permission from the author.
+
+   The code may be modified as required, but any modifications must be
+   documented so that the person responsible can be identified. If
+   someone else breaks this code, the author doesn't want to be blamed
+   for code that does not work! You may not distribute any
+   modifications, but are encouraged to send them to the author so
+   that they may be incorporated into future versions of the code.
+
+   The code may not be sold commercially or used for commercial purposes
+   without prior permission from the author.
+
+**************************************************************************
+
+   Description:
+   ============
+   Renders the frames of an animation given in the control file with
+   FRAMES and KEYFRAME. The structure is read, coloured and mapped to
+   the screen once, giving frame 0. Each keyframe then holds the
+   rotations, scale and centre reached at its frame, starting from the
+   previous keyframe (or frame 0). Between keyframes the motion is
+   interpolated linearly and after the last keyframe the view is held.
+
+**************************************************************************
+
+   Usage:
+   ======
+   InitAnimation() is called after MapSpheres() and before SLAB is
+   applied, to find where the atoms given to CENTRE are on the screen.
+   RenderAnimation() is then called in place of SpaceFill().
+
+**************************************************************************
+
+   Notes:
+   ======
+   Each frame moves the mapped spheres of frame 0 to the frame's view
+   and re-sorts the index on x which the quad tree uses. Consecutive
+   frames move the spheres only a little, so the index from the last
+   frame is nearly in order and is re-sorted with ResortSpheresOnX().
+
+   Rotations are about the centre of the view and all the rotations of
+   a keyframe are interpolated together.
+
+   SLAB is applied once to frame 0. The depth cueing range is scaled
+   with the view but not changed by rotations.
+
+**************************************************************************
+
+   Revision History:
+   =================
+   V3.18 19.10.26 Original
+
+*************************************************************************/
+/* Includes
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bioplib/macros.h"
+#include "bioplib/MathType.h"
+#include "bioplib/SysDefs.h"
+#include "bioplib/pdb.h"
+#include "bioplib/matrix.h"
+
+#include "qtree.h"
+#include "qtree.p"
+#include "graphics.p"
+#include "frames.p"
+#include "animate.p"
+
+/************************************************************************/
+/* Variables global to this file only
+*/
+static SPHERE *sBase    = NULL;  /* Spheres of frame 0                  */
+static SPHERE *sSpheres = NULL;  /* Spheres of the current frame        */
+static SPHERE **sSrtSph = NULL;  /* sSpheres sorted on x                */
+static int    sNSphere  = 0;
+#ifdef DEPTHCUE
+static DCUE   sBaseCue;          /* Depth cueing of frame 0             */
+#endif
+
+/************************************************************************/
+/* Prototypes
+*/
+static BOOL AnimateFrame(int frame);
+static BOOL FrameView(int frame, VEC3F axes[3], REAL *scale,
+                      REAL centre[3]);
+
+
+/************************************************************************/
+/*>void InitAnimation(SPHERE *spheres, int NSphere)
+   ------------------------------------------------
+   Input:   SPHERE *spheres    Mapped spheres, one for each atom
+            int    NSphere     Number of spheres
+
+   Finds the screen position of the atom each keyframe centres on.
+
+   19.10.26 Original    By: ACRM
+*/
+void InitAnimation(SPHERE *spheres, int NSphere)
+{
+   KEYFRAME *key;
+   int      i;
+
+   for(i=0; i<gNKeyFrames; i++)
+   {
+      key = &(gKeyFrames[i]);
+      if(key->centreAtom >= NSphere)
+         key->centreAtom = (-1);
+      if(key->centreAtom >= 0)
+      {
+         key->centre[0] = spheres[key->centreAtom].x;
+         key->centre[1] = spheres[key->centreAtom].y;
+         key->centre[2] = spheres[key->centreAtom].z;
+      }
+   }
+}
+
+
+/************************************************************************/
+/*>BOOL RenderAnimation(SPHERE *spheres, int NSphere, char *outFile,
+                        int outFormat)
+   -----------------------------------------------------------------
+   Input:   SPHERE *spheres    Mapped spheres of frame 0 (after SLAB)
+            int    NSphere     Number of spheres
+            char   *outFile    Output filename containing %d, or the
+                               stream (blank for stdout) for Y4M
+            int    outFormat   Output format
+   Returns: BOOL               Success?
+
+   Renders and writes the gNFrames frames of the animation. The
+   spheres are used for each frame in turn and are left as the last
+   frame rendered.
+
+   19.10.26 Original    By: ACRM
+*/
+BOOL RenderAnimation(SPHERE *spheres, int NSphere, char *outFile,
+                     int outFormat)
+{
+   BOOL ok;
+
+   if(NSphere == 0)
+   {
+      fprintf(stderr,"No atoms to animate\n");
+      return(FALSE);
+   }
+   if((sBase = (SPHERE *)malloc(NSphere * sizeof(SPHERE))) == NULL)
+   {
+      fprintf(stderr,"No memory for animation\n");
+      return(FALSE);
+   }
+   memcpy(sBase, spheres, NSphere * sizeof(SPHERE));
+   sSpheres = spheres;
+   sNSphere = NSphere;
+#ifdef DEPTHCUE
+   sBaseCue = gDepthCue;
+#endif
+
+   ok = RenderFrames(gNFrames, 0, outFile, outFormat, AnimateFrame);
+
+   if(sSrtSph != NULL) free(sSrtSph);
+   free(sBase);
+   sSrtSph = NULL;
+   sBase   = NULL;
+   return(ok);
+}
+
+
+/************************************************************************/
+/*>static BOOL AnimateFrame(int frame)
+   -----------------------------------
+   Input:   int    frame       Frame number
+   Returns: BOOL               Success?
+
+   Moves the spheres to the view for this frame and renders them into
+   the framebuffer.
+
+   19.10.26 Original    By: ACRM
+*/
+static BOOL AnimateFrame(int frame)
+{
+   VEC3F  axes[3];
+   SPHERE *in,
+          *out;
+   REAL   scale,
+          centre[3],
+          x, y, z,
+          midx, midy,
+          fringe;
+   int    i;
+
+   if(!FrameView(frame, axes, &scale, centre))
+   {
+      /* Still the view of frame 0                                      */
+      memcpy(sSpheres, sBase, sNSphere * sizeof(SPHERE));
+#ifdef DEPTHCUE
+      gDepthCue = sBaseCue;
+#endif
+   }
+   else
+   {
+      midx   = (REAL)(gRender[0] / 2);
+      midy   = (REAL)(gRender[1] / 2);
+      fringe = gAntiAlias ? AA_FRINGE : 0.0;
+
+      for(i=0; i<sNSphere; i++)
+      {
+         in  = sBase + i;
+         out = sSpheres + i;
+
+         x = (in->x - centre[0]) * scale;
+         y = (in->y - centre[1]) * scale;
+         z = (in->z - centre[2]) * scale;
+
+         out->x    = x*axes[0].x + y*axes[1].x + z*axes[2].x + midx;
+         out->y    = x*axes[0].y + y*axes[1].y + z*axes[2].y + midy;
+         out->z    = x*axes[0].z + y*axes[1].z + z*axes[2].z;
+         out->rad  = in->rad * scale;
+         out->xmax = out->x + out->rad + fringe;
+         out->xmin = out->x - out->rad - fringe;
+         out->ymax = out->y + out->rad + fringe;
+         out->ymin = out->y - out->rad - fringe;
+      }
+#ifdef DEPTHCUE
+      gDepthCue.ZMin   = (sBaseCue.ZMin - centre[2]) * scale;
+      gDepthCue.ZRange = sBaseCue.ZRange * scale;
+#endif
+   }
+
+   /* The spheres have moved a little since this process's last frame,
+      so the old index needs only a few swaps
+   */
+   if((sSrtSph == NULL) || !ResortSpheresOnX(sSrtSph, sNSphere))
+   {
+      if(sSrtSph != NULL)
+         free(sSrtSph);
+      if((sSrtSph = SortSpheresOnX(sSpheres, sNSphere)) == NULL)
+         return(FALSE);
+   }
+
+   SetBand(0);
+   return(SpaceFillRows(sSrtSph, sNSphere, 0, gScreen[1]));
+}
+
+
+/************************************************************************/
+/*>static BOOL FrameView(int frame, VEC3F axes[3], REAL *scale,
+                         REAL centre[3])
+   ------------------------------------------------------------
+   Input:   int    frame       Frame number
+   Output:  VEC3F  axes[3]     Where the x, y and z axes of frame 0
+                               point in this frame
+            REAL   *scale      Size relative to frame 0
+            REAL   centre[3]   Point of frame 0 (screen coordinates)
+                               at the centre of this frame
+   Returns: BOOL               FALSE if the view is still that of
+                               frame 0
+
+   Interpolates the keyframes to find the view for a frame.
+
+   19.10.26 Original    By: ACRM
+*/
+static BOOL FrameView(int frame, VEC3F axes[3], REAL *scale,
+                      REAL centre[3])
+{
+   KEYFRAME *key;
+   REAL     matrix[3][3],
+            size = gScale,
+            t;
+   VEC3F    axis;
+   int      i, j, k,
+            prev = 0;
+
+   axes[0].x = 1.0; axes[0].y = 0.0; axes[0].z = 0.0;
+   axes[1].x = 0.0; axes[1].y = 1.0; axes[1].z = 0.0;
+   axes[2].x = 0.0; axes[2].y = 0.0; axes[2].z = 1.0;
+   centre[0] = (REAL)(gRender[0] / 2);
+   centre[1] = (REAL)(gRender[1] / 2);
+   centre[2] = 0.0;
+   *scale    = 1.0;
+
+   if((gNKeyFrames == 0) || (frame <= 0))
+      return(FALSE);
+
+   for(i=0; (i<gNKeyFrames) && (frame>prev); i++)
+   {
+      key = &(gKeyFrames[i]);
+      t   = (REAL)(frame - prev) / (REAL)(key->frame - prev);
+      if(t > 1.0)
+         t = 1.0;
+
+      /* Turn the axes through this keyframe's rotations in order       */
+      for(j=0; j<key->nrotate; j++)
+      {
+         blCreateRotMat(key->axis[j], key->angle[j] * t, matrix);
+         for(k=0; k<3; k++)
+         {
+            axis = axes[k];
+            blMatMult3_33(axis, matrix, &(axes[k]));
+         }
+      }
+
+      if(key->scale > 0.0)
+         size += t * (key->scale - size);
+
+      if(key->centreAtom >= 0)
+      {
+         for(k=0; k<3; k++)
+            centre[k] += t * (key->centre[k] - centre[k]);
+      }
+
+      prev = key->frame;
+   }
+
+   *scale = size / gScale;
+   return(TRUE);
+}
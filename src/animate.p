@@ -0,0 +1,5 @@
+void InitAnimation(SPHERE *spheres, int NSphere)
+;
+BOOL RenderAnimation(SPHERE *spheres, int NSphere, char *outFile,
+                     int outFormat)
+;
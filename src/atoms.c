@@ -0,0 +1,853 @@
+/*************************************************************************
+
+   Program:    QTree
+   File:       atoms.c
+
+   Version:    V3.25
+   Date:       19.10.26
+   Function:   Read the atoms of a PDB file into an array
+
+   Copyright:  (c) SciTech Software 2026
+   Author:     Prof. Andrew C. R. Martin
+   EMail:      andrew@bioinf.org.uk
+
+**************************************************************************
+
+   This program is not in the public domain.
+
+   It may not be copied or made available to third parties, but may be
+   freely used by non-profit-making organisations who have obtained it
+   directly from the author or by FTP.
+
+   You are requested to send EMail to the author to say that you are
+   using this code so that you may be informed of future updates.
+
+   The code may not be made available on other FTP sites without express
+   permission from the author.
+
+   The code may be modified as required, but any modifications must be
+   documented so that the person responsible can be identified. If
+   someone else breaks this code, the author doesn't want to be blamed
+   for code that does not work! You may not distribute any
+   modifications, but are encouraged to send them to the author so
+   that they may be incorporated into future versions of the code.
+
+   The code may not be sold commercially or used for commercial purposes
+   without prior permission from the author.
+
+**************************************************************************
+
+   Description:
+   ============
+   Reads the atoms of the first model of a PDB file as blReadPDB() and
+   blReadPDBAll() do, but into a single array of PDB records rather
+   than a list with one allocation for each atom. The records are
+   linked in order through their next pointers, so the array is used
+   wherever a list of atoms is, and is freed with free().
+
+   A file is mapped into memory and a pipe is read into memory. The
+   text is split into one chunk of whole lines for each of gNThreads
+   threads (-t), which count the ATOM and HETATM records of their
+   chunks and then fill in their part of the array from the fixed
+   columns.
+
+   Every model of a file may also be read in one pass, as is needed
+   for the poses of a gallery.
+
+   Only the parsing is faster. Each atom is still a whole PDB record,
+   so the memory used is much as for a list read by bioplib.
+
+**************************************************************************
+
+   Usage:
+   ======
+   ReadAtoms() is called in place of blReadPDB() or blReadPDBAll().
+   ReadModels() reads all the models into one array, in place of
+   calling blDoReadPDB() for each model. ArrayFromList() turns a list
+   read by bioplib into an array.
+
+**************************************************************************
+
+   Notes:
+   ======
+   The model ends at an ENDMDL or END record, as in trajectory.c.
+
+   The fields of each atom are taken from the fixed columns of the
+   record as blReadPDB() takes them, and this defines how atoms are
+   read. Every record is checked by PlainAtom() as it is counted. A
+   file with any record which the columns do not describe plainly (an
+   alternate position, which bioplib chooses between, a tab, or
+   coordinates which are missing or not numbers) is read with
+   blReadPDB() from memory.
+
+**************************************************************************
+
+   Revision History:
+   =================
+   V3.25 19.10.26 Original
+                  Added ReadModels()
+                  Every record is checked by PlainAtom() rather than
+                  comparing the first atoms with bioplib
+
+*************************************************************************/
+/* Includes
+*/
+#define _XOPEN_SOURCE 700
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "bioplib/macros.h"
+#include "bioplib/MathType.h"
+#include "bioplib/SysDefs.h"
+#include "bioplib/pdb.h"
+
+#include "qtree.h"
+#include "atoms.p"
+
+/************************************************************************/
+/* Defines and types
+*/
+#define MINCHUNK    (1 << 20)    /* Smallest chunk given to a thread    */
+#define READBUFF    65536        /* Bytes read from a pipe at a time    */
+#define COORDEND    54           /* Column after the coordinates        */
+
+typedef struct                   /* Lines parsed by one thread          */
+{
+   char *start,
+        *end;
+   PDB  *atoms;                  /* Where the first atom goes           */
+   int  NAtom;
+   BOOL modelEnd,                /* Chunk holds the end of the model    */
+        bioplib;                 /* Chunk has records left to bioplib   */
+}  ATOMCHUNK;
+
+/************************************************************************/
+/* Prototypes
+*/
+static PDB  *ReadText(char *text, size_t length, BOOL allAtoms,
+                      int *NAtom);
+static PDB  *ReadWithBioplib(char *text, size_t length, BOOL allAtoms,
+                             int *NAtom);
+static void RunChunks(ATOMCHUNK *chunks, int nChunks,
+                      void *(*func)(void *));
+static void *CountChunk(void *arg);
+static void *ParseChunk(void *arg);
+static void ParseAtom(char *line, int length, PDB *p);
+static void Field(char *dest, char *line, int length, int start,
+                  int width);
+static int  LineLength(char *line, char *end);
+static BOOL IsAtom(char *line, int length);
+static BOOL PlainAtom(char *line, int length);
+static BOOL IsModelEnd(char *line, int length);
+static char *GetText(FILE *fp, size_t *length, void **map, 
+                     size_t *mapLength);
+static char *NextModel(char *text, char *end);
+
+
+/************************************************************************/
+/*>PDB *ReadAtoms(FILE *fp, BOOL allAtoms, int *NAtom)
+   ---------------------------------------------------
+   Input:   FILE   *fp         PDB file
+            BOOL   allAtoms    Read all atoms (as blReadPDBAll())
+   Output:  int    *NAtom      Number of atoms
+   Returns: PDB    *           Array of atoms linked in order (NULL on
+                               error or if there are none)
+
+   Reads the atoms of the first model from the current position of the
+   file. The array is freed with free().
+
+   19.10.26 Original    By: ACRM
+*/
+PDB *ReadAtoms(FILE *fp, BOOL allAtoms, int *NAtom)
+{
+   char   *text;
+   void   *map;
+   PDB    *atoms;
+   size_t length,
+          mapLength;
+
+   *NAtom = 0;
+   if((text = GetText(fp, &length, &map, &mapLength)) == NULL)
+      return(NULL);
+
+   atoms = (length > 0) ? ReadText(text, length, allAtoms, NAtom) : NULL;
+
+   if(map != NULL)
+      munmap(map, mapLength);
+   else
+      free(text);
+   return(atoms);
+}
+
+
+/************************************************************************/
+/*>PDB *ReadModels(FILE *fp, BOOL allAtoms, int *NAtom, 
+                   int **modelStart, int *NModels)
+   ------------------------------------------------------
+   Input:   FILE   *fp         PDB file
+            BOOL   allAtoms    Read all atoms (as blReadPDBAll())
+   Output:  int    *NAtom      Number of atoms
+            int    **modelStart  Index of the first atom of each model
+                               and of the end of the last (malloc()'d)
+            int    *NModels    Number of models
+   Returns: PDB    *           Array of atoms linked in order (NULL on
+                               error or if there are none)
+
+   Reads every model from the current position of the file. The text is
+   taken once and split at the end of each model, and reading stops at
+   the first model without atoms. The array is freed with free().
+
+   19.10.26 Original    By: ACRM
+*/
+PDB *ReadModels(FILE *fp, BOOL allAtoms, int *NAtom, int **modelStart,
+                int *NModels)
+{
+   char   *text,
+          *start,
+          *stop,
+          *end;
+   void   *map;
+   PDB    *atoms     = NULL,
+          *model,
+          *more;
+   size_t length,
+          mapLength;
+   int    natom,
+          maxModels  = 0,
+          maxAtoms   = 0,
+          *starts,
+          i;
+   BOOL   ok         = TRUE;
+
+   *NAtom      = 0;
+   *NModels    = 0;
+   *modelStart = NULL;
+   if((text = GetText(fp, &length, &map, &mapLength)) == NULL)
+      return(NULL);
+   end = text + length;
+
+   for(start=text; ok && (start < end); start=stop)
+   {
+      stop = NextModel(start, end);
+      if((model = ReadText(start, (size_t)(stop - start), allAtoms,
+                           &natom)) == NULL)
+         break;
+
+      /* One more for the end of the last model                         */
+      if(*NModels + 2 > maxModels)
+      {
+         maxModels = 2 * maxModels + 16;
+         if((starts = (int *)realloc(*modelStart, 
+                                     maxModels * sizeof(int))) == NULL)
+            ok = FALSE;
+         else
+            *modelStart = starts;
+      }
+      if(ok && (*NAtom + natom > maxAtoms))
+      {
+         maxAtoms = 2 * maxAtoms + natom;
+         if((more = (PDB *)realloc(atoms, maxAtoms * sizeof(PDB))) 
+            == NULL)
+            ok = FALSE;
+         else
+            atoms = more;
+      }
+
+      if(ok)
+      {
+         (*modelStart)[(*NModels)++] = *NAtom;
+         memcpy(atoms + *NAtom, model, natom * sizeof(PDB));
+         *NAtom += natom;
+      }
+      free(model);
+   }
+
+   if(map != NULL)
+      munmap(map, mapLength);
+   else
+      free(text);
+
+   if(!ok || (*NModels == 0))
+   {
+      if(!ok)
+         fprintf(stderr,"No memory for %d models\n", *NModels + 1);
+      if(atoms != NULL)
+         free(atoms);
+      if(*modelStart != NULL)
+         free(*modelStart);
+      *modelStart = NULL;
+      *NAtom      = 0;
+      *NModels    = 0;
+      return(NULL);
+   }
+
+   /* The atoms have been moved, so link them again                     */
+   (*modelStart)[*NModels] = *NAtom;
+   for(i=0; i<*NAtom; i++)
+      atoms[i].next = (i < *NAtom-1) ? &(atoms[i+1]) : NULL;
+   return(atoms);
+}
+
+
+/************************************************************************/
+/*>PDB *ArrayFromList(PDB *pdb, int NAtom)
+   ---------------------------------------
+   Input:   PDB    *pdb        List of atoms read by bioplib, which is
+                               freed
+            int    NAtom       Number of atoms
+   Returns: PDB    *           The same atoms as an array linked in
+                               order (NULL if no memory)
+
+   19.10.26 Original    By: ACRM
+*/
+PDB *ArrayFromList(PDB *pdb, int NAtom)
+{
+   PDB *atoms = NULL,
+       *p;
+   int i;
+
+   if((NAtom > 0) &&
+      ((atoms = (PDB *)malloc(NAtom * sizeof(PDB))) != NULL))
+   {
+      for(p=pdb, i=0; (p!=NULL) && (i<NAtom); NEXT(p), i++)
+      {
+         atoms[i]      = *p;
+         atoms[i].next = (i < NAtom-1) ? &(atoms[i+1]) : NULL;
+      }
+   }
+   else if(NAtom > 0)
+   {
+      fprintf(stderr,"No memory for array of atoms\n");
+   }
+
+   if(pdb != NULL)
+      FREELIST(pdb, PDB);
+   return(atoms);
+}
+
+
+/************************************************************************/
+/*>static PDB *ReadText(char *text, size_t length, BOOL allAtoms,
+                        int *NAtom)
+   --------------------------------------------------------------
+   Input:   char   *text       Text of the PDB file
+            size_t length      Its length
+            BOOL   allAtoms    Read all atoms (as blReadPDBAll())
+   Output:  int    *NAtom      Number of atoms
+   Returns: PDB    *           Array of atoms (NULL on error or if none)
+
+   Parses the atoms of the first model in gNThreads chunks.
+
+   19.10.26 Original    By: ACRM
+*/
+static PDB *ReadText(char *text, size_t length, BOOL allAtoms,
+                     int *NAtom)
+{
+   ATOMCHUNK *chunks;
+   PDB       *atoms;
+   char      *end = text + length,
+             *c;
+   int       nChunks,
+             i;
+   BOOL      bioplib = FALSE;
+
+   *NAtom  = 0;
+   nChunks = (int)MIN((size_t)gNThreads, length / MINCHUNK + 1);
+   if((chunks = (ATOMCHUNK *)malloc(nChunks * sizeof(ATOMCHUNK))) == NULL)
+   {
+      fprintf(stderr,"No memory to read PDB file\n");
+      return(NULL);
+   }
+
+   /* Chunks of whole lines                                             */
+   for(i=0; i<nChunks; i++)
+   {
+      c = text + (length / nChunks) * i;
+      if(i > 0)
+      {
+         while((c < end) && (c[-1] != '\n'))
+            c++;
+         chunks[i-1].end = c;
+      }
+      chunks[i].start    = c;
+      chunks[i].end      = end;
+      chunks[i].atoms    = NULL;
+      chunks[i].NAtom    = 0;
+      chunks[i].modelEnd = FALSE;
+      chunks[i].bioplib  = FALSE;
+   }
+
+   /* Count the atoms of each chunk up to the end of the model          */
+   RunChunks(chunks, nChunks, CountChunk);
+   for(i=0; i<nChunks; i++)
+   {
+      *NAtom += chunks[i].NAtom;
+      if(chunks[i].bioplib)
+         bioplib = TRUE;
+      if(chunks[i].modelEnd)
+         break;
+   }
+   nChunks = MIN(i+1, nChunks);
+
+   if(bioplib)
+   {
+      free(chunks);
+      return(ReadWithBioplib(text, length, allAtoms, NAtom));
+   }
+   if(*NAtom == 0)
+   {
+      free(chunks);
+      return(NULL);
+   }
+
+   /* Each chunk fills its own part of the array                        */
+   if((atoms = (PDB *)malloc(*NAtom * sizeof(PDB))) == NULL)
+   {
+      fprintf(stderr,"No memory for %d atoms\n", *NAtom);
+      free(chunks);
+      *NAtom = 0;
+      return(NULL);
+   }
+   chunks[0].atoms = atoms;
+   for(i=1; i<nChunks; i++)
+      chunks[i].atoms = chunks[i-1].atoms + chunks[i-1].NAtom;
+   RunChunks(chunks, nChunks, ParseChunk);
+   atoms[*NAtom-1].next = NULL;
+   free(chunks);
+   return(atoms);
+}
+
+
+/************************************************************************/
+/*>static PDB *ReadWithBioplib(char *text, size_t length, BOOL allAtoms,
+                               int *NAtom)
+   ---------------------------------------------------------------------
+   Input:   char   *text       Text of the PDB file
+            size_t length      Its length
+            BOOL   allAtoms    Read all atoms (as blReadPDBAll())
+   Output:  int    *NAtom      Number of atoms
+   Returns: PDB    *           Array of atoms (NULL on error or if none)
+
+   Reads the text with bioplib for files the chunks do not handle.
+
+   19.10.26 Original    By: ACRM
+*/
+static PDB *ReadWithBioplib(char *text, size_t length, BOOL allAtoms,
+                            int *NAtom)
+{
+   FILE *fp;
+   PDB  *pdb;
+
+   *NAtom = 0;
+   if((fp = fmemopen(text, length, "r")) == NULL)
+   {
+      fprintf(stderr,"Unable to read PDB file from memory\n");
+      return(NULL);
+   }
+   pdb = allAtoms ? blReadPDBAll(fp, NAtom) : blReadPDB(fp, NAtom);
+   fclose(fp);
+
+   if(pdb == NULL)
+      return(NULL);
+   if((pdb = ArrayFromList(pdb, *NAtom)) == NULL)
+      *NAtom = 0;
+   return(pdb);
+}
+
+
+/************************************************************************/
+/*>static void RunChunks(ATOMCHUNK *chunks, int nChunks,
+                         void *(*func)(void *))
+   -----------------------------------------------------
+   Input:   ATOMCHUNK *chunks  The chunks
+            int       nChunks  Number of chunks
+            void      *(*func)(void *)  Run on each chunk
+
+   Runs a function on each chunk, the first on this thread and the
+   others on threads of their own. A chunk whose thread cannot be
+   started is done here.
+
+   19.10.26 Original    By: ACRM
+*/
+static void RunChunks(ATOMCHUNK *chunks, int nChunks,
+                      void *(*func)(void *))
+{
+   pthread_t *threads = NULL;
+   BOOL      *started = NULL;
+   int       i;
+
+   if((nChunks > 1) &&
+      (((threads = (pthread_t *)malloc(nChunks * sizeof(pthread_t)))
+        == NULL) ||
+       ((started = (BOOL *)calloc(nChunks, sizeof(BOOL))) == NULL)))
+   {
+      if(threads != NULL)
+         free(threads);
+      threads = NULL;
+   }
+
+   for(i=1; (threads != NULL) && (i<nChunks); i++)
+   {
+      started[i] = (pthread_create(&(threads[i]), NULL, func,
+                                   (void *)&(chunks[i])) == 0);
+   }
+
+   (*func)((void *)&(chunks[0]));
+   for(i=1; i<nChunks; i++)
+   {
+      if((threads != NULL) && started[i])
+         pthread_join(threads[i], NULL);
+      else
+         (*func)((void *)&(chunks[i]));
+   }
+
+   if(threads != NULL)
+   {
+      free(threads);
+      free(started);
+   }
+}
+
+
+/************************************************************************/
+/*>static void *CountChunk(void *arg)
+   ----------------------------------
+   Input:   void   *arg        ATOMCHUNK
+   Returns: void   *           NULL
+
+   Counts the atoms of a chunk. If the model ends in the chunk, the
+   chunk is cut short there.
+
+   19.10.26 Original    By: ACRM
+   19.10.26 Checks every atom with PlainAtom()
+*/
+static void *CountChunk(void *arg)
+{
+   ATOMCHUNK *chunk = (ATOMCHUNK *)arg;
+   char      *c     = chunk->start;
+   int       len;
+
+   while(c < chunk->end)
+   {
+      len = LineLength(c, chunk->end);
+      if(IsModelEnd(c, len))
+      {
+         chunk->end      = c;
+         chunk->modelEnd = TRUE;
+         break;
+      }
+      if(IsAtom(c, len))
+      {
+         chunk->NAtom++;
+         if(!PlainAtom(c, len))
+            chunk->bioplib = TRUE;
+      }
+      for(c+=len; (c < chunk->end) && (*(c++) != '\n'); );
+   }
+   return(NULL);
+}
+
+
+/************************************************************************/
+/*>static void *ParseChunk(void *arg)
+   ----------------------------------
+   Input:   void   *arg        ATOMCHUNK
+   Returns: void   *           NULL
+
+   Fills in the atoms of a chunk, linked to the ones which follow.
+
+   19.10.26 Original    By: ACRM
+*/
+static void *ParseChunk(void *arg)
+{
+   ATOMCHUNK *chunk = (ATOMCHUNK *)arg;
+   PDB       *p     = chunk->atoms;
+   char      *c     = chunk->start;
+   int       len;
+
+   while(c < chunk->end)
+   {
+      len = LineLength(c, chunk->end);
+      if(IsAtom(c, len))
+      {
+         ParseAtom(c, len, p);
+         p->next = p + 1;
+         p++;
+      }
+      for(c+=len; (c < chunk->end) && (*(c++) != '\n'); );
+   }
+   return(NULL);
+}
+
+
+/************************************************************************/
+/*>static void ParseAtom(char *line, int length, PDB *p)
+   -----------------------------------------------------
+   Input:   char   *line       An ATOM or HETATM record
+            int    length      Its length without the newline
+   Output:  PDB    *p          The atom
+
+   Fills in an atom from the fixed columns of its record as blReadPDB()
+   does. Columns past the end of the line are blank.
+
+   19.10.26 Original    By: ACRM
+*/
+static void ParseAtom(char *line, int length, PDB *p)
+{
+   char buffer[16],
+        *c;
+
+   memset(p, 0, sizeof(PDB));
+   Field(p->record_type, line, length, 0, 6);
+   Field(buffer, line, length, 6, 5);
+   p->atnum = atoi(buffer);
+
+   /* The atom name without leading spaces, padded to 4                 */
+   Field(p->atnam_raw, line, length, 12, 4);
+   for(c=p->atnam_raw; *c==' '; c++);
+   strcpy(p->atnam, c);
+   PADMINTERM(p->atnam, 4);
+
+   Field(p->resnam, line, length, 17, 3);
+   PADMINTERM(p->resnam, 4);
+   Field(p->chain, line, length, 21, 1);
+   if(p->chain[0] == ' ')
+      p->chain[0] = '\0';
+   Field(buffer, line, length, 22, 4);
+   p->resnum = atoi(buffer);
+   Field(p->insert, line, length, 26, 1);
+   if(p->insert[0] == ' ')
+      p->insert[0] = '\0';
+
+   Field(buffer, line, length, 30, 8);
+   p->x    = (REAL)atof(buffer);
+   Field(buffer, line, length, 38, 8);
+   p->y    = (REAL)atof(buffer);
+   Field(buffer, line, length, 46, 8);
+   p->z    = (REAL)atof(buffer);
+   Field(buffer, line, length, 54, 6);
+   p->occ  = (REAL)atof(buffer);
+   Field(buffer, line, length, 60, 6);
+   p->bval = (REAL)atof(buffer);
+}
+
+
+/************************************************************************/
+/*>static void Field(char *dest, char *line, int length, int start,
+                     int width)
+   ----------------------------------------------------------------
+   Output:  char   *dest       The field, ended with a '\0'
+   Input:   char   *line       A line
+            int    length      Its length
+            int    start       First column of the field (from 0)
+            int    width       Width of the field
+
+   19.10.26 Original    By: ACRM
+*/
+static void Field(char *dest, char *line, int length, int start,
+                  int width)
+{
+   int i;
+
+   for(i=0; i<width; i++)
+      dest[i] = (start+i < length) ? line[start+i] : ' ';
+   dest[width] = '\0';
+}
+
+
+/************************************************************************/
+/*>static int LineLength(char *line, char *end)
+   --------------------------------------------
+   Input:   char   *line       Start of a line
+            char   *end        End of the text
+   Returns: int                Length of the line without its newline
+
+   19.10.26 Original    By: ACRM
+*/
+static int LineLength(char *line, char *end)
+{
+   char *c;
+
+   for(c=line; (c < end) && (*c != '\n') && (*c != '\r'); c++);
+   return((int)(c - line));
+}
+
+
+/************************************************************************/
+/*>static BOOL IsAtom(char *line, int length)
+   ------------------------------------------
+   Input:   char   *line       A line of a PDB file
+            int    length      Its length
+   Returns: BOOL               Is it an ATOM or HETATM record?
+
+   19.10.26 Original    By: ACRM
+*/
+static BOOL IsAtom(char *line, int length)
+{
+   return((length >= 6) &&
+          (!strncmp(line, "ATOM  ", 6) || !strncmp(line, "HETATM", 6)));
+}
+
+
+/************************************************************************/
+/*>static BOOL PlainAtom(char *line, int length)
+   ---------------------------------------------
+   Input:   char   *line       An ATOM or HETATM record
+            int    length      Its length
+   Returns: BOOL               Can ParseAtom() read it?
+
+   Checks that a record has no alternate position or tab, and that its
+   three coordinates are there and are numbers.
+
+   19.10.26 Original    By: ACRM
+*/
+static BOOL PlainAtom(char *line, int length)
+{
+   char *c;
+   int  i,
+        digits;
+
+   if((length < COORDEND) || (line[16] != ' ') ||
+      (memchr(line, '\t', (size_t)length) != NULL))
+      return(FALSE);
+
+   /* Each coordinate is blanks then a number with at least one digit   */
+   for(i=30; i<COORDEND; i+=8)
+   {
+      for(c=line+i; (c < line+i+8) && (*c == ' '); c++);
+      if((c < line+i+8) && (*c == '-'))
+         c++;
+      for(digits=0; (c < line+i+8) && ((*c == '.') || isdigit((int)*c));
+          c++)
+      {
+         if(*c != '.')
+            digits++;
+      }
+      if((digits == 0) || (c < line+i+8))
+         return(FALSE);
+   }
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>static BOOL IsModelEnd(char *line, int length)
+   ----------------------------------------------
+   Input:   char   *line       A line of a PDB file
+            int    length      Its length
+   Returns: BOOL               Is it an ENDMDL or END record?
+
+   19.10.26 Original    By: ACRM
+*/
+static BOOL IsModelEnd(char *line, int length)
+{
+   return(((length >= 6) && !strncmp(line, "ENDMDL", 6)) ||
+          ((length >= 3) && !strncmp(line, "END", 3) &&
+           ((length == 3) || (line[3] == ' '))));
+}
+
+
+/************************************************************************/
+/*>static char *GetText(FILE *fp, size_t *length, void **map, 
+                        size_t *mapLength)
+   -------------------------------------------------------------
+   Input:   FILE   *fp         PDB file
+   Output:  size_t *length     Length of the text
+            void   **map       The mapping to munmap() (NULL if the
+                               text was read into memory)
+            size_t *mapLength  Its length
+   Returns: char   *           Text from the current position (NULL on
+                               error). If not mapped, freed with free()
+
+   A file is mapped from where it has been read to, and left at its
+   end. Anything else is read into memory.
+
+   19.10.26 Original (split from ReadAtoms())    By: ACRM
+*/
+static char *GetText(FILE *fp, size_t *length, void **map, 
+                     size_t *mapLength)
+{
+   struct stat st;
+   char        *text     = NULL,
+               *more;
+   size_t      maxLength = 0,
+               nread;
+   long        offset;
+
+   *length    = 0;
+   *map       = NULL;
+   *mapLength = 0;
+
+   /* A file is mapped from where it has been read to                   */
+   if(!fstat(fileno(fp), &st) && S_ISREG(st.st_mode) &&
+      ((offset = ftell(fp)) >= 0L) && (offset < (long)st.st_size))
+   {
+      *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE,
+                  fileno(fp), 0);
+      if(*map != MAP_FAILED)
+      {
+         *mapLength = (size_t)st.st_size;
+         *length    = (size_t)(st.st_size - offset);
+         fseek(fp, 0L, SEEK_END);
+         return((char *)*map + offset);
+      }
+      *map = NULL;
+   }
+
+   /* Otherwise it is read into memory                                  */
+   for(;;)
+   {
+      if(*length + READBUFF > maxLength)
+      {
+         maxLength = 2 * maxLength + READBUFF;
+         if((more = (char *)realloc(text, maxLength)) == NULL)
+         {
+            fprintf(stderr,"No memory to read PDB file\n");
+            if(text != NULL)
+               free(text);
+            return(NULL);
+         }
+         text = more;
+      }
+      if((nread = fread(text + *length, 1, READBUFF, fp)) == 0)
+         break;
+      *length += nread;
+   }
+   return(text);
+}
+
+
+/************************************************************************/
+/*>static char *NextModel(char *text, char *end)
+   ---------------------------------------------
+   Input:   char   *text       Start of a model
+            char   *end        End of the text
+   Returns: char   *           Start of the line after the end of the
+                               model, or the end of the text
+
+   19.10.26 Original    By: ACRM
+*/
+static char *NextModel(char *text, char *end)
+{
+   char *c = text,
+        *line;
+   int  len;
+
+   while(c < end)
+   {
+      line = c;
+      len  = LineLength(line, end);
+      for(c+=len; (c < end) && (*(c++) != '\n'); );
+      if(IsModelEnd(line, len))
+         break;
+   }
+   return(c);
+}
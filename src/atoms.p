@@ -0,0 +1,7 @@
+PDB *ReadAtoms(FILE *fp, BOOL allAtoms, int *NAtom)
+;
+PDB *ReadModels(FILE *fp, BOOL allAtoms, int *NAtom, int **modelStart,
+                int *NModels)
+;
+PDB *ArrayFromList(PDB *pdb, int NAtom)
+;
@@ -0,0 +1,539 @@
+/*************************************************************************
+
+   Program:    QTree
+   File:       bands.c   
+
+   Version:    V3.25
+   Date:       19.10.26
+   Function:   Render an image a band of rows at a time  
+
+   Copyright:  (c) SciTech Software 2026
+   Author:     Prof. Andrew C. R. Martin
+   EMail:      andrew@bioinf.org.uk
+
+**************************************************************************
+
+   This program is not in the public domain.
+
+   It may not be copied or made available to third parties, but may be
+   freely used by non-profit-making organisations who have obtained it
+   directly from the author or by FTP.
+
+   You are requested to send EMail to the author to say that you are
+   using this code so that you may be informed of future updates.
+
+   The code may not be made available on other FTP sites without express
+   permission from the author.
+
+   The code may be modified as required, but any modifications must be
+   documented so that the person responsible can be identified. If
+   someone else breaks this code, the author doesn't want to be blamed
+   for code that does not work! You may not distribute any
+   modifications, but are encouraged to send them to the author so
+   that they may be incorporated into future versions of the code.
+
+   The code may not be sold commercially or used for commercial purposes
+   without prior permission from the author.
+
+**************************************************************************
+
+   Description:
+   ============
+   Renders the image a band of rows at a time so that only one band of
+   the framebuffer is ever held in memory. Each band is written to the
+   output file as soon as it is complete. If a checkpoint file is 
+   given, it is updated after each band so that an interrupted render
+   can be resumed from the last completed band.
+
+**************************************************************************
+
+   Usage:
+   ======
+
+**************************************************************************
+
+   Notes:
+   ======
+   Each band is a separate run of the quad tree over that strip of the
+   render area. The spheres are sorted once and the sorted list is 
+   clipped to each band, so the result is identical to rendering the
+   whole image in one go.
+
+   The checkpoint is a short text header:
+      QTREECKPT 2
+      <output file>
+      <format> <width> <height>
+      <render area> <origin> <size> <anti-alias> <spheres> 
+         <input size> <input time> <control file hash>
+      <next row> <file offset> <state length>
+   followed by <state length> bytes of encoder state. For PNG the file
+   offset is kept in the encoder state and is given as 0.
+   The output file is flushed to disk before the checkpoint is written
+   and the checkpoint is written to a temporary file and renamed, so 
+   the checkpoint never describes data which are not in the file. On
+   resume, the output file is cut back to the saved offset. 
+
+   The third line describes what was rendered: the settings which
+   place the spheres, the size and time of the PDB file and the
+   SHA-256 hash of the control file. A render is not resumed if any of
+   them has changed, since the bands would not match. The PDB file
+   must therefore be read from a file rather than a pipe.
+
+**************************************************************************
+
+   Revision History:
+   =================
+   V3.7  19.10.26 Original
+   V3.8  19.10.26 Split out RenderBand() for tiled output
+   V3.9  19.10.26 Band to render area mapping moved to SpaceFillRows()
+   V3.25 19.10.26 Checkpoint records the input, control file and 
+                  settings
+
+*************************************************************************/
+/* Includes
+*/
+#define _XOPEN_SOURCE 600
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "bioplib/macros.h"
+#include "bioplib/MathType.h"
+#include "bioplib/SysDefs.h"
+#include "bioplib/pdb.h"
+
+#include "qtree.h"
+#include "qtree.p"
+#include "graphics.p"
+#include "rawimage.p"
+#include "hash.p"
+#include "bands.p"
+
+/************************************************************************/
+/* Defines
+*/
+#define CKPT_MAGIC "QTREECKPT 2" /* First line of a checkpoint file    */
+#define MAXLINE    512           /* Longest line in a checkpoint        */
+#define MAXNAME    200           /* Longest checkpoint filename         */
+#define MAXDESC    256           /* Longest description of a render     */
+#define HASHBUFF   65536         /* Bytes of control file hashed at once*/
+
+/************************************************************************/
+/* Prototypes
+*/
+static BOOL ReadCheckpoint(char *checkpoint, char *outFile, int outFormat,
+                           char *desc, int *nextRow, long *offset, 
+                           unsigned char **state, size_t *stateLen);
+static BOOL WriteCheckpoint(char *checkpoint, char *outFile, 
+                            int outFormat, char *desc, int nextRow, 
+                            long offset, unsigned char *state, 
+                            size_t stateLen);
+static BOOL DescribeRender(char *inFile, char *control, int NSphere,
+                           char *desc);
+
+
+/************************************************************************/
+/*>BOOL RenderBands(SPHERE *AllSpheres, int NSphere, char *outFile,
+                    int outFormat, char *checkpoint, char *inFile,
+                    char *control)
+   ----------------------------------------------------------------
+   Input:   SPHERE  *AllSpheres   Array of spheres
+            int     NSphere       Number of spheres
+            char    *outFile      Output file (blank for stdout)
+            int     outFormat     Output format
+            char    *checkpoint   Checkpoint file (blank for none)
+            char    *inFile       PDB file (blank for stdin)
+            char    *control      Control file used
+   Returns: BOOL                  Success?
+
+   Renders and writes the image gBandRows rows at a time. Used instead
+   of SpaceFill() and EndGraphics() writing the file. InitGraphics() 
+   must have been called with gBandRows set. If the checkpoint file 
+   exists, rendering carries on from the point it records; it is 
+   deleted once the image is complete. It is only carried on from if
+   the PDB file, control file and settings are unchanged.
+
+   19.10.26 Original    By: ACRM
+   19.10.26 Added inFile and control    By: ACRM
+*/
+BOOL RenderBands(SPHERE *AllSpheres, int NSphere, char *outFile,
+                 int outFormat, char *checkpoint, char *inFile,
+                 char *control)
+{
+   SPHERE        **SrtSph  = NULL;
+   RAWSTREAM     *raw      = NULL;
+#ifdef SUPPORT_PNG
+   blPNGSTREAM   *png      = NULL;
+#endif
+   unsigned char *state    = NULL,
+                 *resume   = NULL;
+   char          desc[MAXDESC];
+   size_t        stateLen  = 0;
+   long          offset    = 0;
+   int           top       = 0,
+                 nrows;
+   BOOL          ok        = FALSE;
+
+   switch(outFormat)
+   {
+   case OUTPUT_MTV:
+   case OUTPUT_PPM:
+   case OUTPUT_PAM:
+   case OUTPUT_RAW:
+   case OUTPUT_RGBA:
+#ifdef SUPPORT_PNG
+   case OUTPUT_PNG:
+#endif
+      break;
+   default:
+      fprintf(stderr,"This output format cannot be written in bands.\n");
+      return(FALSE);
+   }
+
+   /* See if there is a render to carry on with                         */
+   if(checkpoint[0])
+   {
+      if(!inFile[0] || !outFile[0])
+      {
+         fprintf(stderr,"Input and output files must be given with a \
+checkpoint.\n");
+         return(FALSE);
+      }
+      if(!DescribeRender(inFile, control, NSphere, desc) ||
+         !ReadCheckpoint(checkpoint, outFile, outFormat, desc, &top, 
+                         &offset, &resume, &stateLen))
+         return(FALSE);
+   }
+
+   /* Open the output                                                   */
+#ifdef SUPPORT_PNG
+   if(outFormat == OUTPUT_PNG)
+   {
+      if((png = blOpenPNGStream(outFile, gScreen[0], gScreen[1],
+                                &gPNGOptions, resume, stateLen)) == NULL)
+         goto cleanup;
+   }
+   else
+#endif
+   {
+      if((raw = OpenRawStream(outFile, outFormat, gScreen[0], gScreen[1],
+                              offset)) == NULL)
+         goto cleanup;
+   }
+
+   /* Sort the spheres once for all the bands                           */
+   if((SrtSph = SortSpheresOnX(AllSpheres, NSphere)) == NULL)
+      goto cleanup;
+
+   for(; top < gScreen[1]; top += nrows)
+   {
+      nrows = MIN(gBandRows, gScreen[1] - top);
+      if(!RenderBand(SrtSph, NSphere, top, nrows))
+         goto cleanup;
+
+      /* Write the band                                                 */
+#ifdef SUPPORT_PNG
+      if(png != NULL)
+      {
+         if(!blWritePNGRows(png, GetRGBRow, top, top + nrows))
+            goto cleanup;
+      }
+      else
+#endif
+      {
+         if(!WriteRawRows(raw, top, top + nrows))
+            goto cleanup;
+      }
+
+      /* Update the checkpoint                                          */
+      if(checkpoint[0] && (top + nrows < gScreen[1]))
+      {
+#ifdef SUPPORT_PNG
+         if(png != NULL)
+         {
+            if(!blSyncPNGStream(png))
+               goto cleanup;
+            stateLen = blGetPNGStreamState(png, &state);
+         }
+         else
+#endif
+         {
+            if(!SyncRawStream(raw))
+               goto cleanup;
+            offset   = RawStreamOffset(raw);
+            stateLen = 0;
+         }
+         
+         if(!WriteCheckpoint(checkpoint, outFile, outFormat, desc, 
+                             top + nrows, offset, state, stateLen))
+         {
+            fprintf(stderr,"Unable to write checkpoint file: %s\n",
+                    checkpoint);
+            goto cleanup;
+         }
+      }
+   }
+   ok = TRUE;
+   
+cleanup:
+   if(raw != NULL)
+      ok = CloseRawStream(raw) && ok;
+#ifdef SUPPORT_PNG
+   if(png != NULL)
+      ok = blClosePNGStream(png) && ok;
+#endif
+   if(SrtSph != NULL) free(SrtSph);
+   if(resume != NULL) free(resume);
+
+   if(!ok)
+   {
+      fprintf(stderr,"Banded rendering failed");
+      if(checkpoint[0])
+         fprintf(stderr,"; it may be resumed using the same command");
+      fprintf(stderr,"\n");
+   }
+   else if(checkpoint[0])
+   {
+      remove(checkpoint);
+   }
+
+   return(ok);
+}
+
+
+/************************************************************************/
+/*>BOOL RenderBand(SPHERE **SrtSph, int NSphere, int top, int nrows)
+   -----------------------------------------------------------------
+   Input:   SPHERE **SrtSph    Spheres sorted on x (from SortSpheresOnX())
+            int    NSphere     Number of spheres
+            int    top         First screen row of the band
+            int    nrows       Rows in the band
+   Returns: BOOL               Success?
+
+   Clears the framebuffer for a band of rows and runs the quad tree 
+   over that strip of the render area.
+
+   19.10.26 Original (split from RenderBands())    By: ACRM
+   19.10.26 Uses SpaceFillRows()
+*/
+BOOL RenderBand(SPHERE **SrtSph, int NSphere, int top, int nrows)
+{
+   SetBand(top);
+   return(SpaceFillRows(SrtSph, NSphere, top, nrows));
+}
+
+
+/************************************************************************/
+/*>static BOOL ReadCheckpoint(char *checkpoint, char *outFile, 
+                              int outFormat, char *desc, int *nextRow, 
+                              long *offset, unsigned char **state, 
+                              size_t *stateLen)
+   ---------------------------------------------------------------------
+   Input:   char          *checkpoint   Checkpoint file
+            char          *outFile      Output file
+            int           outFormat     Output format
+            char          *desc         Description of the render
+   Output:  int           *nextRow      First row still to render
+            long          *offset       Bytes of the output to keep
+            unsigned char **state       Encoder state (malloc()'d)
+            size_t        *stateLen     Length of encoder state
+   Returns: BOOL                        OK to go on?
+
+   Read a checkpoint file. If it does not exist, we start from the top.
+   It is an error if it exists but is for a different output file, 
+   format or image size, or the input, control file or settings in
+   the description from DescribeRender() have changed.
+
+   19.10.26 Original    By: ACRM
+   19.10.26 Added desc    By: ACRM
+*/
+static BOOL ReadCheckpoint(char *checkpoint, char *outFile, int outFormat,
+                           char *desc, int *nextRow, long *offset, 
+                           unsigned char **state, size_t *stateLen)
+{
+   FILE          *fp;
+   char          buffer[MAXLINE],
+                 ckptDesc[MAXLINE];
+   int           format, width, height;
+   unsigned long len;
+   BOOL          ok = FALSE;
+
+   *nextRow  = 0;
+   *offset   = 0;
+   *state    = NULL;
+   *stateLen = 0;
+
+   if((fp = fopen(checkpoint, "rb")) == NULL)
+      return(TRUE);
+
+   if((fgets(buffer, MAXLINE, fp) == NULL) || 
+      strncmp(buffer, CKPT_MAGIC, strlen(CKPT_MAGIC)))
+   {
+      fprintf(stderr,"Not a QTree checkpoint file: %s\n", checkpoint);
+      goto cleanup;
+   }
+   
+   if((fgets(buffer, MAXLINE, fp) == NULL) ||
+      (fscanf(fp, "%d %d %d", &format, &width, &height) != 3) ||
+      (fgetc(fp) != '\n') ||
+      (fgets(ckptDesc, MAXLINE, fp) == NULL) ||
+      (fscanf(fp, "%d %ld %lu", nextRow, offset, &len) != 3) ||
+      (fgetc(fp) != '\n'))
+   {
+      fprintf(stderr,"Corrupt checkpoint file: %s\n", checkpoint);
+      goto cleanup;
+   }
+   TERMINATE(buffer);
+   TERMINATE(ckptDesc);
+
+   if(strcmp(buffer, outFile) || (format != outFormat) || 
+      (width != gScreen[0]) || (height != gScreen[1]) ||
+      (*nextRow <= 0) || (*nextRow >= height) || 
+      ((*offset <= 0) && (len == 0)))
+   {
+      fprintf(stderr,"Checkpoint file %s is for a different image.\n",
+              checkpoint);
+      goto cleanup;
+   }
+
+   if(strcmp(ckptDesc, desc))
+   {
+      fprintf(stderr,"The PDB file, control file or settings have \
+changed since checkpoint\nfile %s was written. Remove it to start \
+again.\n", checkpoint);
+      goto cleanup;
+   }
+
+   if(len)
+   {
+      if(((*state = (unsigned char *)malloc(len)) == NULL) ||
+         (fread(*state, 1, len, fp) != len))
+      {
+         fprintf(stderr,"Corrupt checkpoint file: %s\n", checkpoint);
+         goto cleanup;
+      }
+      *stateLen = (size_t)len;
+   }
+   ok = TRUE;
+
+cleanup:
+   fclose(fp);
+   if(!ok && (*state != NULL))
+   {
+      free(*state);
+      *state = NULL;
+   }
+   return(ok);
+}
+
+
+/************************************************************************/
+/*>static BOOL WriteCheckpoint(char *checkpoint, char *outFile, 
+                               int outFormat, char *desc, int nextRow, 
+                               long offset, unsigned char *state, 
+                               size_t stateLen)
+   -------------------------------------------------------------------
+   Input:   char          *checkpoint   Checkpoint file
+            char          *outFile      Output file
+            int           outFormat     Output format
+            char          *desc         Description of the render
+            int           nextRow       First row still to render
+            long          offset        Bytes of the output written
+            unsigned char *state        Encoder state (or NULL)
+            size_t        stateLen      Length of encoder state
+   Returns: BOOL                        Success?
+
+   Write a checkpoint. It is written to a temporary file which is 
+   synchronized and then renamed so a crash leaves either the old or
+   the new checkpoint.
+
+   19.10.26 Original    By: ACRM
+   19.10.26 Added desc    By: ACRM
+*/
+static BOOL WriteCheckpoint(char *checkpoint, char *outFile, 
+                            int outFormat, char *desc, int nextRow, 
+                            long offset, unsigned char *state, 
+                            size_t stateLen)
+{
+   FILE *fp;
+   char tmpFile[MAXNAME];
+   BOOL ok;
+
+   if(strlen(checkpoint) + 5 > MAXNAME)
+      return(FALSE);
+   sprintf(tmpFile, "%s.tmp", checkpoint);
+
+   if((fp = fopen(tmpFile, "wb")) == NULL)
+      return(FALSE);
+
+   fprintf(fp, "%s\n%s\n%d %d %d\n%s\n%d %ld %lu\n", CKPT_MAGIC, 
+           outFile, outFormat, gScreen[0], gScreen[1], desc, nextRow, 
+           offset, (unsigned long)stateLen);
+   ok = ((stateLen == 0) || (fwrite(state, 1, stateLen, fp) == stateLen));
+   ok = (fflush(fp) == 0) && ok;
+   ok = (fsync(fileno(fp)) == 0) && ok;
+   ok = (fclose(fp) == 0) && ok;
+
+   if(ok)
+      ok = (rename(tmpFile, checkpoint) == 0);
+   if(!ok)
+      remove(tmpFile);
+
+   return(ok);
+}
+
+
+/************************************************************************/
+/*>static BOOL DescribeRender(char *inFile, char *control, int NSphere,
+                              char *desc)
+   ---------------------------------------------------------------------
+   Input:   char   *inFile      PDB file
+            char   *control     Control file used
+            int    NSphere      Number of spheres
+   Output:  char   *desc        Description of the render (MAXDESC)
+   Returns: BOOL                Success?
+
+   Describes everything which changes the bands: the settings which
+   place the spheres, the size and time of the PDB file and the hash of
+   the control file. A missing control file is the same as an empty
+   one.
+
+   19.10.26 Original    By: ACRM
+*/
+static BOOL DescribeRender(char *inFile, char *control, int NSphere,
+                           char *desc)
+{
+   unsigned char buffer[HASHBUFF],
+                 digest[HASHSIZE];
+   char          hashText[2*HASHSIZE+1];
+   HASH          hash;
+   struct stat   st;
+   FILE          *fp;
+   size_t        nread;
+
+   if(stat(inFile, &st))
+   {
+      fprintf(stderr,"Unable to read file: %s\n", inFile);
+      return(FALSE);
+   }
+
+   InitHash(&hash);
+   if((fp = fopen(control, "rb")) != NULL)
+   {
+      while((nread = fread(buffer, 1, HASHBUFF, fp)) > 0)
+         AddToHash(&hash, buffer, nread);
+      fclose(fp);
+   }
+   EndHash(&hash, digest);
+   HashText(digest, hashText);
+
+   sprintf(desc, "%d %d %d %d %d %d %d %lu %ld %s", gRender[0], 
+           gRender[1], gOrigin[0], gOrigin[1], gSize, (int)gAntiAlias, 
+           NSphere, (unsigned long)st.st_size, (long)st.st_mtime, 
+           hashText);
+   return(TRUE);
+}
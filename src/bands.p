@@ -0,0 +1,6 @@
+BOOL RenderBands(SPHERE *AllSpheres, int NSphere, char *outFile,
+                 int outFormat, char *checkpoint, char *inFile,
+                 char *control)
+;
+BOOL RenderBand(SPHERE **SrtSph, int NSphere, int top, int nrows)
+;
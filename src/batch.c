@@ -0,0 +1,646 @@
+/*************************************************************************
+
+   Program:    QTree
+   File:       batch.c
+
+   Version:    V3.25
+   Date:       19.10.26
+   Function:   Render a manifest of images in one run
+
+   Copyright:  (c) SciTech Software 2026
+   Author:     Prof. Andrew C. R. Martin
+   EMail:      andrew@bioinf.org.uk
+
+**************************************************************************
+
+   This program is not in the public domain.
+
+   It may not be copied or made available to third parties, but may be
+   freely used by non-profit-making organisations who have obtained it
+   directly from the author or by FTP.
+
+   You are requested to send EMail to the author to say that you are
+   using this code so that you may be informed of future updates.
+
+   The code may not be made available on other FTP sites without express
+   permission from the author.
+
+   The code may be modified as required, but any modifications must be
+   documented so that the person responsible can be identified. If
+   someone else breaks this code, the author doesn't want to be blamed
+   for code that does not work! You may not distribute any
+   modifications, but are encouraged to send them to the author so
+   that they may be incorporated into future versions of the code.
+
+   The code may not be sold commercially or used for commercial purposes
+   without prior permission from the author.
+
+**************************************************************************
+
+
+   Description:
+   ============
+   Renders every image listed in a manifest. Each line of the manifest
+   gives the PDB file, control file, size, format and output file of
+   one image:
+
+      # input      control     size       format   output
+      1crn.pdb     plain.qtr   512x512    png      1crn_plain.png
+      1crn.pdb     plain.qtr   512x512    ppm      1crn_plain.ppm
+      1crn.pdb     spin.qtr    1024x768   png      1crn_spin.png
+
+   Fields are separated by tabs or spaces. A - for the control file
+   means none (the defaults file is used), and a - for the size or
+   format means the one given on the command line. Blank lines and
+   lines starting with # are skipped.
+
+**************************************************************************
+
+   Usage:
+   ======
+   RunBatch() is called from main() in place of reading a PDB file.
+
+**************************************************************************
+
+   Notes:
+   ======
+   The jobs are sorted so that each PDB file is read only once. Jobs
+   with the same PDB file, control file and size make the same picture,
+   so together they form a scene, which is set up and rendered once and
+   then written in each of the formats and to each of the files asked
+   for.
+
+   The control file and the renderer keep their state in global and
+   static variables, so each scene is rendered by a worker process
+   forked once the PDB file has been read. The worker starts with the
+   settings of the command line and its own copy of the atoms, which it
+   may change freely. Up to gNThreads workers run at once.
+
+   A scene which fails does not stop the others. The number of images
+   which could not be made is given at the end.
+
+**************************************************************************
+
+   Revision History:
+   =================
+   V3.21 19.10.26 Original
+   V3.25 19.10.26 Atoms are read into an array by ReadAtoms()
+
+*************************************************************************/
+/* Includes
+*/
+#define _XOPEN_SOURCE 600
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "bioplib/macros.h"
+#include "bioplib/MathType.h"
+#include "bioplib/SysDefs.h"
+#include "bioplib/pdb.h"
+
+#include "qtree.h"
+#include "qtree.p"
+#include "graphics.p"
+#include "commands.p"
+#include "atoms.p"
+#include "batch.p"
+
+/************************************************************************/
+/* Defines and types
+*/
+#define MAXBUFF 1024             /* Longest manifest line               */
+
+typedef struct                   /* One image of the manifest           */
+{
+   char *input,
+        *control,
+        *output;
+   int  width,
+        height,
+        format,
+        line;
+   BOOL ownInput,                /* Names not shared with the line      */
+        ownControl;              /* before, so freed with this job      */
+}  BATCHJOB;
+
+/************************************************************************/
+/* Prototypes
+*/
+static BATCHJOB *ReadManifest(char *manifest, int width, int height,
+                              int format, int *NJobs);
+static char *KeepName(char *name, char *last);
+static int  CompareJobs(const void *a, const void *b);
+static BOOL SameScene(BATCHJOB *a, BATCHJOB *b);
+static int  RenderScene(PDB *pdb, int NAtom, BATCHJOB *jobs, int NJobs,
+                        char *defControl, int resolution);
+static int  WaitScene(pid_t *pids, int *counts, int nWorkers);
+static void FreeJobs(BATCHJOB *jobs, int NJobs);
+
+
+/************************************************************************/
+/*>BOOL RunBatch(char *manifest, char *defControl, BOOL ballStick,
+                 int resolution, int width, int height, int format)
+   ----------------------------------------------------------------
+   Input:   char   *manifest   The manifest file
+            char   *defControl Control file used when none is given
+            BOOL   ballStick   Read all atoms for ball and stick
+            int    resolution  Size the molecule is scaled to (0 to fit
+                               each image)
+            int    width       Size used when the manifest gives -
+            int    height
+            int    format      Format used when the manifest gives -
+   Returns: BOOL               Were all the images made?
+
+   Renders and writes every image in the manifest using up to
+   gNThreads processes.
+
+   19.10.26 Original    By: ACRM
+   19.10.26 Atoms read with ReadAtoms()
+*/
+BOOL RunBatch(char *manifest, char *defControl, BOOL ballStick,
+              int resolution, int width, int height, int format)
+{
+   BATCHJOB *jobs;
+   FILE     *fp;
+   PDB      *pdb;
+   pid_t    *pids    = NULL;
+   int      *counts  = NULL,
+            NJobs,
+            NAtom,
+            nWorkers,
+            nRunning = 0,
+            nFailed  = 0,
+            worker,
+            first,
+            last,
+            scene,
+            end,
+            nBad;
+
+   if((jobs = ReadManifest(manifest, width, height, format, &NJobs))
+      == NULL)
+      return(FALSE);
+
+   nWorkers = MAX(gNThreads, 1);
+   if(((pids   = (pid_t *)malloc(nWorkers * sizeof(pid_t))) == NULL) ||
+      ((counts = (int *)malloc(nWorkers * sizeof(int))) == NULL))
+   {
+      fprintf(stderr,"No memory for batch workers\n");
+      if(pids != NULL) free(pids);
+      FreeJobs(jobs, NJobs);
+      return(FALSE);
+   }
+   for(worker=0; worker<nWorkers; worker++)
+      pids[worker] = (-1);
+
+   /* Bring the jobs for each PDB file, and then each scene, together   */
+   qsort(jobs, NJobs, sizeof(BATCHJOB), CompareJobs);
+
+   for(first=0; first<NJobs; first=last)
+   {
+      for(last=first+1; (last<NJobs) &&
+                        !strcmp(jobs[last].input, jobs[first].input);
+          last++);
+
+      /* Read the PDB file once for all its scenes                      */
+      pdb = NULL;
+      if((fp = fopen(jobs[first].input, "r")) == NULL)
+      {
+         fprintf(stderr,"Unable to read file: %s\n", jobs[first].input);
+      }
+      else
+      {
+         pdb = ReadAtoms(fp, ballStick, &NAtom);
+         fclose(fp);
+         if(pdb == NULL)
+            fprintf(stderr,"Unable to read atoms from PDB file: %s\n",
+                    jobs[first].input);
+      }
+      if(pdb == NULL)
+      {
+         nFailed += last - first;
+         continue;
+      }
+
+      /* Fork a worker for each scene. The workers have their own copy
+         of the atoms so the array may be freed here at once
+      */
+      for(scene=first; scene<last; scene=end)
+      {
+         for(end=scene+1; (end<last) &&
+                          SameScene(&(jobs[end]), &(jobs[scene]));
+             end++);
+
+         if(nRunning == nWorkers)
+         {
+            nFailed += WaitScene(pids, counts, nWorkers);
+            nRunning--;
+         }
+         for(worker=0; pids[worker] >= 0; worker++);
+
+         fflush(stdout);
+         fflush(stderr);
+         if((pids[worker] = fork()) == 0)
+         {
+            /* The exit status is the number of images not made         */
+            gNThreads = 1;
+            nBad      = RenderScene(pdb, NAtom, jobs+scene, end-scene,
+                                    defControl, resolution);
+            _exit(MIN(nBad, 255));
+         }
+         else if(pids[worker] < 0)
+         {
+            fprintf(stderr,"Unable to start batch worker for %s\n",
+                    jobs[scene].output);
+            nFailed += end - scene;
+         }
+         else
+         {
+            counts[worker] = end - scene;
+            nRunning++;
+         }
+      }
+
+      free(pdb);
+   }
+
+   while(nRunning--)
+      nFailed += WaitScene(pids, counts, nWorkers);
+
+   if(nFailed)
+      fprintf(stderr,"%d of %d images could not be made\n", nFailed,
+              NJobs);
+
+   free(pids);
+   free(counts);
+   FreeJobs(jobs, NJobs);
+   return(nFailed == 0);
+}
+
+
+/************************************************************************/
+/*>static BATCHJOB *ReadManifest(char *manifest, int width, int height,
+                                 int format, int *NJobs)
+   --------------------------------------------------------------------
+   Input:   char     *manifest   The manifest file
+            int      width       Size used for -
+            int      height
+            int      format      Format used for -
+   Output:  int      *NJobs      Number of jobs
+   Returns: BATCHJOB *           Malloc'd jobs (NULL on error)
+
+   Reads and checks every line of the manifest.
+
+   19.10.26 Original    By: ACRM
+*/
+static BATCHJOB *ReadManifest(char *manifest, int width, int height,
+                              int format, int *NJobs)
+{
+   FILE     *fp;
+   BATCHJOB *jobs     = NULL,
+            *job,
+            *prev     = NULL;
+   char     buffer[MAXBUFF],
+            *field[5],
+            *chp,
+            extra;
+   int      maxJobs   = 0,
+            line      = 0,
+            i;
+   BOOL     ok        = TRUE;
+
+   *NJobs = 0;
+   if((fp = fopen(manifest, "r")) == NULL)
+   {
+      fprintf(stderr,"Unable to read manifest: %s\n", manifest);
+      return(NULL);
+   }
+
+   while(ok && fgets(buffer, MAXBUFF, fp))
+   {
+      line++;
+      TERMINATE(buffer);
+
+      /* Split the line into its fields                                 */
+      for(i=0, chp=strtok(buffer, " \t\r"); 
+          (i<5) && (chp!=NULL); 
+          i++, chp=strtok(NULL, " \t\r"))
+         field[i] = chp;
+      if((i == 0) || (field[0][0] == '#'))
+         continue;
+      if((i < 5) || (chp != NULL))
+      {
+         fprintf(stderr,"Manifest line %d does not have 5 fields\n", 
+                 line);
+         ok = FALSE;
+         break;
+      }
+
+      if(*NJobs >= maxJobs)
+      {
+         maxJobs = 2 * maxJobs + 1024;
+         if((job = (BATCHJOB *)realloc(jobs, maxJobs * sizeof(BATCHJOB)))
+            == NULL)
+         {
+            fprintf(stderr,"No memory for manifest\n");
+            ok = FALSE;
+            break;
+         }
+         jobs = job;
+         prev = (*NJobs) ? jobs + *NJobs - 1 : NULL;
+      }
+      job       = jobs + *NJobs;
+      job->line = line;
+
+      /* Sizes and formats, with - for those on the command line        */
+      job->width  = width;
+      job->height = height;
+      job->format = format;
+      if(strcmp(field[2], "-") &&
+         (sscanf(field[2], "%dx%d%c", &(job->width), &(job->height),
+                 &extra) != 2))
+      {
+         /* Just one number for a square                                */
+         if(sscanf(field[2], "%d%c", &(job->width), &extra) == 1)
+            job->height = job->width;
+         else
+            job->width  = 0;
+      }
+      if((job->width < 1) || (job->height < 1))
+      {
+         fprintf(stderr,"Manifest line %d has an invalid size: %s\n",
+                 line, field[2]);
+         ok = FALSE;
+         break;
+      }
+      if(strcmp(field[3], "-"))
+         job->format = ParseFormat(field[3]);
+      if((job->format == OUTPUT_DZI) || (job->format == OUTPUT_XYZ))
+      {
+         fprintf(stderr,"Manifest line %d: tiles cannot be made in a \
+batch\n", line);
+         ok = FALSE;
+         break;
+      }
+
+      /* Lines for the same PDB and control file share the names        */
+      job->input      = KeepName(field[0], prev ? prev->input : NULL);
+      job->control    = KeepName(field[1], prev ? prev->control : NULL);
+      job->output     = KeepName(field[4], NULL);
+      job->ownInput   = (prev == NULL) || (job->input   != prev->input);
+      job->ownControl = (prev == NULL) || (job->control != prev->control);
+      (*NJobs)++;
+      prev = job;
+      if((job->input == NULL) || (job->control == NULL) ||
+         (job->output == NULL))
+      {
+         fprintf(stderr,"No memory for manifest\n");
+         ok = FALSE;
+      }
+   }
+   fclose(fp);
+
+   if(ok && (*NJobs == 0))
+   {
+      fprintf(stderr,"No images in manifest: %s\n", manifest);
+      ok = FALSE;
+   }
+   if(!ok)
+   {
+      FreeJobs(jobs, *NJobs);
+      return(NULL);
+   }
+   return(jobs);
+}
+
+
+/************************************************************************/
+/*>static char *KeepName(char *name, char *last)
+   ---------------------------------------------
+   Input:   char   *name       A name from the manifest
+            char   *last       The same field of the line before, or NULL
+   Returns: char   *           last if the same, otherwise a malloc'd
+                               copy of name (NULL if no memory)
+
+   19.10.26 Original    By: ACRM
+*/
+static char *KeepName(char *name, char *last)
+{
+   char *copy;
+
+   if((last != NULL) && !strcmp(name, last))
+      return(last);
+
+   if((copy = (char *)malloc(strlen(name)+1)) != NULL)
+      strcpy(copy, name);
+   return(copy);
+}
+
+
+/************************************************************************/
+/*>static int CompareJobs(const void *a, const void *b)
+   ----------------------------------------------------
+   Input:   const void *a      BATCHJOB
+            const void *b      BATCHJOB
+   Returns: int                Sort order: input, control file, size
+
+   For qsort()
+
+   19.10.26 Original    By: ACRM
+*/
+static int CompareJobs(const void *a, const void *b)
+{
+   const BATCHJOB *ja = (const BATCHJOB *)a,
+                  *jb = (const BATCHJOB *)b;
+   int            cmp;
+
+   if((cmp = strcmp(ja->input, jb->input)) != 0)
+      return(cmp);
+   if((cmp = strcmp(ja->control, jb->control)) != 0)
+      return(cmp);
+   if(ja->width != jb->width)
+      return(ja->width - jb->width);
+   if(ja->height != jb->height)
+      return(ja->height - jb->height);
+   return(ja->line - jb->line);
+}
+
+
+/************************************************************************/
+/*>static BOOL SameScene(BATCHJOB *a, BATCHJOB *b)
+   -----------------------------------------------
+   Input:   BATCHJOB *a, *b    Two jobs for the same PDB file
+   Returns: BOOL               Do they make the same picture?
+
+   19.10.26 Original    By: ACRM
+*/
+static BOOL SameScene(BATCHJOB *a, BATCHJOB *b)
+{
+   return(!strcmp(a->control, b->control) && 
+          (a->width == b->width) && (a->height == b->height));
+}
+
+
+/************************************************************************/
+/*>static int RenderScene(PDB *pdb, int NAtom, BATCHJOB *jobs, 
+                          int NJobs, char *defControl, int resolution)
+   --------------------------------------------------------------------
+   Input:   PDB      *pdb        Atoms as read. Changed by the control 
+                                 file
+            int      NAtom       Number of atoms
+            BATCHJOB *jobs       Jobs making the same picture
+            int      NJobs       Number of jobs
+            char     *defControl Control file used for -
+            int      resolution  Size the molecule is scaled to (0 to 
+                                 fit the image)
+   Returns: int                  Number of images not written
+
+   Sets up, renders and writes one scene. Run in a worker process as 
+   it leaves the control file's settings in place.
+
+   19.10.26 Original    By: ACRM
+*/
+static int RenderScene(PDB *pdb, int NAtom, BATCHJOB *jobs, int NJobs,
+                       char *defControl, int resolution)
+{
+   SPHERE *spheres;
+   FILE   *fp;
+   int    i,
+          aux     = 0,
+          nFailed = 0;
+
+   SetRenderSize(jobs[0].width, jobs[0].height, resolution);
+   for(i=0; i<NJobs; i++)
+   {
+      if(NeedAlpha(jobs[i].format))
+         aux = AUX_ALPHA;
+   }
+   if(!InitGraphics(aux) || 
+      ((spheres = CreateSphereList(pdb, NAtom)) == NULL))
+   {
+      fprintf(stderr,"No memory for %dx%d image of %s\n", jobs[0].width,
+              jobs[0].height, jobs[0].input);
+      return(NJobs);
+   }
+
+   if(strcmp(jobs[0].control, "-"))
+   {
+      if((fp = fopen(jobs[0].control, "r")) == NULL)
+      {
+         fprintf(stderr,"Unable to open control file: %s\n",
+                 jobs[0].control);
+         return(NJobs);
+      }
+      fclose(fp);
+      HandleControl(jobs[0].control, pdb, spheres, NAtom, TRUE);
+   }
+   else
+   {
+      HandleControl(defControl, pdb, spheres, NAtom, FALSE);
+   }
+   if(gNFrames > 0)
+   {
+      fprintf(stderr,"Animations cannot be made in a batch: %s\n",
+              jobs[0].control);
+      return(NJobs);
+   }
+
+   MapSpheres(pdb, spheres, NAtom);
+   if(gSlab.flag)
+      spheres = SlabSphereList(spheres, &NAtom);
+
+   if(!SpaceFill(spheres, NAtom))
+   {
+      fprintf(stderr,"Unable to render %s\n", jobs[0].output);
+      return(NJobs);
+   }
+
+   for(i=0; i<NJobs; i++)
+   {
+      if(!WriteImage(jobs[i].output, jobs[i].format))
+      {
+         fprintf(stderr,"Unable to write image: %s\n", jobs[i].output);
+         nFailed++;
+      }
+   }
+   return(nFailed);
+}
+
+
+/************************************************************************/
+/*>static int WaitScene(pid_t *pids, int *counts, int nWorkers)
+   ------------------------------------------------------------
+   I/O:     pid_t  *pids       Running workers (-1 for a free slot)
+   Input:   int    *counts     Images each worker is making
+            int    nWorkers    Number of slots
+   Returns: int                Number of images which failed
+
+   Waits for a worker to finish and frees its slot. A worker's exit
+   status is the number of its images which failed.
+
+   19.10.26 Original    By: ACRM
+*/
+static int WaitScene(pid_t *pids, int *counts, int nWorkers)
+{
+   pid_t pid;
+   int   status,
+         worker;
+
+   for(;;)
+   {
+      if((pid = waitpid(-1, &status, 0)) < 0)
+      {
+         if(errno == EINTR)
+            continue;
+
+         /* No workers left                                             */
+         for(worker=0; worker<nWorkers; worker++)
+            pids[worker] = (-1);
+         return(0);
+      }
+
+      for(worker=0; worker<nWorkers; worker++)
+      {
+         if(pids[worker] == pid)
+         {
+            pids[worker] = (-1);
+            if(!WIFEXITED(status))
+               return(counts[worker]);
+            return(MIN(WEXITSTATUS(status), counts[worker]));
+         }
+      }
+   }
+}
+
+
+/************************************************************************/
+/*>static void FreeJobs(BATCHJOB *jobs, int NJobs)
+   -----------------------------------------------
+   Input:   BATCHJOB *jobs      Jobs from ReadManifest()
+            int      NJobs      Number of jobs
+
+   Frees the jobs and the names they own.
+
+   19.10.26 Original    By: ACRM
+*/
+static void FreeJobs(BATCHJOB *jobs, int NJobs)
+{
+   int i;
+
+   if(jobs == NULL)
+      return;
+
+   for(i=0; i<NJobs; i++)
+   {
+      if(jobs[i].ownInput)   free(jobs[i].input);
+      if(jobs[i].ownControl) free(jobs[i].control);
+      free(jobs[i].output);
+   }
+   free(jobs);
+}
@@ -0,0 +1,3 @@
+BOOL RunBatch(char *manifest, char *defControl, BOOL ballStick,
+              int resolution, int width, int height, int format)
+;
@@ -0,0 +1,323 @@
+/*************************************************************************
+
+   Program:    QTree
+   File:       borders.c   
+
+   Version:    V3.15
+   Date:       19.10.26
+   Function:   Draw highlight borders as a post-pass  
+
+   Copyright:  (c) SciTech Software 2026
+   Author:     Prof. Andrew C. R. Martin
+   EMail:      andrew@bioinf.org.uk
+
+**************************************************************************
+
+   This program is not in the public domain.
+
+   It may not be copied or made available to third parties, but may be
+   freely used by non-profit-making organisations who have obtained it
+   directly from the author or by FTP.
+
+   You are requested to send EMail to the author to say that you are
+   using this code so that you may be informed of future updates.
+
+   The code may not be made available on other FTP sites without express
+   permission from the author.
+
+   The code may be modified as required, but any modifications must be
+   documented so that the person responsible can be identified. If
+   someone else breaks this code, the author doesn't want to be blamed
+   for code that does not work! You may not distribute any
+   modifications, but are encouraged to send them to the author so
+   that they may be incorporated into future versions of the code.
+
+   The code may not be sold commercially or used for commercial purposes
+   without prior permission from the author.
+
+**************************************************************************
+
+   Description:
+   ============
+   Draws the borders around HIGHLIGHT zones. While the quad tree runs,
+   ColourPixel() records the highlight number of the front sphere at 
+   each highlighted pixel. Once the region is done, one linear pass 
+   finds the border pixels and paints their borders over the image.
+
+**************************************************************************
+
+   Usage:
+   ======
+   InitBorders() is given the part of the render area about to be 
+   covered, SetPixelHighlight() is called for each highlighted pixel
+   and DrawBorders() then paints the borders and frees the buffer.
+
+**************************************************************************
+
+   Notes:
+   ======
+   A highlighted pixel is on a border if any pixel within 
+   BORDER_NEIGHBOUR of it is background or is highlighted differently.
+   Each border pixel is painted in its highlight colour, together with 
+   the pixels up to gBorderWidth to the left of and below it. This is 
+   the same as finding, for every pixel, the nearest border pixel above
+   and to the right in chessboard distance, which is done in a single
+   pass from the top right: each pixel is one further than the nearest
+   of its right, upper and upper right neighbours. The cost therefore 
+   does not depend on the border width. Where borders of different 
+   colours overlap, the nearest wins.
+
+   Pixels outside the region are treated as matching their neighbour,
+   so a highlighted sphere cut by the edge of the render area has no
+   border along that edge.
+
+   Nothing is allocated until the first highlighted pixel is seen, so 
+   pictures without HIGHLIGHT cost nothing extra.
+
+**************************************************************************
+
+   Revision History:
+   =================
+   V3.15 19.10.26 Original
+
+*************************************************************************/
+/* Includes
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bioplib/macros.h"
+#include "bioplib/MathType.h"
+#include "bioplib/SysDefs.h"
+#include "bioplib/pdb.h"
+
+#include "qtree.h"
+#include "graphics.p"
+#include "borders.p"
+
+/************************************************************************/
+/* Defines and types
+*/
+typedef struct                   /* Colour of a highlight               */
+{
+   REAL r, g, b;
+}  HLCOLOUR;
+
+/************************************************************************/
+/* Variables global to this file only
+*/
+static int      *sHighlight = NULL,  /* Highlight number at each pixel */
+                sX0         = 0,     /* Region covered (render area)   */
+                sY0         = 0,
+                sWidth      = 0,
+                sHeight     = 0,
+                sNColours   = 0;     /* Size of sColours               */
+static HLCOLOUR *sColours   = NULL;  /* Colour of each highlight       */
+static BOOL     sNoMemory   = FALSE; /* An allocation failed           */
+
+/************************************************************************/
+/* Prototypes
+*/
+static BOOL IsBorder(int x, int y);
+static void FreeBorders(void);
+
+
+/************************************************************************/
+/*>void InitBorders(int x0, int y0, int x1, int y1)
+   ------------------------------------------------
+   Input:   int    x0,y0       Bottom left of the render area to cover
+            int    x1,y1       Top right (exclusive)
+
+   Start recording highlights for a region of the render area. This 
+   should extend BORDER_NEIGHBOUR beyond the pixels whose borders are 
+   wanted.
+
+   19.10.26 Original    By: ACRM
+*/
+void InitBorders(int x0, int y0, int x1, int y1)
+{
+   FreeBorders();
+   
+   sX0       = x0;
+   sY0       = y0;
+   sWidth    = MAX(x1 - x0, 0);
+   sHeight   = MAX(y1 - y0, 0);
+   sNoMemory = FALSE;
+}
+
+
+/************************************************************************/
+/*>void SetPixelHighlight(int x, int y, SPHERE *sphere)
+   ----------------------------------------------------
+   Input:   int    x, y        Pixel in the render area
+            SPHERE *sphere     Highlighted sphere in front there
+
+   Record that a pixel shows a highlighted sphere.
+
+   19.10.26 Original    By: ACRM
+*/
+void SetPixelHighlight(int x, int y, SPHERE *sphere)
+{
+   HLCOLOUR *colours;
+   int      h = sphere->highlight;
+   
+   x -= sX0;
+   y -= sY0;
+   if((x < 0) || (x >= sWidth) || (y < 0) || (y >= sHeight) ||
+      sNoMemory)
+      return;
+
+   if(sHighlight == NULL)
+   {
+      if((sHighlight = (int *)calloc((size_t)sWidth * sHeight, 
+                                     sizeof(int))) == NULL)
+      {
+         sNoMemory = TRUE;
+         return;
+      }
+   }
+
+   if(h >= sNColours)
+   {
+      if((colours = (HLCOLOUR *)realloc(sColours, 
+                                        (h+1) * sizeof(HLCOLOUR)))
+         == NULL)
+      {
+         sNoMemory = TRUE;
+         return;
+      }
+      sColours  = colours;
+      sNColours = h+1;
+   }
+   
+   sColours[h].r = sphere->hr;
+   sColours[h].g = sphere->hg;
+   sColours[h].b = sphere->hb;
+   sHighlight[(size_t)y * sWidth + x] = h;
+}
+
+
+/************************************************************************/
+/*>BOOL DrawBorders(void)
+   ----------------------
+   Returns: BOOL            Success?
+
+   Paint the borders for the region given to InitBorders() with 
+   SetPixel() and free the highlight buffer.
+
+   19.10.26 Original    By: ACRM
+*/
+BOOL DrawBorders(void)
+{
+   int  *dist = NULL,        /* Distance to border: this row and above */
+        *hl   = NULL,        /* Highlight of that border               */
+        *dCur, *dUp, *hCur, *hUp, *tmp,
+        x, y, d, h;
+   BOOL ok = !sNoMemory;
+   
+   if((sHighlight == NULL) || !ok)
+      goto cleanup;
+
+   if((dist = (int *)calloc(4 * (sWidth+1), sizeof(int))) == NULL)
+   {
+      ok = FALSE;
+      goto cleanup;
+   }
+   hl = dist + 2 * (sWidth+1);
+
+   /* Each row has an extra pixel on the right which is never near a
+      border. The row above the region is the same.
+   */
+   dCur = dist;  dUp = dist + sWidth + 1;
+   hCur = hl;    hUp = hl   + sWidth + 1;
+   for(x=0; x<=sWidth; x++)
+      dUp[x] = dCur[x] = gBorderWidth + 1;
+
+   for(y=sHeight-1; y>=0; y--)
+   {
+      for(x=sWidth-1; x>=0; x--)
+      {
+         if(IsBorder(x, y))
+         {
+            d = 0;
+            h = sHighlight[(size_t)y * sWidth + x];
+         }
+         else
+         {
+            d = dCur[x+1];  h = hCur[x+1];
+            if(dUp[x] < d)   { d = dUp[x];   h = hUp[x];   }
+            if(dUp[x+1] < d) { d = dUp[x+1]; h = hUp[x+1]; }
+            if(d <= gBorderWidth)
+               d++;
+         }
+         dCur[x] = d;
+         hCur[x] = h;
+
+         if(d <= gBorderWidth)
+            SetPixel(x + sX0, y + sY0, 
+                     sColours[h].r, sColours[h].g, sColours[h].b);
+      }
+
+      tmp = dUp;  dUp = dCur;  dCur = tmp;
+      tmp = hUp;  hUp = hCur;  hCur = tmp;
+   }
+
+cleanup:
+   if(!ok)
+      fprintf(stderr, "No memory to draw highlight borders.\n");
+   if(dist != NULL)
+      free(dist);
+   FreeBorders();
+   return(ok);
+}
+
+
+/************************************************************************/
+/*>static BOOL IsBorder(int x, int y)
+   ----------------------------------
+   Input:   int    x, y        Pixel in the highlight buffer
+   Returns: BOOL               Is it a highlighted pixel on a border?
+
+   19.10.26 Original    By: ACRM
+*/
+static BOOL IsBorder(int x, int y)
+{
+   int h = sHighlight[(size_t)y * sWidth + x],
+       xx, yy;
+
+   if(h == 0)
+      return(FALSE);
+   
+   for(yy=MAX(y-BORDER_NEIGHBOUR, 0); 
+       yy<=MIN(y+BORDER_NEIGHBOUR, sHeight-1); 
+       yy++)
+   {
+      for(xx=MAX(x-BORDER_NEIGHBOUR, 0);
+          xx<=MIN(x+BORDER_NEIGHBOUR, sWidth-1);
+          xx++)
+      {
+         if(sHighlight[(size_t)yy * sWidth + xx] != h)
+            return(TRUE);
+      }
+   }
+   return(FALSE);
+}
+
+
+/************************************************************************/
+/*>static void FreeBorders(void)
+   -----------------------------
+   Free the highlight buffer and colours and forget the region
+
+   19.10.26 Original    By: ACRM
+*/
+static void FreeBorders(void)
+{
+   if(sHighlight != NULL) free(sHighlight);
+   if(sColours   != NULL) free(sColours);
+   sHighlight = NULL;
+   sColours   = NULL;
+   sNColours  = 0;
+   sWidth     = sHeight = 0;
+}
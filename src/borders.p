@@ -0,0 +1,6 @@
+void InitBorders(int x0, int y0, int x1, int y1)
+;
+void SetPixelHighlight(int x, int y, SPHERE *sphere)
+;
+BOOL DrawBorders(void)
+;
@@ -0,0 +1,89 @@
+/*************************************************************************
+
+   Program:    QTree
+   File:       buildid.c
+
+   Version:    V3.25
+   Date:       19.10.26
+   Function:   Identify the build of QTree
+
+   Copyright:  (c) SciTech Software 2026
+   Author:     Prof. Andrew C. R. Martin
+   EMail:      andrew@bioinf.org.uk
+
+**************************************************************************
+
+   This program is not in the public domain.
+
+   It may not be copied or made available to third parties, but may be
+   freely used by non-profit-making organisations who have obtained it
+   directly from the author or by FTP.
+
+   You are requested to send EMail to the author to say that you are
+   using this code so that you may be informed of future updates.
+
+   The code may not be made available on other FTP sites without express
+   permission from the author.
+
+   The code may be modified as required, but any modifications must be
+   documented so that the person responsible can be identified. If
+   someone else breaks this code, the author doesn't want to be blamed
+   for code that does not work! You may not distribute any
+   modifications, but are encouraged to send them to the author so
+   that they may be incorporated into future versions of the code.
+
+   The code may not be sold commercially or used for commercial purposes
+   without prior permission from the author.
+
+**************************************************************************
+
+   Description:
+   ============
+   Gives a string which identifies this build of QTree, so that files
+   made by one build are not taken to have been made by another.
+
+**************************************************************************
+
+   Usage:
+   ======
+   BuildID() gives the string.
+
+**************************************************************************
+
+   Notes:
+   ======
+   The Makefile compiles this file again with BUILD_ID set to the time
+   and process of the build every time QTree is linked, so any change
+   to any other file gives a new ID. Compiled by other means, the ID is
+   the time at which this file was compiled.
+
+**************************************************************************
+
+   Revision History:
+   =================
+   V3.25 19.10.26 Original
+
+*************************************************************************/
+/* Includes
+*/
+#include "buildid.p"
+
+/************************************************************************/
+/* Defines
+*/
+#ifndef BUILD_ID
+#  define BUILD_ID __DATE__ " " __TIME__
+#endif
+
+
+/************************************************************************/
+/*>char *BuildID(void)
+   -------------------
+   Returns: char *             Identifies this build
+
+   19.10.26 Original    By: ACRM
+*/
+char *BuildID(void)
+{
+   return(BUILD_ID);
+}
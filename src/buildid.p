@@ -0,0 +1,2 @@
+char *BuildID(void)
+;
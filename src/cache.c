@@ -0,0 +1,959 @@
+/*************************************************************************
+
+   Program:    QTree
+   File:       cache.c
+
+   Version:    V3.25
+   Date:       19.10.26
+   Function:   Cache of rendered images and prepared structures
+
+   Copyright:  (c) SciTech Software 2026
+   Author:     Prof. Andrew C. R. Martin
+   EMail:      andrew@bioinf.org.uk
+
+**************************************************************************
+
+   This program is not in the public domain.
+
+   It may not be copied or made available to third parties, but may be
+   freely used by non-profit-making organisations who have obtained it
+   directly from the author or by FTP.
+
+   You are requested to send EMail to the author to say that you are
+   using this code so that you may be informed of future updates.
+
+   The code may not be made available on other FTP sites without express
+   permission from the author.
+
+   The code may be modified as required, but any modifications must be
+   documented so that the person responsible can be identified. If
+   someone else breaks this code, the author doesn't want to be blamed
+   for code that does not work! You may not distribute any
+   modifications, but are encouraged to send them to the author so
+   that they may be incorporated into future versions of the code.
+
+   The code may not be sold commercially or used for commercial purposes
+   without prior permission from the author.
+
+**************************************************************************
+
+   Description:
+   ============
+   Keeps rendered images in a directory, each named by the SHA-256
+   hash of everything which decides its bytes: the PDB file, the
+   control file used (the one given with -c, otherwise qtree.def), the
+   settings from the command line and the build of QTree. When the
+   same picture is asked for again, the stored image is copied to the
+   output without reading the atoms.
+
+   The atoms read from a PDB file are also kept, in a binary file named
+   by the hash of the PDB file. It holds a header followed by a record
+   of fixed size for each atom with the fields which the sphere list
+   and the control file commands use. On a later run it is mapped into
+   memory and its records are copied into an array of atoms in place
+   of parsing the PDB file. Only the parsing is saved: the atoms are
+   still copied into memory and their spheres made from them.
+
+**************************************************************************
+
+   Usage:
+   ======
+   OpenCache() is called once the PDB file has been opened. For a
+   single picture FindCachedImage() is then called; if it returns FALSE
+   the picture is rendered and StoreCachedImage() is called in place of
+   writing it. ReadCachedPDB() is called in place of ReadAtoms().
+   KeepStructure() and MapStructure() write and read a prepared
+   structure named by the caller, as the daemon does for its workers.
+
+**************************************************************************
+
+   Notes:
+   ======
+   An image is written to a temporary file and renamed into place, so
+   several runs may share a cache. A hit sets the time of the image so
+   that, when the images come to more than the size given, the ones
+   used least recently are removed.
+
+   Input from a pipe is copied to a temporary file as it is hashed, so
+   that it may be read again on a miss.
+
+   So that an unchanged PDB file need not be read to find its hash, the
+   hash is kept with the device, inode, size and time of the file, as
+   git does for its index. It is only kept for a file last changed at
+   least STAMP_AGE seconds before, since a file changed again within
+   the resolution of its time would not be seen to have changed.
+
+   Structure files are checked for the hash of the PDB file they were
+   made from, the build of QTree, the size of their records and their
+   length before they are used. They depend on the sizes of the types
+   of the machine which wrote them.
+
+   The build is given by BuildID(), which changes every time QTree is
+   linked, so that images and structures made by an older build are
+   not used after a change to any file.
+
+**************************************************************************
+
+   Revision History:
+   =================
+   V3.23 19.10.26 Original
+   V3.24 19.10.26 Added prepared structures and kept hashes of inputs
+   V3.25 19.10.26 Atoms are read into an array
+                  Keyed on BuildID() rather than when this file was
+                  compiled
+                  KeepStructure() and MapStructure() made public
+
+*************************************************************************/
+/* Includes
+*/
+#define _XOPEN_SOURCE 700
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <utime.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "bioplib/macros.h"
+#include "bioplib/MathType.h"
+#include "bioplib/SysDefs.h"
+#include "bioplib/pdb.h"
+
+#include "qtree.h"
+#include "graphics.p"
+#include "hash.p"
+#include "atoms.p"
+#include "buildid.p"
+#include "cache.p"
+
+/************************************************************************/
+/* Defines and types
+*/
+#define COPYBUFF    65536        /* Bytes copied at a time              */
+#define IMAGEEXT    ".img"       /* Extension of a cached image         */
+#define STRUCTEXT   ".qts"       /* Extension of a prepared structure   */
+#define STAMPEXT    ".src"       /* Extension of a kept input hash      */
+#define NAMELEN     (2*HASHSIZE + 4)  /* Length of all the names        */
+#define STAMP_AGE   2            /* Seconds before a hash is kept       */
+#define RECNAME     8            /* Names in an atom record             */
+#define BUILDLEN    32           /* Build ID kept in a structure        */
+#define STAMPMAGIC  "QTREESRC"   /* Start of a kept input hash          */
+#define STRUCTMAGIC "QTREEQTS"   /* Start of a prepared structure       */
+
+/* Copies a name, which is always ended                                 */
+#define COPYNAME(to, from) \
+   do { memcpy((to), (from), RECNAME-1); (to)[RECNAME-1] = '\0'; } \
+   while(0)
+
+/* Where the atom records start, aligned for REALs                      */
+#define RECSTART    ((sizeof(STRUCTHEAD) + 15) & ~((size_t)15))
+
+typedef struct                   /* An entry found in the cache         */
+{
+   char   name[NAMELEN+1];
+   time_t used;
+   off_t  size;
+}  CACHEENTRY;
+
+typedef struct                   /* Hash kept for an input file         */
+{
+   char          magic[8];
+   unsigned long device,
+                 inode,
+                 size,
+                 mtime,
+                 mtimeNs;
+   unsigned char hash[HASHSIZE];
+}  INPUTSTAMP;
+
+typedef struct                   /* Start of a prepared structure       */
+{
+   char          magic[8],
+                 build[BUILDLEN]; /* From BuildID()                     */
+   unsigned char source[HASHSIZE];
+   int           recSize,
+                 ballStick,
+                 NAtom;
+}  STRUCTHEAD;
+
+typedef struct                   /* An atom of a prepared structure     */
+{
+   REAL          x, y, z,
+                 occ,
+                 bval;
+   int           atnum,
+                 resnum;
+   char          recordType[RECNAME],
+                 atnam[RECNAME],
+                 resnam[RECNAME],
+                 insert[RECNAME],
+                 chain[RECNAME];
+}  ATOMREC;
+
+/************************************************************************/
+/* Variables global to this file only
+*/
+static char          sDir[160],             /* The cache directory      */
+                     sName[NAMELEN+1];      /* Image for this run       */
+static unsigned char sInput[HASHSIZE];      /* Hash of the PDB file     */
+static unsigned long sMaxBytes = 0;         /* Size of the cache        */
+
+/************************************************************************/
+/* Prototypes
+*/
+static BOOL HashInput(FILE **fp, unsigned char *digest);
+static BOOL HashFile(char *file, HASH *hash);
+static void StampName(struct stat *st, char *name);
+static BOOL FindStamp(struct stat *st, unsigned char *digest);
+static void KeepStamp(struct stat *st, unsigned char *digest);
+static BOOL CopyImage(char *path, char *outFile);
+static void TrimCache(char *keep);
+static int  CompareEntries(const void *a, const void *b);
+
+
+/************************************************************************/
+/*>BOOL OpenCache(char *dir, unsigned long maxBytes, FILE **fp)
+   ------------------------------------------------------------
+   Input:   char    *dir       The cache directory
+            unsigned long maxBytes  Size the cache is kept to
+   I/O:     FILE    **fp       The PDB file, at the start. Input from a
+                               pipe is replaced by a temporary copy.
+                               NULL if it could not be kept
+   Returns: BOOL               Success?
+
+   Makes the cache directory and finds the hash of the PDB file, which
+   is left at its start. If this fails the cache is not used.
+
+   19.10.26 Original    By: ACRM
+*/
+BOOL OpenCache(char *dir, unsigned long maxBytes, FILE **fp)
+{
+   sName[0] = '\0';
+   strncpy(sDir, dir, sizeof(sDir)-1);
+   sDir[sizeof(sDir)-1] = '\0';
+   sMaxBytes = maxBytes;
+   if((mkdir(sDir, 0777) < 0) && (errno != EEXIST))
+   {
+      fprintf(stderr,"Unable to create cache directory: %s\n", sDir);
+      sDir[0] = '\0';
+      return(FALSE);
+   }
+
+   if(!HashInput(fp, sInput))
+   {
+      sDir[0] = '\0';
+      return(FALSE);
+   }
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>BOOL FindCachedImage(char *control, BOOL ballStick, int resolution,
+                        int outFormat, char *outFile)
+   -------------------------------------------------------------------
+   Input:   char    *control   Control file which will be used
+            BOOL    ballStick  Reading all atoms for ball and stick
+            int     resolution Size the molecule is scaled to (0 to fit
+                               the screen)
+            int     outFormat  Output format
+            char    *outFile   Output file (blank for stdout)
+   Returns: BOOL               Was the image found and written?
+
+   Names the picture from its inputs and settings, which must all be
+   set up, and writes it from the cache if it is there. Otherwise the
+   name is kept for StoreCachedImage().
+
+   19.10.26 Original    By: ACRM
+   19.10.26 Split from OpenCache(). Uses the hash of the PDB file
+   19.10.26 Keyed on BuildID()
+*/
+BOOL FindCachedImage(char *control, BOOL ballStick, int resolution,
+                     int outFormat, char *outFile)
+{
+   HASH          hash;
+   unsigned char digest[HASHSIZE];
+   char          settings[512],
+                 path[sizeof(sDir) + NAMELEN + 2];
+   struct stat   st;
+
+   if(!sDir[0])
+      return(FALSE);
+
+   /* The settings which change the image, and the build, since a new
+      build may draw differently
+   */
+   sprintf(settings, "QTree %.*s|%d %d|%d %d|%d %d|%d|%d|%d|%d|%d",
+           BUILDLEN-1, BuildID(), gScreen[0], gScreen[1], gRender[0],
+           gRender[1], gOrigin[0], gOrigin[1], gSize, resolution,
+           (int)gAntiAlias, (int)ballStick, outFormat);
+#ifdef SUPPORT_PNG
+   if(outFormat == OUTPUT_PNG)
+      sprintf(settings+strlen(settings), "|%d %d %d",
+              gPNGOptions.level, gPNGOptions.strategy,
+              gPNGOptions.filters);
+#endif
+
+   InitHash(&hash);
+   AddToHash(&hash, settings, strlen(settings)+1);
+   AddToHash(&hash, sInput, HASHSIZE);
+
+   /* A missing control file is the same as an empty one                */
+   AddToHash(&hash, "|", 1);
+   HashFile(control, &hash);
+   EndHash(&hash, digest);
+
+   HashText(digest, sName);
+   strcat(sName, IMAGEEXT);
+   sprintf(path, "%s/%s", sDir, sName);
+   if(stat(path, &st) || !CopyImage(path, outFile))
+      return(FALSE);
+
+   /* Mark it as used                                                   */
+   utime(path, NULL);
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>BOOL StoreCachedImage(char *outFile, int outFormat)
+   ---------------------------------------------------
+   Input:   char   *outFile    Output file (blank for stdout)
+            int    outFormat   Output format
+   Returns: BOOL               Was the image written to the output?
+
+   Writes the image in the cache under the name found by
+   FindCachedImage(), and then from there to the output. If it cannot
+   be put in the cache, it is written straight to the output.
+
+   19.10.26 Original    By: ACRM
+*/
+BOOL StoreCachedImage(char *outFile, int outFormat)
+{
+   char path[sizeof(sDir) + NAMELEN + 2],
+        temp[sizeof(sDir) + NAMELEN + 24];
+
+   if(!sDir[0] || !sName[0])
+      return(WriteImage(outFile, outFormat));
+
+   sprintf(path, "%s/%s", sDir, sName);
+   sprintf(temp, "%s/%s.%ld", sDir, sName, (long)getpid());
+   if(!WriteImage(temp, outFormat) || rename(temp, path))
+   {
+      unlink(temp);
+      fprintf(stderr,"Unable to add image to cache: %s\n", path);
+      return(WriteImage(outFile, outFormat));
+   }
+
+   TrimCache(sName);
+   if(CopyImage(path, outFile))
+      return(TRUE);
+
+   /* It may have been removed by another run                           */
+   return(WriteImage(outFile, outFormat));
+}
+
+
+/************************************************************************/
+/*>PDB *ReadCachedPDB(FILE *fp, BOOL ballStick, int *NAtom)
+   --------------------------------------------------------
+   Input:   FILE   *fp         The PDB file, at the start
+            BOOL   ballStick   Read all atoms for ball and stick
+   Output:  int    *NAtom      Number of atoms
+   Returns: PDB    *           Array of atoms (NULL if none were read)
+
+   Reads the atoms as ReadAtoms() would. If the PDB file has been read
+   before, they are taken from its prepared structure in the cache;
+   otherwise the prepared structure is written for the next run.
+
+   19.10.26 Original    By: ACRM
+   19.10.26 Reads into an array with ReadAtoms()
+   19.10.26 Keyed on BuildID()
+   19.10.26 Gives the path and source to MapStructure() and
+            KeepStructure()
+*/
+PDB *ReadCachedPDB(FILE *fp, BOOL ballStick, int *NAtom)
+{
+   HASH          hash;
+   unsigned char digest[HASHSIZE];
+   char          settings[128],
+                 name[NAMELEN+1],
+                 path[sizeof(sDir) + NAMELEN + 2];
+   PDB           *pdb;
+
+   if(sDir[0])
+   {
+      sprintf(settings, "QTree structure %.*s|%d|%d|%d",
+              BUILDLEN-1, BuildID(), (int)sizeof(REAL), 
+              (int)sizeof(ATOMREC), (int)ballStick);
+      InitHash(&hash);
+      AddToHash(&hash, settings, strlen(settings)+1);
+      AddToHash(&hash, sInput, HASHSIZE);
+      EndHash(&hash, digest);
+      HashText(digest, name);
+      strcat(name, STRUCTEXT);
+      sprintf(path, "%s/%s", sDir, name);
+
+      if((pdb = MapStructure(path, sInput, ballStick, NAtom)) != NULL)
+      {
+         /* Mark it as used                                             */
+         utime(path, NULL);
+         return(pdb);
+      }
+   }
+
+   pdb = ReadAtoms(fp, ballStick, NAtom);
+   if(sDir[0] && (pdb != NULL))
+   {
+      if(!KeepStructure(path, sInput, pdb, *NAtom, ballStick))
+         fprintf(stderr,"Unable to add structure to cache: %s\n", path);
+      TrimCache(name);
+   }
+   return(pdb);
+}
+
+
+/************************************************************************/
+/*>PDB *MapStructure(char *path, unsigned char *source, BOOL ballStick,
+                     int *NAtom)
+   ---------------------------------------------------------------------
+   Input:   char   *path       A prepared structure
+            unsigned char *source  HASHSIZE bytes naming what it must
+                               have been made from
+            BOOL   ballStick   All atoms were read for ball and stick
+   Output:  int    *NAtom      Number of atoms
+   Returns: PDB    *           Array of atoms (NULL if the structure is
+                               not there or is not valid)
+
+   Maps a prepared structure into memory, checks it was made from the
+   source by this build and copies its records into an array of atoms
+   linked in order.
+
+   19.10.26 Original    By: ACRM
+   19.10.26 Makes an array rather than a list
+   19.10.26 Keyed on BuildID()
+   19.10.26 Made public with source, for the daemon
+*/
+PDB *MapStructure(char *path, unsigned char *source, BOOL ballStick,
+                  int *NAtom)
+{
+   struct stat st;
+   STRUCTHEAD  *head;
+   ATOMREC     *rec;
+   PDB         *pdb,
+               *p;
+   void        *map;
+   char        build[sizeof(head->build)];
+   int         fd,
+               i;
+
+   if((fd = open(path, O_RDONLY)) < 0)
+      return(NULL);
+   if(fstat(fd, &st) || (st.st_size < (off_t)RECSTART))
+   {
+      close(fd);
+      return(NULL);
+   }
+   map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+   close(fd);
+   if(map == MAP_FAILED)
+      return(NULL);
+
+   head = (STRUCTHEAD *)map;
+   memset(build, 0, sizeof(build));
+   strncpy(build, BuildID(), sizeof(build)-1);
+   if(memcmp(head->magic, STRUCTMAGIC, sizeof(head->magic))  ||
+      memcmp(head->build, build, sizeof(build))                ||
+      memcmp(head->source, source, HASHSIZE)                   ||
+      (head->recSize   != (int)sizeof(ATOMREC))                ||
+      (head->ballStick != (int)ballStick)                      ||
+      (head->NAtom     <= 0)                                   ||
+      (st.st_size != (off_t)(RECSTART + 
+                             (size_t)head->NAtom * sizeof(ATOMREC))))
+   {
+      munmap(map, (size_t)st.st_size);
+      return(NULL);
+   }
+
+   if((pdb = (PDB *)malloc(head->NAtom * sizeof(PDB))) == NULL)
+   {
+      fprintf(stderr,"No memory for prepared structure\n");
+      munmap(map, (size_t)st.st_size);
+      return(NULL);
+   }
+
+   rec = (ATOMREC *)((char *)map + RECSTART);
+   for(i=0, p=pdb; i<head->NAtom; i++, rec++, p++)
+   {
+      memset(p, 0, sizeof(PDB));
+      p->next   = (i < head->NAtom-1) ? p+1 : NULL;
+      p->x      = rec->x;
+      p->y      = rec->y;
+      p->z      = rec->z;
+      p->occ    = rec->occ;
+      p->bval   = rec->bval;
+      p->atnum  = rec->atnum;
+      p->resnum = rec->resnum;
+      COPYNAME(p->record_type, rec->recordType);
+      COPYNAME(p->atnam,       rec->atnam);
+      COPYNAME(p->atnam_raw,   rec->atnam);
+      COPYNAME(p->resnam,      rec->resnam);
+      COPYNAME(p->insert,      rec->insert);
+      COPYNAME(p->chain,       rec->chain);
+   }
+
+   *NAtom = head->NAtom;
+   munmap(map, (size_t)st.st_size);
+   return(pdb);
+}
+
+
+/************************************************************************/
+/*>BOOL KeepStructure(char *path, unsigned char *source, PDB *pdb,
+                       int NAtom, BOOL ballStick)
+   --------------------------------------------------------------
+   Input:   char   *path       The prepared structure to write
+            unsigned char *source  HASHSIZE bytes naming what the atoms
+                               were read from
+            PDB    *pdb        The atoms read from the PDB file
+            int    NAtom       Number of atoms
+            BOOL   ballStick   All atoms were read for ball and stick
+   Returns: BOOL               Success?
+
+   Writes the prepared structure for a PDB file. It is written to a
+   temporary file and renamed into place.
+
+   19.10.26 Original    By: ACRM
+   19.10.26 Keyed on BuildID()
+   19.10.26 Made public with path and source, for the daemon
+*/
+BOOL KeepStructure(char *path, unsigned char *source, PDB *pdb,
+                   int NAtom, BOOL ballStick)
+{
+   STRUCTHEAD head;
+   ATOMREC    rec;
+   PDB        *p;
+   FILE       *fp;
+   char       *temp,
+              pad[RECSTART];
+   int        n  = 0;
+   BOOL       ok;
+
+   memset(&head, 0, sizeof(STRUCTHEAD));
+   memcpy(head.magic, STRUCTMAGIC, sizeof(head.magic));
+   strncpy(head.build, BuildID(), sizeof(head.build)-1);
+   memcpy(head.source, source, HASHSIZE);
+   head.recSize   = (int)sizeof(ATOMREC);
+   head.ballStick = (int)ballStick;
+   head.NAtom     = NAtom;
+
+   if((temp = (char *)malloc(strlen(path) + 24)) == NULL)
+      return(FALSE);
+   sprintf(temp, "%s.%ld", path, (long)getpid());
+   if((fp = fopen(temp, "wb")) == NULL)
+   {
+      free(temp);
+      return(FALSE);
+   }
+
+   memset(pad, 0, RECSTART);
+   memcpy(pad, &head, sizeof(STRUCTHEAD));
+   ok = (fwrite(pad, RECSTART, 1, fp) == 1);
+   for(p=pdb; ok && (p!=NULL); NEXT(p), n++)
+   {
+      memset(&rec, 0, sizeof(ATOMREC));
+      rec.x      = p->x;
+      rec.y      = p->y;
+      rec.z      = p->z;
+      rec.occ    = p->occ;
+      rec.bval   = p->bval;
+      rec.atnum  = p->atnum;
+      rec.resnum = p->resnum;
+      COPYNAME(rec.recordType, p->record_type);
+      COPYNAME(rec.atnam,      p->atnam);
+      COPYNAME(rec.resnam,     p->resnam);
+      COPYNAME(rec.insert,     p->insert);
+      COPYNAME(rec.chain,      p->chain);
+      ok = (fwrite(&rec, sizeof(ATOMREC), 1, fp) == 1);
+   }
+   if(fclose(fp) || (n != NAtom))
+      ok = FALSE;
+
+   if(!ok || rename(temp, path))
+   {
+      unlink(temp);
+      ok = FALSE;
+   }
+   free(temp);
+   return(ok);
+}
+
+
+/************************************************************************/
+/*>static BOOL HashInput(FILE **fp, unsigned char *digest)
+   -------------------------------------------------------
+   I/O:     FILE          **fp      The PDB file. Input from a pipe is
+                                    replaced by a temporary copy, or set
+                                    to NULL if it was lost
+   Output:  unsigned char *digest   HASHSIZE bytes of its hash
+   Returns: BOOL                    Success?
+
+   Finds the hash of the PDB file and leaves it at its start. The hash
+   of an unchanged file is taken from the cache without reading it.
+
+   19.10.26 Original    By: ACRM
+   19.10.26 Gives the hash of the file alone. Uses kept hashes
+*/
+static BOOL HashInput(FILE **fp, unsigned char *digest)
+{
+   unsigned char buffer[COPYBUFF];
+   FILE          *copy = NULL;
+   HASH          hash;
+   struct stat   st,
+                 after;
+   size_t        nread;
+   BOOL          regular;
+
+   /* A whole regular file may have its hash kept                       */
+   regular = !fstat(fileno(*fp), &st) && S_ISREG(st.st_mode) &&
+             (ftell(*fp) == 0L);
+   if(regular && FindStamp(&st, digest))
+      return(TRUE);
+
+   /* A pipe cannot be read again, so it is kept as it is hashed        */
+   if(fseek(*fp, 0L, SEEK_CUR) && ((copy = tmpfile()) == NULL))
+   {
+      fprintf(stderr,"Unable to keep input for the cache\n");
+      return(FALSE);
+   }
+
+   InitHash(&hash);
+   while((nread = fread(buffer, 1, COPYBUFF, *fp)) > 0)
+   {
+      AddToHash(&hash, buffer, nread);
+      if((copy != NULL) && (fwrite(buffer, 1, nread, copy) != nread))
+      {
+         fprintf(stderr,"Unable to keep input for the cache\n");
+         fclose(copy);
+         *fp = NULL;
+         return(FALSE);
+      }
+   }
+   EndHash(&hash, digest);
+
+   if(copy != NULL)
+   {
+      if(*fp != stdin)
+         fclose(*fp);
+      *fp = copy;
+   }
+   rewind(*fp);
+
+   /* Not if it changed while it was read                               */
+   if(regular && !fstat(fileno(*fp), &after) &&
+      (after.st_size == st.st_size) &&
+      (after.st_mtim.tv_sec == st.st_mtim.tv_sec) &&
+      (after.st_mtim.tv_nsec == st.st_mtim.tv_nsec))
+      KeepStamp(&st, digest);
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>static void StampName(struct stat *st, char *name)
+   --------------------------------------------------
+   Input:   struct stat *st    The PDB file
+   Output:  char        *name  Name of its kept hash
+
+   19.10.26 Original    By: ACRM
+*/
+static void StampName(struct stat *st, char *name)
+{
+   HASH          hash;
+   unsigned char digest[HASHSIZE];
+   char          file[64];
+
+   sprintf(file, "QTree source %lu %lu", (unsigned long)st->st_dev,
+           (unsigned long)st->st_ino);
+   InitHash(&hash);
+   AddToHash(&hash, file, strlen(file)+1);
+   EndHash(&hash, digest);
+   HashText(digest, name);
+   strcat(name, STAMPEXT);
+}
+
+
+/************************************************************************/
+/*>static BOOL FindStamp(struct stat *st, unsigned char *digest)
+   -------------------------------------------------------------
+   Input:   struct stat   *st       The PDB file
+   Output:  unsigned char *digest   HASHSIZE bytes of its hash
+   Returns: BOOL                    Was a hash kept for the file as it
+                                    is now?
+
+   19.10.26 Original    By: ACRM
+*/
+static BOOL FindStamp(struct stat *st, unsigned char *digest)
+{
+   INPUTSTAMP stamp;
+   FILE       *fp;
+   char       name[NAMELEN+1],
+              path[sizeof(sDir) + NAMELEN + 2];
+   BOOL       found = FALSE;
+
+   StampName(st, name);
+   sprintf(path, "%s/%s", sDir, name);
+   if((fp = fopen(path, "rb")) == NULL)
+      return(FALSE);
+
+   if((fread(&stamp, sizeof(INPUTSTAMP), 1, fp) == 1) &&
+      !memcmp(stamp.magic, STAMPMAGIC, sizeof(stamp.magic)) &&
+      (stamp.device  == (unsigned long)st->st_dev) &&
+      (stamp.inode   == (unsigned long)st->st_ino) &&
+      (stamp.size    == (unsigned long)st->st_size) &&
+      (stamp.mtime   == (unsigned long)st->st_mtim.tv_sec) &&
+      (stamp.mtimeNs == (unsigned long)st->st_mtim.tv_nsec))
+   {
+      memcpy(digest, stamp.hash, HASHSIZE);
+      found = TRUE;
+   }
+   fclose(fp);
+
+   /* Mark it as used                                                   */
+   if(found)
+      utime(path, NULL);
+   return(found);
+}
+
+
+/************************************************************************/
+/*>static void KeepStamp(struct stat *st, unsigned char *digest)
+   -------------------------------------------------------------
+   Input:   struct stat   *st       The PDB file, before it was read
+            unsigned char *digest   HASHSIZE bytes of its hash
+
+   Keeps the hash of a file which has not been changed for STAMP_AGE
+   seconds.
+
+   19.10.26 Original    By: ACRM
+*/
+static void KeepStamp(struct stat *st, unsigned char *digest)
+{
+   INPUTSTAMP stamp;
+   FILE       *fp;
+   char       name[NAMELEN+1],
+              path[sizeof(sDir) + NAMELEN + 2],
+              temp[sizeof(sDir) + NAMELEN + 24];
+   BOOL       ok;
+
+   if((time(NULL) - st->st_mtime) < STAMP_AGE)
+      return;
+
+   memset(&stamp, 0, sizeof(INPUTSTAMP));
+   memcpy(stamp.magic, STAMPMAGIC, sizeof(stamp.magic));
+   stamp.device  = (unsigned long)st->st_dev;
+   stamp.inode   = (unsigned long)st->st_ino;
+   stamp.size    = (unsigned long)st->st_size;
+   stamp.mtime   = (unsigned long)st->st_mtim.tv_sec;
+   stamp.mtimeNs = (unsigned long)st->st_mtim.tv_nsec;
+   memcpy(stamp.hash, digest, HASHSIZE);
+
+   StampName(st, name);
+   sprintf(path, "%s/%s", sDir, name);
+   sprintf(temp, "%s/%s.%ld", sDir, name, (long)getpid());
+   if((fp = fopen(temp, "wb")) == NULL)
+      return;
+   ok = (fwrite(&stamp, sizeof(INPUTSTAMP), 1, fp) == 1);
+   if(fclose(fp))
+      ok = FALSE;
+   if(!ok || rename(temp, path))
+      unlink(temp);
+}
+
+
+/************************************************************************/
+/*>static BOOL HashFile(char *file, HASH *hash)
+   --------------------------------------------
+   Input:   char   *file       A file
+   I/O:     HASH   *hash       The hash
+   Returns: BOOL               Was the file read?
+
+   Adds a file to the hash.
+
+   19.10.26 Original    By: ACRM
+*/
+static BOOL HashFile(char *file, HASH *hash)
+{
+   unsigned char buffer[COPYBUFF];
+   FILE          *fp;
+   size_t        nread;
+
+   if((fp = fopen(file, "rb")) == NULL)
+      return(FALSE);
+   while((nread = fread(buffer, 1, COPYBUFF, fp)) > 0)
+      AddToHash(hash, buffer, nread);
+   fclose(fp);
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>static BOOL CopyImage(char *path, char *outFile)
+   ------------------------------------------------
+   Input:   char   *path       An image in the cache
+            char   *outFile    Output file (blank for stdout)
+   Returns: BOOL               Success?
+
+   Copies an image from the cache to the output.
+
+   19.10.26 Original    By: ACRM
+*/
+static BOOL CopyImage(char *path, char *outFile)
+{
+   unsigned char buffer[COPYBUFF];
+   FILE          *in,
+                 *out = stdout;
+   size_t        nread;
+   BOOL          ok   = TRUE;
+
+   if((in = fopen(path, "rb")) == NULL)
+      return(FALSE);
+   if(outFile[0] && ((out = fopen(outFile, "wb")) == NULL))
+   {
+      fprintf(stderr,"Unable to open output file: %s\n", outFile);
+      fclose(in);
+      return(FALSE);
+   }
+
+   while(ok && ((nread = fread(buffer, 1, COPYBUFF, in)) > 0))
+   {
+      if(fwrite(buffer, 1, nread, out) != nread)
+         ok = FALSE;
+   }
+   if(ferror(in))
+      ok = FALSE;
+   fclose(in);
+
+   if(out == stdout)
+   {
+      if(fflush(out))
+         ok = FALSE;
+   }
+   else if(fclose(out))
+   {
+      ok = FALSE;
+   }
+   if(!ok)
+      fprintf(stderr,"Unable to write image from cache: %s\n",
+              outFile[0] ? outFile : "stdout");
+   return(ok);
+}
+
+
+/************************************************************************/
+/*>static void TrimCache(char *keep)
+   ---------------------------------
+   Input:   char   *keep       Name of an entry which is kept
+
+   Removes the entries used least recently until the cache is no larger
+   than sMaxBytes. The entry just made is kept.
+
+   19.10.26 Original    By: ACRM
+   19.10.26 Also trims prepared structures and kept hashes
+*/
+static void TrimCache(char *keep)
+{
+   DIR           *dp;
+   struct dirent *de;
+   struct stat   st;
+   CACHEENTRY    *entries = NULL,
+                 *entry;
+   char          path[sizeof(sDir) + 512];
+   unsigned long total    = 0;
+   int           nEntries = 0,
+                 maxEntries = 0,
+                 i;
+   size_t        len;
+
+   if((dp = opendir(sDir)) == NULL)
+      return;
+
+   while((de = readdir(dp)) != NULL)
+   {
+      /* Just our entries; temporary files are still being written      */
+      len = strlen(de->d_name);
+      if((len != NAMELEN) ||
+         (strcmp(de->d_name + 2*HASHSIZE, IMAGEEXT)  &&
+          strcmp(de->d_name + 2*HASHSIZE, STRUCTEXT) &&
+          strcmp(de->d_name + 2*HASHSIZE, STAMPEXT)))
+         continue;
+      sprintf(path, "%s/%s", sDir, de->d_name);
+      if(stat(path, &st))
+         continue;
+
+      if(nEntries == maxEntries)
+      {
+         maxEntries = 2 * maxEntries + 256;
+         if((entry = (CACHEENTRY *)realloc(entries,
+                                           maxEntries*sizeof(CACHEENTRY)))
+            == NULL)
+         {
+            fprintf(stderr,"No memory to trim cache\n");
+            break;
+         }
+         entries = entry;
+      }
+      entry = &(entries[nEntries++]);
+      strcpy(entry->name, de->d_name);
+      entry->used = st.st_mtime;
+      entry->size = st.st_size;
+      total      += (unsigned long)st.st_size;
+   }
+   closedir(dp);
+
+   if(total > sMaxBytes)
+   {
+      qsort(entries, nEntries, sizeof(CACHEENTRY), CompareEntries);
+      for(i=0; (i<nEntries) && (total>sMaxBytes); i++)
+      {
+         /* Keep the entry just made even if it is too big by itself    */
+         if(!strcmp(entries[i].name, keep))
+            continue;
+         sprintf(path, "%s/%s", sDir, entries[i].name);
+         if(!unlink(path) || (errno == ENOENT))
+            total -= (unsigned long)entries[i].size;
+      }
+   }
+
+   if(entries != NULL)
+      free(entries);
+}
+
+
+/************************************************************************/
+/*>static int CompareEntries(const void *a, const void *b)
+   -------------------------------------------------------
+   Input:   const void *a      CACHEENTRY
+            const void *b      CACHEENTRY
+   Returns: int                Sort order: least recently used first
+
+   For qsort()
+
+   19.10.26 Original    By: ACRM
+*/
+static int CompareEntries(const void *a, const void *b)
+{
+   const CACHEENTRY *ea = (const CACHEENTRY *)a,
+                    *eb = (const CACHEENTRY *)b;
+
+   if(ea->used != eb->used)
+      return((ea->used < eb->used) ? -1 : 1);
+   return(strcmp(ea->name, eb->name));
+}
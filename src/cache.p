@@ -0,0 +1,15 @@
+BOOL OpenCache(char *dir, unsigned long maxBytes, FILE **fp)
+;
+BOOL FindCachedImage(char *control, BOOL ballStick, int resolution,
+                     int outFormat, char *outFile)
+;
+BOOL StoreCachedImage(char *outFile, int outFormat)
+;
+PDB *ReadCachedPDB(FILE *fp, BOOL ballStick, int *NAtom)
+;
+PDB *MapStructure(char *path, unsigned char *source, BOOL ballStick,
+                  int *NAtom)
+;
+BOOL KeepStructure(char *path, unsigned char *source, PDB *pdb,
+                   int NAtom, BOOL ballStick)
+;
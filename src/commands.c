@@ -3,11 +3,11 @@
    Program:    QTree
    File:       commands.c
    
-   Version:    V3.0
-   Date:       19.08.19
+   Version:    V3.25
+   Date:       19.10.26
    Function:   Handle command files for QTree program
    
-   Copyright:  (c) SciTech Software 1993-2019
+   Copyright:  (c) SciTech Software 1993-2026
    Author:     Prof. Andrew C. R. Martin
    EMail:      andrew@bioinf.org.uk
                
@@ -83,6 +83,12 @@
    V2.4  27.01.15 Modifications for new version of BiopLib
    V2.5  18.08.19 General cleanup and moved into GitHub
    V3.0  19.08.19 Added PNG support
+   V3.7  19.10.26 Background drawn by SetBackground() in graphics.c
+   V3.18 19.10.26 Added FRAMES and KEYFRAME for animations
+   V3.19 19.10.26 Rotations are kept in gRotations by RotatePDB()
+   V3.22 19.10.26 HandleControlFile() reads commands from an open file.
+                  SetupParser() only sets up the parser once
+   V3.25 19.10.26 RotatePDB() combines the rotations into gRotation
 
 *************************************************************************/
 /* Includes
@@ -140,12 +146,15 @@
 #define COM_RADIUS            21
 #define COM_HIGHLIGHT         22
 #define COM_BORDERWIDTH       23
-#define PARSER_NCOMM          24
+#define COM_FRAMES            24
+#define COM_KEYFRAME          25
+#define PARSER_NCOMM          26
 
 /************************************************************************/
 KeyWd sKeyWords[PARSER_NCOMM];         /* Parser keywords               */
 char  *sStrParam[PARSER_MAXSTRPARAM];  /* Parser string parameters      */
 REAL  sRealParam[PARSER_MAXREALPARAM]; /* Parser real parameters        */
+static BOOL sParserReady = FALSE;      /* SetupParser() done            */
 
 
 /************************************************************************/
@@ -161,11 +170,16 @@ REAL  sRealParam[PARSER_MAXREALPARAM]; /* Parser real parameters        */
    06.12.95 Added CHAIN
    14.10.03 Added BOUNDS and RADIUS
    18.10.07 Added HIGHLIGHT
+   19.10.26 Added FRAMES and KEYFRAME
+   19.10.26 Returns at once if already set up
 */
 BOOL SetupParser(void)
 {
    int i;
    
+   if(sParserReady)
+      return(TRUE);
+
    /* Allocate memory for the string parameters                         */
    for(i=0; i<PARSER_MAXSTRPARAM; i++)
    {
@@ -205,6 +219,8 @@ BOOL SetupParser(void)
    MAKEKEY(sKeyWords[COM_RADIUS],     "RADIUS",      STRING,2);
    MAKEKEY(sKeyWords[COM_HIGHLIGHT],  "HIGHLIGHT",   STRING,5);
    MAKEKEY(sKeyWords[COM_BORDERWIDTH],"BORDERWIDTH", NUMBER,1);
+   MAKEKEY(sKeyWords[COM_FRAMES],     "FRAMES",      NUMBER,1);
+   MAKEKEY(sKeyWords[COM_KEYFRAME],   "KEYFRAME",    NUMBER,1);
    
    /* Check all allocations OK                                          */
    for(i=0; i<PARSER_NCOMM; i++)
@@ -213,6 +229,7 @@ BOOL SetupParser(void)
          return(FALSE);
    }
    
+   sParserReady = TRUE;
    return(TRUE);
 }
 
@@ -237,11 +254,39 @@ BOOL SetupParser(void)
    06.12.95 Added CHAIN
    14.10.03 Added BOUNDS and RADIUS
    18.10.07 Added HIGHLIGHT
+   19.10.26 Added FRAMES and KEYFRAME. After a KEYFRAME, ROTATE, SCALE
+            and CENTRE describe the motion to that keyframe
+   19.10.26 MATRIX and XMATRIX applied with RotatePDB()
+   19.10.26 Commands handled by HandleControlFile()
 */
 void HandleControl(char *file, PDB *pdb, SPHERE *spheres, int NSphere,
                    BOOL ReportError)
 {
-   FILE  *fp = NULL;
+   FILE *fp;
+
+   if((fp=fopen(file,"r")) == NULL)
+   {
+      if(ReportError)
+         fprintf(stderr,"Unable to open control file: %s\n",file);
+
+      return;
+   }
+
+   HandleControlFile(fp, pdb, spheres, NSphere);
+   fclose(fp);
+}
+
+
+/************************************************************************/
+/*>void HandleControlFile(FILE *fp, PDB *pdb, SPHERE *spheres, 
+                          int NSphere)
+   ---------------------------------------------------------------
+   Modify the sphere list based on the commands read from an open
+   control file
+   19.10.26 Original (split from HandleControl())    By: ACRM
+*/
+void HandleControlFile(FILE *fp, PDB *pdb, SPHERE *spheres, int NSphere)
+{
    char  buffer[160],
          CentreRes[16],
          CentreAtom[8],
@@ -262,14 +307,6 @@ void HandleControl(char *file, PDB *pdb, SPHERE *spheres, int NSphere,
 
    if(SetupParser())
    {
-      if((fp=fopen(file,"r")) == NULL)
-      {
-         if(ReportError)
-            fprintf(stderr,"Unable to open control file: %s\n",file);
-
-         return;
-      }
-      
       while(fgets(buffer,159,fp))
       {
          TERMINATE(buffer);
@@ -319,10 +356,17 @@ void HandleControl(char *file, PDB *pdb, SPHERE *spheres, int NSphere,
             DoPhong(spheres,NSphere,sRealParam[0],sRealParam[1]);
             break;
          case COM_SCALE:
-            gScale = sRealParam[0];
+            if(gNKeyFrames)
+               gKeyFrames[gNKeyFrames-1].scale = sRealParam[0];
+            else
+               gScale = sRealParam[0];
             break;
          case COM_ROTATE:
-            DoRotate(pdb,sStrParam[0],sStrParam[1]);
+            if(gNKeyFrames)
+               DoKeyRotate(&(gKeyFrames[gNKeyFrames-1]),
+                           sStrParam[0],sStrParam[1]);
+            else
+               DoRotate(pdb,sStrParam[0],sStrParam[1]);
             break;
          case COM_MATRIX:
             for(i=0; i<3; i++)
@@ -332,7 +376,7 @@ void HandleControl(char *file, PDB *pdb, SPHERE *spheres, int NSphere,
                   matrix[i][j] = sRealParam[i*3 + j];
                }
             }
-            blRotatePDB(pdb,matrix);
+            RotatePDB(pdb,matrix);
             break;
          case COM_XMATRIX:
             for(i=0; i<3; i++)
@@ -342,13 +386,21 @@ void HandleControl(char *file, PDB *pdb, SPHERE *spheres, int NSphere,
                   matrix[j][i] = sRealParam[i*3 + j];
                }
             }
-            blRotatePDB(pdb,matrix);
+            RotatePDB(pdb,matrix);
             break;
          case COM_CENTRE:
          case COM_CENTER:
-            SetCentre = TRUE;
-            strcpy(CentreRes,  sStrParam[0]);
-            strcpy(CentreAtom, sStrParam[1]);
+            if(gNKeyFrames)
+            {
+               gKeyFrames[gNKeyFrames-1].centreAtom = 
+                  DoKeyCentre(pdb,sStrParam[0],sStrParam[1]);
+            }
+            else
+            {
+               SetCentre = TRUE;
+               strcpy(CentreRes,  sStrParam[0]);
+               strcpy(CentreAtom, sStrParam[1]);
+            }
             break;
          case COM_LIGHT:
             gLight.x = (REAL)gSize * sRealParam[0];
@@ -403,6 +455,14 @@ void HandleControl(char *file, PDB *pdb, SPHERE *spheres, int NSphere,
                gBorderWidth = 0;
             }
             break;
+         case COM_FRAMES:
+            gNFrames = (int)sRealParam[0];
+            if(gNFrames < 0)
+               gNFrames = 0;
+            break;
+         case COM_KEYFRAME:
+            DoKeyFrame((int)sRealParam[0]);
+            break;
          default:
             break;
          }
@@ -609,6 +669,7 @@ void DoResidue(SPHERE *spheres, PDB *pdb, int NSphere, char *resnam,
    ------------------------------------------------------
    Create a rotation matrix and apply to the pdb linked list.
    22.07.93 Original    By: ACRM
+   19.10.26 Applied with RotatePDB()
 */
 void DoRotate(PDB *pdb, char *direction, char *amount)
 {
@@ -620,7 +681,36 @@ void DoRotate(PDB *pdb, char *direction, char *amount)
    
    blCreateRotMat(*direction, angle, matrix);
    
+   RotatePDB(pdb, matrix);
+}
+
+
+/************************************************************************/
+/*>void RotatePDB(PDB *pdb, REAL matrix[3][3])
+   -------------------------------------------
+   Apply a rotation to the pdb linked list and combine it into 
+   gRotation so that the other models of a trajectory can be rotated in
+   the same way.
+
+   19.10.26 Original    By: ACRM
+   19.10.26 Combines the rotations rather than keeping each one
+*/
+void RotatePDB(PDB *pdb, REAL matrix[3][3])
+{
+   REAL combined[3][3];
+   int  i, j;
+   
    blRotatePDB(pdb, matrix);
+
+   /* This rotation follows the ones before                             */
+   for(i=0; i<3; i++)
+      for(j=0; j<3; j++)
+         combined[i][j] = matrix[i][0] * gRotation[0][j] +
+                          matrix[i][1] * gRotation[1][j] +
+                          matrix[i][2] * gRotation[2][j];
+   for(i=0; i<3; i++)
+      for(j=0; j<3; j++)
+         gRotation[i][j] = combined[i][j];
 }
 
 
@@ -696,21 +786,12 @@ found.\n");
    Colour in the background shading from r1,g1,b1 at the top to r2,g2,b2 
    at the bottom.
    29.07.93 Original    By: ACRM
+   19.10.26 Drawing moved to SetBackground() so that it can be redone
+            for each band
 */
 void DoBackground(REAL r1, REAL g1, REAL b1, REAL r2, REAL g2, REAL b2)
 {
-   int   x, y;
-   REAL  r, g, b;
-   
-   for(y=0; y<gScreen[1]; y++)
-   {
-      r = r1 + y * (r2 - r1)/gScreen[1];
-      g = g1 + y * (g2 - g1)/gScreen[1];
-      b = b1 + y * (b2 - b1)/gScreen[1];
-      
-      for(x=0; x<gScreen[0]; x++)
-         SetAbsPixel(x,y,r,g,b);
-   }
+   SetBackground(r1, g1, b1, r2, g2, b2);
 }
 
 
@@ -1043,3 +1124,109 @@ void DoAtom(SPHERE *spheres, PDB *pdb, int NSphere, char *atom,
 }
 
 
+/************************************************************************/
+/*>void DoKeyFrame(int frame)
+   --------------------------
+   Input:   int    frame       Frame at which the keyframe is reached
+
+   Start a new animation keyframe. Keyframes must be in order of frame.
+
+   19.10.26 Original    By: ACRM
+*/
+void DoKeyFrame(int frame)
+{
+   KEYFRAME *key;
+   
+   if(gNKeyFrames >= MAXKEYFRAMES)
+   {
+      fprintf(stderr,"Warning: Too many keyframes. Keyframe %d \
+ignored.\n", frame);
+      return;
+   }
+   if(frame <= (gNKeyFrames ? gKeyFrames[gNKeyFrames-1].frame : 0))
+   {
+      fprintf(stderr,"Warning: Keyframes must be in order after frame 0. \
+Keyframe %d ignored.\n", frame);
+      return;
+   }
+
+   key             = &(gKeyFrames[gNKeyFrames++]);
+   key->frame      = frame;
+   key->nrotate    = 0;
+   key->scale      = 0.0;
+   key->centreAtom = (-1);
+}
+
+
+/************************************************************************/
+/*>void DoKeyRotate(KEYFRAME *key, char *direction, char *amount)
+   --------------------------------------------------------------
+   Add a rotation to a keyframe.
+
+   19.10.26 Original    By: ACRM
+*/
+void DoKeyRotate(KEYFRAME *key, char *direction, char *amount)
+{
+   if(key->nrotate >= MAXKEYROTATE)
+   {
+      fprintf(stderr,"Warning: Too many rotations in keyframe %d. \
+Rotation ignored.\n", key->frame);
+      return;
+   }
+   
+   key->axis[key->nrotate]  = *direction;
+   key->angle[key->nrotate] = (REAL)atof(amount) * PI/180.0;
+   key->nrotate++;
+}
+
+
+/************************************************************************/
+/*>int DoKeyCentre(PDB *pdb, char *resspec, char *atom)
+   ----------------------------------------------------
+   Returns: int               Number of the atom in the PDB linked list
+                              (-1 if not found)
+
+   As DoCentre(), but finds the number of the atom for a keyframe 
+   rather than setting the centre.
+
+   19.10.26 Original    By: ACRM
+*/
+int DoKeyCentre(PDB *pdb, char *resspec, char *atom)
+{
+   char  chain[8],
+         insert[8];
+   int   resnum,
+         i,
+         found = (-1);
+   PDB   *p;
+   
+   /* Parse the residue specification                                   */
+   blParseResSpec(resspec, chain, &resnum, insert);
+   
+   /* Tidy up atom specification                                        */
+   UPPER(atom);
+   blPadterm(atom,4);
+
+   /* Walk the pdb linked list                                          */
+   for(p=pdb, i=0; p!=NULL; NEXT(p), i++)
+   {
+      /* Check we are in the correct residue                            */
+      if(p->resnum    == resnum &&
+         CHAINMATCH(p->insert, insert) &&
+         CHAINMATCH(p->chain, chain))
+      {
+         /* If we've got the correct atom, that's it; otherwise use the
+            CA
+         */
+         if(!strcmp(p->atnam,atom))
+            return(i);
+         if(!strcmp(p->atnam,"CA  ") || (found == (-1)))
+            found = i;
+      }
+   }
+
+   if(found == (-1))
+      fprintf(stderr,"Warning: Residue for keyframe centre not \
+found.\n");
+   return(found);
+}
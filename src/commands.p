@@ -3,6 +3,8 @@ BOOL SetupParser(void)
 void HandleControl(char *file, PDB *pdb, SPHERE *spheres, int NSphere,
                    BOOL ReportError)
 ;
+void HandleControlFile(FILE *fp, PDB *pdb, SPHERE *spheres, int NSphere)
+;
 void DoDefault(SPHERE *spheres, int NSphere, REAL RGB[3],
                PDB *pdb, BOOL ColourByTemp)
 ;
@@ -16,6 +18,8 @@ void DoResidue(SPHERE *spheres, PDB *pdb, int NSphere, char *resnam,
 ;
 void DoRotate(PDB *pdb, char *direction, char *amount)
 ;
+void RotatePDB(PDB *pdb, REAL matrix[3][3])
+;
 void DoCentre(PDB *pdb, char *resspec, char *atom)
 ;
 void DoBackground(REAL r1, REAL g1, REAL b1, REAL r2, REAL g2, REAL b2)
@@ -33,3 +37,9 @@ void DoRadius(char *atomspec, char *radius_str)
 void DoAtom(SPHERE *spheres, PDB *pdb, int NSphere, char *atom, 
             char *red, char *green, char *blue)
 ;
+void DoKeyFrame(int frame)
+;
+void DoKeyRotate(KEYFRAME *key, char *direction, char *amount)
+;
+int DoKeyCentre(PDB *pdb, char *resspec, char *atom)
+;
@@ -0,0 +1,1402 @@
+/*************************************************************************
+
+   Program:    QTree
+   File:       daemon.c
+
+   Version:    V3.25
+   Date:       19.10.26
+   Function:   Render images asked for over a local socket
+
+   Copyright:  (c) SciTech Software 2026
+   Author:     Prof. Andrew C. R. Martin
+   EMail:      andrew@bioinf.org.uk
+
+**************************************************************************
+
+   This program is not in the public domain.
+
+   It may not be copied or made available to third parties, but may be
+   freely used by non-profit-making organisations who have obtained it
+   directly from the author or by FTP.
+
+   You are requested to send EMail to the author to say that you are
+   using this code so that you may be informed of future updates.
+
+   The code may not be made available on other FTP sites without express
+   permission from the author.
+
+   The code may be modified as required, but any modifications must be
+   documented so that the person responsible can be identified. If
+   someone else breaks this code, the author doesn't want to be blamed
+   for code that does not work! You may not distribute any
+   modifications, but are encouraged to send them to the author so
+   that they may be incorporated into future versions of the code.
+
+   The code may not be sold commercially or used for commercial purposes
+   without prior permission from the author.
+
+**************************************************************************
+
+   Description:
+   ============
+   Runs QTree as a daemon listening on a Unix domain socket. Each
+   connection asks for one image with lines of text:
+
+      PDB      1crn.pdb
+      CONTROL  plain.qtr
+      SIZE     256 256
+      FORMAT   png
+      ROTATE   y 30
+      RENDER
+
+   PDB gives the file to read. Alternatively ATOMS is followed by the
+   PDB records themselves, ending with a line holding just END. CONTROL
+   gives a control file used in place of the defaults file. SIZE (one
+   number for a square) and FORMAT default to those on the command
+   line. Any other line is a control file command, applied after the
+   control file. RENDER ends the request.
+
+   The reply is a line holding OK followed by the image, after which
+   the connection is closed, or a line starting with ERROR giving the
+   reason that no image could be made.
+
+**************************************************************************
+
+   Usage:
+   ======
+   RunDaemon() is called from main() in place of reading a PDB file.
+   It returns when the daemon is stopped with SIGINT or SIGTERM.
+
+**************************************************************************
+
+   Notes:
+   ======
+   The parser is set up once. The atoms of the most recently used PDB
+   files are kept with their sphere lists, as are the most recently
+   used control files. A file is read again when it changes on disk,
+   and the least recently used entry is dropped to make room for a new
+   one.
+
+   The control file and the renderer keep their state in global and
+   static variables, so each connection is handed to a worker process
+   as soon as it is accepted. The worker reads the request and renders
+   the image, starting with the settings of the command line and its
+   own copy of the kept atoms, which it may change freely. Up to
+   gNThreads workers run at once; further connections wait until one
+   finishes.
+
+   Since the daemon does not read requests itself, a slow client or a
+   large ATOMS payload only holds up its own worker. A worker gives up
+   if a line takes more than REQUEST_TIMEOUT seconds or the whole
+   request more than REQUEST_DEADLINE.
+
+   A worker which reads a PDB or control file has only its own copy of
+   the kept files, so it sends the name back to the daemon through a
+   pipe. The daemon reads those names while it waits for connections.
+   It never parses a PDB file itself, as that would hold up every
+   client: a worker which has parsed one writes the atoms as a
+   prepared structure (see cache.c) in a directory of the daemon's
+   own, and the daemon copies them from there. A control file is only
+   text, so the daemon reads it again.
+
+**************************************************************************
+
+   Revision History:
+   =================
+   V3.22 19.10.26 Original
+   V3.25 19.10.26 Atoms are read into an array by ReadAtoms()
+                  Requests are read by the workers
+                  Workers hand their atoms to the daemon as prepared
+                  structures
+
+*************************************************************************/
+/* Includes
+*/
+#define _XOPEN_SOURCE 700
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <poll.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include "bioplib/macros.h"
+#include "bioplib/MathType.h"
+#include "bioplib/SysDefs.h"
+#include "bioplib/pdb.h"
+
+#include "qtree.h"
+#include "qtree.p"
+#include "graphics.p"
+#include "commands.p"
+#include "atoms.p"
+#include "hash.p"
+#include "cache.p"
+#include "daemon.p"
+
+/************************************************************************/
+/* Defines and types
+*/
+#define MAXBUFF         1024     /* Longest request line                */
+#define MAXSTRUCT       16       /* PDB files kept                      */
+#define MAXCONTROL      16       /* Control files kept                  */
+#define REQUEST_TIMEOUT 10       /* Seconds to wait for a request line  */
+#define REQUEST_DEADLINE 60      /* Seconds to wait for a whole request */
+#define NOTICE_PDB      'P'      /* Notice of a PDB file read by worker */
+#define NOTICE_CONTROL  'C'      /* Notice of a control file            */
+#define KEEPEXT         ".qts"   /* Atoms left for the daemon           */
+
+/* Line holding just END, which ends the records given with ATOMS       */
+#define ENDLINE(x) (!strncmp((x), "END", 3) && \
+                    (((x)[3] == '\0') || isspace((int)(x)[3])))
+
+typedef struct                   /* When a file was read                */
+{
+   time_t mtime;
+   long   mtimeNs;
+   off_t  size;
+   ino_t  inode;
+}  FILESTAMP;
+
+typedef struct                   /* A PDB file kept in memory           */
+{
+   char          *file;
+   PDB           *pdb;
+   SPHERE        *spheres;       /* From CreateSphereList()             */
+   FILESTAMP     stamp;
+   int           NAtom;
+   unsigned long used;           /* When last used (0 for a free slot)  */
+}  STRUCTURE;
+
+typedef struct                   /* A control file kept in memory       */
+{
+   char          *file,
+                 *text;
+   FILESTAMP     stamp;
+   unsigned long used;           /* When last used (0 for a free slot)  */
+}  CONTROLTEXT;
+
+typedef struct                   /* One request                         */
+{
+   FILE   *atoms;                /* Records given with ATOMS (or NULL)  */
+   char   *commands;             /* Control commands in the request     */
+   size_t ncommands,
+          maxcommands;
+   char   file[MAXBUFF],
+          control[MAXBUFF];
+   int    width,
+          height,
+          format;
+}  REQUEST;
+
+/************************************************************************/
+/* Variables global to this file only
+*/
+static STRUCTURE   sStructures[MAXSTRUCT];
+static CONTROLTEXT sControls[MAXCONTROL];
+static unsigned long sClock = 0;        /* Counts uses of the caches    */
+static volatile sig_atomic_t sStop = 0; /* Set by SIGINT and SIGTERM    */
+static int         sConn       = (-1);  /* A worker's connection        */
+static char        sKeepDir[MAXBUFF];   /* Where workers leave atoms    */
+
+/************************************************************************/
+/* Prototypes
+*/
+static int  OpenSocket(char *socketName);
+static void StopDaemon(int sig);
+static BOOL ServeRequest(int conn, int sock, int notices, 
+                         char *defControl, BOOL ballStick, 
+                         int resolution, int width, int height, 
+                         int format);
+static BOOL WorkOnRequest(int conn, int notices, char *defControl,
+                          BOOL ballStick, int resolution, int width,
+                          int height, int format);
+static void RequestTimedOut(int sig);
+static BOOL ReadRequest(FILE *fp, int conn, REQUEST *req);
+static BOOL AddCommand(REQUEST *req, char *command);
+static void SendNotice(int notices, int type, long pid, char *file);
+static void KeepNotices(FILE *fp, BOOL ballStick);
+static BOOL PassStructure(STRUCTURE *structure, BOOL ballStick);
+static void AdoptStructure(char *file, long pid, BOOL ballStick);
+static BOOL RenderRequest(int conn, PDB *pdb, SPHERE *spheres,
+                          int NAtom, char *control, REQUEST *req,
+                          int resolution);
+static STRUCTURE *FindStructure(char *file, BOOL ballStick, 
+                                BOOL *fresh);
+static STRUCTURE *KeptStructure(char *file, FILESTAMP *stamp,
+                                STRUCTURE **slot);
+static BOOL FillSlot(STRUCTURE *slot, char *file, FILESTAMP *stamp,
+                     PDB *pdb, int NAtom);
+static void StructureSource(char *file, FILESTAMP *stamp,
+                            unsigned char *source);
+static char *FindControl(char *file);
+static BOOL StampFile(char *file, FILESTAMP *stamp);
+static BOOL SameStamp(FILESTAMP *a, FILESTAMP *b);
+static void SendError(int conn, char *message, char *name);
+static void FreeCaches(void);
+static void MakeKeepDir(void);
+static void RemoveKeepDir(void);
+
+
+/************************************************************************/
+/*>BOOL RunDaemon(char *socketName, char *defControl, BOOL ballStick,
+                  int resolution, int width, int height, int format)
+   ------------------------------------------------------------------
+   Input:   char   *socketName Unix domain socket to listen on
+            char   *defControl Control file used when none is given
+            BOOL   ballStick   Read all atoms for ball and stick
+            int    resolution  Size the molecule is scaled to (0 to fit
+                               each image)
+            int    width       Size used when a request gives none
+            int    height
+            int    format      Format used when a request gives none
+   Returns: BOOL               Was the daemon stopped cleanly?
+
+   Serves requests on the socket until SIGINT or SIGTERM is received,
+   using up to gNThreads processes.
+
+   19.10.26 Original    By: ACRM
+   19.10.26 Keeps the files named by the workers    By: ACRM
+   19.10.26 Makes the directory for the workers' atoms
+*/
+BOOL RunDaemon(char *socketName, char *defControl, BOOL ballStick,
+               int resolution, int width, int height, int format)
+{
+   struct sigaction action;
+   struct pollfd    fds[2];
+   FILE             *noticeFp;
+   int              sock,
+                    conn,
+                    notices[2],
+                    nWorkers,
+                    nRunning = 0;
+   BOOL             ok       = TRUE;
+
+   if(!SetupParser())
+   {
+      fprintf(stderr,"Unable to set up parser\n");
+      return(FALSE);
+   }
+
+   /* Workers send the files they read through a pipe. Neither end 
+      waits, as a lost notice only means a file is not kept
+   */
+   if(pipe(notices))
+   {
+      fprintf(stderr,"Unable to create pipe for workers\n");
+      return(FALSE);
+   }
+   fcntl(notices[0], F_SETFL, fcntl(notices[0], F_GETFL) | O_NONBLOCK);
+   fcntl(notices[1], F_SETFL, fcntl(notices[1], F_GETFL) | O_NONBLOCK);
+   if((noticeFp = fdopen(notices[0], "r")) == NULL)
+   {
+      fprintf(stderr,"Unable to create pipe for workers\n");
+      close(notices[0]);
+      close(notices[1]);
+      return(FALSE);
+   }
+
+   if((sock = OpenSocket(socketName)) < 0)
+   {
+      fclose(noticeFp);
+      close(notices[1]);
+      return(FALSE);
+   }
+   MakeKeepDir();
+
+   /* Stop cleanly on SIGINT or SIGTERM. SA_RESTART is not given so
+      that accept() returns when one arrives. A client which goes away
+      gives a failed write rather than SIGPIPE
+   */
+   memset(&action, 0, sizeof(action));
+   sigemptyset(&(action.sa_mask));
+   action.sa_handler = StopDaemon;
+   sigaction(SIGINT,  &action, NULL);
+   sigaction(SIGTERM, &action, NULL);
+   action.sa_handler = SIG_IGN;
+   sigaction(SIGPIPE, &action, NULL);
+
+   nWorkers = MAX(gNThreads, 1);
+   while(!sStop)
+   {
+      /* Collect finished workers, waiting for one if all are busy      */
+      while((nRunning > 0) && (waitpid(-1, NULL, WNOHANG) > 0))
+         nRunning--;
+      if(nRunning >= nWorkers)
+      {
+         if(waitpid(-1, NULL, 0) > 0)
+            nRunning--;
+         else if(errno == ECHILD)
+            nRunning = 0;
+         continue;
+      }
+
+      /* Wait for a connection, keeping the files named by the workers
+         meanwhile
+      */
+      fds[0].fd     = sock;
+      fds[0].events = POLLIN;
+      fds[1].fd     = notices[0];
+      fds[1].events = POLLIN;
+      if(poll(fds, 2, -1) < 0)
+      {
+         if(errno == EINTR)
+            continue;
+         fprintf(stderr,"Unable to wait for connection on socket: %s\n",
+                 socketName);
+         ok = FALSE;
+         break;
+      }
+      if(fds[1].revents & POLLIN)
+         KeepNotices(noticeFp, ballStick);
+      if(!(fds[0].revents & POLLIN))
+         continue;
+
+      if((conn = accept(sock, NULL, NULL)) < 0)
+      {
+         if((errno == EINTR) || (errno == ECONNABORTED))
+            continue;
+         fprintf(stderr,"Unable to accept connection on socket: %s\n",
+                 socketName);
+         ok = FALSE;
+         break;
+      }
+
+      if(ServeRequest(conn, sock, notices[1], defControl, ballStick, 
+                      resolution, width, height, format))
+         nRunning++;
+      close(conn);
+   }
+
+   close(sock);
+   fclose(noticeFp);
+   close(notices[1]);
+   unlink(socketName);
+   while(nRunning > 0)
+   {
+      if((waitpid(-1, NULL, 0) < 0) && (errno != EINTR))
+         break;
+      nRunning--;
+   }
+   RemoveKeepDir();
+   FreeCaches();
+   return(ok);
+}
+
+
+/************************************************************************/
+/*>static int OpenSocket(char *socketName)
+   ---------------------------------------
+   Input:   char   *socketName Unix domain socket to create
+   Returns: int                The listening socket (-1 on error)
+
+   Creates the socket and listens on it. A socket left by a daemon
+   which has gone is replaced, but not one which is still in use.
+
+   19.10.26 Original    By: ACRM
+*/
+static int OpenSocket(char *socketName)
+{
+   struct sockaddr_un addr;
+   struct stat        st;
+   int                sock;
+
+   if(strlen(socketName) >= sizeof(addr.sun_path))
+   {
+      fprintf(stderr,"Socket name is too long: %s\n", socketName);
+      return(-1);
+   }
+   memset(&addr, 0, sizeof(addr));
+   addr.sun_family = AF_UNIX;
+   strcpy(addr.sun_path, socketName);
+
+   if((sock = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+   {
+      fprintf(stderr,"Unable to create socket: %s\n", socketName);
+      return(-1);
+   }
+
+   if(!stat(socketName, &st))
+   {
+      if(!S_ISSOCK(st.st_mode) ||
+         !connect(sock, (struct sockaddr *)&addr, sizeof(addr)))
+      {
+         fprintf(stderr,"Socket is already in use: %s\n", socketName);
+         close(sock);
+         return(-1);
+      }
+      unlink(socketName);
+   }
+
+   if(bind(sock, (struct sockaddr *)&addr, sizeof(addr)) ||
+      listen(sock, SOMAXCONN))
+   {
+      fprintf(stderr,"Unable to listen on socket: %s\n", socketName);
+      close(sock);
+      return(-1);
+   }
+   return(sock);
+}
+
+
+/************************************************************************/
+/*>static void StopDaemon(int sig)
+   -------------------------------
+   Input:   int    sig         Signal received
+
+   Signal handler asking the daemon to stop.
+
+   19.10.26 Original    By: ACRM
+*/
+static void StopDaemon(int sig)
+{
+   sStop = 1;
+}
+
+
+/************************************************************************/
+/*>static BOOL ServeRequest(int conn, int sock, int notices, 
+                            char *defControl, BOOL ballStick, 
+                            int resolution, int width, int height, 
+                            int format)
+   ---------------------------------------------------------------------
+   Input:   int    conn        Connection from the client
+            int    sock        The listening socket
+            int    notices     Pipe for the files read by the worker
+            char   *defControl Control file used when none is given
+            BOOL   ballStick   Read all atoms for ball and stick
+            int    resolution  Size the molecule is scaled to
+            int    width       Size used when the request gives none
+            int    height
+            int    format      Format used when the request gives none
+   Returns: BOOL               Was a worker started?
+
+   Forks a worker to read the request and render and send the image.
+
+   19.10.26 Original    By: ACRM
+   19.10.26 Atoms read with ReadAtoms()
+   19.10.26 The request is read by the worker
+*/
+static BOOL ServeRequest(int conn, int sock, int notices, 
+                         char *defControl, BOOL ballStick, 
+                         int resolution, int width, int height, 
+                         int format)
+{
+   pid_t pid;
+
+   fflush(stdout);
+   fflush(stderr);
+   if((pid = fork()) == 0)
+   {
+      close(sock);
+      gNThreads = 1;
+      _exit(WorkOnRequest(conn, notices, defControl, ballStick,
+                          resolution, width, height, format) ? 0 : 1);
+   }
+   else if(pid < 0)
+   {
+      SendError(conn, "Unable to start worker", NULL);
+   }
+   return(pid > 0);
+}
+
+
+/************************************************************************/
+/*>static BOOL WorkOnRequest(int conn, int notices, char *defControl,
+                             BOOL ballStick, int resolution, int width,
+                             int height, int format)
+   ---------------------------------------------------------------------
+   Input:   int    conn        Connection from the client
+            int    notices     Pipe for the files read
+            char   *defControl Control file used when none is given
+            BOOL   ballStick   Read all atoms for ball and stick
+            int    resolution  Size the molecule is scaled to
+            int    width       Size used when the request gives none
+            int    height
+            int    format      Format used when the request gives none
+   Returns: BOOL               Was the image sent?
+
+   Run in a worker. Reads a request and the files it needs, then
+   renders and sends the image. The PDB and control files used are
+   sent to the daemon to be kept, with the atoms of a PDB file which
+   the worker parsed.
+
+   19.10.26 Original (split from ServeRequest())    By: ACRM
+   19.10.26 Passes parsed atoms to the daemon
+*/
+static BOOL WorkOnRequest(int conn, int notices, char *defControl,
+                          BOOL ballStick, int resolution, int width,
+                          int height, int format)
+{
+   struct sigaction action;
+   struct timeval   timeout;
+   STRUCTURE        *structure;
+   REQUEST          req;
+   long             pid;
+   FILE             *fp;
+   PDB              *pdb       = NULL;
+   SPHERE           *spheres   = NULL;
+   char             *control   = NULL;
+   int              fd,
+                    NAtom      = 0;
+   BOOL             ok         = FALSE,
+                    fresh;
+
+   /* Each line must come within REQUEST_TIMEOUT and the whole request
+      within REQUEST_DEADLINE
+   */
+   timeout.tv_sec  = REQUEST_TIMEOUT;
+   timeout.tv_usec = 0;
+   setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+   sConn = conn;
+   memset(&action, 0, sizeof(action));
+   sigemptyset(&(action.sa_mask));
+   action.sa_handler = RequestTimedOut;
+   sigaction(SIGALRM, &action, NULL);
+   alarm(REQUEST_DEADLINE);
+
+   req.atoms       = NULL;
+   req.commands    = NULL;
+   req.ncommands   = 0;
+   req.maxcommands = 0;
+   req.file[0]     = req.control[0] = '\0';
+   req.width       = width;
+   req.height      = height;
+   req.format      = format;
+
+   if(((fd = dup(conn)) < 0) || ((fp = fdopen(fd, "r")) == NULL))
+   {
+      if(fd >= 0) close(fd);
+      SendError(conn, "Unable to read request", NULL);
+      return(FALSE);
+   }
+   ok = ReadRequest(fp, conn, &req);
+   fclose(fp);
+   alarm(0);
+   if(!ok)
+   {
+      if(req.atoms != NULL) fclose(req.atoms);
+      if(req.commands != NULL) free(req.commands);
+      return(FALSE);
+   }
+   ok = FALSE;
+
+   /* Atoms given in the request are not kept                           */
+   if(req.atoms != NULL)
+   {
+      rewind(req.atoms);
+      if(((pdb = ReadAtoms(req.atoms, ballStick, &NAtom)) == NULL) ||
+         ((spheres = CreateSphereList(pdb, NAtom)) == NULL))
+         SendError(conn, "Unable to read atoms from request", NULL);
+      fclose(req.atoms);
+   }
+   else if((structure = FindStructure(req.file, ballStick, &fresh))
+           == NULL)
+   {
+      SendError(conn, "Unable to read atoms from PDB file: %s",
+                req.file);
+   }
+   else
+   {
+      /* Atoms just parsed are left for the daemon before the control
+         file changes them
+      */
+      pid = (fresh && PassStructure(structure, ballStick)) ? 
+            (long)getpid() : 0L;
+      SendNotice(notices, NOTICE_PDB, pid, req.file);
+      pdb     = structure->pdb;
+      spheres = structure->spheres;
+      NAtom   = structure->NAtom;
+   }
+
+   if(spheres != NULL)
+   {
+      if(req.control[0])
+      {
+         if((control = FindControl(req.control)) == NULL)
+            SendError(conn, "Unable to open control file: %s",
+                      req.control);
+         else
+            SendNotice(notices, NOTICE_CONTROL, 0L, req.control);
+      }
+      else
+      {
+         /* A missing defaults file is not an error                     */
+         if((control = FindControl(defControl)) == NULL)
+            control = "";
+         else
+            SendNotice(notices, NOTICE_CONTROL, 0L, defControl);
+      }
+   }
+
+   if(control != NULL)
+      ok = RenderRequest(conn, pdb, spheres, NAtom, control, &req,
+                         resolution);
+
+   if(req.commands != NULL)
+      free(req.commands);
+   return(ok);
+}
+
+
+/************************************************************************/
+/*>static void RequestTimedOut(int sig)
+   ------------------------------------
+   Input:   int    sig         Signal received
+
+   Signal handler for a worker whose request has not arrived within
+   REQUEST_DEADLINE. Tells the client and stops the worker.
+
+   19.10.26 Original    By: ACRM
+*/
+static void RequestTimedOut(int sig)
+{
+   static char message[] = "ERROR Request took too long\n";
+
+   if(write(sConn, message, sizeof(message)-1) < 0)
+      sConn = (-1);
+   _exit(1);
+}
+
+
+/************************************************************************/
+/*>static BOOL ReadRequest(FILE *fp, int conn, REQUEST *req)
+   ---------------------------------------------------------
+   Input:   FILE    *fp        Reads the connection
+            int     conn       Connection, for errors
+   I/O:     REQUEST *req       The request, with defaults set
+   Returns: BOOL               Success? Errors are sent to the client
+
+   Reads the lines of a request up to RENDER. A connection closed
+   without sending anything (such as the check made by OpenSocket())
+   is dropped quietly.
+
+   19.10.26 Original    By: ACRM
+   19.10.26 An unknown format is sent back as an error
+*/
+static BOOL ReadRequest(FILE *fp, int conn, REQUEST *req)
+{
+   char buffer[MAXBUFF],
+        key[16],
+        *chp,
+        *rest,
+        extra;
+   int  i;
+   BOOL empty = TRUE;
+
+   while(fgets(buffer, MAXBUFF, fp))
+   {
+      empty = FALSE;
+      TERMINATE(buffer);
+      if((chp = strchr(buffer, '\r')) != NULL)
+         *chp = '\0';
+
+      /* The keyword and the rest of the line                           */
+      for(chp=buffer; isspace((int)*chp); chp++);
+      if((*chp == '\0') || (*chp == '#'))
+         continue;
+      for(i=0; (i<15) && *chp && !isspace((int)*chp); i++, chp++)
+         key[i] = toupper((int)*chp);
+      key[i] = '\0';
+      for(rest=chp; isspace((int)*rest); rest++);
+      for(chp=rest+strlen(rest); (chp>rest) && isspace((int)chp[-1]);
+          chp--)
+         *(chp-1) = '\0';
+
+      if(!strcmp(key, "RENDER"))
+      {
+         if(!req->file[0] && (req->atoms == NULL))
+         {
+            SendError(conn, "No PDB file or atoms in request", NULL);
+            return(FALSE);
+         }
+         return(TRUE);
+      }
+      else if(!strcmp(key, "PDB"))
+      {
+         strcpy(req->file, rest);
+      }
+      else if(!strcmp(key, "ATOMS"))
+      {
+         if((req->atoms == NULL) && ((req->atoms = tmpfile()) == NULL))
+         {
+            SendError(conn, "Unable to store atoms", NULL);
+            return(FALSE);
+         }
+         while(fgets(buffer, MAXBUFF, fp) && !ENDLINE(buffer))
+            fputs(buffer, req->atoms);
+         if(!ENDLINE(buffer))
+            break;
+      }
+      else if(!strcmp(key, "CONTROL"))
+      {
+         strcpy(req->control, rest);
+      }
+      else if(!strcmp(key, "SIZE"))
+      {
+         i = sscanf(rest, "%d %d %c", &(req->width), &(req->height),
+                    &extra);
+         if(i == 1)
+            req->height = req->width;
+         if(((i != 1) && (i != 2)) || (req->width < 1) ||
+            (req->height < 1))
+         {
+            SendError(conn, "Invalid size: %s", rest);
+            return(FALSE);
+         }
+      }
+      else if(!strcmp(key, "FORMAT"))
+      {
+         if((req->format = FormatFromName(rest)) < 0)
+         {
+            SendError(conn, "Unknown output format: %s", rest);
+            return(FALSE);
+         }
+         if((req->format == OUTPUT_DZI) || (req->format == OUTPUT_XYZ))
+         {
+            SendError(conn, "Tiles cannot be made by the daemon", NULL);
+            return(FALSE);
+         }
+      }
+      else if(!AddCommand(req, buffer))
+      {
+         SendError(conn, "No memory for request", NULL);
+         return(FALSE);
+      }
+   }
+
+   if(!empty)
+      SendError(conn, "Request ended before RENDER", NULL);
+   return(FALSE);
+}
+
+
+/************************************************************************/
+/*>static BOOL AddCommand(REQUEST *req, char *command)
+   ---------------------------------------------------
+   I/O:     REQUEST *req       The request
+   Input:   char    *command   A control file command
+   Returns: BOOL               Success?
+
+   Adds a line to the control commands of a request.
+
+   19.10.26 Original    By: ACRM
+*/
+static BOOL AddCommand(REQUEST *req, char *command)
+{
+   char   *commands;
+   size_t len = strlen(command);
+
+   if(req->ncommands + len + 2 > req->maxcommands)
+   {
+      req->maxcommands = 2 * req->maxcommands + len + MAXBUFF;
+      if((commands = (char *)realloc(req->commands, req->maxcommands))
+         == NULL)
+         return(FALSE);
+      req->commands = commands;
+   }
+   strcpy(req->commands + req->ncommands, command);
+   req->ncommands += len;
+   req->commands[req->ncommands++] = '\n';
+   req->commands[req->ncommands]   = '\0';
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>static void SendNotice(int notices, int type, long pid, char *file)
+   -------------------------------------------------------------------
+   Input:   int    notices     Pipe to the daemon
+            int    type        NOTICE_PDB or NOTICE_CONTROL
+            long   pid         Worker which left the atoms of a PDB file
+                               with PassStructure() (or 0)
+            char   *file       File read by a worker
+
+   Tells the daemon which file a worker has used. The line is written
+   in one go, so that lines from different workers are not mixed.
+
+   19.10.26 Original    By: ACRM
+   19.10.26 Added pid
+*/
+static void SendNotice(int notices, int type, long pid, char *file)
+{
+   char   buffer[MAXBUFF+32];
+   size_t len;
+
+   sprintf(buffer, "%c %ld %s\n", type, pid, file);
+   len = strlen(buffer);
+   if(write(notices, buffer, len) != (ssize_t)len)
+      fprintf(stderr,"Unable to tell the daemon to keep file: %s\n",
+              file);
+}
+
+
+/************************************************************************/
+/*>static void KeepNotices(FILE *fp, BOOL ballStick)
+   -------------------------------------------------
+   Input:   FILE   *fp         Pipe from the workers
+            BOOL   ballStick   Read all atoms for ball and stick
+
+   Finds each file named by the workers since the last call, so that it
+   is kept if it is not and marked as used if it is. The atoms of a PDB
+   file are only taken from those a worker left; they are never parsed
+   here.
+
+   19.10.26 Original    By: ACRM
+   19.10.26 PDB files are taken from the workers by AdoptStructure()
+*/
+static void KeepNotices(FILE *fp, BOOL ballStick)
+{
+   char buffer[MAXBUFF+32],
+        type,
+        *file;
+   long pid;
+
+   while(fgets(buffer, MAXBUFF+32, fp))
+   {
+      TERMINATE(buffer);
+      if((sscanf(buffer, "%c %ld", &type, &pid) != 2) ||
+         ((file = strchr(buffer+2, ' ')) == NULL))
+         continue;
+      file++;
+      if(type == NOTICE_PDB)
+         AdoptStructure(file, pid, ballStick);
+      else if(type == NOTICE_CONTROL)
+         FindControl(file);
+   }
+   clearerr(fp);
+}
+
+
+/************************************************************************/
+/*>static BOOL PassStructure(STRUCTURE *structure, BOOL ballStick)
+   ---------------------------------------------------------------
+   Input:   STRUCTURE *structure  Atoms parsed by this worker
+            BOOL      ballStick   All atoms were read for ball and stick
+   Returns: BOOL                  Were they written?
+
+   Run in a worker. Writes the atoms as a prepared structure named by
+   the worker's process ID in the daemon's directory, for
+   AdoptStructure().
+
+   19.10.26 Original    By: ACRM
+*/
+static BOOL PassStructure(STRUCTURE *structure, BOOL ballStick)
+{
+   unsigned char source[HASHSIZE];
+   char          path[MAXBUFF+32];
+
+   if(!sKeepDir[0])
+      return(FALSE);
+   sprintf(path, "%s/%ld%s", sKeepDir, (long)getpid(), KEEPEXT);
+   StructureSource(structure->file, &(structure->stamp), source);
+   return(KeepStructure(path, source, structure->pdb, structure->NAtom,
+                        ballStick));
+}
+
+
+/************************************************************************/
+/*>static void AdoptStructure(char *file, long pid, BOOL ballStick)
+   ----------------------------------------------------------------
+   Input:   char   *file       PDB file used by a worker
+            long   pid         The worker, if it left the atoms (or 0)
+            BOOL   ballStick   All atoms were read for ball and stick
+
+   Marks a kept PDB file as used. If it is not kept, or has changed, the
+   atoms left by the worker are copied in if they are of the file as it
+   is now. The file left by the worker is removed.
+
+   19.10.26 Original    By: ACRM
+*/
+static void AdoptStructure(char *file, long pid, BOOL ballStick)
+{
+   unsigned char source[HASHSIZE];
+   STRUCTURE     *slot;
+   FILESTAMP     stamp;
+   PDB           *pdb;
+   char          path[MAXBUFF+32];
+   int           NAtom;
+
+   if(pid <= 0L)
+   {
+      if(StampFile(file, &stamp))
+         KeptStructure(file, &stamp, &slot);
+      return;
+   }
+
+   sprintf(path, "%s/%ld%s", sKeepDir, pid, KEEPEXT);
+   if(StampFile(file, &stamp) && 
+      (KeptStructure(file, &stamp, &slot) == NULL))
+   {
+      StructureSource(file, &stamp, source);
+      if((pdb = MapStructure(path, source, ballStick, &NAtom)) != NULL)
+         FillSlot(slot, file, &stamp, pdb, NAtom);
+   }
+   unlink(path);
+}
+
+
+/************************************************************************/
+/*>static BOOL RenderRequest(int conn, PDB *pdb, SPHERE *spheres,
+                            int NAtom, char *control, REQUEST *req,
+                            int resolution)
+   -------------------------------------------------------------------
+   Input:   int     conn       Connection to the client
+            PDB     *pdb       Atoms. Changed by the control file
+            SPHERE  *spheres   Sphere list. Changed by the control file
+            int     NAtom      Number of atoms
+            char    *control   Text of the control file
+            REQUEST *req       The request
+            int     resolution Size the molecule is scaled to (0 to
+                               fit the image)
+   Returns: BOOL               Success?
+
+   Sets up, renders and sends one image. Run in a worker process as it
+   leaves the control file's settings in place.
+
+   19.10.26 Original    By: ACRM
+*/
+static BOOL RenderRequest(int conn, PDB *pdb, SPHERE *spheres,
+                         int NAtom, char *control, REQUEST *req,
+                         int resolution)
+{
+   FILE *fp;
+   BOOL ok;
+
+   SetRenderSize(req->width, req->height, resolution);
+   if(!InitGraphics(NeedAlpha(req->format) ? AUX_ALPHA : 0))
+   {
+      SendError(conn, "No memory for image", NULL);
+      return(FALSE);
+   }
+
+   /* The commands of the request follow those of the control file      */
+   if((fp = tmpfile()) == NULL)
+   {
+      SendError(conn, "Unable to store control commands", NULL);
+      return(FALSE);
+   }
+   fputs(control, fp);
+   if(req->commands != NULL)
+      fputs(req->commands, fp);
+   rewind(fp);
+   HandleControlFile(fp, pdb, spheres, NAtom);
+   fclose(fp);
+   if(gNFrames > 0)
+   {
+      SendError(conn, "Animations cannot be made by the daemon", NULL);
+      return(FALSE);
+   }
+
+   MapSpheres(pdb, spheres, NAtom);
+   if(gSlab.flag)
+      spheres = SlabSphereList(spheres, &NAtom);
+
+   if(!SpaceFill(spheres, NAtom))
+   {
+      SendError(conn, "Unable to render image", NULL);
+      return(FALSE);
+   }
+
+   /* The image is written to stdout, which is now the connection       */
+   if((write(conn, "OK\n", 3) != 3) || (dup2(conn, 1) < 0))
+      return(FALSE);
+   ok = WriteImage("", req->format);
+   if(fflush(stdout))
+      ok = FALSE;
+   return(ok);
+}
+
+
+/************************************************************************/
+/*>static STRUCTURE *FindStructure(char *file, BOOL ballStick,
+                                   BOOL *fresh)
+   -----------------------------------------------------------
+   Input:   char      *file      PDB file
+            BOOL      ballStick  Read all atoms for ball and stick
+   Output:  BOOL      *fresh     Was the file parsed?
+   Returns: STRUCTURE *          The atoms and spheres (NULL on error)
+
+   Finds a PDB file in memory, reading it if it is not there or has
+   changed.
+
+   19.10.26 Original    By: ACRM
+   19.10.26 Atoms read with ReadAtoms()
+   19.10.26 Added fresh. Split into KeptStructure() and FillSlot()
+*/
+static STRUCTURE *FindStructure(char *file, BOOL ballStick, 
+                                BOOL *fresh)
+{
+   STRUCTURE *s,
+             *slot;
+   FILESTAMP stamp;
+   FILE      *fp;
+   PDB       *pdb;
+   int       NAtom;
+
+   *fresh = FALSE;
+   if(!StampFile(file, &stamp))
+      return(NULL);
+   if((s = KeptStructure(file, &stamp, &slot)) != NULL)
+      return(s);
+
+   if((fp = fopen(file, "r")) == NULL)
+      return(NULL);
+   pdb = ReadAtoms(fp, ballStick, &NAtom);
+   fclose(fp);
+   if(!FillSlot(slot, file, &stamp, pdb, NAtom))
+      return(NULL);
+
+   *fresh = TRUE;
+   return(slot);
+}
+
+
+/************************************************************************/
+/*>static STRUCTURE *KeptStructure(char *file, FILESTAMP *stamp,
+                                   STRUCTURE **slot)
+   -------------------------------------------------------------
+   Input:   char      *file      PDB file
+            FILESTAMP *stamp     When it was last changed
+   Output:  STRUCTURE **slot     Where to keep it if it is not kept
+   Returns: STRUCTURE *          The kept atoms (NULL if not kept)
+
+   Looks for a PDB file among those kept, marking it as used. If it is
+   not kept as it is now, the slot is its old one or the one used least
+   recently.
+
+   19.10.26 Original (split from FindStructure())    By: ACRM
+*/
+static STRUCTURE *KeptStructure(char *file, FILESTAMP *stamp,
+                                STRUCTURE **slot)
+{
+   STRUCTURE *s;
+   int       i;
+
+   *slot = sStructures;
+   for(i=0; i<MAXSTRUCT; i++)
+   {
+      s = &(sStructures[i]);
+      if(s->used && !strcmp(s->file, file))
+      {
+         *slot = s;
+         if(SameStamp(&(s->stamp), stamp))
+         {
+            s->used = ++sClock;
+            return(s);
+         }
+         break;
+      }
+      if(s->used < (*slot)->used)
+         *slot = s;
+   }
+   return(NULL);
+}
+
+
+/************************************************************************/
+/*>static BOOL FillSlot(STRUCTURE *slot, char *file, FILESTAMP *stamp,
+                        PDB *pdb, int NAtom)
+   -------------------------------------------------------------------
+   I/O:     STRUCTURE *slot      Slot from KeptStructure()
+   Input:   char      *file      PDB file
+            FILESTAMP *stamp     When it was last changed
+            PDB       *pdb       Its atoms, which belong to the slot
+                                 (NULL if they could not be read)
+            int       NAtom      Number of atoms
+   Returns: BOOL                 Success?
+
+   Keeps the atoms of a PDB file in the slot, with their spheres, in
+   place of what it held.
+
+   19.10.26 Original (split from FindStructure())    By: ACRM
+*/
+static BOOL FillSlot(STRUCTURE *slot, char *file, FILESTAMP *stamp,
+                     PDB *pdb, int NAtom)
+{
+   SPHERE *spheres = NULL;
+   char   *name    = NULL;
+
+   if((pdb == NULL) ||
+      ((spheres = CreateSphereList(pdb, NAtom)) == NULL) ||
+      ((name = (char *)malloc(strlen(file)+1)) == NULL))
+   {
+      if(pdb != NULL)     free(pdb);
+      if(spheres != NULL) free(spheres);
+      return(FALSE);
+   }
+
+   if(slot->used)
+   {
+      free(slot->file);
+      free(slot->pdb);
+      free(slot->spheres);
+   }
+   strcpy(name, file);
+   slot->file    = name;
+   slot->pdb     = pdb;
+   slot->spheres = spheres;
+   slot->NAtom   = NAtom;
+   slot->stamp   = *stamp;
+   slot->used    = ++sClock;
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>static void StructureSource(char *file, FILESTAMP *stamp,
+                               unsigned char *source)
+   ---------------------------------------------------------
+   Input:   char      *file      PDB file
+            FILESTAMP *stamp     When it was last changed
+   Output:  unsigned char *source  HASHSIZE bytes naming the file as it
+                                 is, for a prepared structure
+
+   19.10.26 Original    By: ACRM
+*/
+static void StructureSource(char *file, FILESTAMP *stamp,
+                            unsigned char *source)
+{
+   HASH hash;
+
+   InitHash(&hash);
+   AddToHash(&hash, file, strlen(file)+1);
+   AddToHash(&hash, stamp, sizeof(FILESTAMP));
+   EndHash(&hash, source);
+}
+
+
+/************************************************************************/
+/*>static char *FindControl(char *file)
+   ------------------------------------
+   Input:   char   *file       Control file
+   Returns: char   *           Text of the file (NULL on error)
+
+   Finds a control file in memory, reading it if it is not there or has
+   changed.
+
+   19.10.26 Original    By: ACRM
+*/
+static char *FindControl(char *file)
+{
+   CONTROLTEXT *c,
+               *slot = sControls;
+   FILESTAMP   stamp;
+   FILE        *fp;
+   size_t      nread;
+   int         i;
+
+   if(!StampFile(file, &stamp))
+      return(NULL);
+
+   for(i=0; i<MAXCONTROL; i++)
+   {
+      c = &(sControls[i]);
+      if(c->used && !strcmp(c->file, file))
+      {
+         slot = c;
+         if(SameStamp(&(c->stamp), &stamp))
+         {
+            c->used = ++sClock;
+            return(c->text);
+         }
+         break;
+      }
+      if(c->used < slot->used)
+         slot = c;
+   }
+
+   if(slot->used)
+   {
+      free(slot->file);
+      free(slot->text);
+      slot->used = 0;
+   }
+
+   if((fp = fopen(file, "r")) == NULL)
+      return(NULL);
+   if(((slot->text = (char *)malloc(stamp.size+1)) == NULL) ||
+      ((slot->file = (char *)malloc(strlen(file)+1)) == NULL))
+   {
+      if(slot->text != NULL) free(slot->text);
+      fclose(fp);
+      return(NULL);
+   }
+   nread = fread(slot->text, 1, stamp.size, fp);
+   fclose(fp);
+   slot->text[nread] = '\0';
+   strcpy(slot->file, file);
+   slot->stamp = stamp;
+   slot->used  = ++sClock;
+   return(slot->text);
+}
+
+
+/************************************************************************/
+/*>static BOOL StampFile(char *file, FILESTAMP *stamp)
+   ---------------------------------------------------
+   Input:   char      *file    A file
+   Output:  FILESTAMP *stamp   When it was last changed
+   Returns: BOOL               Does the file exist?
+
+   19.10.26 Original    By: ACRM
+*/
+static BOOL StampFile(char *file, FILESTAMP *stamp)
+{
+   struct stat st;
+
+   if(stat(file, &st) || !S_ISREG(st.st_mode))
+      return(FALSE);
+   memset(stamp, 0, sizeof(FILESTAMP));
+   stamp->mtime   = st.st_mtim.tv_sec;
+   stamp->mtimeNs = st.st_mtim.tv_nsec;
+   stamp->size    = st.st_size;
+   stamp->inode   = st.st_ino;
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>static BOOL SameStamp(FILESTAMP *a, FILESTAMP *b)
+   -------------------------------------------------
+   Input:   FILESTAMP *a, *b   Two stamps of a file
+   Returns: BOOL               Is the file unchanged?
+
+   The time is to the nanosecond so that a file changed twice in a
+   second is seen. A file replaced by another (as most editors save)
+   has a new inode.
+
+   19.10.26 Original    By: ACRM
+*/
+static BOOL SameStamp(FILESTAMP *a, FILESTAMP *b)
+{
+   return((a->mtime == b->mtime) && (a->mtimeNs == b->mtimeNs) &&
+          (a->size == b->size) && (a->inode == b->inode));
+}
+
+
+/************************************************************************/
+/*>static void SendError(int conn, char *message, char *name)
+   ----------------------------------------------------------
+   Input:   int    conn        Connection to the client
+            char   *message    Message, containing %s if name is given
+            char   *name       Name put in the message (or NULL)
+
+   Sends an error to the client and reports it on stderr.
+
+   19.10.26 Original    By: ACRM
+*/
+static void SendError(int conn, char *message, char *name)
+{
+   char   buffer[MAXBUFF+80];
+   size_t len;
+
+   strcpy(buffer, "ERROR ");
+   sprintf(buffer+6, message, (name == NULL) ? "" : name);
+   fprintf(stderr, "%s\n", buffer+6);
+
+   len = strlen(buffer);
+   buffer[len++] = '\n';
+   if(write(conn, buffer, len) < 0)
+      fprintf(stderr,"Unable to send error to client\n");
+}
+
+
+/************************************************************************/
+/*>static void FreeCaches(void)
+   ----------------------------
+   Frees the PDB and control files kept in memory.
+
+   19.10.26 Original    By: ACRM
+   19.10.26 Atoms are an array
+*/
+static void FreeCaches(void)
+{
+   int i;
+
+   for(i=0; i<MAXSTRUCT; i++)
+   {
+      if(sStructures[i].used)
+      {
+         free(sStructures[i].file);
+         free(sStructures[i].pdb);
+         free(sStructures[i].spheres);
+         sStructures[i].used = 0;
+      }
+   }
+   for(i=0; i<MAXCONTROL; i++)
+   {
+      if(sControls[i].used)
+      {
+         free(sControls[i].file);
+         free(sControls[i].text);
+         sControls[i].used = 0;
+      }
+   }
+}
+
+
+/************************************************************************/
+/*>static void MakeKeepDir(void)
+   -----------------------------
+   Makes the directory in which workers leave the atoms they parse, in
+   $TMPDIR or /tmp. If it cannot be made the workers do not leave them,
+   and the daemon does not keep PDB files.
+
+   19.10.26 Original    By: ACRM
+*/
+static void MakeKeepDir(void)
+{
+   char *tmp = getenv("TMPDIR");
+
+   if((tmp == NULL) || !tmp[0] || (strlen(tmp) > MAXBUFF - 16))
+      tmp = "/tmp";
+   sprintf(sKeepDir, "%s/qtreeXXXXXX", tmp);
+   if(mkdtemp(sKeepDir) == NULL)
+   {
+      fprintf(stderr,"Unable to create directory for the atoms read by \
+workers\n");
+      sKeepDir[0] = '\0';
+   }
+}
+
+
+/************************************************************************/
+/*>static void RemoveKeepDir(void)
+   -------------------------------
+   Removes the directory made by MakeKeepDir() with anything the
+   workers left in it.
+
+   19.10.26 Original    By: ACRM
+*/
+static void RemoveKeepDir(void)
+{
+   DIR           *dir;
+   struct dirent *de;
+   char          path[MAXBUFF+NAME_MAX+2];
+
+   if(!sKeepDir[0] || ((dir = opendir(sKeepDir)) == NULL))
+      return;
+   while((de = readdir(dir)) != NULL)
+   {
+      if(de->d_name[0] == '.')
+         continue;
+      sprintf(path, "%s/%s", sKeepDir, de->d_name);
+      unlink(path);
+   }
+   closedir(dir);
+   rmdir(sKeepDir);
+   sKeepDir[0] = '\0';
+}
@@ -0,0 +1,3 @@
+BOOL RunDaemon(char *socketName, char *defControl, BOOL ballStick,
+               int resolution, int width, int height, int format)
+;
@@ -0,0 +1,260 @@
+/*************************************************************************
+
+   Program:    QTree
+   File:       encoder.c
+
+   Version:    V3.21
+   Date:       19.10.26
+   Function:   Write images in a separate process while rendering
+
+   Copyright:  (c) SciTech Software 2026
+   Author:     Prof. Andrew C. R. Martin
+   EMail:      andrew@bioinf.org.uk
+
+**************************************************************************
+
+   This program is not in the public domain.
+
+   It may not be copied or made available to third parties, but may be
+   freely used by non-profit-making organisations who have obtained it
+   directly from the author or by FTP.
+
+   You are requested to send EMail to the author to say that you are
+   using this code so that you may be informed of future updates.
+
+   The code may not be made available on other FTP sites without express
+   permission from the author.
+
+   The code may be modified as required, but any modifications must be
+   documented so that the person responsible can be identified. If
+   someone else breaks this code, the author doesn't want to be blamed
+   for code that does not work! You may not distribute any
+   modifications, but are encouraged to send them to the author so
+   that they may be incorporated into future versions of the code.
+
+   The code may not be sold commercially or used for commercial purposes
+   without prior permission from the author.
+
+**************************************************************************
+
+
+   Description:
+   ============
+   When a run writes many pictures, compressing and writing each one
+   (PNG especially) takes about as long as rendering it. The encoder is
+   a second process which writes the pictures while this one renders
+   the next, so the two overlap.
+
+**************************************************************************
+
+   Usage:
+   ======
+   Once the framebuffer has been set up, StartEncoder() starts the
+   encoder. Each picture is then handed over with EncodeImage() in
+   place of WriteImage() and StopEncoder() waits for the last one to be
+   written. If the encoder could not be started, EncodeImage() simply
+   calls WriteImage().
+
+**************************************************************************
+
+   Notes:
+   ======
+   The encoder is forked after InitGraphics() so it has its own copy
+   of the framebuffer, which it reuses for every picture. Each picture
+   is sent down a pipe as its name and format followed by the colour
+   and coverage planes. The encoder reads a whole picture before
+   writing it, so the renderer can only get one picture ahead and no
+   more than two framebuffers are ever held.
+
+   The encoder must be started before any other threads, as only the
+   thread which forks is copied.
+
+**************************************************************************
+
+   Revision History:
+   =================
+   V3.20 19.10.26 Original
+   V3.21 19.10.26 Encoder fails if a picture could not be written
+
+*************************************************************************/
+/* Includes
+*/
+#define _XOPEN_SOURCE 600
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+
+#include "bioplib/MathType.h"
+#include "bioplib/SysDefs.h"
+
+#include "qtree.h"
+#include "graphics.p"
+#include "rawimage.p"
+#include "encoder.p"
+
+/************************************************************************/
+/* Defines
+*/
+#define MAXNAME 512              /* Longest output filename             */
+
+/************************************************************************/
+/* Variables global to this file only
+*/
+static pid_t sPid = (-1);        /* The encoder process                 */
+static int   sFd  = (-1);        /* Write end of its pipe               */
+
+/************************************************************************/
+/* Prototypes
+*/
+static BOOL EncodeImages(int fd);
+
+
+/************************************************************************/
+/*>BOOL StartEncoder(void)
+   -----------------------
+   Returns: BOOL               Was the encoder started?
+
+   Forks the encoder process. The framebuffer must already be set up.
+
+   19.10.26 Original    By: ACRM
+*/
+BOOL StartEncoder(void)
+{
+   int  pipeFd[2];
+   BOOL ok;
+
+   if(sFd >= 0)
+      return(TRUE);
+   if(pipe(pipeFd) < 0)
+      return(FALSE);
+
+   fflush(stdout);
+   fflush(stderr);
+   if((sPid = fork()) == 0)
+   {
+      close(pipeFd[1]);
+      ok = EncodeImages(pipeFd[0]);
+      fflush(stdout);
+      fflush(stderr);
+      _exit(ok ? 0 : 1);
+   }
+
+   close(pipeFd[0]);
+   if(sPid < 0)
+   {
+      close(pipeFd[1]);
+      return(FALSE);
+   }
+   sFd = pipeFd[1];
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>BOOL EncodeImage(char *name, int outFormat)
+   -------------------------------------------
+   Input:   char   *name       File to write
+            int    outFormat   Output format
+   Returns: BOOL               Success?
+
+   Hands the framebuffer to the encoder to be written, or writes it
+   here if there is no encoder. The encoder must finish the picture
+   before taking this one, but the framebuffer may be drawn on
+   again as soon as this returns.
+
+   19.10.26 Original    By: ACRM
+   19.10.26 Returns WriteImage() result when there is no encoder
+*/
+BOOL EncodeImage(char *name, int outFormat)
+{
+   struct iovec iov[2];
+   int          head[2];
+
+   if(sFd < 0)
+      return(WriteImage(name, outFormat));
+
+   head[0]         = outFormat;
+   head[1]         = strlen(name);
+   iov[0].iov_base = (char *)head;
+   iov[0].iov_len  = sizeof(head);
+   iov[1].iov_base = name;
+   iov[1].iov_len  = head[1];
+
+   if((head[1] >= MAXNAME) ||
+      !WriteVector(sFd, iov, 2) || !WriteFramebuffer(sFd))
+   {
+      fprintf(stderr,"Unable to pass picture to the encoder: %s\n", name);
+      return(FALSE);
+   }
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>BOOL StopEncoder(void)
+   ----------------------
+   Returns: BOOL               Did the encoder finish cleanly?
+
+   Waits for the encoder to write the pictures it has been given.
+
+   19.10.26 Original    By: ACRM
+*/
+BOOL StopEncoder(void)
+{
+   int  status;
+   BOOL ok = TRUE;
+
+   if(sFd < 0)
+      return(TRUE);
+
+   close(sFd);
+   if((waitpid(sPid, &status, 0) < 0) ||
+      !WIFEXITED(status) || (WEXITSTATUS(status) != 0))
+      ok = FALSE;
+
+   sFd  = (-1);
+   sPid = (-1);
+   return(ok);
+}
+
+
+/************************************************************************/
+/*>static BOOL EncodeImages(int fd)
+   --------------------------------
+   Input:   int    fd          Read end of the encoder's pipe
+   Returns: BOOL               Was every picture read and written?
+
+   The encoder process. Reads pictures into the framebuffer and writes
+   them until the pipe is closed.
+
+   19.10.26 Original    By: ACRM
+   19.10.26 Fails if a picture could not be written
+*/
+static BOOL EncodeImages(int fd)
+{
+   char name[MAXNAME];
+   int  head[2];
+   BOOL ok = TRUE;
+
+   while(ReadBlock(fd, (unsigned char *)head, sizeof(head)))
+   {
+      if((head[1] < 0) || (head[1] >= MAXNAME) ||
+         !ReadBlock(fd, (unsigned char *)name, head[1]) ||
+         !ReadFramebuffer(fd))
+         return(FALSE);
+      name[head[1]] = '\0';
+
+      if(!WriteImage(name, head[0]))
+      {
+         fprintf(stderr,"Unable to write picture: %s\n", name);
+         ok = FALSE;
+      }
+   }
+
+   return(ok);
+}
@@ -0,0 +1,6 @@
+BOOL StartEncoder(void)
+;
+BOOL EncodeImage(char *name, int outFormat)
+;
+BOOL StopEncoder(void)
+;
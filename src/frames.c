@@ -0,0 +1,481 @@
+/*************************************************************************
+
+   Program:    QTree
+   File:       frames.c
+
+   Version:    V3.20
+   Date:       19.10.26
+   Function:   Render a sequence of frames in parallel
+
+   Copyright:  (c) SciTech Software 2026
+   Author:     Prof. Andrew C. R. Martin
+   EMail:      andrew@bioinf.org.uk
+
+**************************************************************************
+
+   This program is not in the public domain.
+
+   It may not be copied or made available to third parties, but may be
+   freely used by non-profit-making organisations who have obtained it
+   directly from the author or by FTP.
+
+   You are requested to send EMail to the author to say that you are
+   using this code so that you may be informed of future updates.
+
+   The code may not be made available on other FTP sites without express
+   permission from the author.
+
+   The code may be modified as required, but any modifications must be
+   documented so that the person responsible can be identified. If
+   someone else breaks this code, the author doesn't want to be blamed
+   for code that does not work! You may not distribute any
+   modifications, but are encouraged to send them to the author so
+   that they may be incorporated into future versions of the code.
+
+   The code may not be sold commercially or used for commercial purposes
+   without prior permission from the author.
+
+**************************************************************************
+
+   Description:
+   ============
+   Renders a numbered sequence of frames and writes them either as one
+   picture per frame or as a single YUV4MPEG2 stream. Each frame is
+   drawn into the framebuffer by a function supplied by the caller, so
+   the same code serves any kind of animation.
+
+**************************************************************************
+
+   Usage:
+   ======
+   RenderFrames() is given the number of frames and a function which
+   renders frame n (counting from 0) into the framebuffer. The output
+   filename must contain %d for the frame number unless the output
+   format is Y4M, when a blank filename means standard output.
+
+**************************************************************************
+
+   Notes:
+   ======
+   As for galleries, the renderer keeps its state in static variables
+   so frames are rendered in parallel by gNThreads worker processes.
+   Everything set up before RenderFrames() is called is shared
+   copy-on-write.
+
+   When writing pictures, worker n renders the n-th run of consecutive
+   frames so each worker moves smoothly through its part of the
+   sequence. Each worker starts its own encoder (see encoder.c) so its
+   pictures are compressed and written while it renders the next.
+
+   For a stream, the frames must be written in order, so worker n
+   renders every n-th frame instead and writes it to its own pipe. This
+   process renders nothing and copies the frames from the pipes to the
+   stream in turn; a pipe only holds a frame or so, which keeps the
+   workers in step with each other.
+
+**************************************************************************
+
+   Revision History:
+   =================
+   V3.18 19.10.26 Original
+   V3.19 19.10.26 CheckFrameFile() message not just for animations
+   V3.20 19.10.26 Pictures written by an encoder process for each worker
+
+*************************************************************************/
+/* Includes
+*/
+#define _XOPEN_SOURCE 600
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "bioplib/macros.h"
+#include "bioplib/MathType.h"
+#include "bioplib/SysDefs.h"
+
+#include "qtree.h"
+#include "graphics.p"
+#include "rawimage.p"
+#include "encoder.p"
+#include "frames.p"
+
+/************************************************************************/
+/* Defines
+*/
+#define MAXNAME 512              /* Longest output filename             */
+
+/************************************************************************/
+/* Prototypes
+*/
+static BOOL WriteFrames(int nFrames, int first, char *outFile,
+                        int outFormat, BOOL (*RenderFrame)(int frame),
+                        int worker, int nWorkers);
+static BOOL StreamFrames(int nFrames, char *outFile,
+                         BOOL (*RenderFrame)(int frame), int nWorkers);
+static BOOL PipeFrames(int nFrames, int fd, BOOL (*RenderFrame)(int frame),
+                       int worker, int nWorkers);
+static BOOL WaitWorkers(pid_t *pids, int first, int last);
+
+
+/************************************************************************/
+/*>BOOL CheckFrameFile(char *outFile, int outFormat)
+   -------------------------------------------------
+   Input:   char   *outFile    Output filename for a sequence of frames
+            int    outFormat   Output format
+   Returns: BOOL               Is it usable?
+
+   Unless writing a Y4M stream, checks that the filename contains %d
+   (and no other conversion) for the frame number, giving a message if
+   not.
+
+   19.10.26 Original    By: ACRM
+   19.10.26 Message not just for animations
+*/
+BOOL CheckFrameFile(char *outFile, int outFormat)
+{
+   char *pct;
+
+   if(outFormat == OUTPUT_Y4M)
+      return(TRUE);
+
+   pct = strchr(outFile, '%');
+   if((pct == NULL) || (pct[1] != 'd') || (strchr(pct+1, '%') != NULL))
+   {
+      fprintf(stderr,"The output filename for a sequence of frames must \
+contain %%d\nor the output format must be Y4M.\n");
+      return(FALSE);
+   }
+   if(strlen(outFile) > MAXNAME-16)
+   {
+      fprintf(stderr,"Output filename too long: %s\n", outFile);
+      return(FALSE);
+   }
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>BOOL RenderFrames(int nFrames, int first, char *outFile, int outFormat,
+                     BOOL (*RenderFrame)(int frame))
+   ----------------------------------------------------------------------
+   Input:   int    nFrames     Number of frames
+            int    first       Number of the first frame in filenames
+            char   *outFile    Output filename containing %d, or the
+                               stream (blank for stdout) for Y4M
+            int    outFormat   Output format
+            BOOL   (*RenderFrame)(int frame)
+                               Renders frame 0..nFrames-1 into the
+                               framebuffer
+   Returns: BOOL               Success?
+
+   Renders and writes all the frames using up to gNThreads processes.
+
+   19.10.26 Original    By: ACRM
+   19.10.26 Each worker writes pictures with an encoder process
+*/
+BOOL RenderFrames(int nFrames, int first, char *outFile, int outFormat,
+                  BOOL (*RenderFrame)(int frame))
+{
+   pid_t *pids    = NULL;
+   int   nWorkers,
+         nStarted,
+         worker;
+   BOOL  ok       = TRUE;
+
+   if(!CheckFrameFile(outFile, outFormat))
+      return(FALSE);
+
+   nWorkers = MIN(gNThreads, nFrames);
+   if(nWorkers < 1)
+      nWorkers = 1;
+
+   if(outFormat == OUTPUT_Y4M)
+      return(StreamFrames(nFrames, outFile, RenderFrame, nWorkers));
+
+   if((nWorkers > 1) &&
+      ((pids = (pid_t *)malloc(nWorkers * sizeof(pid_t))) == NULL))
+      nWorkers = 1;
+
+   /* Start the other workers. The first is this process                */
+   fflush(stdout);
+   fflush(stderr);
+   for(nStarted=1; nStarted<nWorkers; nStarted++)
+   {
+      if((pids[nStarted] = fork()) == 0)
+      {
+         gNThreads = 1;
+         StartEncoder();
+         ok = WriteFrames(nFrames, first, outFile, outFormat, RenderFrame,
+                          nStarted, nWorkers);
+         if(!StopEncoder())
+            ok = FALSE;
+         fflush(stdout);
+         fflush(stderr);
+         _exit(ok ? 0 : 1);
+      }
+      else if(pids[nStarted] < 0)
+      {
+         fprintf(stderr,"Unable to start frame worker\n");
+         break;
+      }
+   }
+
+   /* Render our own frames and those of any workers not started        */
+   if(nWorkers > 1)
+      gNThreads = 1;
+   StartEncoder();
+   for(worker=0; worker<nWorkers; worker++)
+   {
+      if(((worker == 0) || (worker >= nStarted)) &&
+         !WriteFrames(nFrames, first, outFile, outFormat, RenderFrame,
+                      worker, nWorkers))
+         ok = FALSE;
+   }
+   if(!StopEncoder())
+      ok = FALSE;
+
+   if(!WaitWorkers(pids, 1, nStarted))
+      ok = FALSE;
+
+   if(pids != NULL) free(pids);
+   return(ok);
+}
+
+
+/************************************************************************/
+/*>static BOOL WriteFrames(int nFrames, int first, char *outFile,
+                           int outFormat, BOOL (*RenderFrame)(int frame),
+                           int worker, int nWorkers)
+   ----------------------------------------------------------------------
+   Input:   int    nFrames     Number of frames
+            int    first       Number of the first frame in filenames
+            char   *outFile    Output filename containing %d
+            int    outFormat   Output format
+            BOOL   (*RenderFrame)(int frame)
+                               Renders a frame
+            int    worker      This worker
+            int    nWorkers    Number of workers
+   Returns: BOOL               Success?
+
+   Renders and writes this worker's run of consecutive frames.
+
+   19.10.26 Original    By: ACRM
+   19.10.26 Pictures passed to EncodeImage()
+*/
+static BOOL WriteFrames(int nFrames, int first, char *outFile,
+                        int outFormat, BOOL (*RenderFrame)(int frame),
+                        int worker, int nWorkers)
+{
+   char name[MAXNAME];
+   int  frame,
+        last;
+   BOOL ok = TRUE;
+
+   last = (int)(((long)nFrames * (worker+1)) / nWorkers);
+   for(frame=(int)(((long)nFrames * worker) / nWorkers);
+       frame<last;
+       frame++)
+   {
+      if((*RenderFrame)(frame))
+      {
+         sprintf(name, outFile, first+frame);
+         if(!EncodeImage(name, outFormat))
+            ok = FALSE;
+      }
+      else
+      {
+         fprintf(stderr,"Unable to render frame %d\n", first+frame);
+         ok = FALSE;
+      }
+   }
+
+   return(ok);
+}
+
+
+/************************************************************************/
+/*>static BOOL StreamFrames(int nFrames, char *outFile,
+                            BOOL (*RenderFrame)(int frame), int nWorkers)
+   ----------------------------------------------------------------------
+   Input:   int    nFrames     Number of frames
+            char   *outFile    Stream to write (blank for stdout)
+            BOOL   (*RenderFrame)(int frame)
+                               Renders a frame
+            int    nWorkers    Number of workers
+   Returns: BOOL               Success?
+
+   Writes the frames in order as one Y4M stream. With more than one
+   worker, the workers are all child processes and this one copies the
+   frames from their pipes.
+
+   19.10.26 Original    By: ACRM
+*/
+static BOOL StreamFrames(int nFrames, char *outFile,
+                         BOOL (*RenderFrame)(int frame), int nWorkers)
+{
+   Y4MSTREAM *stream;
+   pid_t     *pids    = NULL;
+   int       *fds     = NULL,
+             pipeFd[2],
+             nStarted = 0,
+             frame;
+   BOOL      ok       = TRUE;
+
+   if((stream = OpenY4MStream(outFile, gScreen[0], gScreen[1], Y4M_FPS))
+      == NULL)
+   {
+      fprintf(stderr,"Unable to write stream: %s\n",
+              outFile[0] ? outFile : "(stdout)");
+      return(FALSE);
+   }
+
+   if(nWorkers == 1)
+   {
+      for(frame=0; ok && (frame<nFrames); frame++)
+      {
+         if(!(*RenderFrame)(frame))
+         {
+            fprintf(stderr,"Unable to render frame %d\n", frame);
+            ok = FALSE;
+         }
+         else
+         {
+            ok = WriteY4MFrame(stream);
+         }
+      }
+      if(!CloseY4MStream(stream))
+         ok = FALSE;
+      return(ok);
+   }
+
+   if(((pids = (pid_t *)malloc(nWorkers * sizeof(pid_t))) == NULL) ||
+      ((fds  = (int *)malloc(nWorkers * sizeof(int))) == NULL))
+   {
+      fprintf(stderr,"No memory for frame workers\n");
+      ok = FALSE;
+   }
+
+   /* Start the workers, each writing to its own pipe                   */
+   fflush(stdout);
+   fflush(stderr);
+   for(nStarted=0; ok && (nStarted<nWorkers); nStarted++)
+   {
+      if(pipe(pipeFd) < 0)
+      {
+         fprintf(stderr,"Unable to start frame worker\n");
+         ok = FALSE;
+         break;
+      }
+      if((pids[nStarted] = fork()) == 0)
+      {
+         /* Keep only the write end of our own pipe                     */
+         close(pipeFd[0]);
+         for(frame=0; frame<nStarted; frame++)
+            close(fds[frame]);
+         gNThreads = 1;
+         ok = PipeFrames(nFrames, pipeFd[1], RenderFrame, nStarted,
+                         nWorkers);
+         _exit(ok ? 0 : 1);
+      }
+      close(pipeFd[1]);
+      if(pids[nStarted] < 0)
+      {
+         fprintf(stderr,"Unable to start frame worker\n");
+         close(pipeFd[0]);
+         ok = FALSE;
+         break;
+      }
+      fds[nStarted] = pipeFd[0];
+   }
+
+   /* Copy the frames to the stream in order                            */
+   for(frame=0; ok && (frame<nFrames); frame++)
+   {
+      if(!CopyY4MFrame(stream, fds[frame % nWorkers]))
+      {
+         fprintf(stderr,"Unable to render frame %d\n", frame);
+         ok = FALSE;
+      }
+   }
+
+   /* Closing the pipes stops any workers still running                 */
+   for(frame=0; frame<nStarted; frame++)
+      close(fds[frame]);
+   if(!WaitWorkers(pids, 0, nStarted))
+      ok = FALSE;
+
+   if(!CloseY4MStream(stream))
+      ok = FALSE;
+   if(pids != NULL) free(pids);
+   if(fds  != NULL) free(fds);
+   return(ok);
+}
+
+
+/************************************************************************/
+/*>static BOOL PipeFrames(int nFrames, int fd,
+                          BOOL (*RenderFrame)(int frame),
+                          int worker, int nWorkers)
+   -------------------------------------------------------
+   Input:   int    nFrames     Number of frames
+            int    fd          Write end of this worker's pipe
+            BOOL   (*RenderFrame)(int frame)
+                               Renders a frame
+            int    worker      This worker
+            int    nWorkers    Number of workers
+   Returns: BOOL               Success?
+
+   Renders every nWorkers-th frame starting at worker and writes each
+   to the pipe. Stops at the first failure, which the process reading
+   the pipe sees as the pipe ending.
+
+   19.10.26 Original    By: ACRM
+*/
+static BOOL PipeFrames(int nFrames, int fd, BOOL (*RenderFrame)(int frame),
+                       int worker, int nWorkers)
+{
+   Y4MSTREAM *stream;
+   int       frame;
+   BOOL      ok = TRUE;
+
+   if((stream = OpenY4MPipe(fd, gScreen[0], gScreen[1])) == NULL)
+      return(FALSE);
+
+   for(frame=worker; ok && (frame<nFrames); frame+=nWorkers)
+      ok = (*RenderFrame)(frame) && WriteY4MFrame(stream);
+
+   if(!CloseY4MStream(stream))
+      ok = FALSE;
+   return(ok);
+}
+
+
+/************************************************************************/
+/*>static BOOL WaitWorkers(pid_t *pids, int first, int last)
+   ---------------------------------------------------------
+   Input:   pid_t  *pids       Worker processes
+            int    first       First to wait for
+            int    last        One after the last
+   Returns: BOOL               Did they all succeed?
+
+   19.10.26 Original    By: ACRM
+*/
+static BOOL WaitWorkers(pid_t *pids, int first, int last)
+{
+   int  worker,
+        status;
+   BOOL ok = TRUE;
+
+   for(worker=first; worker<last; worker++)
+   {
+      if((waitpid(pids[worker], &status, 0) < 0) ||
+         !WIFEXITED(status) || (WEXITSTATUS(status) != 0))
+         ok = FALSE;
+   }
+
+   return(ok);
+}
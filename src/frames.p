@@ -0,0 +1,5 @@
+BOOL CheckFrameFile(char *outFile, int outFormat)
+;
+BOOL RenderFrames(int nFrames, int first, char *outFile, int outFormat,
+                  BOOL (*RenderFrame)(int frame))
+;
@@ -0,0 +1,559 @@
+/*************************************************************************
+
+   Program:    QTree
+   File:       gallery.c
+
+   Version:    V3.25
+   Date:       19.10.26
+   Function:   Galleries of ligand poses on a fixed receptor
+
+   Copyright:  (c) SciTech Software 2026
+   Author:     Prof. Andrew C. R. Martin
+   EMail:      andrew@bioinf.org.uk
+
+**************************************************************************
+
+   This program is not in the public domain.
+
+   It may not be copied or made available to third parties, but may be
+   freely used by non-profit-making organisations who have obtained it
+   directly from the author or by FTP.
+
+   You are requested to send EMail to the author to say that you are
+   using this code so that you may be informed of future updates.
+
+   The code may not be made available on other FTP sites without express
+   permission from the author.
+
+   The code may be modified as required, but any modifications must be
+   documented so that the person responsible can be identified. If
+   someone else breaks this code, the author doesn't want to be blamed
+   for code that does not work! You may not distribute any
+   modifications, but are encouraged to send them to the author so
+   that they may be incorporated into future versions of the code.
+
+   The code may not be sold commercially or used for commercial purposes
+   without prior permission from the author.
+
+**************************************************************************
+
+   Description:
+   ============
+   Renders one picture for each MODEL (pose) of a ligand file, each
+   shown in place on the same receptor. The receptor is rendered once
+   and its colour, coverage and depth are kept. For each pose, only
+   the rectangle of the image which the pose can reach is cleared, the
+   pose is rendered there and the receptor is merged back in by depth
+   with MergeLayerRow(), exactly as for a layer given with -x. The
+   picture is written and the rectangle put back to the receptor for
+   the next pose.
+
+**************************************************************************
+
+   Usage:
+   ======
+   ReadGallery() reads the receptor followed by every pose into one
+   array of atoms, so the control file and MapSpheres() treat them
+   all together and the poses are placed consistently on the receptor.
+   RenderGallery() is then called with the sphere list in place of
+   SpaceFill().
+
+**************************************************************************
+
+   Notes:
+   ======
+   Apart from writing each picture, the work for a pose depends only
+   on the number of its atoms and the area they cover, not on the
+   receptor.
+
+   The renderer keeps its framebuffer and state in static variables,
+   so poses are done in parallel by gNThreads worker processes rather
+   than threads. The workers are forked once the receptor has been
+   rendered and share it copy-on-write; worker n does every n-th pose.
+   Each worker hands its pictures to its own encoder process (see
+   encoder.c) which compresses PNGs on one thread while the worker
+   renders the next pose.
+
+   The ligand file is read once with ReadModels(), which splits it at
+   the end of each model.
+
+   Output filenames are made by replacing %d with the model number.
+
+**************************************************************************
+
+   Revision History:
+   =================
+   V3.17 19.10.26 Original
+   V3.20 19.10.26 Pictures written by an encoder process for each worker
+   V3.25 19.10.26 The atoms are returned as an array
+                  The poses are read in one pass
+
+*************************************************************************/
+/* Includes
+*/
+#define _XOPEN_SOURCE 600
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "bioplib/macros.h"
+#include "bioplib/MathType.h"
+#include "bioplib/SysDefs.h"
+#include "bioplib/pdb.h"
+
+#include "qtree.h"
+#include "qtree.p"
+#include "graphics.p"
+#include "encoder.p"
+#include "atoms.p"
+#include "gallery.p"
+
+/************************************************************************/
+/* Defines
+*/
+#define MAXNAME 512              /* Longest output filename             */
+
+/************************************************************************/
+/* Variables global to this file only
+*/
+static unsigned char *sRecRGBA  = NULL;  /* The receptor: RGB+coverage  */
+static float         *sRecDepth = NULL;  /*               and depth     */
+
+/************************************************************************/
+/* Prototypes
+*/
+static BOOL SaveReceptor(void);
+static BOOL RenderPoses(SPHERE *spheres, int NSphere, int *poseStart,
+                        int NPoses, char *outFile, int outFormat,
+                        int worker, int nWorkers);
+static BOOL RenderPose(SPHERE *spheres, int NSphere, char *name,
+                       int outFormat);
+static void ScreenRect(int x0, int y0, int x1, int y1, int *left,
+                       int *top, int *right, int *bottom);
+
+
+/************************************************************************/
+/*>PDB *ReadGallery(FILE *fp, char *receptorFile, BOOL allAtoms,
+                    int *NAtom, int **poseStart, int *NPoses)
+   -------------------------------------------------------------
+   Input:   FILE   *fp            Ligand file (all models)
+            char   *receptorFile  Receptor PDB file
+            BOOL   allAtoms       Read all occupancy atoms (ball and
+                                  stick)
+   Output:  int    *NAtom         Total atoms read
+            int    **poseStart    Malloc'd: index of the first atom of
+                                  each pose, plus NAtom at the end
+            int    *NPoses        Number of poses
+   Returns: PDB    *              Receptor followed by all the poses
+                                  or NULL on error
+
+   Reads the receptor and then every MODEL of the ligand file into one
+   array like those from ReadAtoms().
+
+   19.10.26 Original    By: ACRM
+   19.10.26 Returns an array
+   19.10.26 Reads the poses in one pass with ReadModels()
+*/
+PDB *ReadGallery(FILE *fp, char *receptorFile, BOOL allAtoms, int *NAtom,
+                 int **poseStart, int *NPoses)
+{
+   FILE *fpRec;
+   PDB  *receptor,
+        *poses,
+        *pdb   = NULL;
+   int  nRec,
+        nPose,
+        i;
+
+   *NAtom     = 0;
+   *NPoses    = 0;
+   *poseStart = NULL;
+
+   if((fpRec = fopen(receptorFile, "r")) == NULL)
+   {
+      fprintf(stderr,"Unable to read receptor file: %s\n", receptorFile);
+      return(NULL);
+   }
+   receptor = ReadAtoms(fpRec, allAtoms, &nRec);
+   fclose(fpRec);
+   if(receptor == NULL)
+   {
+      fprintf(stderr,"No atoms read from receptor file: %s\n",
+              receptorFile);
+      return(NULL);
+   }
+
+   if((poses = ReadModels(fp, allAtoms, &nPose, poseStart, NPoses)) 
+      == NULL)
+   {
+      fprintf(stderr,"No ligand poses read\n");
+      free(receptor);
+      return(NULL);
+   }
+
+   /* The receptor followed by the poses                                */
+   *NAtom = nRec + nPose;
+   if((pdb = (PDB *)malloc(*NAtom * sizeof(PDB))) == NULL)
+   {
+      fprintf(stderr,"No memory for ligand poses\n");
+      free(*poseStart);
+      *poseStart = NULL;
+      *NPoses    = 0;
+      *NAtom     = 0;
+   }
+   else
+   {
+      memcpy(pdb, receptor, nRec * sizeof(PDB));
+      memcpy(pdb + nRec, poses, nPose * sizeof(PDB));
+      for(i=0; i<*NAtom; i++)
+         pdb[i].next = (i < *NAtom-1) ? &(pdb[i+1]) : NULL;
+      for(i=0; i<=*NPoses; i++)
+         (*poseStart)[i] += nRec;
+   }
+
+   free(receptor);
+   free(poses);
+   return(pdb);
+}
+
+
+/************************************************************************/
+/*>BOOL CheckGalleryFile(char *outFile)
+   ------------------------------------
+   Input:   char   *outFile    Output filename for a gallery
+   Returns: BOOL               Is it usable?
+
+   Checks that the filename contains %d (and no other conversion) for
+   the model number, giving a message if not.
+
+   19.10.26 Original    By: ACRM
+*/
+BOOL CheckGalleryFile(char *outFile)
+{
+   char *pct;
+
+   pct = strchr(outFile, '%');
+   if((pct == NULL) || (pct[1] != 'd') || (strchr(pct+1, '%') != NULL))
+   {
+      fprintf(stderr,"The output filename for a gallery must contain \
+%%d.\n");
+      return(FALSE);
+   }
+   if(strlen(outFile) > MAXNAME-16)
+   {
+      fprintf(stderr,"Output filename too long: %s\n", outFile);
+      return(FALSE);
+   }
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>BOOL RenderGallery(SPHERE *spheres, int NSphere, int *poseStart,
+                      int NPoses, char *outFile, int outFormat)
+   ---------------------------------------------------------------
+   Input:   SPHERE *spheres    Receptor and pose spheres in the order
+                               read by ReadGallery(). Some may have
+                               been removed by SLAB
+            int    NSphere     Number of spheres
+            int    *poseStart  From ReadGallery()
+            int    NPoses      Number of poses
+            char   *outFile    Output filename containing %d
+            int    outFormat   Output format
+   Returns: BOOL               Success?
+
+   Renders the receptor and writes a picture for each pose.
+   InitGraphics() must have been called with AUX_ALPHA and AUX_DEPTH.
+
+   19.10.26 Original    By: ACRM
+   19.10.26 Each worker writes pictures with an encoder process
+*/
+BOOL RenderGallery(SPHERE *spheres, int NSphere, int *poseStart,
+                   int NPoses, char *outFile, int outFormat)
+{
+   pid_t *pids   = NULL;
+   int   nRec,
+         nWorkers,
+         worker,
+         status;
+   BOOL  ok      = TRUE;
+
+   if(!CheckGalleryFile(outFile))
+      return(FALSE);
+
+   /* Spheres stay in the order of the atoms, so the receptor is first  */
+   for(nRec=0; (nRec<NSphere) && (spheres[nRec].atom<poseStart[0]);
+       nRec++);
+
+   if(!SpaceFill(spheres, nRec) || !SaveReceptor())
+      return(FALSE);
+
+   nWorkers = MIN(gNThreads, NPoses);
+   if((nWorkers > 1) &&
+      ((pids = (pid_t *)malloc(nWorkers * sizeof(pid_t))) == NULL))
+      nWorkers = 1;
+
+   /* Start the other workers. The first is this process                */
+   fflush(stdout);
+   fflush(stderr);
+   for(worker=1; worker<nWorkers; worker++)
+   {
+      if((pids[worker] = fork()) == 0)
+      {
+         gNThreads = 1;
+         StartEncoder();
+         ok = RenderPoses(spheres+nRec, NSphere-nRec, poseStart, NPoses,
+                          outFile, outFormat, worker, nWorkers);
+         if(!StopEncoder())
+            ok = FALSE;
+         fflush(stdout);
+         fflush(stderr);
+         _exit(ok ? 0 : 1);
+      }
+      else if(pids[worker] < 0)
+      {
+         /* Take on the poses of the workers not started                */
+         fprintf(stderr,"Unable to start gallery worker\n");
+         nWorkers = worker;
+         break;
+      }
+   }
+
+   if(nWorkers > 1)
+      gNThreads = 1;
+   StartEncoder();
+   ok = RenderPoses(spheres+nRec, NSphere-nRec, poseStart, NPoses,
+                    outFile, outFormat, 0, nWorkers);
+   if(!StopEncoder())
+      ok = FALSE;
+
+   for(worker=1; worker<nWorkers; worker++)
+   {
+      if((waitpid(pids[worker], &status, 0) < 0) ||
+         !WIFEXITED(status) || (WEXITSTATUS(status) != 0))
+         ok = FALSE;
+   }
+
+   if(pids      != NULL) free(pids);
+   if(sRecRGBA  != NULL) free(sRecRGBA);
+   if(sRecDepth != NULL) free(sRecDepth);
+   sRecRGBA  = NULL;
+   sRecDepth = NULL;
+
+   return(ok);
+}
+
+
+/************************************************************************/
+/*>static BOOL SaveReceptor(void)
+   ------------------------------
+   Returns: BOOL               Success?
+
+   Keeps a copy of the rendered receptor (RGB, coverage and depth) in
+   the same form as a layer read for MergeLayerRow().
+
+   19.10.26 Original    By: ACRM
+*/
+static BOOL SaveReceptor(void)
+{
+   unsigned char *rgb,
+                 *alpha,
+                 *rgbBuf   = NULL,
+                 *alphaBuf = NULL,
+                 *out;
+   double        *depth,
+                 *depthBuf = NULL;
+   unsigned long row = (unsigned long)gScreen[0];
+   int           x, y;
+   BOOL          ok        = FALSE;
+
+   if(((sRecRGBA  = (unsigned char *)malloc(4 * row * gScreen[1]))
+       == NULL) ||
+      ((sRecDepth = (float *)malloc(row * gScreen[1] * sizeof(float)))
+       == NULL) ||
+      ((rgbBuf    = (unsigned char *)malloc(3 * row)) == NULL) ||
+      ((alphaBuf  = (unsigned char *)malloc(row)) == NULL) ||
+      ((depthBuf  = (double *)malloc(row * sizeof(double))) == NULL))
+   {
+      fprintf(stderr,"No memory to keep the receptor\n");
+      goto cleanup;
+   }
+
+   for(y=0; y<gScreen[1]; y++)
+   {
+      rgb   = GetRGBRow(y, rgbBuf);
+      alpha = GetAlphaRow(y, alphaBuf);
+      depth = GetDepthRow(y, depthBuf);
+      out   = sRecRGBA + 4 * row * y;
+      for(x=0; x<gScreen[0]; x++)
+      {
+         *(out++) = rgb[3*x];
+         *(out++) = rgb[3*x+1];
+         *(out++) = rgb[3*x+2];
+         *(out++) = alpha[x];
+         sRecDepth[row * y + x] = (float)depth[x];
+      }
+   }
+   ok = TRUE;
+
+cleanup:
+   if(rgbBuf   != NULL) free(rgbBuf);
+   if(alphaBuf != NULL) free(alphaBuf);
+   if(depthBuf != NULL) free(depthBuf);
+   return(ok);
+}
+
+
+/************************************************************************/
+/*>static BOOL RenderPoses(SPHERE *spheres, int NSphere, int *poseStart,
+                           int NPoses, char *outFile, int outFormat,
+                           int worker, int nWorkers)
+   ---------------------------------------------------------------------
+   Input:   SPHERE *spheres    Pose spheres (receptor removed)
+            int    NSphere     Number of spheres
+            int    *poseStart  From ReadGallery()
+            int    NPoses      Number of poses
+            char   *outFile    Output filename containing %d
+            int    outFormat   Output format
+            int    worker      This worker
+            int    nWorkers    Number of workers
+   Returns: BOOL               Success?
+
+   Renders and writes every nWorkers-th pose starting at worker.
+
+   19.10.26 Original    By: ACRM
+*/
+static BOOL RenderPoses(SPHERE *spheres, int NSphere, int *poseStart,
+                        int NPoses, char *outFile, int outFormat,
+                        int worker, int nWorkers)
+{
+   char name[MAXNAME];
+   int  pose,
+        first = 0,
+        last  = 0;
+   BOOL ok    = TRUE;
+
+   for(pose=worker; pose<NPoses; pose+=nWorkers)
+   {
+      /* Find this pose's spheres                                       */
+      for(first=last; (first<NSphere) &&
+                      (spheres[first].atom<poseStart[pose]); first++);
+      for(last=first; (last<NSphere) &&
+                      (spheres[last].atom<poseStart[pose+1]); last++);
+
+      sprintf(name, outFile, pose+1);
+      if(!RenderPose(spheres+first, last-first, name, outFormat))
+      {
+         fprintf(stderr,"Unable to render pose %d\n", pose+1);
+         ok = FALSE;
+      }
+   }
+
+   return(ok);
+}
+
+
+/************************************************************************/
+/*>static BOOL RenderPose(SPHERE *spheres, int NSphere, char *name,
+                          int outFormat)
+   ----------------------------------------------------------------
+   Input:   SPHERE *spheres    Spheres of one pose
+            int    NSphere     Number of spheres
+            char   *name       Output file
+            int    outFormat   Output format
+   Returns: BOOL               Success?
+
+   Renders a pose over the receptor and writes the picture. The
+   framebuffer holds the receptor before and after.
+
+   19.10.26 Original    By: ACRM
+   19.10.26 Picture passed to EncodeImage()
+*/
+static BOOL RenderPose(SPHERE *spheres, int NSphere, char *name,
+                       int outFormat)
+{
+   SPHERE        **SrtSph = NULL;
+   REAL          xmin, xmax,
+                 ymin, ymax;
+   unsigned long row      = (unsigned long)gScreen[0];
+   int           i, y,
+                 margin,
+                 x0, y0, x1, y1,
+                 left, top, right, bottom;
+   BOOL          ok;
+
+   if(NSphere == 0)
+      return(EncodeImage(name, outFormat));
+
+   /* Find the part of the render area the pose reaches. Highlight
+      borders may be drawn just beyond it
+   */
+   xmin = spheres[0].xmin;  xmax = spheres[0].xmax;
+   ymin = spheres[0].ymin;  ymax = spheres[0].ymax;
+   for(i=1; i<NSphere; i++)
+   {
+      if(spheres[i].xmin < xmin) xmin = spheres[i].xmin;
+      if(spheres[i].xmax > xmax) xmax = spheres[i].xmax;
+      if(spheres[i].ymin < ymin) ymin = spheres[i].ymin;
+      if(spheres[i].ymax > ymax) ymax = spheres[i].ymax;
+   }
+   margin = gBorderWidth + BORDER_NEIGHBOUR;
+   x0     = (int)floor(xmin) - margin;
+   y0     = (int)floor(ymin) - margin;
+   x1     = (int)ceil(xmax)  + margin + 1;
+   y1     = (int)ceil(ymax)  + margin + 1;
+
+   if((SrtSph = SortSpheresOnX(spheres, NSphere)) == NULL)
+      return(FALSE);
+
+   /* Clear the receptor from there and render the pose alone, then 
+      merge the receptor back in
+   */
+   ScreenRect(x0, y0, x1, y1, &left, &top, &right, &bottom);
+   ClearRegion(left, top, right, bottom);
+   ok = SpaceFillRegion(SrtSph, NSphere, x0, y0, x1, y1);
+   free(SrtSph);
+   for(y=top; y<bottom; y++)
+      MergeLayerRow(y, left, right, sRecRGBA + 4 * row * y,
+                    sRecDepth + row * y);
+
+   if(ok)
+      ok = EncodeImage(name, outFormat);
+
+   /* Back to just the receptor for the next pose                       */
+   for(y=top; y<bottom; y++)
+      PutLayerRow(y, left, right, sRecRGBA + 4 * row * y,
+                  sRecDepth + row * y);
+
+   return(ok);
+}
+
+
+/************************************************************************/
+/*>static void ScreenRect(int x0, int y0, int x1, int y1, int *left,
+                          int *top, int *right, int *bottom)
+   -------------------------------------------------------------------
+   Input:   int    x0,y0       Bottom left of a region of the render
+                               area
+            int    x1,y1       Top right (exclusive)
+   Output:  int    *left,*top  Top left of the same region of the image
+            int    *right      Right and bottom (exclusive), limited to
+            int    *bottom     the image rows
+
+   19.10.26 Original    By: ACRM
+*/
+static void ScreenRect(int x0, int y0, int x1, int y1, int *left,
+                       int *top, int *right, int *bottom)
+{
+   *left   = x0 - gOrigin[0];
+   *right  = x1 - gOrigin[0];
+   *top    = gRender[1] - y1 - gOrigin[1];
+   *bottom = gRender[1] - y0 - gOrigin[1];
+   if(*top    < 0)          *top    = 0;
+   if(*bottom > gScreen[1]) *bottom = gScreen[1];
+}
@@ -0,0 +1,8 @@
+PDB *ReadGallery(FILE *fp, char *receptorFile, BOOL allAtoms, int *NAtom,
+                 int **poseStart, int *NPoses)
+;
+BOOL CheckGalleryFile(char *outFile)
+;
+BOOL RenderGallery(SPHERE *spheres, int NSphere, int *poseStart,
+                   int NPoses, char *outFile, int outFormat)
+;
@@ -0,0 +1,364 @@
+/*************************************************************************
+
+   Program:    QTree
+   File:       gbuffer.c   
+
+   Version:    V3.15
+   Date:       19.10.26
+   Function:   Save visibility and re-shade from it  
+
+   Copyright:  (c) SciTech Software 2026
+   Author:     Prof. Andrew C. R. Martin
+   EMail:      andrew@bioinf.org.uk
+
+**************************************************************************
+
+   This program is not in the public domain.
+
+   It may not be copied or made available to third parties, but may be
+   freely used by non-profit-making organisations who have obtained it
+   directly from the author or by FTP.
+
+   You are requested to send EMail to the author to say that you are
+   using this code so that you may be informed of future updates.
+
+   The code may not be made available on other FTP sites without express
+   permission from the author.
+
+   The code may be modified as required, but any modifications must be
+   documented so that the person responsible can be identified. If
+   someone else breaks this code, the author doesn't want to be blamed
+   for code that does not work! You may not distribute any
+   modifications, but are encouraged to send them to the author so
+   that they may be incorporated into future versions of the code.
+
+   The code may not be sold commercially or used for commercial purposes
+   without prior permission from the author.
+
+**************************************************************************
+
+   Description:
+   ============
+   Saves the result of the quad-tree (which sphere is in front at each
+   pixel and the depth of its surface) together with the placed 
+   spheres, so that the image may be shaded again with new colours and
+   lighting without working out visibility again. 
+
+**************************************************************************
+
+   Usage:
+   ======
+
+**************************************************************************
+
+   Notes:
+   ======
+   The G-buffer file starts with a short text header:
+      QTREEGBUF 1
+      <width> <height> <render x> <render y> <origin x> <origin y> <size>
+      <atoms> <spheres> <depth cue zmin> <depth cue zrange>
+   This is followed, in native byte order, by <spheres> GBSPHERE 
+   records giving the atom number and double x, y, z and radius of each
+   sphere (after mapping to the render area), then <width> x <height> 
+   ints giving the atom number of the front sphere at each pixel (-1 
+   for background) and the same number of doubles giving its depth. 
+   Rows run from the top. Doubles are used so that re-shading gives 
+   exactly the same image as a full render.
+
+   The surface normal is not stored as it follows from the pixel, the
+   depth and the sphere centre.
+
+   Re-shading reads the same PDB file and applies the new control file
+   as normal, so colours, highlighting, lighting, ambient, specular, 
+   Phong and depth cue contrast may all change. Anything which would 
+   move the atoms or change which are shown (rotation, centring, 
+   scaling, radii, slab) is ignored. Highlight borders are recomputed
+   from the saved front spheres by DrawBorders(), which treats pixels 
+   beyond the edge of the image as matching their neighbour. For a 
+   picture of the whole screen, that is exactly what happens when 
+   rendering. Anti-aliasing is not re-applied.
+   
+   Only one row of the front spheres and depths is held in memory at a 
+   time.
+
+**************************************************************************
+
+   Revision History:
+   =================
+   V3.13 19.10.26 Original
+   V3.15 19.10.26 Borders drawn by DrawBorders(). Reads the front 
+                  spheres a row at a time
+
+*************************************************************************/
+/* Includes
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bioplib/macros.h"
+#include "bioplib/MathType.h"
+#include "bioplib/SysDefs.h"
+#include "bioplib/pdb.h"
+
+#include "qtree.h"
+#include "qtree.p"
+#include "graphics.p"
+#include "gbuffer.p"
+#include "borders.p"
+
+/************************************************************************/
+/* Defines and types
+*/
+#define GB_MAGIC   "QTREEGBUF 1" /* First line of a G-buffer file       */
+#define MAXLINE    256           /* Longest header line                 */
+
+typedef struct                   /* Sphere record in the file           */
+{
+   double x, y, z,
+          rad;
+   int    atom;
+}  GBSPHERE;
+
+/************************************************************************/
+/* Variables global to this file only
+*/
+static FILE *sGBFile  = NULL;    /* G-buffer being re-shaded            */
+static int  sNAtom    = 0,       /* Atoms in the PDB file it came from  */
+            sNSphere  = 0;       /* Sphere records                      */
+
+
+/************************************************************************/
+/*>BOOL WriteGBuffer(char *file, SPHERE *spheres, int NSphere, 
+                     int NAtom)
+   ------------------------------------------------------------
+   Input:   char    *file       G-buffer file to write
+            SPHERE  *spheres    The spheres which were rendered
+            int     NSphere     Number of spheres
+            int     NAtom       Number of atoms in the PDB file
+   Returns: BOOL                Success?
+
+   Write the front sphere and depth planes of the framebuffer, with the
+   spheres, to a G-buffer file. InitGraphics() must have been called 
+   with AUX_GBUFFER.
+
+   19.10.26 Original    By: ACRM
+*/
+BOOL WriteGBuffer(char *file, SPHERE *spheres, int NSphere, int NAtom)
+{
+   FILE     *fp;
+   GBSPHERE rec;
+   int      *idBuff = NULL,
+            *ids,
+            i, y;
+   double   *zBuff  = NULL,
+            *depth;
+   BOOL     ok      = FALSE;
+
+   if((fp = fopen(file, "wb")) == NULL)
+   {
+      fprintf(stderr, "Unable to write G-buffer: %s\n", file);
+      return(FALSE);
+   }
+
+   if(((idBuff = (int *)malloc(gScreen[0] * sizeof(int))) == NULL) ||
+      ((zBuff  = (double *)malloc(gScreen[0] * sizeof(double))) == NULL))
+      goto cleanup;
+
+   fprintf(fp, "%s\n%d %d %d %d %d %d %d\n%d %d %.8g %.8g\n",
+           GB_MAGIC, gScreen[0], gScreen[1], gRender[0], gRender[1],
+           gOrigin[0], gOrigin[1], gSize, NAtom, NSphere,
+           (double)gDepthCue.ZMin, (double)gDepthCue.ZRange);
+
+   memset(&rec, 0, sizeof(GBSPHERE));
+   for(i=0; i<NSphere; i++)
+   {
+      rec.atom = spheres[i].atom;
+      rec.x    = (double)spheres[i].x;
+      rec.y    = (double)spheres[i].y;
+      rec.z    = (double)spheres[i].z;
+      rec.rad  = (double)spheres[i].rad;
+      if(fwrite(&rec, sizeof(GBSPHERE), 1, fp) != 1)
+         goto cleanup;
+   }
+
+   for(y=0; y<gScreen[1]; y++)
+   {
+      if(((ids = GetSphereIDRow(y, idBuff)) == NULL) ||
+         (fwrite(ids, sizeof(int), gScreen[0], fp) != gScreen[0]))
+         goto cleanup;
+   }
+   for(y=0; y<gScreen[1]; y++)
+   {
+      if(((depth = GetDepthRow(y, zBuff)) == NULL) ||
+         (fwrite(depth, sizeof(double), gScreen[0], fp) != gScreen[0]))
+         goto cleanup;
+   }
+   ok = TRUE;
+
+cleanup:
+   if(fclose(fp) != 0)
+      ok = FALSE;
+   if(idBuff != NULL) free(idBuff);
+   if(zBuff  != NULL) free(zBuff);
+
+   if(!ok)
+      fprintf(stderr, "Error writing G-buffer: %s\n", file);
+   return(ok);
+}
+
+
+/************************************************************************/
+/*>BOOL OpenGBuffer(char *file)
+   ----------------------------
+   Input:   char    *file       G-buffer file to re-shade
+   Returns: BOOL                Success?
+
+   Open a G-buffer and read its header, setting gScreen, gRender, 
+   gOrigin, gSize and the depth cue range to those used when it was 
+   saved. Must be called before InitGraphics(). The rest is read by 
+   ReshadeGBuffer().
+
+   19.10.26 Original    By: ACRM
+*/
+BOOL OpenGBuffer(char *file)
+{
+   char   buffer[MAXLINE];
+   double zmin, zrange;
+
+   if((sGBFile = fopen(file, "rb")) == NULL)
+   {
+      fprintf(stderr, "Unable to read G-buffer: %s\n", file);
+      return(FALSE);
+   }
+
+   if((fgets(buffer, MAXLINE, sGBFile) == NULL) ||
+      strncmp(buffer, GB_MAGIC, strlen(GB_MAGIC)) ||
+      (fscanf(sGBFile, "%d %d %d %d %d %d %d", 
+              &(gScreen[0]), &(gScreen[1]), &(gRender[0]), &(gRender[1]),
+              &(gOrigin[0]), &(gOrigin[1]), &gSize) != 7) ||
+      (fscanf(sGBFile, "%d %d %lf %lf", &sNAtom, &sNSphere, 
+              &zmin, &zrange) != 4) ||
+      (fgetc(sGBFile) != '\n') ||
+      (gScreen[0] <= 0) || (gScreen[1] <= 0) || (sNSphere < 0))
+   {
+      fprintf(stderr, "Not a QTree G-buffer: %s\n", file);
+      fclose(sGBFile);
+      sGBFile = NULL;
+      return(FALSE);
+   }
+
+   gDepthCue.ZMin   = (REAL)zmin;
+   gDepthCue.ZRange = (REAL)zrange;
+
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>BOOL ReshadeGBuffer(SPHERE *spheres, int NAtom)
+   -----------------------------------------------
+   Input:   SPHERE  *spheres    Spheres for every atom, coloured from 
+                                the control file but not mapped
+            int     NAtom       Number of atoms
+   Returns: BOOL                Success?
+
+   Shade the image from the G-buffer opened by OpenGBuffer(). The
+   spheres are moved to where they were when the G-buffer was saved,
+   then each pixel with a sphere is shaded in one pass down the image.
+   Highlight borders are then drawn over the top by DrawBorders() just
+   as they are when rendering.
+
+   19.10.26 Original    By: ACRM
+   19.10.26 Borders drawn by DrawBorders(). Reads a row of front spheres
+            at a time
+*/
+BOOL ReshadeGBuffer(SPHERE *spheres, int NAtom)
+{
+   GBSPHERE      rec;
+   SPHERE        *sp;
+   int           *ids   = NULL,
+                 x, y, i,
+                 yr,
+                 id;
+   double        *depth = NULL;
+   long          idStart,
+                 zStart;
+   BOOL          ok     = FALSE;
+
+   if(sGBFile == NULL)
+      return(FALSE);
+
+   if(NAtom != sNAtom)
+   {
+      fprintf(stderr, "The G-buffer was made from a different PDB \
+file.\n");
+      goto cleanup;
+   }
+
+   /* Put the spheres back where they were                              */
+   for(i=0; i<sNSphere; i++)
+   {
+      if((fread(&rec, sizeof(GBSPHERE), 1, sGBFile) != 1) ||
+         (rec.atom < 0) || (rec.atom >= NAtom))
+         goto badfile;
+      
+      spheres[rec.atom].x   = (REAL)rec.x;
+      spheres[rec.atom].y   = (REAL)rec.y;
+      spheres[rec.atom].z   = (REAL)rec.z;
+      spheres[rec.atom].rad = (REAL)rec.rad;
+   }
+
+   /* The front spheres and depths are read a row at a time             */
+   if(((ids   = (int *)malloc(gScreen[0] * sizeof(int))) == NULL) ||
+      ((depth = (double *)malloc(gScreen[0] * sizeof(double))) == NULL))
+   {
+      fprintf(stderr, "No memory to re-shade the G-buffer.\n");
+      goto cleanup;
+   }
+   idStart = ftell(sGBFile);
+   zStart  = idStart + (long)gScreen[0] * gScreen[1] * sizeof(int);
+
+   /* Shade every pixel which has a sphere. The borders are worked out
+      for the image alone
+   */
+   InitBorders(gOrigin[0], gRender[1] - gOrigin[1] - gScreen[1],
+               gOrigin[0] + gScreen[0], gRender[1] - gOrigin[1]);
+   for(y=0; y<gScreen[1]; y++)
+   {
+      if(fseek(sGBFile, idStart + (long)y * gScreen[0] * sizeof(int),
+               SEEK_SET) ||
+         (fread(ids, sizeof(int), gScreen[0], sGBFile) != gScreen[0]) ||
+         fseek(sGBFile, zStart + (long)y * gScreen[0] * sizeof(double),
+               SEEK_SET) ||
+         (fread(depth, sizeof(double), gScreen[0], sGBFile) != gScreen[0]))
+         goto badfile;
+      
+      yr = gRender[1] - 1 - gOrigin[1] - y;
+      for(x=0; x<gScreen[0]; x++)
+      {
+         if((id = ids[x]) < 0)
+            continue;
+         if(id >= NAtom)
+            goto badfile;
+         
+         sp = spheres + id;
+         if(sp->highlight)
+            SetPixelHighlight(x + gOrigin[0], yr, sp);
+         ShadePixel((REAL)(x + gOrigin[0]), (REAL)yr, (REAL)depth[x], sp);
+      }
+   }
+   ok = DrawBorders();
+   goto cleanup;
+   
+badfile:
+   fprintf(stderr, "The G-buffer file is damaged.\n");
+   
+cleanup:
+   fclose(sGBFile);
+   sGBFile = NULL;
+   if(ids   != NULL) free(ids);
+   if(depth != NULL) free(depth);
+
+   return(ok);
+}
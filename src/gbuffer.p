@@ -0,0 +1,6 @@
+BOOL WriteGBuffer(char *file, SPHERE *spheres, int NSphere, int NAtom)
+;
+BOOL OpenGBuffer(char *file)
+;
+BOOL ReshadeGBuffer(SPHERE *spheres, int NAtom)
+;
@@ -3,11 +3,11 @@
    Program:    QTree
    File:       graphics.c
    
-   Version:    V3.0
-   Date:       19.08.19
+   Version:    V3.25
+   Date:       19.10.26
    Function:   Display routines for QTree
    
-   Copyright:  (c) SciTech Software 1993-2019
+   Copyright:  (c) SciTech Software 1993-2026
    Author:     Prof. Andrew C. R. Martin
    EMail:      andrew@bioinf.org.uk
                
@@ -77,30 +77,171 @@
    V2.4  27.01.15 Skipped
    V2.5  18.08.19 General cleanup and moved into GitHub
    V3.0  19.08.19 Added PNG support
+   V3.1  19.10.26 Packed RGB framebuffer with optional Morton-order tiled
+                  layout
+   V3.2  19.10.26 Added coverage plane and raw output formats
+   V3.3  19.10.26 PNG rows streamed straight from the framebuffer
+   V3.4  19.10.26 PNG compressed on gNThreads threads
+   V3.5  19.10.26 Added QOI output
+   V3.6  19.10.26 Render area is a rectangle (gRender) not a square
+   V3.7  19.10.26 Framebuffer may hold just a band of rows. Background
+                  moved here from commands.c so it can be redrawn for
+                  each band
+   V3.9  19.10.26 Image may be a window (gOrigin) on the full frame
+   V3.10 19.10.26 Added SpreadPixel() for previews
+   V3.11 19.10.26 Writes extra output sizes (gOutputs) by shrinking the
+                  image with a box filter
+   V3.12 19.10.26 Added BlendPixel() for anti-aliasing
+   V3.13 19.10.26 Added front sphere and depth planes (AUX_GBUFFER)
+   V3.14 19.10.26 Front sphere plane alone for atom ID maps (AUX_ATOMID)
+   V3.16 19.10.26 Depth plane alone (AUX_DEPTH). Added MergeLayerRow() 
+                  to merge separately rendered layers by depth
+   V3.17 19.10.26 MergeLayerRow() takes a span. Added PutLayerRow() and
+                  ClearRegion() for pose galleries
+   V3.20 19.10.26 Added WriteFramebuffer() and ReadFramebuffer() to pass
+                  images to an encoder process
+   V3.21 19.10.26 WriteImage() returns success
+   V3.25 19.10.26 EndGraphics() returns success
 
 *************************************************************************/
 /* Includes
 */
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/uio.h>
 
+#include "bioplib/macros.h"
 #include "bioplib/MathType.h"
 #include "bioplib/SysDefs.h"
-#include "bioplib/array.h"
 
 #include "qtree.h"
 #include "graphics.p"
+#include "rawimage.p"
+#include "qoi.p"
 
 /************************************************************************/
-/* Arrays to contain the image
+/* The image is held as a single packed RGB framebuffer. In the linear
+   layout this is simply row-major with the top row first. In the Morton
+   layout the image is cut into FB_TILESIZE square tiles (stored in
+   row-major tile order) and the pixels within each tile are stored in
+   Morton (Z) order, which is the order in which SplitPic() visits them.
+   The tile grid is anchored on the origin of the quad-tree area so
+   that quad-tree blocks of a power-of-two area never straddle a tile.
+   When rendering in bands (gBandRows set) the linear layout is always
+   used and the framebuffer holds only the rows sBandTop onwards.
 */
 static unsigned char 
 #ifdef _AMIGA
                      __far 
 #endif
-                           **sRed   = NULL,
-                           **sGreen = NULL,
-                           **sBlue  = NULL;
-               
+                           *sPixels   = NULL,
+                           *sAlpha    = NULL;  /* Optional coverage     */
+static int                 *sSphereID = NULL;  /* Optional front atom   */
+static double              *sDepth    = NULL;  /* Optional front depth  */
+static int                 sLayout    = FB_LINEAR,
+                           sXOrigin   = 0,  /* Tile grid offsets        */
+                           sYOrigin   = 0,
+                           sNXTiles   = 0,
+                           sBandTop   = 0,  /* First row held           */
+                           sBandRows  = 0,  /* Rows held in this band   */
+                           sBandSize  = 0;  /* Rows allocated           */
+static unsigned long       sNPixels   = 0;  /* Pixels allocated         */
+static BOOL                sDoBackground = FALSE;
+static REAL                sBackground[6];  /* Top and bottom RGB       */
+static unsigned long       sMortonX[FB_TILESIZE],
+                           sMortonY[FB_TILESIZE];
+
+/************************************************************************/
+/* Prototypes
+*/
+static void ClearSpherePlanes(void);
+static void BackgroundColour(int y, REAL *rgb);
+
+/************************************************************************/
+/* Index of a pixel (in screen coordinates) in the framebuffer. sPixels
+   holds 3 bytes per pixel and sAlpha 1 byte per pixel. sSphereID and
+   sDepth have one int and one double per pixel.
+*/
+#define FB_TILEMASK  (FB_TILESIZE-1)
+#define PIXINDEX(x, y)                                                   \
+   ((sLayout == FB_MORTON) ? MortonIndex((x), (y)) :                     \
+    ((unsigned long)((y) - sBandTop) * (unsigned long)gScreen[0] +       \
+     (unsigned long)(x)))
+
+/************************************************************************/
+/*>static unsigned long MortonIndex(int x, int y)
+   ----------------------------------------------
+   Input:   int           x, y     Screen coordinates (top row is 0)
+   Returns: unsigned long          Pixel index into the framebuffer
+
+   Find the index of a pixel in the Morton-order tiled framebuffer
+
+   19.10.26 Original    By: ACRM
+*/
+static unsigned long MortonIndex(int x, int y)
+{
+   unsigned long rx, ry;
+
+   rx = (unsigned long)(x + sXOrigin);
+   ry = (unsigned long)(sYOrigin - y);
+
+   return((((ry >> FB_TILESHIFT) * sNXTiles + (rx >> FB_TILESHIFT))
+           << (2 * FB_TILESHIFT)) +
+          (sMortonX[rx & FB_TILEMASK] | sMortonY[ry & FB_TILEMASK]));
+}
+
+
+/************************************************************************/
+/*>static unsigned char *DeswizzleRow(unsigned char *plane, int bpp, 
+                                      int y, unsigned char *buffer)
+   ------------------------------------------------------------------
+   Input:   unsigned char  *plane    sPixels, sAlpha, sSphereID or 
+                                     sDepth
+            int            bpp       Bytes per pixel in plane
+            int            y         Row (0 is the top of the image)
+            unsigned char  *buffer   Space for one row of the plane
+   Returns: unsigned char  *         The row
+
+   Obtain one row of a framebuffer plane in row order. With the linear
+   layout this is simply a pointer into the plane and buffer is not
+   touched. With the Morton layout the row is de-swizzled into buffer.
+
+   19.10.26 Original    By: ACRM
+*/
+static unsigned char *DeswizzleRow(unsigned char *plane, int bpp, int y,
+                                   unsigned char *buffer)
+{
+   unsigned char *tile,
+                 *in,
+                 *out;
+   unsigned long ry,
+                 my;
+   int           x, rx, i;
+   
+   if(sLayout != FB_MORTON)
+      return(plane + bpp * PIXINDEX(0, y));
+
+   ry   = (unsigned long)(sYOrigin - y);
+   my   = sMortonY[ry & FB_TILEMASK];
+   tile = plane + bpp * (((ry >> FB_TILESHIFT) * sNXTiles) 
+                         << (2 * FB_TILESHIFT));
+   out  = buffer;
+   
+   for(x=0, rx=sXOrigin; x<gScreen[0]; x++, rx++)
+   {
+      in = tile + bpp * (((unsigned long)(rx >> FB_TILESHIFT) 
+                          << (2 * FB_TILESHIFT)) |
+                         sMortonX[rx & FB_TILEMASK] | my);
+      for(i=0; i<bpp; i++)
+         *(out++) = in[i];
+   }
+   
+   return(buffer);
+}
+
+
 /************************************************************************/
 /*>BOOL InitGraphics(void)
    -----------------------
@@ -108,46 +249,143 @@ static unsigned char
    19.07.93 Original    By: ACRM
    12.08.93 Modified for file output only.
    04.01.94 Added casts on blFreeArray2D
+   19.10.26 Single packed RGB framebuffer with optional Morton layout.
+            Added auxBuffers
+   19.10.26 Tiles anchored on gRender rather than gSize
+   19.10.26 Only allocates one band if gBandRows is set
+   19.10.26 Tiles anchored for a window on the frame
+   19.10.26 Allocates front sphere and depth planes for AUX_GBUFFER and
+            just the front sphere plane for AUX_ATOMID
+   19.10.26 Just the depth plane for AUX_DEPTH
 */
-BOOL InitGraphics(void)
+BOOL InitGraphics(int auxBuffers)
 {
-   int   x, y;
+   unsigned long npixels;
+   int           i, bit,
+                 xoff, yoff,
+                 ymax;
+
+   sLayout   = gFBLayout;
+   sBandTop  = 0;
+   sBandSize = gScreen[1];
+   if(gBandRows > 0)
+   {
+      sLayout = FB_LINEAR;
+      if(gBandRows < gScreen[1])
+         sBandSize = gBandRows;
+   }
+   sBandRows = sBandSize;
    
-   sRed   = (unsigned char **)blArray2D(sizeof(unsigned char), 
-                                      gScreen[0], gScreen[1]);
-   sGreen = (unsigned char **)blArray2D(sizeof(unsigned char), 
-                                      gScreen[0], gScreen[1]);
-   sBlue  = (unsigned char **)blArray2D(sizeof(unsigned char), 
-                                      gScreen[0], gScreen[1]);
-
-   if(sRed == NULL || sGreen == NULL || sBlue == NULL)
+   if(sLayout == FB_MORTON)
    {
-      if(sRed   == NULL) blFreeArray2D((char **)sRed,  
-                                     gScreen[0], gScreen[1]);
-      if(sGreen == NULL) blFreeArray2D((char **)sGreen, 
-                                     gScreen[0], gScreen[1]);
-      if(sBlue  == NULL) blFreeArray2D((char **)sBlue,  
-                                     gScreen[0], gScreen[1]);
-      
-      sRed   = NULL;
-      sGreen = NULL;
-      sBlue  = NULL;
+      /* Build the bit-interleaving tables for a tile                   */
+      for(i=0; i<FB_TILESIZE; i++)
+      {
+         sMortonX[i] = sMortonY[i] = 0;
+         for(bit=0; bit<FB_TILESHIFT; bit++)
+         {
+            if(i & (1 << bit))
+            {
+               sMortonX[i] |= 1UL << (2 * bit);
+               sMortonY[i] |= 1UL << (2 * bit + 1);
+            }
+         }
+      }
+
+      /* Anchor the tile grid on the origin of the quad-tree area. 
+         Render space has y running upwards, so flip it here.
+      */
+      xoff     = -gOrigin[0];
+      yoff     = gScreen[1] - gRender[1] + gOrigin[1];
+      sXOrigin = ((xoff + FB_TILEMASK) & ~FB_TILEMASK) - xoff;
+      sYOrigin = ((yoff + FB_TILEMASK) & ~FB_TILEMASK) - yoff + 
+                 gScreen[1] - 1;
+      ymax     = sYOrigin;
       
-      return(FALSE);
+      sNXTiles = (sXOrigin + gScreen[0] - 1) / FB_TILESIZE + 1;
+      npixels  = (unsigned long)sNXTiles * 
+                 (unsigned long)(ymax / FB_TILESIZE + 1) *
+                 FB_TILESIZE * FB_TILESIZE;
    }
+   else
+   {
+      npixels  = (unsigned long)gScreen[0] * (unsigned long)sBandSize;
+   }
+   sNPixels = npixels;
    
-   /* Clear the screen                                                  */
-   for(y=0; y<gScreen[1]; y++)
-      for(x=0; x<gScreen[0]; x++)
-         sRed[x][y] = sGreen[x][y] = sBlue[x][y] = 0;
+   /* Allocate and clear the screen                                     */
+   if((sPixels = (unsigned char *)calloc(npixels, 3)) == NULL)
+      return(FALSE);
+
+   /* And the coverage plane if required                                */
+   if(auxBuffers & AUX_ALPHA)
+   {
+      if((sAlpha = (unsigned char *)calloc(npixels, 1)) == NULL)
+      {
+         free(sPixels);
+         sPixels = NULL;
+         return(FALSE);
+      }
+   }
+
+   /* And the front sphere and depth planes. An atom ID map just needs
+      the front sphere and depth output just the depth
+   */
+   if(auxBuffers & (AUX_GBUFFER | AUX_ATOMID))
+   {
+      if((sSphereID = (int *)malloc(npixels * sizeof(int))) == NULL)
+      {
+         EndGraphics("", (-1));
+         return(FALSE);
+      }
+   }
+   if(auxBuffers & (AUX_GBUFFER | AUX_DEPTH))
+   {
+      if((sDepth = (double *)malloc(npixels * sizeof(double))) == NULL)
+      {
+         EndGraphics("", (-1));
+         return(FALSE);
+      }
+   }
+   ClearSpherePlanes();
 
    return(TRUE);
 }
 
 
 /************************************************************************/
-/*>void EndGraphics(void)
-   ----------------------
+/*>static void ClearSpherePlanes(void)
+   -----------------------------------
+   Mark every pixel of the front sphere and depth planes as background
+   (-1 and DEPTH_BACKGROUND)
+
+   19.10.26 Original    By: ACRM
+   19.10.26 Also clears the depth plane
+*/
+static void ClearSpherePlanes(void)
+{
+   unsigned long i;
+   
+   if(sSphereID != NULL)
+   {
+      for(i=0; i<sNPixels; i++)
+         sSphereID[i] = (-1);
+   }
+   if(sDepth != NULL)
+   {
+      for(i=0; i<sNPixels; i++)
+         sDepth[i] = DEPTH_BACKGROUND;
+   }
+}
+
+
+/************************************************************************/
+/*>BOOL EndGraphics(char *outFile, int outFormat)
+   -----------------------------------------------
+   Input:   char  *outFile     File to write (blank for stdout)
+            int   outFormat    Output format (-1 to write nothing)
+   Returns: BOOL               Were the image and extra sizes written?
+
    Performs any remaining graphics display routines, waits for return to
    be pressed, and cleans up the graphics. Also writes the graphics to
    a file if specified.
@@ -157,36 +395,257 @@ BOOL InitGraphics(void)
    04.01.94 Added casts on blFreeArray2D
    28.03.95 No longer checks file specified
    19.08.19 Now takes filename and type as a parameter
+   19.10.26 Frees the packed framebuffer. Added raw formats
+   19.10.26 Added QOI
+   19.10.26 When rendering in bands, the image has already been written
+   19.10.26 Writing moved to WriteImage(). Writes the extra sizes in 
+            gOutputs, largest first
+   19.10.26 Returns success
 */
-void EndGraphics(char *outFile, int outFormat)
+BOOL EndGraphics(char *outFile, int outFormat)
+{
+   int screen[2],
+       i, j,
+       width, height;
+   OUTSIZE temp;
+   BOOL ok = TRUE;
+
+   /* When rendering in bands, the image has already been written      */
+   if(gBandRows > 0)
+      outFormat = (-1);
+   if(!WriteImage(outFile, outFormat))
+   {
+      fprintf(stderr,"Unable to write image: %s\n", 
+              outFile[0] ? outFile : "(stdout)");
+      ok = FALSE;
+   }
+
+   if((outFormat != (-1)) && (gNOutputs > 0))
+   {
+      /* Sort the extra sizes so each is shrunk from the one before     */
+      for(i=1; i<gNOutputs; i++)
+      {
+         for(j=i; j>0 && gOutputs[j].size > gOutputs[j-1].size; j--)
+         {
+            temp          = gOutputs[j];
+            gOutputs[j]   = gOutputs[j-1];
+            gOutputs[j-1] = temp;
+         }
+      }
+
+      screen[0] = gScreen[0];
+      screen[1] = gScreen[1];
+      for(i=0; i<gNOutputs; i++)
+      {
+         /* Fit the longer side to the size asked for, keeping the shape
+            of the image. Images are never enlarged
+         */
+         if(screen[0] >= screen[1])
+         {
+            width  = MIN(gOutputs[i].size, screen[0]);
+            height = (int)(((double)screen[1] * width) / screen[0] + 0.5);
+         }
+         else
+         {
+            height = MIN(gOutputs[i].size, screen[1]);
+            width  = (int)(((double)screen[0] * height) / screen[1] + 0.5);
+         }
+         if(width  < 1) width  = 1;
+         if(height < 1) height = 1;
+
+         if(!ShrinkImage(width, height))
+         {
+            fprintf(stderr, "No memory to shrink image for %s\n",
+                    gOutputs[i].file);
+            ok = FALSE;
+            break;
+         }
+         if(!WriteImage(gOutputs[i].file, gOutputs[i].format))
+         {
+            fprintf(stderr,"Unable to write image: %s\n", 
+                    gOutputs[i].file);
+            ok = FALSE;
+         }
+      }
+
+      /* Put the screen size back for the statistics                    */
+      gScreen[0] = screen[0];
+      gScreen[1] = screen[1];
+   }
+
+   /* Free memory for the framebuffer                                   */
+   if(sPixels   != NULL) free(sPixels);
+   if(sAlpha    != NULL) free(sAlpha);
+   if(sSphereID != NULL) free(sSphereID);
+   if(sDepth    != NULL) free(sDepth);
+   sPixels   = NULL;
+   sAlpha    = NULL;
+   sSphereID = NULL;
+   sDepth    = NULL;
+
+   return(ok);
+}
+
+
+/************************************************************************/
+/*>BOOL WriteImage(char *outFile, int outFormat)
+   ---------------------------------------------
+   Input:   char  *outFile     File to write (blank for stdout)
+            int   outFormat    Output format (-1 to write nothing)
+   Returns: BOOL               Success?
+
+   Write the framebuffer to a file.
+
+   19.10.26 Original (split from EndGraphics())    By: ACRM
+   19.10.26 Returns success
+*/
+BOOL WriteImage(char *outFile, int outFormat)
 {
-   /* Write the file in MTV format                                      */
    switch(outFormat)
    {
+   case (-1):
+      return(TRUE);
    case OUTPUT_MTV:
-      WriteMTVFile(outFile,gScreen[0],gScreen[1]);
-      break;
+      return(WriteMTVFile(outFile,gScreen[0],gScreen[1]));
+   case OUTPUT_PPM:
+   case OUTPUT_PAM:
+   case OUTPUT_RAW:
+   case OUTPUT_RGBA:
+      return(WriteRawImage(outFile,outFormat,gScreen[0],gScreen[1]));
+   case OUTPUT_Y4M:
+      return(WriteY4MFile(outFile,gScreen[0],gScreen[1]));
+   case OUTPUT_QOI:
+      return(WriteQOIFile(outFile,gScreen[0],gScreen[1]));
 #ifdef SUPPORT_PNG
    case OUTPUT_PNG:
-      WritePNGFile(outFile,gScreen[0],gScreen[1]);
-      break;
+      return(WritePNGFile(outFile,gScreen[0],gScreen[1]));
 #endif
    default:
       fprintf(stderr, "Error: Unknown output format! Using MTV");
-      WriteMTVFile(outFile,gScreen[0],gScreen[1]);
+      return(WriteMTVFile(outFile,gScreen[0],gScreen[1]));
    }
+}
 
-   /* Free memory for RGB arrays                                        */
-   if(sRed   != NULL) blFreeArray2D((char **)sRed,   
-                                  gScreen[0], gScreen[1]);
-   if(sGreen != NULL) blFreeArray2D((char **)sGreen, 
-                                  gScreen[0], gScreen[1]);
-   if(sBlue  != NULL) blFreeArray2D((char **)sBlue,  
-                                  gScreen[0], gScreen[1]);
-   
-   sRed   = NULL;
-   sGreen = NULL;
-   sBlue  = NULL;
+
+/************************************************************************/
+/*>BOOL ShrinkImage(int width, int height)
+   ---------------------------------------
+   Input:   int    width       New image width  (not more than gScreen[0])
+            int    height      New image height (not more than gScreen[1])
+   Returns: BOOL               Success? On failure the image is unchanged
+
+   Replace the image with a smaller copy, setting gScreen to the new 
+   size. Each source pixel goes to exactly one new pixel which is the
+   average of its block of source pixels (a box filter). The coverage
+   plane is shrunk the same way. The new framebuffer is linear.
+
+   19.10.26 Original    By: ACRM
+*/
+BOOL ShrinkImage(int width, int height)
+{
+   unsigned char *pixels  = NULL,
+                 *alpha   = NULL,
+                 *rgbBuff = NULL,
+                 *aBuff   = NULL,
+                 *rgb,
+                 *a;
+   unsigned long *sum     = NULL,
+                 *s,
+                 npixels,
+                 n;
+   int           *xmap    = NULL,
+                 *ncol    = NULL,
+                 nchan,
+                 x, y, ty, i,
+                 nrows;
+   BOOL          ok       = FALSE;
+
+   if((width == gScreen[0]) && (height == gScreen[1]))
+      return(TRUE);
+
+   nchan   = (sAlpha != NULL) ? 4 : 3;
+   npixels = (unsigned long)width * (unsigned long)height;
+
+   if(((pixels  = (unsigned char *)malloc(3 * npixels)) == NULL)        ||
+      ((sAlpha != NULL) &&
+       ((alpha  = (unsigned char *)malloc(npixels)) == NULL))           ||
+      ((rgbBuff = (unsigned char *)malloc(3 * (size_t)gScreen[0])) 
+       == NULL)                                                         ||
+      ((aBuff   = (unsigned char *)malloc((size_t)gScreen[0])) == NULL) ||
+      ((sum     = (unsigned long *)calloc((size_t)nchan * width,
+                                          sizeof(unsigned long))) 
+       == NULL)                                                         ||
+      ((xmap    = (int *)malloc(gScreen[0] * sizeof(int))) == NULL)     ||
+      ((ncol    = (int *)calloc(width, sizeof(int))) == NULL))
+      goto cleanup;
+
+   /* Which new column each source column goes to                       */
+   for(x=0; x<gScreen[0]; x++)
+   {
+      xmap[x] = (int)(((unsigned long)x * width) / gScreen[0]);
+      ncol[xmap[x]]++;
+   }
+
+   /* Add up the source rows for each new row, then average them        */
+   for(y=0, ty=0, nrows=0; y<gScreen[1]; y++)
+   {
+      rgb = GetRGBRow(y, rgbBuff);
+      a   = GetAlphaRow(y, aBuff);
+      for(x=0; x<gScreen[0]; x++)
+      {
+         s     = sum + nchan * xmap[x];
+         s[0] += rgb[3*x];
+         s[1] += rgb[3*x+1];
+         s[2] += rgb[3*x+2];
+         if(a != NULL)
+            s[3] += a[x];
+      }
+      nrows++;
+
+      if((unsigned long)(y+1) * height / gScreen[1] != (unsigned long)ty)
+      {
+         for(x=0; x<width; x++)
+         {
+            s = sum + nchan * x;
+            n = (unsigned long)ncol[x] * nrows;
+            for(i=0; i<3; i++)
+               pixels[3*((unsigned long)ty*width + x) + i] = 
+                  (unsigned char)((s[i] + n/2) / n);
+            if(alpha != NULL)
+               alpha[(unsigned long)ty*width + x] = 
+                  (unsigned char)((s[3] + n/2) / n);
+            for(i=0; i<nchan; i++)
+               s[i] = 0;
+         }
+         ty++;
+         nrows = 0;
+      }
+   }
+
+   /* Swap in the new image                                             */
+   free(sPixels);
+   if(sAlpha != NULL) free(sAlpha);
+   sPixels    = pixels;
+   sAlpha     = alpha;
+   pixels     = alpha = NULL;
+   sLayout    = FB_LINEAR;
+   sBandTop   = 0;
+   sBandRows  = sBandSize = height;
+   sNPixels   = npixels;
+   gScreen[0] = width;
+   gScreen[1] = height;
+   ok         = TRUE;
+
+cleanup:
+   if(pixels  != NULL) free(pixels);
+   if(alpha   != NULL) free(alpha);
+   if(rgbBuff != NULL) free(rgbBuff);
+   if(aBuff   != NULL) free(aBuff);
+   if(sum     != NULL) free(sum);
+   if(xmap    != NULL) free(xmap);
+   if(ncol    != NULL) free(ncol);
+
+   return(ok);
 }
 
 
@@ -201,27 +660,189 @@ void EndGraphics(char *outFile, int outFormat)
    29.07.93 Added centering
    12.08.93 Modified for screen size spec
    19.10.07 Checks that pixels are in range
+   19.10.26 Writes into the packed framebuffer. Sets coverage
+   19.10.26 Offsets and checks use the render area, gRender. Ignores 
+            pixels outside the current band
+   19.10.26 The image may be a window on the render area starting at
+            gOrigin
 */
 void SetPixel(int x0, int y0, REAL r, REAL g, REAL b)
 {
-   int temp;
+   if((x0 >= 0) && (x0 < gRender[0]) &&
+      (y0 >= 0) && (y0 < gRender[1]))
+   {
+      x0 -= gOrigin[0];
+      y0  = gRender[1] - y0 - 1 - gOrigin[1];
+
+      if((x0 >= 0) && (x0 < gScreen[0]) &&
+         (y0 >= sBandTop) && (y0 < sBandTop + sBandRows))
+      {
+         SetAbsPixel(x0, y0, r, g, b);
+         if(sAlpha != NULL)
+            sAlpha[PIXINDEX(x0, y0)] = 255;
+      }
+   }
+}
+
+
+/************************************************************************/
+/*>void SetPixelSphere(int x0, int y0, int id, REAL z)
+   ---------------------------------------------------
+   Input:   int    x0, y0      Pixel (as for SetPixel())
+            int    id          Atom number of the front sphere
+            REAL   z           Depth of its surface
 
-   if((x0 >= 0) && (x0 < gScreen[0]) &&
-      (y0 >= 0) && (y0 < gScreen[1]))
+   Records the front sphere at a pixel in the front sphere and depth 
+   planes, if they are in use.
+
+   19.10.26 Original    By: ACRM
+   19.10.26 Depth plane is optional
+   19.10.26 Front sphere plane is optional
+*/
+void SetPixelSphere(int x0, int y0, int id, REAL z)
+{
+   unsigned long idx;
+   
+   if(((sSphereID != NULL) || (sDepth != NULL)) &&
+      (x0 >= 0) && (x0 < gRender[0]) &&
+      (y0 >= 0) && (y0 < gRender[1]))
    {
-      x0 += (gScreen[0]-gSize)/2;
-      y0 += (gScreen[1]-gSize)/2;
-      
-      y0 = gScreen[1] - y0 - 1;
-      
-      temp = (int)(256.0 * r + 0.5);
-      sRed[x0][y0]   = (temp > 255) ? 255 : temp;
-      
-      temp = (int)(256.0 * g + 0.5);
-      sGreen[x0][y0] = (temp > 255) ? 255 : temp;
-      
-      temp = (int)(256.0 * b + 0.5);
-      sBlue[x0][y0]  = (temp > 255) ? 255 : temp;
+      x0 -= gOrigin[0];
+      y0  = gRender[1] - y0 - 1 - gOrigin[1];
+
+      if((x0 >= 0) && (x0 < gScreen[0]) &&
+         (y0 >= sBandTop) && (y0 < sBandTop + sBandRows))
+      {
+         idx = PIXINDEX(x0, y0);
+         if(sSphereID != NULL)
+            sSphereID[idx] = id;
+         if(sDepth != NULL)
+            sDepth[idx] = z;
+      }
+   }
+}
+
+
+/************************************************************************/
+/*>void SetPixelDepth(int x0, int y0, REAL z)
+   ------------------------------------------
+   Input:   int    x0, y0      Pixel (as for SetPixel())
+            REAL   z           Depth
+
+   Records the depth of a pixel with no front sphere, but which is 
+   partly covered by the edge of one, if the depth plane is in use.
+
+   19.10.26 Original    By: ACRM
+*/
+void SetPixelDepth(int x0, int y0, REAL z)
+{
+   if((sDepth != NULL) &&
+      (x0 >= 0) && (x0 < gRender[0]) &&
+      (y0 >= 0) && (y0 < gRender[1]))
+   {
+      x0 -= gOrigin[0];
+      y0  = gRender[1] - y0 - 1 - gOrigin[1];
+
+      if((x0 >= 0) && (x0 < gScreen[0]) &&
+         (y0 >= sBandTop) && (y0 < sBandTop + sBandRows))
+      {
+         sDepth[PIXINDEX(x0, y0)] = z;
+      }
+   }
+}
+
+
+/************************************************************************/
+/*>void BlendPixel(int x0, int y0, REAL r, REAL g, REAL b, REAL cover)
+   -------------------------------------------------------------------
+   Input:   int    x0, y0      Pixel (as for SetPixel())
+            REAL   r, g, b     Colour
+            REAL   cover       Fraction of the pixel covered (0.0-1.0)
+
+   As SetPixel(), but mixes the colour with what is already there (the
+   background) in proportion to cover, which also becomes the coverage
+   (alpha) of the pixel.
+
+   19.10.26 Original    By: ACRM
+*/
+void BlendPixel(int x0, int y0, REAL r, REAL g, REAL b, REAL cover)
+{
+   unsigned char *pixel;
+   REAL          colour[3];
+   int           i, temp;
+
+   if((x0 >= 0) && (x0 < gRender[0]) &&
+      (y0 >= 0) && (y0 < gRender[1]))
+   {
+      x0 -= gOrigin[0];
+      y0  = gRender[1] - y0 - 1 - gOrigin[1];
+
+      if((x0 >= 0) && (x0 < gScreen[0]) &&
+         (y0 >= sBandTop) && (y0 < sBandTop + sBandRows))
+      {
+         colour[0] = r;
+         colour[1] = g;
+         colour[2] = b;
+         pixel     = sPixels + 3 * PIXINDEX(x0, y0);
+         for(i=0; i<3; i++)
+         {
+            temp = (int)(256.0 * colour[i] + 0.5);
+            if(temp > 255) temp = 255;
+            pixel[i] = (unsigned char)(cover * temp + 
+                                       (1.0 - cover) * pixel[i] + 0.5);
+         }
+         if(sAlpha != NULL)
+            sAlpha[PIXINDEX(x0, y0)] = (unsigned char)(255.0 * cover + 
+                                                       0.5);
+      }
+   }
+}
+
+
+/************************************************************************/
+/*>void SpreadPixel(int xc, int yc, int x0, int y0, int x1, int y1)
+   ----------------------------------------------------------------
+   Input:   int    xc,yc       Pixel to copy (render area coordinates)
+            int    x0,y0       Bottom left of block (inclusive)
+            int    x1,y1       Top right of block (exclusive)
+
+   Copies the colour and coverage of one pixel over a block of pixels.
+   Used to make preview images. Coordinates are as for SetPixel() and
+   the parts of the block outside the image or band are ignored.
+
+   19.10.26 Original    By: ACRM
+*/
+void SpreadPixel(int xc, int yc, int x0, int y0, int x1, int y1)
+{
+   unsigned char *from;
+   unsigned long idx;
+   int           x, y, sy;
+
+   xc -= gOrigin[0];
+   yc  = gRender[1] - yc - 1 - gOrigin[1];
+   if((xc < 0) || (xc >= gScreen[0]) ||
+      (yc < sBandTop) || (yc >= sBandTop + sBandRows))
+      return;
+   from = sPixels + 3 * PIXINDEX(xc, yc);
+
+   for(y=y0; y<y1; y++)
+   {
+      sy = gRender[1] - y - 1 - gOrigin[1];
+      if((sy < sBandTop) || (sy >= sBandTop + sBandRows))
+         continue;
+
+      for(x=x0-gOrigin[0]; x<x1-gOrigin[0]; x++)
+      {
+         if((x < 0) || (x >= gScreen[0]))
+            continue;
+
+         idx = PIXINDEX(x, sy);
+         sPixels[3*idx]   = from[0];
+         sPixels[3*idx+1] = from[1];
+         sPixels[3*idx+2] = from[2];
+         if(sAlpha != NULL)
+            sAlpha[idx] = sAlpha[PIXINDEX(xc, yc)];
+      }
    }
 }
 
@@ -235,65 +856,472 @@ void SetPixel(int x0, int y0, REAL r, REAL g, REAL b)
 
    29.07.93 Original based on SetPixel()     By: ACRM
    12.08.93 Modified for screen size spec
+   19.10.26 Writes into the packed framebuffer
 */
 void SetAbsPixel(int x0, int y0, REAL r, REAL g, REAL b)
 {
-   int temp;
+   unsigned char *pixel;
+   int           temp;
 
+   pixel = sPixels + 3 * PIXINDEX(x0, y0);
 
    temp = (int)(256.0 * r + 0.5);
-   sRed[x0][y0]   = (temp > 255) ? 255 : temp;
+   pixel[0] = (temp > 255) ? 255 : temp;
    
    temp = (int)(256.0 * g + 0.5);
-   sGreen[x0][y0] = (temp > 255) ? 255 : temp;
+   pixel[1] = (temp > 255) ? 255 : temp;
    
    temp = (int)(256.0 * b + 0.5);
-   sBlue[x0][y0]  = (temp > 255) ? 255 : temp;
+   pixel[2] = (temp > 255) ? 255 : temp;
 }
 
+
 /************************************************************************/
-/*>BOOL WriteMTVFile(char *FileName, int xsize, int ysize)
-   -------------------------------------------------------
-   Write a graphics file in MTV format
-   29.07.93 Original    By: ACRM
-   12.08.93 Added check on arrays
-   28.03.95 Modified for output on stdout if blank filename
+/*>static void FillBackground(void)
+   --------------------------------
+   Colour the rows of the screen which are currently held with the
+   background shading.
+
+   29.07.93 Original (as DoBackground() in commands.c)    By: ACRM
+   19.10.26 Moved here and only fills the rows held
+   19.10.26 Shading runs over the whole frame, not just the window
+   19.10.26 Colour from BackgroundColour()
 */
-BOOL WriteMTVFile(char *FileName, int xsize, int ysize)
+static void FillBackground(void)
 {
-   FILE  *fp;
    int   x, y;
+   REAL  rgb[3];
+   
+   for(y=sBandTop; y<sBandTop+sBandRows; y++)
+   {
+      BackgroundColour(y, rgb);
+      for(x=0; x<gScreen[0]; x++)
+         SetAbsPixel(x,y,rgb[0],rgb[1],rgb[2]);
+   }
+}
 
 
-   if(sRed==NULL || sGreen == NULL || sBlue==NULL) 
-      return(FALSE);
+/************************************************************************/
+/*>static void BackgroundColour(int y, REAL *rgb)
+   ----------------------------------------------
+   Input:   int   y          Row of the image
+   Output:  REAL  *rgb       Background colour of that row
 
-   if(FileName[0])
-      fp = fopen(FileName,"w");
-   else
-      fp = stdout;
+   19.10.26 Original (split from FillBackground())    By: ACRM
+*/
+static void BackgroundColour(int y, REAL *rgb)
+{
+   int i, 
+       fy = y + gOrigin[1];          /* Row of the full frame            */
 
-   if(fp != NULL)
+   for(i=0; i<3; i++)
    {
-      /* Header                                                         */
-      fprintf(fp,"%d %d\n",xsize,ysize);
-      
-      /* And the graphics                                               */
-      for(y=0; y<ysize; y++)
+      rgb[i] = sDoBackground ? 
+               sBackground[i] + fy * (sBackground[i+3]-sBackground[i]) /
+                                gRender[1] : 
+               0.0;
+   }
+}
+
+
+/************************************************************************/
+/*>void SetBackground(REAL r1, REAL g1, REAL b1, 
+                      REAL r2, REAL g2, REAL b2)
+   ---------------------------------------------
+   Input:   REAL  r1,g1,b1     Colour at the top of the screen
+            REAL  r2,g2,b2     Colour at the bottom of the screen
+
+   Set the background shading and colour in the rows currently held.
+   With banded rendering, it is redrawn by SetBand() for each band.
+
+   19.10.26 Original    By: ACRM
+*/
+void SetBackground(REAL r1, REAL g1, REAL b1, REAL r2, REAL g2, REAL b2)
+{
+   sBackground[0] = r1;
+   sBackground[1] = g1;
+   sBackground[2] = b1;
+   sBackground[3] = r2;
+   sBackground[4] = g2;
+   sBackground[5] = b2;
+   sDoBackground  = TRUE;
+
+   if(sPixels != NULL)
+      FillBackground();
+}
+
+
+/************************************************************************/
+/*>void SetBand(int top)
+   ---------------------
+   Input:   int   top          First screen row of the band
+
+   Start a new band when rendering in bands. The framebuffer is cleared
+   to hold rows top to top+gBandRows-1 (or to the bottom of the screen)
+   and the background is drawn.
+
+   19.10.26 Original    By: ACRM
+*/
+void SetBand(int top)
+{
+   sBandTop  = top;
+   sBandRows = gScreen[1] - top;
+   if(sBandRows > sBandSize)
+      sBandRows = sBandSize;
+
+   memset(sPixels, 0, 3 * sNPixels);
+   if(sAlpha != NULL)
+      memset(sAlpha, 0, sNPixels);
+   ClearSpherePlanes();
+
+   if(sDoBackground)
+      FillBackground();
+}
+
+
+/************************************************************************/
+/*>unsigned char *GetRGBRow(int y, unsigned char *buffer)
+   ------------------------------------------------------
+   Input:   int            y         Row (0 is the top of the image)
+            unsigned char  *buffer   Space for one row of packed RGB
+   Returns: unsigned char  *         The row of packed RGB
+
+   Obtain a row of the image for output. With the linear layout this
+   is simply a pointer into the framebuffer and buffer is not touched.
+   With the Morton layout the row is de-swizzled into buffer.
+
+   19.10.26 Original    By: ACRM
+*/
+unsigned char *GetRGBRow(int y, unsigned char *buffer)
+{
+   return(DeswizzleRow(sPixels, 3, y, buffer));
+}
+
+
+/************************************************************************/
+/*>unsigned char *GetAlphaRow(int y, unsigned char *buffer)
+   --------------------------------------------------------
+   Input:   int            y         Row (0 is the top of the image)
+            unsigned char  *buffer   Space for one row of coverage
+   Returns: unsigned char  *         The row of coverage values or NULL
+                                     if no coverage plane was allocated
+
+   As GetRGBRow(), but for the coverage (alpha) plane. Pixels covered by
+   the molecule are 255, background pixels are 0.
+
+   19.10.26 Original    By: ACRM
+*/
+unsigned char *GetAlphaRow(int y, unsigned char *buffer)
+{
+   if(sAlpha == NULL)
+      return(NULL);
+   return(DeswizzleRow(sAlpha, 1, y, buffer));
+}
+
+
+/************************************************************************/
+/*>int *GetSphereIDRow(int y, int *buffer)
+   ---------------------------------------
+   Input:   int    y           Row (0 is the top of the image)
+            int    *buffer     Space for one row of sphere IDs
+   Returns: int    *           The row or NULL if there is no front 
+                               sphere plane
+
+   As GetRGBRow(), but for the front sphere plane. Each pixel holds the
+   atom number (SPHERE.atom) of the front sphere or -1 for background.
+
+   19.10.26 Original    By: ACRM
+*/
+int *GetSphereIDRow(int y, int *buffer)
+{
+   if(sSphereID == NULL)
+      return(NULL);
+   return((int *)DeswizzleRow((unsigned char *)sSphereID, sizeof(int), 
+                              y, (unsigned char *)buffer));
+}
+
+
+/************************************************************************/
+/*>double *GetDepthRow(int y, double *buffer)
+   ------------------------------------------
+   Input:   int    y           Row (0 is the top of the image)
+            double *buffer     Space for one row of depths
+   Returns: double *           The row or NULL if there is no depth plane
+
+   As GetRGBRow(), but for the depth plane. Each pixel holds the z of
+   the surface of the front sphere (larger is nearer).
+
+   19.10.26 Original    By: ACRM
+*/
+double *GetDepthRow(int y, double *buffer)
+{
+   if(sDepth == NULL)
+      return(NULL);
+   return((double *)DeswizzleRow((unsigned char *)sDepth, 
+                                 sizeof(double), y, 
+                                 (unsigned char *)buffer));
+}
+
+
+/************************************************************************/
+/*>void MergeLayerRow(int y, int x0, int x1, unsigned char *rgba, 
+                       float *depth)
+   -------------------------------------------------------------
+   Input:   int            y        Row (0 is the top of the image)
+            int            x0, x1   Pixels to merge (x1 exclusive)
+            unsigned char  *rgba    A row of a layer rendered separately
+                                    (RGB and coverage)
+            float          *depth   Depth of each pixel of the layer
+
+   Merges a row of another layer into the image by depth. At each pixel
+   whichever of the image and the layer is nearer is laid over the 
+   other according to its coverage. Where the molecule only partly 
+   covers a pixel it has already been mixed with the background, so
+   the background is taken out of what shows through. The depth plane
+   becomes that of the merged image. The depth plane must be in use.
+
+   19.10.26 Original    By: ACRM
+   19.10.26 Added x0 and x1 to merge part of a row
+*/
+void MergeLayerRow(int y, int x0, int x1, unsigned char *rgba, 
+                   float *depth)
+{
+   unsigned char *pixel,
+                 bg[3];
+   unsigned long idx;
+   REAL          rgb[3];
+   int           x, i,
+                 cover,           /* Coverage in the image              */
+                 temp;
+   double        part;            /* Part of the back one showing       */
+
+   if((sDepth == NULL) || (y < sBandTop) || (y >= sBandTop + sBandRows))
+      return;
+
+   BackgroundColour(y, rgb);
+   for(i=0; i<3; i++)
+   {
+      temp  = (int)(256.0 * rgb[i] + 0.5);
+      bg[i] = (temp > 255) ? 255 : temp;
+   }
+
+   if(x0 < 0)          x0 = 0;
+   if(x1 > gScreen[0]) x1 = gScreen[0];
+   
+   for(x=x0, rgba+=4*x0; x<x1; x++, rgba+=4)
+   {
+      if(rgba[3] == 0)
+         continue;
+
+      idx   = PIXINDEX(x, y);
+      pixel = sPixels + 3 * idx;
+      if(sAlpha != NULL)
+         cover = sAlpha[idx];
+      else
+         cover = (sDepth[idx] > DEPTH_BACKGROUND) ? 255 : 0;
+
+      if((double)depth[x] > sDepth[idx])
       {
-         for(x=0; x<xsize; x++)
+         /* The layer is in front                                       */
+         part = (255 - rgba[3]) / 255.0;
+         for(i=0; i<3; i++)
          {
-            fputc((int)sRed[x][y],   fp);
-            fputc((int)sGreen[x][y], fp);
-            fputc((int)sBlue[x][y],  fp);
+            temp     = (int)floor(rgba[i] + part * (pixel[i] - bg[i]) + 
+                                  0.5);
+            pixel[i] = (unsigned char)MAX(0, MIN(temp, 255));
          }
+         cover       = rgba[3] + (int)(part * cover + 0.5);
+         sDepth[idx] = (double)depth[x];
       }
-      
-      fclose(fp);
-      return(TRUE);
+      else
+      {
+         /* The image is in front                                       */
+         part = (255 - cover) / 255.0;
+         for(i=0; i<3; i++)
+         {
+            temp     = (int)floor(pixel[i] + part * (rgba[i] - bg[i]) + 
+                                  0.5);
+            pixel[i] = (unsigned char)MAX(0, MIN(temp, 255));
+         }
+         if(cover == 0)
+            sDepth[idx] = (double)depth[x];
+         cover      += (int)(part * rgba[3] + 0.5);
+      }
+
+      if(sAlpha != NULL)
+         sAlpha[idx] = (unsigned char)MIN(cover, 255);
    }
-   
-   return(FALSE);
+}
+
+
+/************************************************************************/
+/*>void PutLayerRow(int y, int x0, int x1, unsigned char *rgba, 
+                    float *depth)
+   -----------------------------------------------------------
+   Input:   int            y        Row (0 is the top of the image)
+            int            x0, x1   Pixels to copy (x1 exclusive)
+            unsigned char  *rgba    A row of RGB and coverage
+            float          *depth   Depth of each pixel
+
+   Copies part of a row saved from GetRGBRow(), GetAlphaRow() and 
+   GetDepthRow() back into the image, replacing what is there.
+
+   19.10.26 Original    By: ACRM
+*/
+void PutLayerRow(int y, int x0, int x1, unsigned char *rgba, 
+                 float *depth)
+{
+   unsigned char *pixel;
+   unsigned long idx;
+   int           x;
+
+   if((y < sBandTop) || (y >= sBandTop + sBandRows))
+      return;
+   if(x0 < 0)          x0 = 0;
+   if(x1 > gScreen[0]) x1 = gScreen[0];
+
+   for(x=x0, rgba+=4*x0; x<x1; x++, rgba+=4)
+   {
+      idx      = PIXINDEX(x, y);
+      pixel    = sPixels + 3 * idx;
+      pixel[0] = rgba[0];
+      pixel[1] = rgba[1];
+      pixel[2] = rgba[2];
+      if(sAlpha != NULL)
+         sAlpha[idx] = rgba[3];
+      if(sDepth != NULL)
+         sDepth[idx] = (depth[x] > DEPTH_BACKGROUND) ? 
+                       (double)depth[x] : DEPTH_BACKGROUND;
+   }
+}
+
+
+/************************************************************************/
+/*>void ClearRegion(int x0, int y0, int x1, int y1)
+   ------------------------------------------------
+   Input:   int    x0, y0      Top left of the region (screen coords)
+            int    x1, y1      Bottom right (exclusive)
+
+   Clears a rectangle of the image back to the background, as SetBand()
+   does for the whole band.
+
+   19.10.26 Original    By: ACRM
+*/
+void ClearRegion(int x0, int y0, int x1, int y1)
+{
+   unsigned long idx;
+   int           x, y;
+   REAL          rgb[3];
+
+   if(x0 < 0)                     x0 = 0;
+   if(y0 < sBandTop)              y0 = sBandTop;
+   if(x1 > gScreen[0])            x1 = gScreen[0];
+   if(y1 > sBandTop + sBandRows)  y1 = sBandTop + sBandRows;
+
+   for(y=y0; y<y1; y++)
+   {
+      BackgroundColour(y, rgb);
+      for(x=x0; x<x1; x++)
+      {
+         SetAbsPixel(x, y, rgb[0], rgb[1], rgb[2]);
+         idx = PIXINDEX(x, y);
+         if(sAlpha != NULL)
+            sAlpha[idx]    = 0;
+         if(sSphereID != NULL)
+            sSphereID[idx] = (-1);
+         if(sDepth != NULL)
+            sDepth[idx]    = DEPTH_BACKGROUND;
+      }
+   }
+}
+
+
+/************************************************************************/
+/*>BOOL FramebufferIsLinear(void)
+   ------------------------------
+   Returns: BOOL          Is the framebuffer a single row-major block?
+
+   19.10.26 Original    By: ACRM
+*/
+BOOL FramebufferIsLinear(void)
+{
+   return((sPixels != NULL) && (sLayout != FB_MORTON));
+}
+
+
+/************************************************************************/
+/*>BOOL WriteFramebuffer(int fd)
+   -----------------------------
+   Input:   int    fd          File descriptor (normally a pipe)
+   Returns: BOOL               Success?
+
+   Write the colour and coverage planes exactly as they are held, for 
+   another process with the same framebuffer to take with 
+   ReadFramebuffer().
+
+   19.10.26 Original    By: ACRM
+*/
+BOOL WriteFramebuffer(int fd)
+{
+   struct iovec iov[2];
+   int          niov = 0;
+
+   if(sPixels == NULL)
+      return(FALSE);
+
+   iov[niov].iov_base = (char *)sPixels;
+   iov[niov].iov_len  = 3 * sNPixels;
+   niov++;
+   if(sAlpha != NULL)
+   {
+      iov[niov].iov_base = (char *)sAlpha;
+      iov[niov].iov_len  = sNPixels;
+      niov++;
+   }
+
+   return(WriteVector(fd, iov, niov));
+}
+
+
+/************************************************************************/
+/*>BOOL ReadFramebuffer(int fd)
+   ----------------------------
+   Input:   int    fd          File descriptor (normally a pipe)
+   Returns: BOOL               Success?
+
+   Read the colour and coverage planes written by WriteFramebuffer()
+   into this framebuffer. The framebuffers must have been set up in the
+   same way, as they are when one process is forked from the other.
+
+   19.10.26 Original    By: ACRM
+*/
+BOOL ReadFramebuffer(int fd)
+{
+   if(sPixels == NULL)
+      return(FALSE);
+
+   if(!ReadBlock(fd, sPixels, 3 * sNPixels))
+      return(FALSE);
+   if((sAlpha != NULL) && !ReadBlock(fd, sAlpha, sNPixels))
+      return(FALSE);
+
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>BOOL WriteMTVFile(char *FileName, int xsize, int ysize)
+   -------------------------------------------------------
+   Write a graphics file in MTV format
+   29.07.93 Original    By: ACRM
+   12.08.93 Added check on arrays
+   28.03.95 Modified for output on stdout if blank filename
+   19.10.26 Now simply a raw image with a size header so uses the bulk
+            writer
+*/
+BOOL WriteMTVFile(char *FileName, int xsize, int ysize)
+{
+   return(WriteRawImage(FileName, OUTPUT_MTV, xsize, ysize));
 }
 
 
@@ -305,47 +1333,31 @@ BOOL WriteMTVFile(char *FileName, int xsize, int ysize)
    Write a graphics file in PNG format
 
    19.08.19 Original    By: ACRM
+   19.10.26 Streams rows from the framebuffer rather than building a 
+            copy of the image. Uses gPNGOptions
+   19.10.26 Compresses on gNThreads threads
 */
 BOOL WritePNGFile(char *FileName, int xsize, int ysize)
 {
-   int   x, y;
-   blPNGIMAGE image;
-   BOOL retval = TRUE;
-   
-   if(sRed==NULL || sGreen == NULL || sBlue==NULL) 
+   if(sPixels==NULL) 
       return(FALSE);
 
-   image.width  = xsize;
-   image.height = ysize;
-   if((image.pixels = (blPNGPIXEL *)calloc(xsize*ysize,
-                                           sizeof(blPNGPIXEL)))==NULL)
-   {
-      return(FALSE);
-   }
-   
-   /* Copy the image over into the blPNGIMAGE bitmap                     */
-   for(y=0; y<ysize; y++)
-   {
-      for(x=0; x<xsize; x++)
-      {
-         blPNGPIXEL *pixel = blPNGPixelAt(&image, x, y);
+   /* GetRGBRow() only reads the framebuffer so may be used by the 
+      parallel encoder
+   */
+   gPNGOptions.threads = gNThreads;
 
-         pixel->red   = (int)sRed[x][y];
-         pixel->green = (int)sGreen[x][y];
-         pixel->blue  = (int)sBlue[x][y];
-      }
-   }
-
-   /* Write the image to the file or stdout if FileName is a NULL string */
-   if(!blSavePNGToFile(&image, FileName)) 
+   /* Stream the rows from the framebuffer to the file or stdout if 
+      FileName is a NULL string 
+   */
+   if(!blSavePNGRowsToFile(GetRGBRow, xsize, ysize, FileName, 
+                           &gPNGOptions))
    {
       fprintf(stderr, "Error writing file.\n");
-      retval = FALSE;
+      return(FALSE);
    }
    
-   free(image.pixels);
-   
-   return(retval);
+   return(TRUE);
 }
 
 #endif
@@ -1,10 +1,48 @@
-BOOL InitGraphics(void)
+BOOL InitGraphics(int auxBuffers)
 ;
-void EndGraphics(char *outFile, int outFormat)
+BOOL EndGraphics(char *outFile, int outFormat)
+;
+BOOL WriteImage(char *outFile, int outFormat)
+;
+BOOL ShrinkImage(int width, int height)
 ;
 void SetPixel(int x0, int y0, REAL r, REAL g, REAL b)
 ;
+void SetPixelSphere(int x0, int y0, int id, REAL z)
+;
+void SetPixelDepth(int x0, int y0, REAL z)
+;
+void BlendPixel(int x0, int y0, REAL r, REAL g, REAL b, REAL cover)
+;
+void SpreadPixel(int xc, int yc, int x0, int y0, int x1, int y1)
+;
 void SetAbsPixel(int x0, int y0, REAL r, REAL g, REAL b)
 ;
+unsigned char *GetRGBRow(int y, unsigned char *buffer)
+;
+unsigned char *GetAlphaRow(int y, unsigned char *buffer)
+;
+int *GetSphereIDRow(int y, int *buffer)
+;
+double *GetDepthRow(int y, double *buffer)
+;
+void MergeLayerRow(int y, int x0, int x1, unsigned char *rgba, 
+                   float *depth)
+;
+void PutLayerRow(int y, int x0, int x1, unsigned char *rgba, 
+                 float *depth)
+;
+void ClearRegion(int x0, int y0, int x1, int y1)
+;
+BOOL FramebufferIsLinear(void)
+;
+BOOL WriteFramebuffer(int fd)
+;
+BOOL ReadFramebuffer(int fd)
+;
+void SetBackground(REAL r1, REAL g1, REAL b1, REAL r2, REAL g2, REAL b2)
+;
+void SetBand(int top)
+;
 BOOL WriteMTVFile(char *FileName, int xsize, int ysize);
 BOOL WritePNGFile(char *FileName, int xsize, int ysize);
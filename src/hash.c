@@ -0,0 +1,283 @@
+/*************************************************************************
+
+   Program:    QTree
+   File:       hash.c
+
+   Version:    V3.23
+   Date:       19.10.26
+   Function:   SHA-256 content hashes
+
+   Copyright:  (c) SciTech Software 2026
+   Author:     Prof. Andrew C. R. Martin
+   EMail:      andrew@bioinf.org.uk
+
+**************************************************************************
+
+   This program is not in the public domain.
+
+   It may not be copied or made available to third parties, but may be
+   freely used by non-profit-making organisations who have obtained it
+   directly from the author or by FTP.
+
+   You are requested to send EMail to the author to say that you are
+   using this code so that you may be informed of future updates.
+
+   The code may not be made available on other FTP sites without express
+   permission from the author.
+
+   The code may be modified as required, but any modifications must be
+   documented so that the person responsible can be identified. If
+   someone else breaks this code, the author doesn't want to be blamed
+   for code that does not work! You may not distribute any
+   modifications, but are encouraged to send them to the author so
+   that they may be incorporated into future versions of the code.
+
+   The code may not be sold commercially or used for commercial purposes
+   without prior permission from the author.
+
+**************************************************************************
+
+   Description:
+   ============
+   Computes the SHA-256 hash (FIPS 180-4) of a stream of bytes, used
+   to name things by their content.
+
+**************************************************************************
+
+   Usage:
+   ======
+   InitHash() starts a hash, AddToHash() hashes bytes and EndHash()
+   gives the HASHSIZE bytes of the result. HashText() gives the result
+   as hex.
+
+**************************************************************************
+
+   Notes:
+   ======
+   The 32-bit words are kept in unsigned longs, masked to 32 bits, so
+   that nothing depends on the size of an int.
+
+**************************************************************************
+
+   Revision History:
+   =================
+   V3.23 19.10.26 Original
+
+*************************************************************************/
+/* Includes
+*/
+#include <stdio.h>
+#include <string.h>
+
+#include "bioplib/macros.h"
+#include "bioplib/MathType.h"
+#include "bioplib/SysDefs.h"
+
+#include "qtree.h"
+#include "hash.p"
+
+/************************************************************************/
+/* Defines and macros
+*/
+#define MASK32        0xffffffffUL
+#define ROTR(x,n)     ((((x) >> (n)) | ((x) << (32-(n)))) & MASK32)
+#define CH(x,y,z)     (((x) & (y)) ^ (~(x) & (z)))
+#define MAJ(x,y,z)    (((x) & (y)) ^ ((x) & (z)) ^ ((y) & (z)))
+#define BSIG0(x)      (ROTR(x,2)  ^ ROTR(x,13) ^ ROTR(x,22))
+#define BSIG1(x)      (ROTR(x,6)  ^ ROTR(x,11) ^ ROTR(x,25))
+#define SSIG0(x)      (ROTR(x,7)  ^ ROTR(x,18) ^ ((x) >> 3))
+#define SSIG1(x)      (ROTR(x,17) ^ ROTR(x,19) ^ ((x) >> 10))
+
+/************************************************************************/
+/* Variables global to this file only
+*/
+static const unsigned long sK[64] =
+{
+   0x428a2f98UL, 0x71374491UL, 0xb5c0fbcfUL, 0xe9b5dba5UL,
+   0x3956c25bUL, 0x59f111f1UL, 0x923f82a4UL, 0xab1c5ed5UL,
+   0xd807aa98UL, 0x12835b01UL, 0x243185beUL, 0x550c7dc3UL,
+   0x72be5d74UL, 0x80deb1feUL, 0x9bdc06a7UL, 0xc19bf174UL,
+   0xe49b69c1UL, 0xefbe4786UL, 0x0fc19dc6UL, 0x240ca1ccUL,
+   0x2de92c6fUL, 0x4a7484aaUL, 0x5cb0a9dcUL, 0x76f988daUL,
+   0x983e5152UL, 0xa831c66dUL, 0xb00327c8UL, 0xbf597fc7UL,
+   0xc6e00bf3UL, 0xd5a79147UL, 0x06ca6351UL, 0x14292967UL,
+   0x27b70a85UL, 0x2e1b2138UL, 0x4d2c6dfcUL, 0x53380d13UL,
+   0x650a7354UL, 0x766a0abbUL, 0x81c2c92eUL, 0x92722c85UL,
+   0xa2bfe8a1UL, 0xa81a664bUL, 0xc24b8b70UL, 0xc76c51a3UL,
+   0xd192e819UL, 0xd6990624UL, 0xf40e3585UL, 0x106aa070UL,
+   0x19a4c116UL, 0x1e376c08UL, 0x2748774cUL, 0x34b0bcb5UL,
+   0x391c0cb3UL, 0x4ed8aa4aUL, 0x5b9cca4fUL, 0x682e6ff3UL,
+   0x748f82eeUL, 0x78a5636fUL, 0x84c87814UL, 0x8cc70208UL,
+   0x90befffaUL, 0xa4506cebUL, 0xbef9a3f7UL, 0xc67178f2UL
+};
+
+/************************************************************************/
+/* Prototypes
+*/
+static void HashBlock(HASH *hash, const unsigned char *block);
+
+
+/************************************************************************/
+/*>void InitHash(HASH *hash)
+   -------------------------
+   Output:  HASH   *hash       A new hash
+
+   19.10.26 Original    By: ACRM
+*/
+void InitHash(HASH *hash)
+{
+   hash->state[0] = 0x6a09e667UL;
+   hash->state[1] = 0xbb67ae85UL;
+   hash->state[2] = 0x3c6ef372UL;
+   hash->state[3] = 0xa54ff53aUL;
+   hash->state[4] = 0x510e527fUL;
+   hash->state[5] = 0x9b05688cUL;
+   hash->state[6] = 0x1f83d9abUL;
+   hash->state[7] = 0x5be0cd19UL;
+   hash->nbits[0] = hash->nbits[1] = 0;
+   hash->nblock   = 0;
+}
+
+
+/************************************************************************/
+/*>void AddToHash(HASH *hash, const void *data, size_t nbytes)
+   -----------------------------------------------------------
+   I/O:     HASH   *hash       The hash
+   Input:   void   *data       Bytes to add
+            size_t nbytes      Number of bytes
+
+   19.10.26 Original    By: ACRM
+*/
+void AddToHash(HASH *hash, const void *data, size_t nbytes)
+{
+   const unsigned char *bytes = (const unsigned char *)data;
+   unsigned long       nbits;
+   size_t              n;
+
+   /* Count the bits, carrying into the high word                       */
+   nbits           = ((unsigned long)nbytes << 3) & MASK32;
+   hash->nbits[1] += (unsigned long)(nbytes >> 29);
+   hash->nbits[0]  = (hash->nbits[0] + nbits) & MASK32;
+   if(hash->nbits[0] < nbits)
+      hash->nbits[1]++;
+   hash->nbits[1] &= MASK32;
+
+   /* Finish a part block, hash whole blocks in place and keep the rest */
+   if(hash->nblock)
+   {
+      n = MIN(nbytes, (size_t)(64 - hash->nblock));
+      memcpy(hash->block + hash->nblock, bytes, n);
+      hash->nblock += n;
+      bytes        += n;
+      nbytes       -= n;
+      if(hash->nblock < 64)
+         return;
+      HashBlock(hash, hash->block);
+      hash->nblock = 0;
+   }
+   for(; nbytes >= 64; bytes += 64, nbytes -= 64)
+      HashBlock(hash, bytes);
+   if(nbytes)
+   {
+      memcpy(hash->block, bytes, nbytes);
+      hash->nblock = nbytes;
+   }
+}
+
+
+/************************************************************************/
+/*>void EndHash(HASH *hash, unsigned char *digest)
+   -----------------------------------------------
+   I/O:     HASH          *hash     The hash, which is finished
+   Output:  unsigned char *digest   HASHSIZE bytes of the result
+
+   19.10.26 Original    By: ACRM
+*/
+void EndHash(HASH *hash, unsigned char *digest)
+{
+   unsigned char length[8];
+   int           i;
+
+   /* The length as it was before the padding is added                  */
+   for(i=0; i<4; i++)
+   {
+      length[i]   = (unsigned char)(hash->nbits[1] >> (24 - 8*i));
+      length[i+4] = (unsigned char)(hash->nbits[0] >> (24 - 8*i));
+   }
+
+   /* A 1 bit, then 0s up to 8 bytes short of a block, then the length  */
+   AddToHash(hash, "\200", 1);
+   while(hash->nblock != 56)
+      AddToHash(hash, "", 1);
+   AddToHash(hash, length, 8);
+
+   for(i=0; i<HASHSIZE; i++)
+      digest[i] = (unsigned char)(hash->state[i/4] >> (24 - 8*(i%4)));
+}
+
+
+/************************************************************************/
+/*>void HashText(unsigned char *digest, char *text)
+   ------------------------------------------------
+   Input:   unsigned char *digest   HASHSIZE bytes from EndHash()
+   Output:  char          *text     2*HASHSIZE hex digits and a '\0'
+
+   19.10.26 Original    By: ACRM
+*/
+void HashText(unsigned char *digest, char *text)
+{
+   int i;
+
+   for(i=0; i<HASHSIZE; i++)
+      sprintf(text + 2*i, "%02x", digest[i]);
+}
+
+
+/************************************************************************/
+/*>static void HashBlock(HASH *hash, const unsigned char *block)
+   -------------------------------------------------------------
+   I/O:     HASH          *hash     The hash
+   Input:   unsigned char *block    64 bytes
+
+   The SHA-256 compression function.
+
+   19.10.26 Original    By: ACRM
+*/
+static void HashBlock(HASH *hash, const unsigned char *block)
+{
+   unsigned long w[64],
+                 v[8],
+                 t1, t2;
+   int           i;
+
+   for(i=0; i<16; i++)
+   {
+      w[i] = ((unsigned long)block[4*i]   << 24) |
+             ((unsigned long)block[4*i+1] << 16) |
+             ((unsigned long)block[4*i+2] <<  8) |
+              (unsigned long)block[4*i+3];
+   }
+   for(i=16; i<64; i++)
+      w[i] = (SSIG1(w[i-2]) + w[i-7] + SSIG0(w[i-15]) + w[i-16]) & MASK32;
+
+   for(i=0; i<8; i++)
+      v[i] = hash->state[i];
+
+   for(i=0; i<64; i++)
+   {
+      t1 = (v[7] + BSIG1(v[4]) + CH(v[4],v[5],v[6]) + sK[i] + w[i])
+           & MASK32;
+      t2 = (BSIG0(v[0]) + MAJ(v[0],v[1],v[2])) & MASK32;
+      v[7] = v[6];
+      v[6] = v[5];
+      v[5] = v[4];
+      v[4] = (v[3] + t1) & MASK32;
+      v[3] = v[2];
+      v[2] = v[1];
+      v[1] = v[0];
+      v[0] = (t1 + t2) & MASK32;
+   }
+
+   for(i=0; i<8; i++)
+      hash->state[i] = (hash->state[i] + v[i]) & MASK32;
+}
@@ -0,0 +1,8 @@
+void InitHash(HASH *hash)
+;
+void AddToHash(HASH *hash, const void *data, size_t nbytes)
+;
+void EndHash(HASH *hash, unsigned char *digest)
+;
+void HashText(unsigned char *digest, char *text)
+;
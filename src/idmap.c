@@ -0,0 +1,267 @@
+/*************************************************************************
+
+   Program:    QTree
+   File:       idmap.c   
+
+   Version:    V3.14
+   Date:       19.10.26
+   Function:   Write a map of the atom at each pixel for picking  
+
+   Copyright:  (c) SciTech Software 2026
+   Author:     Prof. Andrew C. R. Martin
+   EMail:      andrew@bioinf.org.uk
+
+**************************************************************************
+
+   This program is not in the public domain.
+
+   It may not be copied or made available to third parties, but may be
+   freely used by non-profit-making organisations who have obtained it
+   directly from the author or by FTP.
+
+   You are requested to send EMail to the author to say that you are
+   using this code so that you may be informed of future updates.
+
+   The code may not be made available on other FTP sites without express
+   permission from the author.
+
+   The code may be modified as required, but any modifications must be
+   documented so that the person responsible can be identified. If
+   someone else breaks this code, the author doesn't want to be blamed
+   for code that does not work! You may not distribute any
+   modifications, but are encouraged to send them to the author so
+   that they may be incorporated into future versions of the code.
+
+   The code may not be sold commercially or used for commercial purposes
+   without prior permission from the author.
+
+**************************************************************************
+
+   Description:
+   ============
+   Writes an atom ID map alongside the image, so that a viewer can find
+   the atom under the cursor with a single lookup, and a table giving 
+   the chain, residue and atom for each ID.
+
+**************************************************************************
+
+   Usage:
+   ======
+
+**************************************************************************
+
+   Notes:
+   ======
+   The map is an RGB PNG the same size as the image. Each pixel holds 
+   one more than the number of the front atom in the PDB file (counting
+   from zero) as a 24-bit number, most significant byte in red. 0 is
+   background. The map takes the front atom at the centre of each 
+   pixel, so it is not affected by anti-aliasing or highlight borders.
+   Long runs of the same value compress very well.
+
+   The table is tab-separated text with a header line, then one line
+   per atom in the PDB file giving the ID used in the map, the atom 
+   serial number, chain, residue number, insert code, residue name and
+   atom name. Blank chains and insert codes are left empty.
+
+**************************************************************************
+
+   Revision History:
+   =================
+   V3.14 19.10.26 Original
+
+*************************************************************************/
+/* Includes
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bioplib/macros.h"
+#include "bioplib/MathType.h"
+#include "bioplib/SysDefs.h"
+#include "bioplib/pdb.h"
+
+#include "qtree.h"
+#include "qtree.p"
+#include "graphics.p"
+#include "idmap.p"
+
+/************************************************************************/
+/* Defines
+*/
+#define MAXFIELD 16              /* Longest PDB field written           */
+
+/************************************************************************/
+/* Variables global to this file only
+*/
+#ifdef SUPPORT_PNG
+static int *sIDRow = NULL;       /* One row of the front sphere plane   */
+#endif
+
+/************************************************************************/
+/* Prototypes
+*/
+static char *Field(char *in, char *out);
+#ifdef SUPPORT_PNG
+static unsigned char *GetIDMapRow(int y, unsigned char *buffer);
+#endif
+
+
+/************************************************************************/
+/*>BOOL WriteAtomTable(char *file, PDB *pdb)
+   -----------------------------------------
+   Input:   char    *file       Table file to write
+            PDB     *pdb        The PDB linked list
+   Returns: BOOL                Success?
+
+   Write the table which maps the IDs in the atom ID map to the atoms 
+   in the PDB file. Must be called before the linked list is freed.
+
+   19.10.26 Original    By: ACRM
+*/
+BOOL WriteAtomTable(char *file, PDB *pdb)
+{
+   FILE *fp;
+   PDB  *p;
+   int  id;
+   char chain[MAXFIELD],
+        insert[MAXFIELD],
+        resnam[MAXFIELD],
+        atnam[MAXFIELD];
+   BOOL ok = TRUE;
+
+   if((fp = fopen(file, "w")) == NULL)
+   {
+      fprintf(stderr, "Unable to write atom table: %s\n", file);
+      return(FALSE);
+   }
+
+   fprintf(fp, "id\tatnum\tchain\tresnum\tinsert\tresnam\tatnam\n");
+   for(p=pdb, id=1; p!=NULL; NEXT(p), id++)
+   {
+      fprintf(fp, "%d\t%d\t%s\t%d\t%s\t%s\t%s\n", 
+              id, p->atnum, Field(p->chain, chain), p->resnum, 
+              Field(p->insert, insert), Field(p->resnam, resnam),
+              Field(p->atnam, atnam));
+   }
+
+   if(ferror(fp))
+      ok = FALSE;
+   if(fclose(fp) != 0)
+      ok = FALSE;
+   if(!ok)
+      fprintf(stderr, "Error writing atom table: %s\n", file);
+   return(ok);
+}
+
+
+/************************************************************************/
+/*>static char *Field(char *in, char *out)
+   ---------------------------------------
+   Input:   char   *in       A PDB text field
+   Output:  char   *out      The field without leading or trailing 
+                             spaces (at most MAXFIELD-1 characters)
+   Returns: char   *         out
+
+   19.10.26 Original    By: ACRM
+*/
+static char *Field(char *in, char *out)
+{
+   int len;
+   
+   while(*in == ' ')
+      in++;
+   strncpy(out, in, MAXFIELD-1);
+   out[MAXFIELD-1] = '\0';
+   
+   for(len=strlen(out); len>0 && out[len-1]==' '; len--)
+      out[len-1] = '\0';
+   
+   return(out);
+}
+
+
+#ifdef SUPPORT_PNG
+#include "writepng.h"
+/************************************************************************/
+/*>BOOL WriteAtomIDMap(char *file)
+   -------------------------------
+   Input:   char    *file       PNG file to write
+   Returns: BOOL                Success?
+
+   Write the front sphere plane of the framebuffer as an atom ID map.
+   InitGraphics() must have been called with AUX_ATOMID.
+
+   19.10.26 Original    By: ACRM
+*/
+BOOL WriteAtomIDMap(char *file)
+{
+   blPNGOPTIONS options;
+   BOOL         ok;
+   
+   if((sIDRow = (int *)malloc(gScreen[0] * sizeof(int))) == NULL)
+   {
+      fprintf(stderr, "No memory to write atom ID map.\n");
+      return(FALSE);
+   }
+
+   /* GetIDMapRow() shares sIDRow so the map is encoded on one thread   */
+   options         = gPNGOptions;
+   options.threads = 1;
+   
+   if(!(ok = blSavePNGRowsToFile(GetIDMapRow, gScreen[0], gScreen[1], 
+                                 file, &options)))
+      fprintf(stderr, "Error writing atom ID map: %s\n", file);
+
+   free(sIDRow);
+   sIDRow = NULL;
+   return(ok);
+}
+
+
+/************************************************************************/
+/*>static unsigned char *GetIDMapRow(int y, unsigned char *buffer)
+   ---------------------------------------------------------------
+   Input:   int            y         Row (0 is the top of the image)
+            unsigned char  *buffer   Space for one row of packed RGB
+   Returns: unsigned char  *         buffer
+
+   Row function for blSavePNGRowsToFile() which packs each atom number
+   (plus one, so background is 0) into 24 bits of RGB.
+
+   19.10.26 Original    By: ACRM
+*/
+static unsigned char *GetIDMapRow(int y, unsigned char *buffer)
+{
+   int           *ids,
+                 x;
+   unsigned long id;
+   unsigned char *out = buffer;
+   
+   if((ids = GetSphereIDRow(y, sIDRow)) == NULL)
+      return(NULL);
+   
+   for(x=0; x<gScreen[0]; x++)
+   {
+      id     = (unsigned long)(ids[x] + 1);
+      *out++ = (unsigned char)((id >> 16) & 0xFF);
+      *out++ = (unsigned char)((id >> 8)  & 0xFF);
+      *out++ = (unsigned char)(id & 0xFF);
+   }
+   return(buffer);
+}
+#else
+/************************************************************************/
+/*>BOOL WriteAtomIDMap(char *file)
+   -------------------------------
+   Atom ID maps are PNG files, so cannot be written without PNG support
+
+   19.10.26 Original    By: ACRM
+*/
+BOOL WriteAtomIDMap(char *file)
+{
+   fprintf(stderr, "Atom ID maps need PNG support.\n");
+   return(FALSE);
+}
+#endif
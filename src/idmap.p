@@ -0,0 +1,4 @@
+BOOL WriteAtomTable(char *file, PDB *pdb)
+;
+BOOL WriteAtomIDMap(char *file)
+;
@@ -0,0 +1,427 @@
+/*************************************************************************
+
+   Program:    QTree
+   File:       layers.c   
+
+   Version:    V3.17
+   Date:       19.10.26
+   Function:   Depth output and merging of separately rendered layers  
+
+   Copyright:  (c) SciTech Software 2026
+   Author:     Prof. Andrew C. R. Martin
+   EMail:      andrew@bioinf.org.uk
+
+**************************************************************************
+
+   This program is not in the public domain.
+
+   It may not be copied or made available to third parties, but may be
+   freely used by non-profit-making organisations who have obtained it
+   directly from the author or by FTP.
+
+   You are requested to send EMail to the author to say that you are
+   using this code so that you may be informed of future updates.
+
+   The code may not be made available on other FTP sites without express
+   permission from the author.
+
+   The code may be modified as required, but any modifications must be
+   documented so that the person responsible can be identified. If
+   someone else breaks this code, the author doesn't want to be blamed
+   for code that does not work! You may not distribute any
+   modifications, but are encouraged to send them to the author so
+   that they may be incorporated into future versions of the code.
+
+   The code may not be sold commercially or used for commercial purposes
+   without prior permission from the author.
+
+**************************************************************************
+
+   Description:
+   ============
+   Writes the depth of each pixel of the image and merges in layers
+   (an image and its depth) which were rendered separately, so that a
+   large part of a scene need only be rendered once.
+
+**************************************************************************
+
+   Usage:
+   ======
+
+**************************************************************************
+
+   Notes:
+   ======
+   Depths are written as a greyscale Portable Float Map (PFM): a text
+   header "Pf\n<width> <height>\n<scale>\n", where a negative scale 
+   means little-endian, followed by a float for each pixel with the 
+   rows running from the bottom of the image. The depth is the z of the
+   surface in pixels, relative to the centre of the molecule, with 
+   larger values nearer the viewer. Background is DEPTH_BACKGROUND.
+
+   A layer image must be a PAM with alpha (as written by -f pam) or a 
+   PPM. For a PPM, every pixel with a depth is taken to be fully 
+   covered. Layers are only comparable if they were placed in the 
+   same way, so each should be rendered with the same screen size and
+   the same BOUNDS (and CENTRE if used) in its control file. The same
+   background should also be used.
+
+**************************************************************************
+
+   Revision History:
+   =================
+   V3.16 19.10.26 Original
+   V3.17 19.10.26 MergeLayerRow() takes a span
+
+*************************************************************************/
+/* Includes
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "bioplib/macros.h"
+#include "bioplib/MathType.h"
+#include "bioplib/SysDefs.h"
+#include "bioplib/pdb.h"
+
+#include "qtree.h"
+#include "graphics.p"
+#include "layers.p"
+
+/************************************************************************/
+/* Defines
+*/
+#define MAXTOKEN 32              /* Longest header token                */
+
+/************************************************************************/
+/* Prototypes
+*/
+static BOOL LittleEndian(void);
+static BOOL ReadToken(FILE *fp, char *token);
+static BOOL ReadLayerImageHeader(FILE *fp, char *file, int *channels);
+static BOOL ReadDepthHeader(FILE *fp, char *file, BOOL *swap, 
+                            long *offset);
+static BOOL MergeLayer(char *imageFile, char *depthFile);
+
+
+/************************************************************************/
+/*>BOOL WriteDepthFile(char *file)
+   -------------------------------
+   Input:   char    *file       PFM file to write
+   Returns: BOOL                Success?
+
+   Write the depth plane of the framebuffer. InitGraphics() must have 
+   been called with AUX_DEPTH or AUX_GBUFFER.
+
+   19.10.26 Original    By: ACRM
+*/
+BOOL WriteDepthFile(char *file)
+{
+   FILE   *fp;
+   double *zBuff = NULL,
+          *depth;
+   float  *row   = NULL;
+   int    x, y;
+   BOOL   ok     = FALSE;
+
+   if((fp = fopen(file, "wb")) == NULL)
+   {
+      fprintf(stderr, "Unable to write depth file: %s\n", file);
+      return(FALSE);
+   }
+
+   if(((zBuff = (double *)malloc(gScreen[0] * sizeof(double))) == NULL) ||
+      ((row   = (float *)malloc(gScreen[0] * sizeof(float))) == NULL))
+      goto cleanup;
+
+   fprintf(fp, "Pf\n%d %d\n%s\n", gScreen[0], gScreen[1], 
+           LittleEndian() ? "-1.0" : "1.0");
+
+   for(y=gScreen[1]-1; y>=0; y--)
+   {
+      if((depth = GetDepthRow(y, zBuff)) == NULL)
+         goto cleanup;
+      for(x=0; x<gScreen[0]; x++)
+         row[x] = (float)depth[x];
+      if(fwrite(row, sizeof(float), gScreen[0], fp) != gScreen[0])
+         goto cleanup;
+   }
+   ok = TRUE;
+
+cleanup:
+   if(fclose(fp) != 0)
+      ok = FALSE;
+   if(zBuff != NULL) free(zBuff);
+   if(row   != NULL) free(row);
+
+   if(!ok)
+      fprintf(stderr, "Error writing depth file: %s\n", file);
+   return(ok);
+}
+
+
+/************************************************************************/
+/*>BOOL MergeLayers(void)
+   ----------------------
+   Returns: BOOL                Success?
+
+   Merge each of the layers in gLayers into the image by depth. 
+   InitGraphics() must have been called with AUX_DEPTH and, so that
+   partly covered pixels merge smoothly, AUX_ALPHA.
+
+   19.10.26 Original    By: ACRM
+*/
+BOOL MergeLayers(void)
+{
+   int i;
+   
+   for(i=0; i<gNLayers; i++)
+   {
+      if(!MergeLayer(gLayers[i].image, gLayers[i].depth))
+         return(FALSE);
+   }
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>static BOOL MergeLayer(char *imageFile, char *depthFile)
+   --------------------------------------------------------
+   Input:   char    *imageFile  Layer image (PAM or PPM)
+            char    *depthFile  Its depths (PFM)
+   Returns: BOOL                Success?
+
+   Merge one layer into the image a row at a time.
+
+   19.10.26 Original    By: ACRM
+*/
+static BOOL MergeLayer(char *imageFile, char *depthFile)
+{
+   FILE          *fImage = NULL,
+                 *fDepth = NULL;
+   unsigned char *in     = NULL,
+                 *rgba   = NULL;
+   float         *depth  = NULL;
+   unsigned char *b, t;
+   int           channels,
+                 x, y;
+   long          offset;
+   BOOL          swap,
+                 ok      = FALSE;
+
+   if((fImage = fopen(imageFile, "rb")) == NULL)
+   {
+      fprintf(stderr, "Unable to read layer: %s\n", imageFile);
+      goto cleanup;
+   }
+   if((fDepth = fopen(depthFile, "rb")) == NULL)
+   {
+      fprintf(stderr, "Unable to read layer depths: %s\n", depthFile);
+      goto cleanup;
+   }
+   if(!ReadLayerImageHeader(fImage, imageFile, &channels) ||
+      !ReadDepthHeader(fDepth, depthFile, &swap, &offset))
+      goto cleanup;
+
+   if(((in    = (unsigned char *)malloc(gScreen[0] * channels)) == NULL) ||
+      ((rgba  = (unsigned char *)malloc(gScreen[0] * 4)) == NULL) ||
+      ((depth = (float *)malloc(gScreen[0] * sizeof(float))) == NULL))
+   {
+      fprintf(stderr, "No memory to merge layers.\n");
+      goto cleanup;
+   }
+
+   for(y=0; y<gScreen[1]; y++)
+   {
+      /* Depth rows run from the bottom                                 */
+      if((fread(in, channels, gScreen[0], fImage) != gScreen[0]) ||
+         fseek(fDepth, offset + (long)(gScreen[1]-1-y) * gScreen[0] *
+                       sizeof(float), SEEK_SET) ||
+         (fread(depth, sizeof(float), gScreen[0], fDepth) != gScreen[0]))
+      {
+         fprintf(stderr, "Layer is too short: %s\n", imageFile);
+         goto cleanup;
+      }
+
+      for(x=0; x<gScreen[0]; x++)
+      {
+         if(swap)
+         {
+            b = (unsigned char *)(depth + x);
+            t = b[0];  b[0] = b[3];  b[3] = t;
+            t = b[1];  b[1] = b[2];  b[2] = t;
+         }
+         rgba[4*x]   = in[channels*x];
+         rgba[4*x+1] = in[channels*x+1];
+         rgba[4*x+2] = in[channels*x+2];
+         if(channels == 4)
+            rgba[4*x+3] = in[4*x+3];
+         else
+            rgba[4*x+3] = (depth[x] > DEPTH_BACKGROUND) ? 255 : 0;
+      }
+      MergeLayerRow(y, 0, gScreen[0], rgba, depth);
+   }
+   ok = TRUE;
+
+cleanup:
+   if(fImage != NULL) fclose(fImage);
+   if(fDepth != NULL) fclose(fDepth);
+   if(in     != NULL) free(in);
+   if(rgba   != NULL) free(rgba);
+   if(depth  != NULL) free(depth);
+   return(ok);
+}
+
+
+/************************************************************************/
+/*>static BOOL ReadLayerImageHeader(FILE *fp, char *file, int *channels)
+   ---------------------------------------------------------------------
+   Input:   FILE    *fp         Layer image file
+            char    *file       Its name
+   Output:  int     *channels   3 for PPM, 4 for PAM with alpha
+   Returns: BOOL                Is it a PPM or RGB_ALPHA PAM the size of
+                                the image?
+
+   19.10.26 Original    By: ACRM
+*/
+static BOOL ReadLayerImageHeader(FILE *fp, char *file, int *channels)
+{
+   char token[MAXTOKEN];
+   int  width  = 0, 
+        height = 0,
+        maxval = 0;
+   
+   *channels = 0;
+   if(!ReadToken(fp, token))
+      return(FALSE);
+
+   if(!strcmp(token, "P6"))
+   {
+      *channels = 3;
+      if(!ReadToken(fp, token) || (sscanf(token, "%d", &width) != 1)  ||
+         !ReadToken(fp, token) || (sscanf(token, "%d", &height) != 1) ||
+         !ReadToken(fp, token) || (sscanf(token, "%d", &maxval) != 1))
+         width = 0;
+   }
+   else if(!strcmp(token, "P7"))
+   {
+      while(ReadToken(fp, token) && strcmp(token, "ENDHDR"))
+      {
+         if(!strcmp(token, "WIDTH") && ReadToken(fp, token))
+            sscanf(token, "%d", &width);
+         else if(!strcmp(token, "HEIGHT") && ReadToken(fp, token))
+            sscanf(token, "%d", &height);
+         else if(!strcmp(token, "DEPTH") && ReadToken(fp, token))
+            sscanf(token, "%d", channels);
+         else if(!strcmp(token, "MAXVAL") && ReadToken(fp, token))
+            sscanf(token, "%d", &maxval);
+      }
+   }
+
+   if((width != gScreen[0]) || (height != gScreen[1]) || 
+      (maxval != 255) || ((*channels != 3) && (*channels != 4)))
+   {
+      fprintf(stderr, "Layer must be an 8-bit PPM or PAM the same size \
+as the image: %s\n", file);
+      return(FALSE);
+   }
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>static BOOL ReadDepthHeader(FILE *fp, char *file, BOOL *swap, 
+                               long *offset)
+   -------------------------------------------------------------
+   Input:   FILE    *fp         Layer depth file
+            char    *file       Its name
+   Output:  BOOL    *swap       Are the bytes of the floats to be 
+                                reversed?
+            long    *offset     Start of the floats
+   Returns: BOOL                Is it a greyscale PFM the size of the
+                                image?
+
+   19.10.26 Original    By: ACRM
+*/
+static BOOL ReadDepthHeader(FILE *fp, char *file, BOOL *swap, 
+                            long *offset)
+{
+   char   token[MAXTOKEN];
+   int    width  = 0,
+          height = 0;
+   double scale  = 0.0;
+
+   if(!ReadToken(fp, token) || strcmp(token, "Pf") ||
+      !ReadToken(fp, token) || (sscanf(token, "%d", &width) != 1)  ||
+      !ReadToken(fp, token) || (sscanf(token, "%d", &height) != 1) ||
+      !ReadToken(fp, token) || (sscanf(token, "%lf", &scale) != 1) ||
+      (width != gScreen[0]) || (height != gScreen[1]) || (scale == 0.0))
+   {
+      fprintf(stderr, "Layer depths must be a greyscale PFM the same \
+size as the image: %s\n", file);
+      return(FALSE);
+   }
+
+   *swap   = ((scale < 0.0) != LittleEndian());
+   *offset = ftell(fp);
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>static BOOL ReadToken(FILE *fp, char *token)
+   --------------------------------------------
+   Input:   FILE    *fp         Netpbm style file
+   Output:  char    *token      Next header token
+   Returns: BOOL                Was one found?
+
+   Reads a whitespace separated token from a header, skipping comments.
+   Exactly one whitespace character after the token is consumed, as the
+   data start after that.
+
+   19.10.26 Original    By: ACRM
+*/
+static BOOL ReadToken(FILE *fp, char *token)
+{
+   int c, 
+       n = 0;
+
+   while((c = getc(fp)) != EOF)
+   {
+      if(c == '#')
+      {
+         while(((c = getc(fp)) != EOF) && (c != '\n'));
+      }
+      else if(!isspace(c))
+      {
+         break;
+      }
+   }
+
+   while((c != EOF) && !isspace(c))
+   {
+      if(n < MAXTOKEN-1)
+         token[n++] = (char)c;
+      c = getc(fp);
+   }
+   token[n] = '\0';
+   
+   return(n > 0);
+}
+
+
+/************************************************************************/
+/*>static BOOL LittleEndian(void)
+   ------------------------------
+   Returns: BOOL                Is this machine little-endian?
+
+   19.10.26 Original    By: ACRM
+*/
+static BOOL LittleEndian(void)
+{
+   int one = 1;
+   
+   return(*(unsigned char *)&one == 1);
+}
@@ -0,0 +1,4 @@
+BOOL WriteDepthFile(char *file)
+;
+BOOL MergeLayers(void)
+;
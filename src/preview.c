@@ -0,0 +1,188 @@
+/*************************************************************************
+
+   Program:    QTree
+   File:       preview.c   
+
+   Version:    V3.10
+   Date:       19.10.26
+   Function:   Progressive preview frames  
+
+   Copyright:  (c) SciTech Software 2026
+   Author:     Prof. Andrew C. R. Martin
+   EMail:      andrew@bioinf.org.uk
+
+**************************************************************************
+
+   This program is not in the public domain.
+
+   It may not be copied or made available to third parties, but may be
+   freely used by non-profit-making organisations who have obtained it
+   directly from the author or by FTP.
+
+   You are requested to send EMail to the author to say that you are
+   using this code so that you may be informed of future updates.
+
+   The code may not be made available on other FTP sites without express
+   permission from the author.
+
+   The code may be modified as required, but any modifications must be
+   documented so that the person responsible can be identified. If
+   someone else breaks this code, the author doesn't want to be blamed
+   for code that does not work! You may not distribute any
+   modifications, but are encouraged to send them to the author so
+   that they may be incorporated into future versions of the code.
+
+   The code may not be sold commercially or used for commercial purposes
+   without prior permission from the author.
+
+**************************************************************************
+
+   Description:
+   ============
+   Writes coarse preview images before the real image is rendered. 
+   Each preview stops the quad tree a given number of levels down and
+   colours one pixel for each block there, copying it over the block.
+   Going down one level quarters the size of the blocks, so a list of 
+   levels gives a sequence of ever finer previews.
+
+**************************************************************************
+
+   Usage:
+   ======
+
+**************************************************************************
+
+   Notes:
+   ======
+   The levels are done in order, coarsest first, and each is a fresh 
+   run of the quad tree from the top down to that level. This gives
+   the breadth-first order without having to keep the sphere lists for
+   every block across a whole level. A level costs about as much as
+   colouring one pixel per block, so the previews together cost little
+   compared with the real image.
+
+   If the filename contains %d, each preview is written as a separate
+   PPM file with %d replaced by the level. Otherwise the previews are 
+   written as frames of one YUV4MPEG2 stream, which may be a FIFO being
+   read by a viewer or a blank filename for standard output.
+
+**************************************************************************
+
+   Revision History:
+   =================
+   V3.10 19.10.26 Original
+
+*************************************************************************/
+/* Includes
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bioplib/macros.h"
+#include "bioplib/MathType.h"
+#include "bioplib/SysDefs.h"
+#include "bioplib/pdb.h"
+
+#include "qtree.h"
+#include "qtree.p"
+#include "graphics.p"
+#include "rawimage.p"
+#include "preview.p"
+
+/************************************************************************/
+/* Defines
+*/
+#define MAXNAME 512              /* Longest preview filename            */
+
+
+/************************************************************************/
+/*>BOOL RenderPreviews(SPHERE *AllSpheres, int NSphere, 
+                       unsigned long levels, char *file)
+   ------------------------------------------------------------
+   Input:   SPHERE        *AllSpheres   Array of spheres
+            int           NSphere       Number of spheres
+            unsigned long levels        Bit n set for a preview at 
+                                        level n
+            char          *file         Preview file (see Notes)
+   Returns: BOOL                        Success?
+
+   Renders and writes the previews. InitGraphics() must have been 
+   called. The framebuffer is cleared again afterwards ready for the
+   real image.
+
+   19.10.26 Original    By: ACRM
+*/
+BOOL RenderPreviews(SPHERE *AllSpheres, int NSphere, unsigned long levels,
+                    char *file)
+{
+   SPHERE    **SrtSph = NULL;
+   Y4MSTREAM *stream  = NULL;
+   char      *pct,
+             name[MAXNAME];
+   int       depth;
+   BOOL      perLevel,
+             ok       = FALSE;
+
+   /* One file per level if there is a %d and no other % conversions    */
+   pct      = strchr(file, '%');
+   perLevel = ((pct != NULL) && (pct[1] == 'd') && 
+               (strchr(pct+1, '%') == NULL));
+   if(perLevel && (strlen(file) > MAXNAME-16))
+   {
+      fprintf(stderr,"Preview filename too long: %s\n", file);
+      return(FALSE);
+   }
+   
+   if(!perLevel)
+   {
+      if((stream = OpenY4MStream(file, gScreen[0], gScreen[1], Y4M_FPS))
+         == NULL)
+      {
+         fprintf(stderr,"Unable to open preview stream: %s\n", file);
+         return(FALSE);
+      }
+   }
+   
+   if((SrtSph = SortSpheresOnX(AllSpheres, NSphere)) == NULL)
+      goto cleanup;
+
+   for(depth=0; depth<MAXPREVIEW; depth++)
+   {
+      if(!(levels & (1UL << depth)))
+         continue;
+      
+      SetBand(0);
+      if(!SpaceFillPreview(SrtSph, NSphere, depth))
+         goto cleanup;
+
+      if(perLevel)
+      {
+         sprintf(name, file, depth);
+         if(!WriteRawImage(name, OUTPUT_PPM, gScreen[0], gScreen[1]))
+         {
+            fprintf(stderr,"Unable to write preview: %s\n", name);
+            goto cleanup;
+         }
+      }
+      else
+      {
+         if(!WriteY4MFrame(stream))
+         {
+            fprintf(stderr,"Unable to write preview frame\n");
+            goto cleanup;
+         }
+      }
+   }
+   ok = TRUE;
+
+cleanup:
+   if(stream != NULL)
+      ok = CloseY4MStream(stream) && ok;
+   if(SrtSph != NULL) free(SrtSph);
+
+   /* Clear for the real image                                          */
+   SetBand(0);
+
+   return(ok);
+}
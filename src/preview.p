@@ -0,0 +1,3 @@
+BOOL RenderPreviews(SPHERE *AllSpheres, int NSphere, unsigned long levels,
+                    char *file)
+;
@@ -0,0 +1,285 @@
+/*************************************************************************
+
+   Program:    QTree
+   File:       qoi.c
+
+   Version:    V3.5
+   Date:       19.10.26
+   Function:   Write QOI ("Quite OK Image") files
+
+   Copyright:  (c) SciTech Software 2026
+   Author:     Prof. Andrew C. R. Martin
+   EMail:      andrew@bioinf.org.uk
+
+**************************************************************************
+
+   This program is not in the public domain.
+
+   It may not be copied or made available to third parties, but may be
+   freely used by non-profit-making organisations who have obtained it
+   directly from the author or by FTP.
+
+   You are requested to send EMail to the author to say that you are
+   using this code so that you may be informed of future updates.
+
+   The code may not be made available on other FTP sites without express
+   permission from the author.
+
+   The code may be modified as required, but any modifications must be
+   documented so that the person responsible can be identified. If
+   someone else breaks this code, the author doesn't want to be blamed
+   for code that does not work! You may not distribute any
+   modifications, but are encouraged to send them to the author so
+   that they may be incorporated into future versions of the code.
+
+   The code may not be sold commercially or used for commercial purposes
+   without prior permission from the author.
+
+**************************************************************************
+
+   Description:
+   ============
+   A self-contained encoder for the QOI lossless image format
+   (https://qoiformat.org/). QOI compresses in a single pass with a
+   handful of operations per pixel, so it is many times faster than
+   PNG while the long runs of identical background pixels in our
+   images still compress well.
+
+**************************************************************************
+
+   Usage:
+   ======
+
+**************************************************************************
+
+   Notes:
+   ======
+   The encoder follows the QOI 1.0 specification. Images are written
+   with 3 channels and the sRGB colour space flag. Rows are taken from
+   the framebuffer one at a time and the output is collected in a
+   buffer which is written with WriteVector() whenever it fills.
+
+**************************************************************************
+
+   Revision History:
+   =================
+   V3.5  19.10.26 Original
+
+*************************************************************************/
+/* Includes
+*/
+#define _XOPEN_SOURCE 600
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+
+#include "bioplib/MathType.h"
+#include "bioplib/SysDefs.h"
+
+#include "qtree.h"
+#include "graphics.p"
+#include "rawimage.p"
+#include "qoi.p"
+
+/************************************************************************/
+/* Defines
+*/
+#define QOI_OP_INDEX  0x00    /* 00xxxxxx                               */
+#define QOI_OP_DIFF   0x40    /* 01xxxxxx                               */
+#define QOI_OP_LUMA   0x80    /* 10xxxxxx                               */
+#define QOI_OP_RUN    0xc0    /* 11xxxxxx                               */
+#define QOI_OP_RGB    0xfe    /* 11111110                               */
+#define QOI_MAXRUN    62      /* Longest run in one QOI_OP_RUN          */
+#define QOI_BUFSIZE   262144  /* Output buffer size                     */
+
+/* Position of an opaque colour in the 64-entry index                   */
+#define QOI_HASH(r,g,b) (((r)*3 + (g)*5 + (b)*7 + 255*11) & 63)
+
+#define PUT32(p,v) { (p)[0] = (unsigned char)((v) >> 24);               \
+                     (p)[1] = (unsigned char)((v) >> 16);               \
+                     (p)[2] = (unsigned char)((v) >>  8);               \
+                     (p)[3] = (unsigned char)(v); }
+
+
+/************************************************************************/
+/*>static BOOL FlushBuffer(int fd, unsigned char *buffer, size_t *len)
+   -------------------------------------------------------------------
+   I/O:     int            fd       File descriptor
+            unsigned char  *buffer  Output buffer
+            size_t         *len     Bytes in the buffer (reset to 0)
+   Returns: BOOL                    Success?
+
+   19.10.26 Original    By: ACRM
+*/
+static BOOL FlushBuffer(int fd, unsigned char *buffer, size_t *len)
+{
+   struct iovec iov;
+
+   iov.iov_base = buffer;
+   iov.iov_len  = *len;
+   *len         = 0;
+
+   return(WriteVector(fd, &iov, 1));
+}
+
+
+/************************************************************************/
+/*>BOOL WriteQOIFile(char *FileName, int xsize, int ysize)
+   -------------------------------------------------------
+   Input:   char  *FileName    File to write (blank for stdout)
+            int   xsize        Image width
+            int   ysize        Image height
+   Returns: BOOL               Success?
+
+   Write the framebuffer as a QOI image. Each pixel becomes a run, an
+   index into the table of recently seen colours, a small difference
+   from the previous pixel or, failing all those, a literal RGB value.
+
+   19.10.26 Original    By: ACRM
+*/
+BOOL WriteQOIFile(char *FileName, int xsize, int ysize)
+{
+   static unsigned char padding[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+   unsigned char index[64][4],
+                 *out   = NULL,
+                 *row   = NULL,
+                 *rgb,
+                 r, g, b,
+                 pr     = 0,
+                 pg     = 0,
+                 pb     = 0;
+   size_t        len    = 0;
+   int           fd,
+                 x, y,
+                 hash,
+                 vr, vg, vb,
+                 run    = 0;
+   BOOL          retval = TRUE;
+
+   if(((out = (unsigned char *)malloc(QOI_BUFSIZE)) == NULL) ||
+      ((row = (unsigned char *)malloc((size_t)3 * xsize)) == NULL))
+   {
+      if(out != NULL) free(out);
+      return(FALSE);
+   }
+
+   if((fd = OpenOutputFile(FileName)) < 0)
+   {
+      free(out);
+      free(row);
+      return(FALSE);
+   }
+
+   /* Header                                                            */
+   memcpy(out, "qoif", 4);
+   PUT32(out+4, (unsigned long)xsize);
+   PUT32(out+8, (unsigned long)ysize);
+   out[12] = 3;                           /* Channels                   */
+   out[13] = 0;                           /* sRGB with linear alpha     */
+   len     = 14;
+
+   /* The index starts as all zeros (transparent black) so no pixel can
+      match an entry until it has been filled. The previous pixel starts
+      as opaque black
+   */
+   memset(index, 0, sizeof(index));
+   
+   for(y=0; y<ysize && retval; y++)
+   {
+      rgb = GetRGBRow(y, row);
+
+      for(x=0; x<xsize; x++, rgb+=3)
+      {
+         /* Make sure there is space for the longest op (4 bytes)       */
+         if(len > QOI_BUFSIZE - 8)
+         {
+            if(!(retval = FlushBuffer(fd, out, &len)))
+               break;
+         }
+
+         r = rgb[0];
+         g = rgb[1];
+         b = rgb[2];
+
+         if((r == pr) && (g == pg) && (b == pb))
+         {
+            if(++run == QOI_MAXRUN)
+            {
+               out[len++] = (unsigned char)(QOI_OP_RUN | (run - 1));
+               run = 0;
+            }
+            continue;
+         }
+
+         if(run)
+         {
+            out[len++] = (unsigned char)(QOI_OP_RUN | (run - 1));
+            run = 0;
+         }
+
+         hash = QOI_HASH(r, g, b);
+         if((index[hash][0] == r) && (index[hash][1] == g) &&
+            (index[hash][2] == b) && (index[hash][3] == 255))
+         {
+            out[len++] = (unsigned char)(QOI_OP_INDEX | hash);
+         }
+         else
+         {
+            index[hash][0] = r;
+            index[hash][1] = g;
+            index[hash][2] = b;
+            index[hash][3] = 255;
+
+            vr = (signed char)(r - pr);
+            vg = (signed char)(g - pg);
+            vb = (signed char)(b - pb);
+
+            if((vr > -3) && (vr < 2) && 
+               (vg > -3) && (vg < 2) && 
+               (vb > -3) && (vb < 2))
+            {
+               out[len++] = (unsigned char)(QOI_OP_DIFF | ((vr + 2) << 4) |
+                                            ((vg + 2) << 2) | (vb + 2));
+            }
+            else if((vg > -33) && (vg < 32) &&
+                    (vr - vg > -9) && (vr - vg < 8) &&
+                    (vb - vg > -9) && (vb - vg < 8))
+            {
+               out[len++] = (unsigned char)(QOI_OP_LUMA | (vg + 32));
+               out[len++] = (unsigned char)(((vr - vg + 8) << 4) | 
+                                            (vb - vg + 8));
+            }
+            else
+            {
+               out[len++] = QOI_OP_RGB;
+               out[len++] = r;
+               out[len++] = g;
+               out[len++] = b;
+            }
+         }
+
+         pr = r;
+         pg = g;
+         pb = b;
+      }
+   }
+
+   /* Finish any run and add the end marker                             */
+   if(retval)
+   {
+      if(run)
+         out[len++] = (unsigned char)(QOI_OP_RUN | (run - 1));
+      memcpy(out+len, padding, 8);
+      len += 8;
+      retval = FlushBuffer(fd, out, &len);
+   }
+
+   if(!CloseOutputFile(fd))
+      retval = FALSE;
+   free(out);
+   free(row);
+   
+   return(retval);
+}
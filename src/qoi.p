@@ -0,0 +1,2 @@
+BOOL WriteQOIFile(char *FileName, int xsize, int ysize)
+;
@@ -3,11 +3,11 @@
    Program:    QTree
    File:       qtree.c
    
-   Version:    V3.0
-   Date:       19.08.19
+   Version:    V3.25
+   Date:       19.10.26
    Function:   Use quad-tree algorithm to display a molecule
    
-   Copyright:  (c) SciTech Software 1993-2019
+   Copyright:  (c) SciTech Software 1993-2026
    Author:     Prof. Andrew C. R. Martin
    EMail:      andrew@bioinf.org.uk
                
@@ -103,6 +103,40 @@
                   insert are handled as strings
    V2.5  18.08.19 General cleanup and moved into GitHub
    V3.0  19.08.19 Started to add different output formats
+   V3.1  19.10.26 Added -m for Morton-order framebuffer
+   V3.2  19.10.26 Added PPM, PAM, raw and Y4M output
+   V3.3  19.10.26 Added -z for PNG compression options
+   V3.4  19.10.26 Added -t for multi-threaded PNG compression
+   V3.5  19.10.26 Added QOI output
+   V3.6  19.10.26 Quad-tree covers the whole (rectangular) image rather
+                  than a power-of-two square
+   V3.7  19.10.26 Added -l and -k to render in bands with checkpoints
+   V3.8  19.10.26 Added DZI and XYZ tile pyramid output
+   V3.9  19.10.26 Added -w to render a window on the full frame
+   V3.10 19.10.26 Added -p for progressive previews
+   V3.11 19.10.26 Added -o for extra output sizes
+   V3.12 19.10.26 Added -a for anti-aliased edges
+   V3.13 19.10.26 Added -g and -u to save and re-shade a G-buffer
+   V3.14 19.10.26 Added -i to write an atom ID map for picking
+   V3.15 19.10.26 Highlight borders drawn in one pass after the quad tree
+   V3.16 19.10.26 Added -d to write depths and -x to merge layers by depth
+   V3.17 19.10.26 Added -e for galleries of ligand poses on a receptor
+   V3.18 19.10.26 Added FRAMES and KEYFRAME animations
+   V3.19 19.10.26 Added -n to render each model of a trajectory. Added
+                  MapSphere()
+   V3.20 19.10.26 Pictures written by an encoder process while the next
+                  is rendered
+   V3.21 19.10.26 Added -j to render a manifest of images in one run.
+                  Added SetRenderSize()
+   V3.22 19.10.26 Added -v to run as a daemon serving images over a
+                  Unix domain socket
+   V3.23 19.10.26 Added -y to keep rendered images in a cache named by
+                  their inputs
+   V3.24 19.10.26 The cache also keeps the atoms read from each PDB
+                  file in a binary form which is read in place of
+                  parsing the PDB file
+   V3.25 19.10.26 PDB files are mapped into memory and their atoms read
+                  into an array on gNThreads threads by ReadAtoms()
 
 *************************************************************************/
 /* Includes
@@ -135,6 +169,7 @@ typedef void (*sighandler_t)(int);
 */
 #define DEF_CONTROL  "qtree.def"    /* Default control file             */
 #define HELPFILE     "qtree.hlp"    /* Help file                        */
+#define MAXCKPTNAME  160            /* Checkpoint file name (-k)        */
 
 /************************************************************************/
 /* Prototypes
@@ -142,13 +177,37 @@ typedef void (*sighandler_t)(int);
 #include "qtree.p"
 #include "graphics.p"
 #include "commands.p"
+#include "bands.p"
+#ifdef SUPPORT_PNG
+#include "tiles.p"
+#endif
+#include "preview.p"
+#include "gbuffer.p"
+#include "idmap.p"
+#include "borders.p"
+#include "layers.p"
+#include "gallery.p"
+#include "frames.p"
+#include "animate.p"
+#include "trajectory.p"
+#include "batch.p"
+#include "daemon.p"
+#include "cache.p"
+#include "atoms.p"
+
+static void ImageRegion(int top, int nrows, int *x0, int *y0, int *x1,
+                        int *y1);
+static BOOL RunQuadTree(SPHERE **SrtSph, int NSphere, int x0, int y0, 
+                        int x1, int y1, int depth);
 
 /************************************************************************/
 /* Variables global to this file only
 */
 static jmp_buf sSaveUnwind;         /* For setjmp() / longjmp()         */
 static BOOL    sOKFlag    = TRUE,   /* Set FALSE on calling longjmp()   */
-               sBallStick = FALSE;  /* Default to CPK images            */
+               sBallStick = FALSE,  /* Default to CPK images            */
+               sFitFrame  = TRUE;   /* Fit molecule to the whole image  */
+static REAL    sMapScale  = 1.0;    /* Pixels per Angstrom              */
 
 #ifdef SHOW_INFO
 static int     sNPixels = 0;        /* Number of pixels coloured        */
@@ -157,7 +216,7 @@ static int     sNPixels = 0;        /* Number of pixels coloured        */
 #ifdef _AMIGA
 /* Version string                                                       */
 static unsigned char 
-   *sVers="\0$VER: QTree V3.0 - SciTech Software, 1993-2019";
+   *sVers="\0$VER: QTree V3.25 - SciTech Software, 1993-2026";
 #endif
 
 
@@ -194,6 +253,25 @@ static unsigned char
    14.10.03 V2.2
    18.10.07 V2.2a Cast added to onbreak()
    19.08.19 Added PNG output
+   19.10.26 Added framebuffer layout. Allocates coverage plane for
+            formats with alpha
+   19.10.26 Render area is the whole screen. Resolution need no longer
+            be a power of 2 and, if not given, the molecule is fitted
+            to the screen
+   19.10.26 Writes previews
+   19.10.26 Coverage plane also allocated for extra sizes which need it
+   19.10.26 Saves and re-shades G-buffers
+   19.10.26 Writes atom ID maps
+   19.10.26 Writes depths and merges layers
+   19.10.26 Renders galleries of ligand poses
+   19.10.26 Renders FRAMES/KEYFRAME animations
+   19.10.26 Renders trajectories
+   19.10.26 Renders batches. Sizes set by SetRenderSize()
+   19.10.26 Runs as a daemon
+   19.10.26 Images may be taken from and added to a cache
+   19.10.26 Atoms may be read from the cache
+   19.10.26 Atoms read into an array by ReadAtoms()
+   19.10.26 Returns 1 if an image could not be written
 */
 int main(int argc, char **argv)
 {
@@ -203,13 +281,32 @@ int main(int argc, char **argv)
    BOOL     DoControl      = FALSE,
             OK             = TRUE,
             DoResolution   = FALSE,
-            Quiet          = FALSE;
+            Quiet          = FALSE,
+            Reshade        = FALSE,
+            Trajectory     = FALSE,
+            cacheImage     = FALSE;
+   unsigned long previews  = 0;
    int      NAtom          = 0,
+            NPDBAtom       = 0,
+            NPoses         = 0,
+            *poseStart     = NULL,
             resolution     = 0,
+            cacheSize      = 0,
+            window[4],
             outFormat      = OUTPUT_MTV;
    char     ControlFile[160],
             InFile[160],
-            outFile[160];
+            outFile[160],
+            checkpoint[MAXCKPTNAME],
+            previewFile[160],
+            gbuffer[160],
+            idMap[160],
+            idTable[160],
+            depthFile[160],
+            receptor[160],
+            manifest[160],
+            socketName[160],
+            cacheDir[160];
             
 #ifdef SHOW_INFO
    clock_t  StartTime,
@@ -253,45 +350,216 @@ int main(int argc, char **argv)
 
    if(ParseCmdLine(argc, argv, InFile, outFile, &DoControl, ControlFile,
                    &sBallStick, &DoResolution, &resolution, &Quiet,
-                   &(gScreen[0]), &(gScreen[1]), &outFormat))
+                   &(gScreen[0]), &(gScreen[1]), &outFormat,
+                   &gFBLayout, &gNThreads, &gBandRows, checkpoint,
+                   window, &previews, previewFile, gbuffer, &Reshade,
+                   idMap, idTable, depthFile, receptor, &Trajectory,
+                   manifest, socketName, cacheDir, &cacheSize))
    {
-      /* If the resolution flag has been set, calculate the resolution  */
+      /* The quad-tree covers the whole screen. If a resolution was 
+         given, the molecule is scaled to that rather than fitted to the
+         screen
+      */
+      SetRenderSize(gScreen[0], gScreen[1], 
+                    DoResolution ? resolution : 0);
       if(DoResolution)
+         sFitFrame = FALSE;
+
+      /* If a window was given, the image is just that part of the 
+         screen. The molecule is still placed and lit for the whole
+         screen, which remains the render area
+      */
+      if(window[2] > 0)
       {
-         int size;
-         
-         size = MIN(gScreen[0],gScreen[1]);
-         if(resolution > size) resolution = size;
-         
-         /* Ensure size a power of 2                                    */
-         for(gSize = 2; gSize<resolution; gSize*=2);
-         if(gSize > resolution) gSize /= 2;
+         if((window[0] < 0) || (window[1] < 0) || (window[3] <= 0) ||
+            (window[0] + window[2] > gScreen[0]) ||
+            (window[1] + window[3] > gScreen[1]))
+         {
+            fprintf(stderr,"The window must lie within the screen.\n");
+            exit(1);
+         }
+         gOrigin[0] = window[0];
+         gOrigin[1] = window[1];
+         gScreen[0] = window[2];
+         gScreen[1] = window[3];
+      }
+
+      /* Tile pyramids are rendered a row of tiles at a time            */
+      if((outFormat == OUTPUT_DZI) || (outFormat == OUTPUT_XYZ))
+         gBandRows = DZ_TILESIZE;
+
+      /* Previews and extra sizes need the whole image in memory        */
+      if((previews || gNOutputs) && (gBandRows > 0))
+      {
+         fprintf(stderr,"Previews and extra sizes cannot be made when \
+rendering in bands or tiles.\n");
+         exit(1);
+      }
+
+      /* Saving or re-shading a G-buffer needs the whole image. When 
+         re-shading, the sizes are those used when it was saved
+      */
+      if(gbuffer[0])
+      {
+         if((gBandRows > 0) || previews)
+         {
+            fprintf(stderr,"G-buffers cannot be used when rendering in \
+bands or tiles or with previews.\n");
+            exit(1);
+         }
+         /* The G-buffer holds one sphere per pixel, so edges cannot be
+            anti-aliased when it is re-shaded
+         */
+         if(Reshade && gAntiAlias)
+         {
+            fprintf(stderr,"Edges cannot be anti-aliased (-a) when \
+re-shading a G-buffer (-u).\n");
+            exit(1);
+         }
+         if(Reshade && !OpenGBuffer(gbuffer))
+            exit(1);
+      }
+
+      /* So does an atom ID map, which is only made when rendering      */
+      if(idMap[0] && ((gBandRows > 0) || Reshade))
+      {
+         fprintf(stderr,"Atom ID maps cannot be made when rendering in \
+bands or tiles or when re-shading.\n");
+         exit(1);
+      }
+
+      /* And depth output or merging layers                             */
+      if((depthFile[0] || gNLayers) && ((gBandRows > 0) || Reshade))
+      {
+         fprintf(stderr,"Depths cannot be written or layers merged when \
+rendering in bands or\ntiles or when re-shading.\n");
+         exit(1);
+      }
+
+      /* A gallery writes a picture for each pose of a ligand file      */
+      if(receptor[0])
+      {
+         if(!InFile[0] || !outFile[0])
+         {
+            fprintf(stderr,"A gallery needs the ligand file and an output \
+filename.\n");
+            exit(1);
+         }
+         if((gBandRows > 0) || previews || gNOutputs || gbuffer[0] || 
+            idMap[0] || depthFile[0] || gNLayers)
+         {
+            fprintf(stderr,"A gallery cannot be rendered in bands or tiles \
+or with -p, -o, -g, -u,\n-i, -d or -x.\n");
+            exit(1);
+         }
+         if(!CheckGalleryFile(outFile))
+            exit(1);
+      }
+
+      /* A trajectory writes a frame for each model of a PDB file       */
+      if(Trajectory)
+      {
+         if(!InFile[0])
+         {
+            fprintf(stderr,"A trajectory must be read from a file.\n");
+            exit(1);
+         }
+         if((gBandRows > 0) || previews || gNOutputs || gbuffer[0] || 
+            idMap[0] || depthFile[0] || gNLayers || receptor[0])
+         {
+            fprintf(stderr,"A trajectory cannot be rendered in bands or \
+tiles or with -p, -o, -g,\n-u, -i, -d, -x or -e.\n");
+            exit(1);
+         }
+         if(!CheckFrameFile(outFile, outFormat))
+            exit(1);
       }
       
-      /* Make sure gSize is OK (if screen size specified, but not res   */
-      while(gSize > MIN(gScreen[0],gScreen[1]))
-         gSize /= 2;
+      /* A batch takes everything else from the manifest                */
+      if(manifest[0])
+      {
+         if(InFile[0] || outFile[0] || DoControl)
+         {
+            fprintf(stderr,"A batch takes the PDB, control and output \
+files from the manifest.\n");
+            exit(1);
+         }
+         if((gBandRows > 0) || (window[2] > 0) || previews || gNOutputs ||
+            gbuffer[0] || idMap[0] || depthFile[0] || gNLayers || 
+            receptor[0] || Trajectory)
+         {
+            fprintf(stderr,"A batch cannot be rendered in bands or tiles \
+or with -w, -p, -o, -g,\n-u, -i, -d, -x, -e or -n.\n");
+            exit(1);
+         }
+      }
       
-      /* Set up default lighting condition                              */
-      gLight.x    = (REAL)gSize*2;
-      gLight.y    = (REAL)gSize*2;
-      gLight.z    = (REAL)gSize*5;
-      gLight.amb  = 0.3;
-      gLight.spec = FALSE;
+      /* And the daemon from each request                               */
+      if(socketName[0])
+      {
+         if(InFile[0] || outFile[0] || DoControl || manifest[0])
+         {
+            fprintf(stderr,"The daemon takes the PDB and control files \
+from each request and\nreturns the image to the client.\n");
+            exit(1);
+         }
+         if((gBandRows > 0) || (window[2] > 0) || previews || gNOutputs ||
+            gbuffer[0] || idMap[0] || depthFile[0] || gNLayers || 
+            receptor[0] || Trajectory)
+         {
+            fprintf(stderr,"The daemon cannot render in bands or tiles \
+or with -w, -p, -o, -g,\n-u, -i, -d, -x, -e or -n.\n");
+            exit(1);
+         }
+      }
+      
+      /* Only single images are cached; otherwise just the structure   */
+      if(cacheDir[0] &&
+         (receptor[0] || Trajectory || manifest[0] || socketName[0]))
+      {
+         fprintf(stderr,"The cache cannot be used with -e, -n, -j or \
+-v.\n");
+         exit(1);
+      }
+      cacheImage = cacheDir[0] && 
+                   !((gBandRows > 0) || previews || gNOutputs || 
+                     gbuffer[0] || idMap[0] || depthFile[0] || gNLayers);
       
       /* Banner message                                                 */
       if(!Quiet)
       {
-         fprintf(stderr,"\nQTree V3.0\n");
+         fprintf(stderr,"\nQTree V3.25\n");
          fprintf(stderr,"========== \n");
          fprintf(stderr,"CPK program for PDB files. SciTech Software\n");
-         fprintf(stderr,"Copyright (C) 1993-2019 SciTech Software. All \
+         fprintf(stderr,"Copyright (C) 1993-2026 SciTech Software. All \
 Rights Reserved.\n");
          fprintf(stderr,"This program is freely distributable providing \
 no profit is made in so doing.\n\n");
          fprintf(stderr,"Rendering...");
       }
       
+      /* Each scene of a batch is rendered by a process of its own      */
+      if(manifest[0])
+      {
+         OK = RunBatch(manifest, DEF_CONTROL, sBallStick, 
+                       DoResolution ? resolution : 0, gScreen[0], 
+                       gScreen[1], outFormat);
+         if(OK && !Quiet) 
+            fprintf(stderr,"Complete.\n");
+         return(OK ? 0 : 1);
+      }
+      
+      /* The daemon renders each request in a process of its own        */
+      if(socketName[0])
+      {
+         OK = RunDaemon(socketName, DEF_CONTROL, sBallStick, 
+                        DoResolution ? resolution : 0, gScreen[0], 
+                        gScreen[1], outFormat);
+         if(OK && !Quiet) 
+            fprintf(stderr,"Complete.\n");
+         return(OK ? 0 : 1);
+      }
+      
       /* Open file for reading (Modified for V2.0)                      */
       if(InFile[0])
       {
@@ -306,13 +574,42 @@ no profit is made in so doing.\n\n");
          fp = stdin;
       }
       
-      if(InitGraphics())
+      /* A picture made before from the same input, control file and
+         settings is copied from the cache without reading the atoms
+      */
+      if(cacheDir[0])
       {
-         /* Read the PDB file                                           */
-         if(sBallStick)
-            pdb = blReadPDBAll(fp, &NAtom);
+         if(!OpenCache(cacheDir, (unsigned long)cacheSize << 20, &fp) &&
+            (fp == NULL))
+            exit(1);
+         if(cacheImage &&
+            FindCachedImage(DoControl ? ControlFile : DEF_CONTROL,
+                            sBallStick, DoResolution ? resolution : 0,
+                            outFormat, outFile))
+         {
+            if(!Quiet) 
+               fprintf(stderr,"Complete.\n");
+            return(0);
+         }
+      }
+      
+      if(InitGraphics(((NeedAlpha(outFormat) || gNLayers || receptor[0]) ? 
+                       AUX_ALPHA : 0) |
+                      ((depthFile[0] || gNLayers || receptor[0]) ? 
+                       AUX_DEPTH : 0) |
+                      ((gbuffer[0] && !Reshade) ? AUX_GBUFFER : 0) |
+                      (idMap[0] ? AUX_ATOMID : 0)))
+      {
+         /* Read the PDB file. For a gallery, the receptor then all the
+            poses
+         */
+         if(receptor[0])
+            pdb = ReadGallery(fp, receptor, sBallStick, &NAtom, 
+                              &poseStart, &NPoses);
+         else if(cacheDir[0])
+            pdb = ReadCachedPDB(fp, sBallStick, &NAtom);
          else
-            pdb = blReadPDB(fp, &NAtom);
+            pdb = ReadAtoms(fp, sBallStick, &NAtom);
          
          if(pdb != NULL)
          {
@@ -325,24 +622,115 @@ no profit is made in so doing.\n\n");
                else
                   HandleControl(DEF_CONTROL, pdb, spheres, NAtom, FALSE);
                
-               /* Set and scale coords in sphere list                   */
-               MapSpheres(pdb, spheres, NAtom);
+               /* An animation writes a picture for each frame          */
+               if(gNFrames > 0)
+               {
+                  if((gBandRows > 0) || previews || gNOutputs || 
+                     gbuffer[0] || idMap[0] || depthFile[0] || gNLayers ||
+                     receptor[0] || Trajectory)
+                  {
+                     fprintf(stderr,"An animation cannot be rendered in \
+bands or tiles or with -p, -o,\n-g, -u, -i, -d, -x, -e or -n.\n");
+                     exit(1);
+                  }
+                  if(!CheckFrameFile(outFile, outFormat))
+                     exit(1);
+               }
+               
+               /* Set and scale coords in sphere list. When re-shading,
+                  the G-buffer says where the spheres were
+               */
+               NPDBAtom = NAtom;
+               if(!Reshade)
+                  MapSpheres(pdb, spheres, NAtom);
+               
+               /* Find the atoms the keyframes centre on before SLAB 
+                  removes any
+               */
+               if(gNFrames > 0)
+                  InitAnimation(spheres, NAtom);
                
                /* Remove spheres outside slab range                     */
-               if(gSlab.flag)
+               if(gSlab.flag && !Reshade)
                   spheres = SlabSphereList(spheres, &NAtom);
                
-               /* Free memory of PDB linked list                        */
-               FREELIST(pdb, PDB);
-               pdb = NULL;
+               /* The atom table for an ID map comes from the PDB file  */
+               if(idMap[0] && !WriteAtomTable(idTable, pdb))
+                  OK = FALSE;
+               
+               /* Free the array of atoms. A trajectory reads the other
+                  models into it
+               */
+               if(!Trajectory)
+               {
+                  free(pdb);
+                  pdb = NULL;
+               }
+               
+               /* Write any previews first                              */
+               if(previews && 
+                  !RenderPreviews(spheres, NAtom, previews, previewFile))
+                  OK = FALSE;
                
-               /* Run the space fill                                    */
-               if(!SpaceFill(spheres, NAtom))
+               /* Run the space fill, writing each band as it is done 
+                  if rendering in bands
+               */
+               if(Reshade)
+               {
+                  if(!ReshadeGBuffer(spheres, NAtom))
+                     OK = FALSE;
+               }
+               else if(receptor[0])
+               {
+                  if(!RenderGallery(spheres, NAtom, poseStart, NPoses, 
+                                    outFile, outFormat))
+                     OK = FALSE;
+               }
+               else if(gNFrames > 0)
+               {
+                  if(!RenderAnimation(spheres, NAtom, outFile, outFormat))
+                     OK = FALSE;
+               }
+               else if(Trajectory)
+               {
+                  if(!RenderTrajectory(InFile, pdb, NPDBAtom, spheres, 
+                                       NAtom, outFile, outFormat))
+                     OK = FALSE;
+               }
+               else
+#ifdef SUPPORT_PNG
+               if((outFormat == OUTPUT_DZI) || (outFormat == OUTPUT_XYZ))
+               {
+                  if(!RenderTiles(spheres, NAtom, outFile, outFormat))
+                     OK = FALSE;
+               }
+               else
+#endif
+               if(gBandRows > 0)
+               {
+                  if(!RenderBands(spheres, NAtom, outFile, outFormat,
+                                  checkpoint, InFile, 
+                                  DoControl ? ControlFile : DEF_CONTROL))
+                     OK = FALSE;
+               }
+               else if(!SpaceFill(spheres, NAtom))
                {
                   fprintf(stderr,"Memory allocation failed or Ctrl-C \
 pressed.\n");
                   OK = FALSE;
                }
+               else
+               {
+                  if(gNLayers && !MergeLayers())
+                     OK = FALSE;
+                  if(depthFile[0] && !WriteDepthFile(depthFile))
+                     OK = FALSE;
+                  if(gbuffer[0] && 
+                     !WriteGBuffer(gbuffer, spheres, NAtom, NPDBAtom))
+                     OK = FALSE;
+                  if(idMap[0] && !WriteAtomIDMap(idMap))
+                     OK = FALSE;
+               }
                
                /* Free the allocated space                              */
                free(spheres);
@@ -354,9 +742,11 @@ sphere list.\n");
                OK = FALSE;
             }
             
-            /* Free PDB linked list if CreateSphereList() failed        */
+            /* Free the atoms if CreateSphereList() failed or they were
+               kept for a trajectory
+            */
             if(pdb != NULL)
-               FREELIST(pdb, PDB);
+               free(pdb);
          }
          else
          {
@@ -365,20 +755,42 @@ sphere list.\n");
          }
       }
       
-      if(OK && !Quiet) 
-         fprintf(stderr,"Complete.\n");
-      
 #ifdef SHOW_INFO
       StopTime = clock();
 #endif
       
-      EndGraphics(outFile, outFormat);
+      /* Gallery, animation and trajectory pictures have already been 
+         written. A cached picture is written from the cache
+      */
+      if(cacheImage && OK && !gNFrames)
+      {
+         if(!StoreCachedImage(outFile, outFormat))
+         {
+            fprintf(stderr,"Unable to write image: %s\n", 
+                    outFile[0] ? outFile : "(stdout)");
+            OK = FALSE;
+         }
+         if(!EndGraphics(outFile, (-1)))
+            OK = FALSE;
+      }
+      else
+      {
+         if(!EndGraphics(outFile, 
+                         (receptor[0] || gNFrames || Trajectory) ? 
+                         (-1) : outFormat))
+            OK = FALSE;
+      }
+      if(poseStart != NULL)
+         free(poseStart);
+      
+      if(OK && !Quiet) 
+         fprintf(stderr,"Complete.\n");
       
 #ifdef SHOW_INFO
       if(OK && !Quiet)
       {
          fprintf(stderr,"Pixel coverage: %.3f\n",
-                 (double)sNPixels/(double)(gSize*gSize));
+                 (double)sNPixels/((double)gScreen[0]*(double)gScreen[1]));
          fprintf(stderr,"CPU Time:       %.3f seconds\n",
                  (double)(StopTime-StartTime)/CLOCKS_PER_SEC);
       }
@@ -389,7 +801,39 @@ sphere list.\n");
       UsageExit(FALSE);
    }
 
-   return(0);  
+   return(OK ? 0 : 1);  
+}
+
+
+/************************************************************************/
+/*>void SetRenderSize(int width, int height, int resolution)
+   ---------------------------------------------------------
+   Input:   int    width       Screen width
+            int    height      Screen height
+            int    resolution  Size of the square the molecule is scaled
+                               into (0 to fit it to the screen)
+
+   Sets the screen and the render area (the quad-tree covers the whole
+   screen) and gSize, the size into which the molecule is scaled. When
+   the molecule is fitted to the screen gSize is just used to scale the
+   lighting. The light is put in its default place for this size.
+
+   19.10.26 Original (extracted from main())    By: ACRM
+*/
+void SetRenderSize(int width, int height, int resolution)
+{
+   gScreen[0] = gRender[0] = width;
+   gScreen[1] = gRender[1] = height;
+   gSize      = MIN(width, height);
+   if((resolution > 0) && (resolution < gSize))
+      gSize = resolution;
+
+   /* Set up default lighting condition                                 */
+   gLight.x    = (REAL)gSize*2;
+   gLight.y    = (REAL)gSize*2;
+   gLight.z    = (REAL)gSize*5;
+   gLight.amb  = 0.3;
+   gLight.spec = FALSE;
 }
 
 
@@ -407,6 +851,10 @@ sphere list.\n");
             Radius multiplied by gSphScale when using bval
    04.10.94 Sphere radius taken from oxx rather than bval
    14.10.03 Added BOUNDS and RADII stuff
+   19.10.26 Centres on the render area. Fits the molecule to the render
+            area unless a resolution was given
+   19.10.26 Widens the bounds of each sphere for anti-aliasing
+   19.10.26 Each sphere placed by MapSphere()
 */
 void MapSpheres(PDB *pdb, SPHERE *spheres, int NSphere)
 {
@@ -415,7 +863,8 @@ void MapSpheres(PDB *pdb, SPHERE *spheres, int NSphere)
    REAL  xmin, xmax,
          ymin, ymax,
          zmin, zmax,
-         size;
+         size,
+         scale;
    BOOL  found;
    RADII *r;
    
@@ -526,48 +975,72 @@ void MapSpheres(PDB *pdb, SPHERE *spheres, int NSphere)
       gMidPoint.z = zmin + (zmax - zmin) / 2.0;
    }
 
-   size = MAX((xmax-xmin),(ymax-ymin));
+   size  = MAX((xmax-xmin),(ymax-ymin));
+   scale = gSize * gScale / size;
+
+   /* Fit the molecule to the render area, taking the aspect ratio of
+      both into account
+   */
+   if(sFitFrame && (xmax > xmin) && (ymax > ymin))
+   {
+      scale = gScale * MIN(gRender[0] / (xmax-xmin),
+                           gRender[1] / (ymax-ymin));
+   }
       
    /* Move atoms to centre picture and scale                            */
+   sMapScale = scale;
    for(i=0; i<NSphere; i++)
    {
-      spheres[i].x    -= gMidPoint.x;
-      spheres[i].x    *= gSize * gScale / size;
-      spheres[i].x    += gSize / 2;
-      
-      spheres[i].y    -= gMidPoint.y;
-      spheres[i].y    *= gSize * gScale / size;
-      spheres[i].y    += gSize / 2;
-      
-      spheres[i].z    -= gMidPoint.z;
-      spheres[i].z    *= gSize * gScale / size;
-
-      spheres[i].rad  *= gSize * gScale / size;
-
-      spheres[i].xmax = spheres[i].x + spheres[i].rad;
-      spheres[i].xmin = spheres[i].x - spheres[i].rad;
-      spheres[i].ymax = spheres[i].y + spheres[i].rad;
-      spheres[i].ymin = spheres[i].y - spheres[i].rad;
+      spheres[i].rad  *= scale;
+      MapSphere(&(spheres[i]), spheres[i].x, spheres[i].y, spheres[i].z);
    }
 
    /* Apply z scaling to the Slab information                           */
    gSlab.z     -= gMidPoint.z;
-   gSlab.z     *= gSize * gScale / size;
-   gSlab.depth *= gSize * gScale / size;
+   gSlab.z     *= scale;
+   gSlab.depth *= scale;
    
 #ifdef DEPTHCUE
    /* Calculate values for depth cueing                                 */
    zmin             -= gMidPoint.z;
-   gDepthCue.ZMin    = zmin * gSize * gScale / size;
+   gDepthCue.ZMin    = zmin * scale;
    
    zmax             -= gMidPoint.z;
-   zmax             *= gSize * gScale / size;
+   zmax             *= scale;
    
    gDepthCue.ZRange  = zmax - gDepthCue.ZMin;
 #endif
 }
 
 
+/************************************************************************/
+/*>void MapSphere(SPHERE *sphere, REAL x, REAL y, REAL z)
+   ------------------------------------------------------
+   Input:   REAL   x,y,z       Coordinates of the atom
+   I/O:     SPHERE *sphere     Sphere with its radius already scaled
+
+   Places a sphere on the screen with the scale and centre found by
+   MapSpheres(). With anti-aliasing, the pixels just outside a sphere
+   may be partly covered by it, so its bounds are widened.
+
+   19.10.26 Original (split from MapSpheres())    By: ACRM
+*/
+void MapSphere(SPHERE *sphere, REAL x, REAL y, REAL z)
+{
+   REAL fringe;
+
+   sphere->x    = (x - gMidPoint.x) * sMapScale + gRender[0] / 2;
+   sphere->y    = (y - gMidPoint.y) * sMapScale + gRender[1] / 2;
+   sphere->z    = (z - gMidPoint.z) * sMapScale;
+
+   fringe       = gAntiAlias ? AA_FRINGE : 0.0;
+   sphere->xmax = sphere->x + sphere->rad + fringe;
+   sphere->xmin = sphere->x - sphere->rad - fringe;
+   sphere->ymax = sphere->y + sphere->rad + fringe;
+   sphere->ymin = sphere->y - sphere->rad - fringe;
+}
+
+
 /************************************************************************/
 /*>SPHERE *CreateSphereList(PDB *pdb, int NAtom)
    ---------------------------------------------
@@ -582,6 +1055,7 @@ void MapSpheres(PDB *pdb, SPHERE *spheres, int NSphere)
             Added depth cue handling
    22.07.93 Separated out MapSpheres()
    17.10.07 Sets .highlight
+   19.10.26 Sets .atom
 */
 SPHERE *CreateSphereList(PDB *pdb, int NAtom)
 {
@@ -594,6 +1068,7 @@ SPHERE *CreateSphereList(PDB *pdb, int NAtom)
       /* Set colour info in sphere list                                 */
       for(p=pdb,NSphere=0; p!=NULL; NEXT(p), NSphere++)
       {
+         sp[NSphere].atom        = NSphere;
          sp[NSphere].set         = FALSE;
          sp[NSphere].highlight   = 0;
          
@@ -651,14 +1126,183 @@ SPHERE *CreateSphereList(PDB *pdb, int NAtom)
    20.07.93 Added onbreak() for Amiga. Corrected call to SplitPic() to
             use NSphOut, not NSphere
    18.10.07 Added casts to onbreak()
+   19.10.26 Covers the render area rather than a gSize square
+   19.10.26 Work moved to SpaceFillRegion()
+   19.10.26 Only covers the part of the render area in the image
 */
 BOOL SpaceFill(SPHERE *AllSpheres, int NSphere)
 {
-   int      NSphOut     = 0;
-   SPHERE   **SrtSph    = NULL,
-            **spheres   = NULL;
+   SPHERE   **SrtSph    = NULL;
+   BOOL     retval;
+   
+   /* Create an index into AllSpheres sorted on x                       */
+   if((SrtSph = SortSpheresOnX(AllSpheres, NSphere)) == NULL)
+      return(FALSE);
 
+   retval = SpaceFillRows(SrtSph, NSphere, 0, gScreen[1]);
+   
+   free(SrtSph);
+   return(retval);
+}
+
+
+/************************************************************************/
+/*>BOOL SpaceFillRows(SPHERE **SrtSph, int NSphere, int top, int nrows)
+   --------------------------------------------------------------------
+   Input:   SPHERE **SrtSph    Spheres sorted on x (from SortSpheresOnX())
+            int    NSphere     Number of spheres
+            int    top         First row of the image
+            int    nrows       Number of rows
+   Returns: BOOL               Success?
+
+   Runs the quad tree over the part of the render area which appears
+   in the given rows of the image. The image may be a window on the 
+   render area (gOrigin) and screen rows run downwards while the render
+   area runs upwards. Highlight borders are then drawn over the top.
+   A border reaches gBorderWidth pixels left of and below the pixel it
+   starts from, and whether a pixel starts one depends on the pixels 
+   around it, so a margin around the image is also covered.
+
+   19.10.26 Original    By: ACRM
+   19.10.26 Draws highlight borders with DrawBorders()
+*/
+BOOL SpaceFillRows(SPHERE **SrtSph, int NSphere, int top, int nrows)
+{
+   int  x0, y0, x1, y1;
+   BOOL retval;
    
+   ImageRegion(top, nrows, &x0, &y0, &x1, &y1);
+   InitBorders(x0, y0, x1, y1);
+   retval = RunQuadTree(SrtSph, NSphere, x0, y0, x1, y1, -1);
+   if(!DrawBorders())
+      retval = FALSE;
+   return(retval);
+}
+
+
+/************************************************************************/
+/*>BOOL SpaceFillPreview(SPHERE **SrtSph, int NSphere, int depth)
+   --------------------------------------------------------------
+   Input:   SPHERE **SrtSph    Spheres sorted on x (from SortSpheresOnX())
+            int    NSphere     Number of spheres
+            int    depth       Levels of the quad tree to go down
+   Returns: BOOL               Success?
+
+   Makes a preview of the image by going only depth levels down the 
+   quad tree and colouring one pixel for each block there. The 
+   framebuffer should be cleared first.
+
+   19.10.26 Original    By: ACRM
+*/
+BOOL SpaceFillPreview(SPHERE **SrtSph, int NSphere, int depth)
+{
+   int  x0, y0, x1, y1;
+   BOOL retval;
+#ifdef SHOW_INFO
+   int  NPixels = sNPixels;
+#endif
+   
+   ImageRegion(0, gScreen[1], &x0, &y0, &x1, &y1);
+   retval = RunQuadTree(SrtSph, NSphere, x0, y0, x1, y1, depth);
+
+#ifdef SHOW_INFO
+   /* Only count pixels coloured in the real image                      */
+   sNPixels = NPixels;
+#endif
+
+   return(retval);
+}
+
+
+/************************************************************************/
+/*>static void ImageRegion(int top, int nrows, int *x0, int *y0, 
+                           int *x1, int *y1)
+   -------------------------------------------------------------
+   Input:   int    top         First row of the image
+            int    nrows       Number of rows
+   Output:  int    *x0,*y0     Bottom left of the render area to cover
+            int    *x1,*y1     Top right (exclusive)
+
+   Finds the part of the render area to cover for the given rows of the
+   image. See SpaceFillRows().
+
+   19.10.26 Original (split from SpaceFillRows())    By: ACRM
+   19.10.26 Margin of BORDER_NEIGHBOUR all round for DrawBorders()
+*/
+static void ImageRegion(int top, int nrows, int *x0, int *y0, int *x1,
+                        int *y1)
+{
+   *x0 = gOrigin[0] - BORDER_NEIGHBOUR;
+   *x1 = gOrigin[0] + gScreen[0] + gBorderWidth + BORDER_NEIGHBOUR;
+   *y1 = gRender[1] - gOrigin[1] - top;
+   *y0 = *y1 - nrows - BORDER_NEIGHBOUR;
+   *y1 += gBorderWidth + BORDER_NEIGHBOUR;
+
+   if(*x0 < 0)          *x0 = 0;
+   if(*y0 < 0)          *y0 = 0;
+   if(*x1 > gRender[0]) *x1 = gRender[0];
+   if(*y1 > gRender[1]) *y1 = gRender[1];
+}
+
+
+/************************************************************************/
+/*>BOOL SpaceFillRegion(SPHERE **SrtSph, int NSphere, int x0, int y0,
+                        int x1, int y1)
+   ------------------------------------------------------------------
+   Input:   SPHERE **SrtSph    Spheres sorted on x (from SortSpheresOnX())
+            int    NSphere     Number of spheres
+            int    x0,y0       Bottom left of the region (inclusive)
+            int    x1,y1       Top right of the region (exclusive)
+   Returns: BOOL               Success?
+
+   Runs the quad tree over one rectangle of the render area, clipped to
+   the part needed for the image, and draws highlight borders in it.
+
+   19.10.26 Original (split from SpaceFill())    By: ACRM
+   19.10.26 Clipped to ImageRegion(). Draws highlight borders
+*/
+BOOL SpaceFillRegion(SPHERE **SrtSph, int NSphere, int x0, int y0, 
+                     int x1, int y1)
+{
+   int  rx0, ry0, rx1, ry1;
+   BOOL retval;
+   
+   ImageRegion(0, gScreen[1], &rx0, &ry0, &rx1, &ry1);
+   if(x0 < rx0) x0 = rx0;
+   if(y0 < ry0) y0 = ry0;
+   if(x1 > rx1) x1 = rx1;
+   if(y1 > ry1) y1 = ry1;
+   
+   InitBorders(x0, y0, x1, y1);
+   retval = RunQuadTree(SrtSph, NSphere, x0, y0, x1, y1, -1);
+   if(!DrawBorders())
+      retval = FALSE;
+   return(retval);
+}
+
+
+/************************************************************************/
+/*>static BOOL RunQuadTree(SPHERE **SrtSph, int NSphere, int x0, int y0,
+                           int x1, int y1, int depth)
+   ---------------------------------------------------------------------
+   Input:   SPHERE **SrtSph    Spheres sorted on x (from SortSpheresOnX())
+            int    NSphere     Number of spheres
+            int    x0,y0       Bottom left of the region (inclusive)
+            int    x1,y1       Top right of the region (exclusive)
+            int    depth       Depth for a preview (-1 for the image)
+   Returns: BOOL               Success?
+
+   Sets up for unwinding from errors and Ctrl-C and starts the quad 
+   tree.
+
+   19.10.26 Original (split from SpaceFillRegion())    By: ACRM
+*/
+static BOOL RunQuadTree(SPHERE **SrtSph, int NSphere, int x0, int y0, 
+                        int x1, int y1, int depth)
+{
+   int      NSphOut     = 0;
+   SPHERE   **spheres   = NULL;
+
    /* Assume all OK (no error has occurred)                             */
    sOKFlag = TRUE;
    
@@ -672,20 +1316,16 @@ BOOL SpaceFill(SPHERE *AllSpheres, int NSphere)
       splitting process and will only be set if we have returned here 
       via longjmp()
    */
-   if(sOKFlag)
+   if(sOKFlag && (x1 > x0) && (y1 > y0))
    {
-      /* Create an index into AllSpheres sorted on x                    */
-      if((SrtSph = SortSpheresOnX(AllSpheres, NSphere)) != NULL)
+      /* Extract list which is within the bounds of the region          */
+      if((spheres = UpdateSphereList((REAL)x0, (REAL)y0,
+                                     (REAL)x1, (REAL)y1,
+                                     SrtSph,   NSphere,
+                                     &NSphOut)) != NULL)
       {
-         /* Extract list which is within the bounds of the screen       */
-         if((spheres = UpdateSphereList((REAL)0,    (REAL)0,
-                                        (REAL)gSize, (REAL)gSize,
-                                        SrtSph,     NSphere,
-                                        &NSphOut)) != NULL)
-         {
-            /* Call recursive quad-tree routine.                        */
-            SplitPic(0,0,gSize,gSize,spheres,NSphOut);
-         }
+         /* Call recursive quad-tree routine.                           */
+         SplitPic(x0,y0,x1,y1,spheres,NSphOut,depth);
       }
    }
    
@@ -694,7 +1334,6 @@ BOOL SpaceFill(SPHERE *AllSpheres, int NSphere)
    
    /* Free memory                                                       */
    if(spheres != NULL)  free(spheres);
-   if(SrtSph  != NULL)  free(SrtSph);
    
    return(sOKFlag);
 }
@@ -702,7 +1341,7 @@ BOOL SpaceFill(SPHERE *AllSpheres, int NSphere)
 
 /************************************************************************/
 /*>void SplitPic(int x0, int y0, int x1, int y1, SPHERE **spheres,
-                 int NSphere)
+                 int NSphere, int depth)
    ---------------------------------------------------------------
    This is the recursive quad-tree algorithm. Takes the top left and
    bottom right of the pixel block and the current array of sphere 
@@ -711,12 +1350,22 @@ BOOL SpaceFill(SPHERE *AllSpheres, int NSphere)
    If the picture contains only 1 pixel, the shading algorithm is called 
    instead, ending the recursion
    
+   The block may be any rectangle. A dimension of odd size is split
+   unevenly and a dimension which is down to one pixel is not split, so
+   some blocks have only two quadrants.
+
+   depth is normally -1. For a preview, it is the number of levels 
+   still to go; at 0, one pixel near the middle of the block is 
+   coloured and copied over the block.
+
    19.07.93 Original    By: ACRM
    20.07.93 Added chkabort() for Amiga
    21.07.93 Cast x0 and y0 to REAL in call to ColourPixel
+   19.10.26 Handles rectangular blocks of any size
+   19.10.26 Added depth for previews
 */
 void SplitPic(int x0, int y0, int x1, int y1, SPHERE **spheres,
-              int NSphere)
+              int NSphere, int depth)
 {
    SPHERE   **SplitSpheres = NULL;
    int      xm,
@@ -732,11 +1381,20 @@ void SplitPic(int x0, int y0, int x1, int y1, SPHERE **spheres,
    {
       ColourPixel(x0, y0, spheres, NSphere);
    }
+   else if(depth == 0)
+   {
+      PreviewBlock(x0, y0, x1, y1, spheres, NSphere);
+   }
    else
    {
-      /* Find mid point of current square                               */
-      xm = x0 + (x1-x0)/2;
-      ym = y0 + (y1-y0)/2;
+      if(depth > 0)
+         depth--;
+      
+      /* Find mid point of current block. If it is only one pixel wide 
+         (or high) the `right' (or `bottom') quadrants are empty
+      */
+      xm = (x1-x0 > 1) ? x0 + (x1-x0)/2 : x1;
+      ym = (y1-y0 > 1) ? y0 + (y1-y0)/2 : y1;
       
       /* Recurse for the top left quadrants                             */
       if((SplitSpheres = UpdateSphereList((REAL)x0, (REAL)y0,
@@ -744,37 +1402,40 @@ void SplitPic(int x0, int y0, int x1, int y1, SPHERE **spheres,
                                           spheres,  NSphere,
                                           &NSphOut)) != NULL)
       {
-         SplitPic(x0,y0,xm,ym,SplitSpheres,NSphOut);
+         SplitPic(x0,y0,xm,ym,SplitSpheres,NSphOut,depth);
          free(SplitSpheres);
       }
       
       /* Recurse for the top right quadrants                            */
-      if((SplitSpheres = UpdateSphereList((REAL)xm, (REAL)y0,
-                                          (REAL)x1, (REAL)ym,
-                                          spheres,  NSphere,
-                                          &NSphOut)) != NULL)
+      if((xm < x1) &&
+         ((SplitSpheres = UpdateSphereList((REAL)xm, (REAL)y0,
+                                           (REAL)x1, (REAL)ym,
+                                           spheres,  NSphere,
+                                           &NSphOut)) != NULL))
       {
-         SplitPic(xm,y0,x1,ym,SplitSpheres,NSphOut);
+         SplitPic(xm,y0,x1,ym,SplitSpheres,NSphOut,depth);
          free(SplitSpheres);
       }
       
       /* Recurse for the bottom left quadrants                          */
-      if((SplitSpheres = UpdateSphereList((REAL)x0, (REAL)ym,
-                                          (REAL)xm, (REAL)y1,
-                                          spheres,  NSphere,
-                                          &NSphOut)) != NULL)
+      if((ym < y1) &&
+         ((SplitSpheres = UpdateSphereList((REAL)x0, (REAL)ym,
+                                           (REAL)xm, (REAL)y1,
+                                           spheres,  NSphere,
+                                           &NSphOut)) != NULL))
       {
-         SplitPic(x0,ym,xm,y1,SplitSpheres,NSphOut);
+         SplitPic(x0,ym,xm,y1,SplitSpheres,NSphOut,depth);
          free(SplitSpheres);
       }
       
       /* Recurse for the bottom right quadrants                         */
-      if((SplitSpheres = UpdateSphereList((REAL)xm, (REAL)ym,
-                                          (REAL)x1, (REAL)y1,
-                                          spheres,  NSphere,
-                                          &NSphOut)) != NULL)
+      if((xm < x1) && (ym < y1) &&
+         ((SplitSpheres = UpdateSphereList((REAL)xm, (REAL)ym,
+                                           (REAL)x1, (REAL)y1,
+                                           spheres,  NSphere,
+                                           &NSphOut)) != NULL))
       {
-         SplitPic(xm,ym,x1,y1,SplitSpheres,NSphOut);
+         SplitPic(xm,ym,x1,y1,SplitSpheres,NSphOut,depth);
          free(SplitSpheres);
       }
    }
@@ -942,6 +1603,49 @@ SPHERE **SortSpheresOnX(SPHERE *AllSpheres, int NSphere)
 }
 
 
+/************************************************************************/
+/*>BOOL ResortSpheresOnX(SPHERE **sp, int NSphere)
+   -----------------------------------------------
+   I/O:     SPHERE **sp        Index from SortSpheresOnX() whose spheres
+                               have since moved
+   Input:   int    NSphere     Number of spheres
+   Returns: BOOL               Is the index sorted again?
+
+   Re-sorts the index on x with an insertion sort. When the spheres
+   have only moved a little (as between the frames of an animation) the
+   index is nearly in order and this is much faster than the heapsort.
+   Gives up, returning FALSE, once the spheres have been moved a few
+   times as far as there are spheres; a new index should then be made
+   with SortSpheresOnX().
+
+   19.10.26 Original    By: ACRM
+*/
+BOOL ResortSpheresOnX(SPHERE **sp, int NSphere)
+{
+   SPHERE   *temp;
+   int      i, j;
+   long     moves = 0,
+            maxMoves;
+   REAL     q;
+
+   maxMoves = RESORT_MOVES * (long)NSphere;
+
+   for(i=1; i<NSphere; i++)
+   {
+      temp = sp[i];
+      q    = temp->x;
+      for(j=i; (j>0) && ((sp[j-1])->x > q); j--)
+         sp[j] = sp[j-1];
+      sp[j] = temp;
+
+      if((moves += i-j) > maxMoves)
+         return(FALSE);
+   }
+
+   return(TRUE);
+}
+
+
 /************************************************************************/
 /*>void ColourPixel(int x, int y, SPHERE **spheres, int NSphere)
    ---------------------------------------------------------------
@@ -954,68 +1658,34 @@ SPHERE **SortSpheresOnX(SPHERE *AllSpheres, int NSphere)
    21.07.93 Made x and y real
    23.07.93 Removed the Z sorting; always run through the whole list.
    18.10.07 Made x and y ints the cast them inside here
+   19.10.26 Calls AntiAliasPixel() if gAntiAlias is set
+   19.10.26 Records the front sphere for the G-buffer
+   19.10.26 Highlight borders are drawn afterwards by DrawBorders() 
+            rather than by calling FindSphere() for the neighbours
 */
 void ColourPixel(int xi, int yi, SPHERE **spheres, int NSphere)
 {
    REAL           x, y,
-                  MaxZ,
-                  junk;
-   int            FrontSphere = (-1),
-                  sph,
-                  xx, yy;
-   BOOL           border;
+                  MaxZ;
+   int            FrontSphere = (-1);
 
+   /* Anti-aliasing handles all but highlighted spheres                 */
+   if(gAntiAlias && AntiAliasPixel(xi, yi, spheres, NSphere))
+      return;
+   
    /* Cast x and y as REALs                                             */
    x = (REAL)xi;
    y = (REAL)yi;
 
    FrontSphere = FindSphere(x, y, spheres, NSphere, &MaxZ);
    
-   /* Shade the pixel                                                   */
+   /* Shade the pixel, noting highlighted spheres for their borders     */
    if(FrontSphere != (-1))
    {
+      SetPixelSphere(xi, yi, spheres[FrontSphere]->atom, MaxZ);
       if(spheres[FrontSphere]->highlight)
-      {
-         border = FALSE;
-         for(xx = xi-BORDER_NEIGHBOUR; xx <= xi+BORDER_NEIGHBOUR; xx++)
-         {
-            for(yy = yi-BORDER_NEIGHBOUR; yy <= yi+BORDER_NEIGHBOUR; yy++)
-            {
-               sph = FindSphere((REAL)xx, (REAL)yy,
-                                   spheres, NSphere, &junk);
-               if((sph==(-1)) ||
-                  (spheres[sph]->highlight != 
-                   spheres[FrontSphere]->highlight))
-               {
-                  border = TRUE;
-                  xx = xi+BORDER_NEIGHBOUR+BORDER_NEIGHBOUR;
-                  break;
-               }
-            }
-         }
-         
-         if(border)
-         {
-            for(xx = xi-gBorderWidth; xx <= xi; xx++)
-            {
-               for(yy = yi-gBorderWidth; yy <= yi; yy++)
-               {
-                  SetPixel(xx, yy, 
-                           spheres[FrontSphere]->hr,
-                           spheres[FrontSphere]->hg,
-                           spheres[FrontSphere]->hb);
-               }
-            }
-         }
-         else
-         {
-            ShadePixel(x, y, MaxZ, spheres[FrontSphere]);
-         }
-      }
-      else
-      {
-         ShadePixel(x, y, MaxZ, spheres[FrontSphere]);
-      }
+         SetPixelHighlight(xi, yi, spheres[FrontSphere]);
+      ShadePixel(x, y, MaxZ, spheres[FrontSphere]);
    }
 }
 
@@ -1063,6 +1733,240 @@ int FindSphere(REAL x, REAL y, SPHERE **spheres, int NSphere, REAL *MaxZ)
    return(FrontSphere);
 }   
 
+/************************************************************************/
+/*>BOOL AntiAliasPixel(int xi, int yi, SPHERE **spheres, int NSphere)
+   ------------------------------------------------------------------
+   Input:   int    xi, yi      Pixel
+            SPHERE **spheres   Spheres which may cover the pixel
+            int    NSphere     Number of spheres
+   Returns: BOOL               Was the pixel coloured? FALSE if the 
+                               front sphere is highlighted
+
+   Colours a pixel with anti-aliased edges. One pass through the 
+   spheres finds the front and next sphere at the pixel centre and any
+   spheres whose edge passes within half a pixel of the centre. The 
+   fraction of the pixel covered by a sphere is then taken from the
+   distance of the centre to the edge (in pixels) plus 0.5, as though
+   the edge were straight across the pixel. 
+
+   - If the edge of a sphere in front crosses the pixel, the colour 
+     just inside that edge is mixed with what is behind it.
+   - If the pixel is at the edge of the front sphere, it is mixed with
+     the next sphere or the background.
+   - Otherwise, if the front and next spheres cut each other within
+     the pixel, they are mixed. The distance to the line where they 
+     cut is the difference in their depth divided by the gradient of
+     that difference.
+
+   Pixels which are not at an edge come out exactly as ShadePixel()
+   would colour them.
+
+   19.10.26 Original    By: ACRM
+   19.10.26 Records the depth of an edge over the background
+*/
+BOOL AntiAliasPixel(int xi, int yi, SPHERE **spheres, int NSphere)
+{
+   SPHERE *front = NULL,
+          *back  = NULL,
+          *edge  = NULL,
+          *rim[AA_MAXRIM];
+   REAL   x, y,
+          XOff, YOff,
+          q, z, d, k,
+          zFront = 0.0,
+          zBack  = 0.0,
+          cover  = 1.0,
+          rimCover[AA_MAXRIM],
+          hf, hb,
+          gx, gy,
+          r1, g1, b1,
+          r2, g2, b2;
+   int    i,
+          nrim   = 0;
+
+   x = (REAL)xi;
+   y = (REAL)yi;
+
+   /* As FindSphere(), but also keep the next sphere back and any 
+      spheres whose edge is within half a pixel
+   */
+   for(i=NSphere-1; i>=0; i--)
+   {
+      XOff = x - spheres[i]->x;
+      YOff = y - spheres[i]->y;
+      q    = (spheres[i]->rad * spheres[i]->rad) - 
+             (XOff * XOff) -
+             (YOff * YOff);
+
+      if(q >= 0.0)
+      {
+         z = sqrt(q) + spheres[i]->z;
+         if((front == NULL) || (z > zFront))
+         {
+            back   = front;
+            zBack  = zFront;
+            front  = spheres[i];
+            zFront = z;
+         }
+         else if((back == NULL) || (z > zBack))
+         {
+            back  = spheres[i];
+            zBack = z;
+         }
+      }
+      else if((q > -(spheres[i]->rad + 0.25)) && (nrim < AA_MAXRIM))
+      {
+         /* Distance from the edge is under half a pixel                */
+         rim[nrim]      = spheres[i];
+         rimCover[nrim] = spheres[i]->rad + 0.5 - 
+                          sqrt(XOff * XOff + YOff * YOff);
+         nrim++;
+      }
+   }
+
+   if((front != NULL) && front->highlight)
+      return(FALSE);
+   if(front != NULL)
+      SetPixelSphere(xi, yi, front->atom, zFront);
+
+   /* Find the front-most sphere whose edge crosses this pixel in front
+      of whatever is at the centre. At its edge, a sphere is at the 
+      depth of its centre
+   */
+   for(i=0; i<nrim; i++)
+   {
+      if(!rim[i]->highlight &&
+         ((front == NULL) || (rim[i]->z > zFront)) &&
+         ((edge  == NULL) || (rim[i]->z > edge->z)))
+      {
+         edge  = rim[i];
+         cover = rimCover[i];
+      }
+   }
+
+   if(edge != NULL)
+   {
+      /* Colour just inside the edge, nearest this pixel                */
+      XOff = x - edge->x;
+      YOff = y - edge->y;
+      d    = sqrt(XOff * XOff + YOff * YOff);
+      k    = (edge->rad > AA_FRINGE) ? (edge->rad - AA_FRINGE) / d : 0.0;
+      q    = edge->rad * edge->rad - k * k * d * d;
+      ShadeColour(edge->x + k * XOff, edge->y + k * YOff,
+                  edge->z + sqrt(MAX(q, 0.0)), edge, &r1, &g1, &b1);
+
+      if(front != NULL)
+      {
+         ShadeColour(x, y, zFront, front, &r2, &g2, &b2);
+         SetPixel(xi, yi, 
+                  cover * r1 + (1.0 - cover) * r2,
+                  cover * g1 + (1.0 - cover) * g2,
+                  cover * b1 + (1.0 - cover) * b2);
+      }
+      else
+      {
+         BlendPixel(xi, yi, r1, g1, b1, cover);
+         SetPixelDepth(xi, yi, edge->z);
+      }
+#ifdef SHOW_INFO
+      sNPixels++;
+#endif
+      return(TRUE);
+   }
+
+   if(front == NULL)
+      return(TRUE);
+
+#ifdef SHOW_INFO
+   sNPixels++;
+#endif
+   ShadeColour(x, y, zFront, front, &r1, &g1, &b1);
+
+   /* Is the pixel at the edge of the front sphere?                     */
+   XOff = x - front->x;
+   YOff = y - front->y;
+   d    = front->rad - sqrt(XOff * XOff + YOff * YOff);
+   if(d < AA_FRINGE)
+   {
+      cover = d + 0.5;
+   }
+   else if(back != NULL)
+   {
+      /* Does it cut the next sphere in this pixel? Only if that sphere
+         covers the whole pixel, so its surface is not too steep
+      */
+      XOff = x - back->x;
+      YOff = y - back->y;
+      hf   = zFront - front->z;
+      hb   = zBack  - back->z;
+      if(back->rad - sqrt(XOff * XOff + YOff * YOff) >= AA_FRINGE)
+      {
+         /* Gradient of the difference in depth                         */
+         gx = (x - back->x) / hb - (x - front->x) / hf;
+         gy = (y - back->y) / hb - (y - front->y) / hf;
+         d  = sqrt(gx * gx + gy * gy) * AA_FRINGE;
+         if(zFront - zBack < d)
+            cover = 0.5 + AA_FRINGE * (zFront - zBack) / d;
+      }
+   }
+
+   if(cover >= 1.0)
+   {
+      SetPixel(xi, yi, r1, g1, b1);
+   }
+   else if(back != NULL)
+   {
+      ShadeColour(x, y, zBack, back, &r2, &g2, &b2);
+      SetPixel(xi, yi, 
+               cover * r1 + (1.0 - cover) * r2,
+               cover * g1 + (1.0 - cover) * g2,
+               cover * b1 + (1.0 - cover) * b2);
+   }
+   else
+   {
+      BlendPixel(xi, yi, r1, g1, b1, cover);
+   }
+
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>void PreviewBlock(int x0, int y0, int x1, int y1, SPHERE **spheres,
+                     int NSphere)
+   -------------------------------------------------------------------
+   Input:   int    x0,y0       Bottom left of the block (inclusive)
+            int    x1,y1       Top right of the block (exclusive)
+            SPHERE **spheres   Spheres which may cover the block
+            int    NSphere     Number of spheres
+
+   Colours one pixel near the middle of a block of the render area and
+   copies it over the rest of the block to give a preview. Only the 
+   part of the block inside the image is used.
+
+   19.10.26 Original    By: ACRM
+*/
+void PreviewBlock(int x0, int y0, int x1, int y1, SPHERE **spheres,
+                  int NSphere)
+{
+   int xc, yc;
+   
+   /* Clip to the image                                                 */
+   x0 = MAX(x0, gOrigin[0]);
+   x1 = MIN(x1, gOrigin[0] + gScreen[0]);
+   y0 = MAX(y0, gRender[1] - gOrigin[1] - gScreen[1]);
+   y1 = MIN(y1, gRender[1] - gOrigin[1]);
+
+   if((x1 > x0) && (y1 > y0))
+   {
+      xc = x0 + (x1-x0)/2;
+      yc = y0 + (y1-y0)/2;
+      ColourPixel(xc, yc, spheres, NSphere);
+      SpreadPixel(xc, yc, x0, y0, x1, y1);
+   }
+}
+
+
 /************************************************************************/
 /*>int FarLeftSearch(SPHERE **spheres, int NSphere, REAL x)
    --------------------------------------------------------
@@ -1173,13 +2077,42 @@ void onbreak(void *func)
    20.07.93 Modified and corrected specular reflection code
    21.07.93 Added depth cue handling
    23.07.93 Added pixel count
+   19.10.26 Observer is over the centre of the render area
+   19.10.26 Colour calculation split out to ShadeColour()
 */
 void ShadePixel(REAL x, REAL y, REAL z, SPHERE *sphere)
+{
+   REAL rr, gg, bb;
+
+#ifdef SHOW_INFO
+   sNPixels++;
+#endif
+
+   ShadeColour(x, y, z, sphere, &rr, &gg, &bb);
+   SetPixel((int)x, (int)y, rr, gg, bb);
+}
+
+
+/************************************************************************/
+/*>void ShadeColour(REAL x, REAL y, REAL z, SPHERE *sphere, REAL *rr,
+                    REAL *gg, REAL *bb)
+   ------------------------------------------------------------------
+   Input:   REAL   x, y, z     Point on the sphere surface
+            SPHERE *sphere     The sphere
+   Output:  REAL   *rr,*gg,*bb Colour of the point (0.0-1.0)
+
+   Calculates the colour of a point on a sphere.
+   If SPEC is defined, specular reflections will be considered.
+   If DEPTHCUE is defined, handle depth cueing.
+
+   19.10.26 Original (split from ShadePixel())    By: ACRM
+*/
+void ShadeColour(REAL x, REAL y, REAL z, SPHERE *sphere, REAL *rr, 
+                 REAL *gg, REAL *bb)
 {
    VEC3F L,             /* Vector from surface point to light           */
          N;             /* Surface normal vector                        */
    REAL  dot,
-         rr, gg, bb,
          cosval,
          NLen,
          LLen;
@@ -1195,11 +2128,6 @@ void ShadePixel(REAL x, REAL y, REAL z, SPHERE *sphere)
 #endif
 
 
-#ifdef SHOW_INFO
-   sNPixels++;
-#endif
-
-
    /* Calculate surface normal                                          */
    N.x        = x - sphere->x;
    N.y        = y - sphere->y;
@@ -1230,9 +2158,9 @@ void ShadePixel(REAL x, REAL y, REAL z, SPHERE *sphere)
    if(cosval < 0.0) cosval = 0.0;
    
    /* Calculate diffuse reflection colour components                    */
-   rr = sphere->r * ((1.0-gLight.amb)*cosval + gLight.amb);
-   gg = sphere->g * ((1.0-gLight.amb)*cosval + gLight.amb);
-   bb = sphere->b * ((1.0-gLight.amb)*cosval + gLight.amb);
+   *rr = sphere->r * ((1.0-gLight.amb)*cosval + gLight.amb);
+   *gg = sphere->g * ((1.0-gLight.amb)*cosval + gLight.amb);
+   *bb = sphere->b * ((1.0-gLight.amb)*cosval + gLight.amb);
 
 
 #ifdef SPEC
@@ -1253,8 +2181,8 @@ void ShadePixel(REAL x, REAL y, REAL z, SPHERE *sphere)
                     R.z * R.z);
       
       /* Observer                                                       */
-      V.x = gSize/2.0 - x;
-      V.y = gSize/2.0 - y;
+      V.x = gRender[0]/2.0 - x;
+      V.y = gRender[1]/2.0 - y;
       V.z = gSize*5.0 - z;
       VLen   = sqrt(V.x * V.x + 
                     V.y * V.y + 
@@ -1273,17 +2201,15 @@ void ShadePixel(REAL x, REAL y, REAL z, SPHERE *sphere)
       else
          spec = sphere->shine * pow(cosval,sphere->metallic);
    
-      rr += spec;
-      gg += spec;
-      bb += spec;
+      *rr += spec;
+      *gg += spec;
+      *bb += spec;
    }
 #endif
 
-   if(rr > 1.0) rr = 1.0;
-   if(gg > 1.0) gg = 1.0;
-   if(bb > 1.0) bb = 1.0;
-   
-   SetPixel((int)x, (int)y, rr, gg, bb);
+   if(*rr > 1.0) *rr = 1.0;
+   if(*gg > 1.0) *gg = 1.0;
+   if(*bb > 1.0) *bb = 1.0;
 }
 
 
@@ -1351,7 +2277,12 @@ SPHERE *SlabSphereList(SPHERE *spheres, int *Natom)
                      BOOL *DoControl, char *ControlFile, 
                      BOOL *DoBallStick, 
                      BOOL *DoResolution, int *resolution, BOOL *quiet,
-                     int *screenx, int *screeny, int *outFormat)
+                     int *screenx, int *screeny, int *outFormat,
+                     int *fbLayout, int *nThreads, int *bandRows,
+                     char *checkpoint, int *window, 
+                     unsigned long *previews, char *previewFile,
+                     char *gbuffer, BOOL *reshade, char *idMap,
+                     char *idTable, char *depthFile, char *receptor)
    ---------------------------------------------------------------------
    Input:   int    argc               Argument count
             char   **argv             Argument array
@@ -1366,22 +2297,77 @@ SPHERE *SlabSphereList(SPHERE *spheres, int *Natom)
             int    *screenx           X image size
             int    *screeny           Y image size
             int    *outFormat         Output format
+            int    *fbLayout          Framebuffer layout
+            int    *nThreads          Number of worker threads
+            int    *bandRows          Rows per band (0 for no bands)
+            char   *checkpoint        Checkpoint file (or blank string)
+            int    *window            Window on the screen: x, y, width
+                                      and height (width 0 for none)
+            unsigned long *previews   Bit n set for a preview at level n
+            char   *previewFile       Preview file (or blank string)
+            char   *gbuffer           G-buffer file (or blank string)
+            BOOL   *reshade           Re-shade the G-buffer rather than
+                                      saving it
+            char   *idMap             Atom ID map file (or blank string)
+            char   *idTable           Atom table file for the map
+            char   *depthFile         Depth file (or blank string)
+            char   *receptor          Receptor for a gallery (or blank 
+                                      string)
+            BOOL   *trajectory        Render each model as a frame
+            char   *manifest          Manifest for a batch (or blank 
+                                      string)
+            char   *socketName        Socket for the daemon (or blank
+                                      string)
+            char   *cacheDir          Image cache directory (or blank
+                                      string)
+            int    *cacheSize         Size of the image cache in Mb
    Returns: BOOL                      Success?
 
    Parse the command line
    
    28.03.95 Original    By: ACRM
    19.08.19 Added outFormat
+   19.10.26 Added fbLayout. Added raw output formats. Added -z
+   19.10.26 Added -t
+   19.10.26 Added QOI format
+   19.10.26 Added -l and -k
+   19.10.26 Added DZI and XYZ formats
+   19.10.26 Added -w
+   19.10.26 Added -p
+   19.10.26 Added -o. Format names parsed by ParseFormat()
+   19.10.26 Added -a
+   19.10.26 Added -g and -u
+   19.10.26 Added -i
+   19.10.26 Added -d and -x
+   19.10.26 Added -e
+   19.10.26 Added -n
+   19.10.26 Added -j
+   19.10.26 Added -v
+   19.10.26 Added -y
 */
 BOOL ParseCmdLine(int argc, char **argv, char *infile, char *outfile, 
                   BOOL *DoControl, char *ControlFile, BOOL *DoBallStick, 
                   BOOL *DoResolution, int *resolution, BOOL *quiet,
-                  int *screenx, int *screeny, int *outFormat)
+                  int *screenx, int *screeny, int *outFormat,
+                  int *fbLayout, int *nThreads, int *bandRows,
+                  char *checkpoint, int *window, 
+                  unsigned long *previews, char *previewFile,
+                  char *gbuffer, BOOL *reshade, char *idMap,
+                  char *idTable, char *depthFile, char *receptor,
+                  BOOL *trajectory, char *manifest, char *socketName,
+                  char *cacheDir, int *cacheSize)
 {
+   int  i;
+   char *level;
+   
    argc--;
    argv++;
 
-   infile[0] = outfile[0] = '\0';
+   infile[0] = outfile[0] = checkpoint[0] = previewFile[0] = '\0';
+   gbuffer[0] = idMap[0] = idTable[0] = depthFile[0] = receptor[0] = '\0';
+   manifest[0] = socketName[0] = cacheDir[0] = '\0';
+   *previews = 0;
+   window[0] = window[1] = window[2] = window[3] = 0;
    
    while(argc)
    {
@@ -1422,32 +2408,188 @@ BOOL ParseCmdLine(int argc, char **argv, char *infile, char *outfile,
          case 'Q':
             *quiet = TRUE;
             break;
-         case 's':
-         case 'S':
+         case 'm':
+         case 'M':
+            *fbLayout = FB_MORTON;
+            break;
+         case 'a':
+         case 'A':
+            gAntiAlias = TRUE;
+            break;
+         case 'g':
+         case 'G':
+         case 'u':
+         case 'U':
+            *reshade = ((argv[0][1] == 'u') || (argv[0][1] == 'U'));
             argc--;  argv++;
-            sscanf(argv[0],"%d",screenx);
+            if(!argc)
+               return(FALSE);
+            strcpy(gbuffer,argv[0]);
+            break;
+         case 'd':
+         case 'D':
             argc--;  argv++;
-            sscanf(argv[0],"%d",screeny);
+            if(!argc)
+               return(FALSE);
+            strcpy(depthFile,argv[0]);
             break;
-         case 'f':
-         case 'F':
+         case 'e':
+         case 'E':
+            argc--;  argv++;
+            if(!argc)
+               return(FALSE);
+            strcpy(receptor,argv[0]);
+            break;
+         case 'n':
+         case 'N':
+            *trajectory = TRUE;
+            break;
+         case 'j':
+         case 'J':
+            argc--;  argv++;
+            if(!argc)
+               return(FALSE);
+            strcpy(manifest,argv[0]);
+            break;
+         case 'v':
+         case 'V':
             argc--;  argv++;
-            LOWER(argv[0]);
-            if(!strncmp(argv[0], "mtv", 3))
+            if(!argc)
+               return(FALSE);
+            strcpy(socketName,argv[0]);
+            break;
+         case 'y':
+         case 'Y':
+            /* The cache: <dir> <Mb>                                    */
+            if(argc < 3)
+               return(FALSE);
+            argc--;  argv++;
+            strcpy(cacheDir,argv[0]);
+            argc--;  argv++;
+            if((sscanf(argv[0],"%d",cacheSize) != 1) || (*cacheSize < 1))
+               return(FALSE);
+            break;
+         case 'x':
+         case 'X':
+            /* A layer to merge: <image> <depth>                        */
+            if((argc < 3) || (gNLayers >= MAXLAYERS))
+               return(FALSE);
+            argc--;  argv++;
+            strcpy(gLayers[gNLayers].image,argv[0]);
+            argc--;  argv++;
+            strcpy(gLayers[gNLayers].depth,argv[0]);
+            gNLayers++;
+            break;
+         case 't':
+         case 'T':
+            argc--;  argv++;
+            if(!argc)
+               return(FALSE);
+            if((sscanf(argv[0],"%d",nThreads) != 1) || (*nThreads < 1))
+               *nThreads = 1;
+            break;
+         case 'l':
+         case 'L':
+            argc--;  argv++;
+            if(!argc)
+               return(FALSE);
+            if((sscanf(argv[0],"%d",bandRows) != 1) || (*bandRows < 1))
+               return(FALSE);
+            break;
+         case 'k':
+         case 'K':
+            argc--;  argv++;
+            if(!argc || (strlen(argv[0]) >= MAXCKPTNAME))
+               return(FALSE);
+            strcpy(checkpoint,argv[0]);
+            break;
+         case 'w':
+         case 'W':
+            for(i=0; i<4; i++)
             {
-               *outFormat = OUTPUT_MTV;
+               argc--;  argv++;
+               if(!argc || (sscanf(argv[0],"%d",&(window[i])) != 1))
+                  return(FALSE);
             }
+            if(window[2] <= 0)
+               return(FALSE);
+            break;
+         case 'p':
+         case 'P':
+            /* Comma-separated list of levels then the file             */
+            argc--;  argv++;
+            if(!argc)
+               return(FALSE);
+            for(level=argv[0]; level!=NULL; level=strchr(level+1,','))
+            {
+               if(*level == ',')
+                  level++;
+               if((sscanf(level,"%d",&i) != 1) || 
+                  (i < 0) || (i >= MAXPREVIEW))
+                  return(FALSE);
+               *previews |= (1UL << i);
+            }
+            argc--;  argv++;
+            if(!argc)
+               return(FALSE);
+            strcpy(previewFile,argv[0]);
+            break;
 #ifdef SUPPORT_PNG
-            else if(!strncmp(argv[0], "png", 3))
+         case 'i':
+         case 'I':
+            /* Atom ID map then its table                               */
+            if(argc < 3)
+               return(FALSE);
+            argc--;  argv++;
+            strcpy(idMap,argv[0]);
+            argc--;  argv++;
+            strcpy(idTable,argv[0]);
+            break;
+         case 'z':
+         case 'Z':
+            argc--;  argv++;
+            if(!argc)
+               return(FALSE);
+            if(!blParsePNGOptions(argv[0], &gPNGOptions))
             {
-               *outFormat = OUTPUT_PNG;
+               fprintf(stderr, "Invalid PNG compression options: %s\n",
+                       argv[0]);
+               exit(1);
             }
+            break;
 #endif
-            else
+         case 's':
+         case 'S':
+            argc--;  argv++;
+            sscanf(argv[0],"%d",screenx);
+            argc--;  argv++;
+            sscanf(argv[0],"%d",screeny);
+            break;
+         case 'f':
+         case 'F':
+            argc--;  argv++;
+            *outFormat = ParseFormat(argv[0]);
+            break;
+         case 'o':
+         case 'O':
+            /* Another size: <size> <format> <file>                     */
+            if((argc < 4) || (gNOutputs >= MAXOUTPUTS))
+               return(FALSE);
+            argc--;  argv++;
+            if((sscanf(argv[0],"%d",&(gOutputs[gNOutputs].size)) != 1) ||
+               (gOutputs[gNOutputs].size < 1))
+               return(FALSE);
+            argc--;  argv++;
+            gOutputs[gNOutputs].format = ParseFormat(argv[0]);
+            if((gOutputs[gNOutputs].format == OUTPUT_DZI) ||
+               (gOutputs[gNOutputs].format == OUTPUT_XYZ))
             {
-               fprintf(stderr, "Unknown output format: %s\n", argv[0]);
+               fprintf(stderr, "Tiles cannot be an extra output size\n");
                exit(1);
             }
+            argc--;  argv++;
+            strcpy(gOutputs[gNOutputs].file,argv[0]);
+            gNOutputs++;
             break;
          default:
             return(FALSE);
@@ -1479,6 +2621,121 @@ BOOL ParseCmdLine(int argc, char **argv, char *infile, char *outfile,
 }
 
 
+/************************************************************************/
+/*>int ParseFormat(char *name)
+   ---------------------------
+   Input:   char   *name       Format name from the command line
+   Returns: int                OUTPUT_xxx format
+
+   Convert a format name to its OUTPUT_xxx value. Exits with a message
+   if the name is not known.
+
+   19.10.26 Original (split from ParseCmdLine())    By: ACRM
+   19.10.26 Names looked up by FormatFromName()
+*/
+int ParseFormat(char *name)
+{
+   int format;
+
+   if((format = FormatFromName(name)) < 0)
+   {
+      fprintf(stderr, "Unknown output format: %s\n", name);
+      exit(1);
+   }
+   return(format);
+}
+
+
+/************************************************************************/
+/*>int FormatFromName(char *name)
+   ------------------------------
+   Input:   char   *name       Format name
+   Returns: int                OUTPUT_xxx format or -1 if not known
+
+   Convert a format name to its OUTPUT_xxx value.
+
+   19.10.26 Original (split from ParseFormat())    By: ACRM
+*/
+int FormatFromName(char *name)
+{
+   LOWER(name);
+   if(!strncmp(name, "mtv", 3))
+   {
+      return(OUTPUT_MTV);
+   }
+#ifdef SUPPORT_PNG
+   else if(!strncmp(name, "png", 3))
+   {
+      return(OUTPUT_PNG);
+   }
+   else if(!strncmp(name, "dzi", 3))
+   {
+      return(OUTPUT_DZI);
+   }
+   else if(!strncmp(name, "xyz", 3))
+   {
+      return(OUTPUT_XYZ);
+   }
+#endif
+   else if(!strncmp(name, "ppm", 3))
+   {
+      return(OUTPUT_PPM);
+   }
+   else if(!strncmp(name, "pam", 3))
+   {
+      return(OUTPUT_PAM);
+   }
+   else if(!strncmp(name, "raw", 3))
+   {
+      return(OUTPUT_RAW);
+   }
+   else if(!strncmp(name, "rgba", 4))
+   {
+      return(OUTPUT_RGBA);
+   }
+   else if(!strncmp(name, "y4m", 3))
+   {
+      return(OUTPUT_Y4M);
+   }
+   else if(!strncmp(name, "qoi", 3))
+   {
+      return(OUTPUT_QOI);
+   }
+
+   return(-1);
+}
+
+
+/************************************************************************/
+/*>BOOL NeedAlpha(int outFormat)
+   -----------------------------
+   Input:   int    outFormat   Main output format
+   Returns: BOOL               Is the coverage plane needed?
+
+   See whether the main output or any extra size (gOutputs) is in a 
+   format with an alpha channel, or needs coverage to skip empty tiles.
+
+   19.10.26 Original    By: ACRM
+*/
+BOOL NeedAlpha(int outFormat)
+{
+   int i;
+   
+   if((outFormat == OUTPUT_PAM) || (outFormat == OUTPUT_RGBA) ||
+      (outFormat == OUTPUT_DZI) || (outFormat == OUTPUT_XYZ))
+      return(TRUE);
+
+   for(i=0; i<gNOutputs; i++)
+   {
+      if((gOutputs[i].format == OUTPUT_PAM) || 
+         (gOutputs[i].format == OUTPUT_RGBA))
+         return(TRUE);
+   }
+
+   return(FALSE);
+}
+
+
 /************************************************************************/
 /*>void UsageExit(BOOL ShowHelp)
    -----------------------------
@@ -1501,6 +2758,31 @@ BOOL ParseCmdLine(int argc, char **argv, char *infile, char *outfile,
    27.01.15 V2.4
    18.08.19 V2.5
    19.08.19 V3.0
+   19.10.26 V3.1
+   19.10.26 V3.2
+   19.10.26 V3.3
+   19.10.26 V3.4
+   19.10.26 V3.5
+   19.10.26 V3.6
+   19.10.26 V3.7
+   19.10.26 V3.8
+   19.10.26 V3.9
+   19.10.26 V3.10
+   19.10.26 V3.11
+   19.10.26 V3.12
+   19.10.26 V3.13
+   19.10.26 V3.14
+   19.10.26 V3.15
+   19.10.26 V3.16
+   19.10.26 V3.17
+   19.10.26 V3.18
+   19.10.26 V3.19
+   19.10.26 V3.20
+   19.10.26 V3.21
+   19.10.26 V3.22
+   19.10.26 V3.23
+   19.10.26 V3.24
+   19.10.26 V3.25
 */
 void UsageExit(BOOL ShowHelp)
 {
@@ -1511,24 +2793,115 @@ void UsageExit(BOOL ShowHelp)
    }
    else
    {
-      fprintf(stderr,"\nQTree V3.0 (c) 1993-2019 Prof. Andrew C.R. \
+      fprintf(stderr,"\nQTree V3.25 (c) 1993-2026 Prof. Andrew C.R. \
 Martin, SciTech Software\n\n");
       
-      fprintf(stderr,"Usage: qtree [-q] [-b] [-c <control.dat>] [-r <n>] \
-[-f fmt] [-s <x> <y>] [<file.pdb> [<file.mtv>]]\n");
+      fprintf(stderr,"Usage: qtree [-q] [-b] [-a] [-m] [-c <control.dat>] \
+[-r <n>] [-f fmt] [-z <png>] [-t <n>]\n");
+      fprintf(stderr,"             [-l <n> [-k <file.ckp>]] [-s <x> <y>] \
+[-w <x> <y> <w> <h>]\n");
+      fprintf(stderr,"             [-p <n>[,<n>...] <preview>] \
+[-o <size> <fmt> <file> ...]\n");
+      fprintf(stderr,"             [-g <file.gbuf> | -u <file.gbuf>] \
+[-i <map.png> <table.txt>]\n");
+      fprintf(stderr,"             [-d <depth.pfm>] \
+[-x <layer.pam> <layer.pfm> ...] [-e <receptor.pdb>]\n");
+      fprintf(stderr,"             [-n] [-y <dir> <Mb>] \
+[<file.pdb> [<file.mtv>]]\n");
+      fprintf(stderr,"       qtree [options] -j <manifest>\n");
+      fprintf(stderr,"       qtree [options] -v <socket>\n");
       fprintf(stderr,"       qtree [--help]\n\n");
       fprintf(stderr,"       -q Operate quietly\n");
       fprintf(stderr,"       -b Interpret occupancy as radius for ball \
 & stick\n");
       fprintf(stderr,"       -c Specify control file\n");
-      fprintf(stderr,"       -r Specify pixel resolution (power of 2) \
-[%d]\n", SIZE);
+      fprintf(stderr,"       -r Specify size of molecule in pixels \
+[fit to screen]\n");
       fprintf(stderr,"       -s Specify screen size (%d %d)\n",
              XSIZE,YSIZE);
+      fprintf(stderr,"       -w Only render the window of the screen with \
+top left <x>,<y>\n");
+      fprintf(stderr,"          and size <w>x<h>\n");
+      fprintf(stderr,"       -a Anti-alias the edges of spheres\n");
+      fprintf(stderr,"       -m Hold the image in Morton-order tiles \
+in the order the quad tree\n");
+      fprintf(stderr,"          visits pixels; the image written is \
+unchanged\n");
+      fprintf(stderr,"       -l Render and write the image <n> rows at a \
+time to save memory\n");
+      fprintf(stderr,"          (not y4m or qoi)\n");
+      fprintf(stderr,"       -k Checkpoint file for -l; an interrupted \
+render carries on from\n");
+      fprintf(stderr,"          the last band written when run again\n");
+      fprintf(stderr,"       -p Write previews stopping the quad tree \
+<n> levels down. If\n");
+      fprintf(stderr,"          <preview> contains %%d, one PPM per level; \
+otherwise a y4m stream\n");
+      fprintf(stderr,"       -o Also write the image shrunk to <size> \
+pixels on its longer side\n");
+      fprintf(stderr,"          in format <fmt>. May be given up to %d \
+times\n", MAXOUTPUTS);
+      fprintf(stderr,"       -g Save which sphere is in front at each \
+pixel to a G-buffer\n");
+      fprintf(stderr,"       -u Shade a saved G-buffer with the colours \
+and lighting from\n");
+      fprintf(stderr,"          the control file instead of rendering; \
+give the same PDB file\n");
+      fprintf(stderr,"       -d Write the depth of each pixel as a PFM \
+file\n");
+      fprintf(stderr,"       -x Merge in a layer rendered separately \
+(with -f pam and -d),\n");
+      fprintf(stderr,"          nearest in front. May be given up to %d \
+times\n", MAXLAYERS);
+      fprintf(stderr,"       -e Write a picture of each MODEL of the PDB \
+file on this receptor.\n");
+      fprintf(stderr,"          The output file must contain %%d for the \
+model number. Poses\n");
+      fprintf(stderr,"          are rendered by -t processes\n");
+      fprintf(stderr,"       -n Write a frame for each MODEL of the PDB \
+file. The output file\n");
+      fprintf(stderr,"          must contain %%d for the model number \
+unless the format is y4m\n");
+      fprintf(stderr,"       -j Render every image listed in a manifest. \
+Each line gives the\n");
+      fprintf(stderr,"          PDB file, control file, size (<x>x<y>), \
+format and output file\n");
+      fprintf(stderr,"       -y Keep images in the cache directory <dir> \
+of up to <Mb> megabytes,\n");
+      fprintf(stderr,"          copying an image from there when the \
+same one is asked for\n");
+      fprintf(stderr,"          and keeping the atoms read from each \
+PDB file\n");
+      fprintf(stderr,"       -v Run as a daemon rendering the images asked \
+for on a Unix domain\n");
+      fprintf(stderr,"          socket. See the README for the \
+requests\n");
+#ifdef SUPPORT_PNG
+      fprintf(stderr,"       -i Write a PNG map of the atom at each pixel \
+and a table of the\n");
+      fprintf(stderr,"          atoms for picking\n");
+#endif
       fprintf(stderr,"       -h Enter help utility\n");
-      fprintf(stderr,"       -f Specify output format (mtv|png)\n");
+      fprintf(stderr,"       -f Specify output format \
+(mtv|png|qoi|ppm|pam|raw|rgba|y4m|dzi|xyz)\n");
+      fprintf(stderr,"          dzi and xyz write a pyramid of 256x256 \
+PNG tiles for deep zoom\n");
       fprintf(stderr,"          Default output is in MTV raytracer \
-format\n\n");
+format\n");
+#ifdef SUPPORT_PNG
+      fprintf(stderr,"       -z Specify PNG compression as \
+level[,strategy[,filter]]\n");
+      fprintf(stderr,"          level is 0-9; strategy is default, \
+filtered, huffman, rle\n");
+      fprintf(stderr,"          or fixed; filter is none, sub, up, avg, \
+paeth or all\n");
+#endif
+      fprintf(stderr,"       -t Number of threads used to read the PDB \
+file and compress PNG\n");
+      fprintf(stderr,"          output or tiles [1], or of processes \
+for galleries, animations,\n");
+      fprintf(stderr,"          trajectories, batches and the daemon\n");
+      fprintf(stderr,"\n");
       fprintf(stderr,"       Render a space filling picture of a PDB \
 file\n\n");
       fprintf(stderr,"       Enter 'qtree --help' to enter the help \
@@ -3,11 +3,11 @@
    Program:    QTree
    File:       qtree.h
    
-   Version:    V3.0
-   Date:       19.09.19
+   Version:    V3.25
+   Date:       19.10.26
    Function:   Include file for QTree
    
-   Copyright:  (c) SciTech Software 1993-2019
+   Copyright:  (c) SciTech Software 1993-2026
    Author:     Prof. Andrew C. R. Martin
    EMail:      andrew@bioinf.org.uk
                
@@ -76,6 +76,27 @@
    V2.2  14.10.03 Added BOUNDS and RADIUS stuff
    V2.3  18.10.07 Added highlight stuff
    V3.0  19.08.19 Added PNG support
+   V3.1  19.10.26 Added framebuffer layouts
+   V3.2  19.10.26 Added raw output formats and auxiliary buffers
+   V3.3  19.10.26 Added PNG compression options
+   V3.4  19.10.26 Added gNThreads
+   V3.5  19.10.26 Added OUTPUT_QOI
+   V3.6  19.10.26 Added gRender
+   V3.7  19.10.26 Added gBandRows
+   V3.8  19.10.26 Added OUTPUT_DZI and OUTPUT_XYZ
+   V3.9  19.10.26 Added gOrigin
+   V3.10 19.10.26 Added MAXPREVIEW
+   V3.11 19.10.26 Added OUTSIZE, gOutputs and gNOutputs
+   V3.12 19.10.26 Added gAntiAlias
+   V3.13 19.10.26 Added AUX_GBUFFER and SPHERE.atom
+   V3.14 19.10.26 Added AUX_ATOMID
+   V3.16 19.10.26 Added AUX_DEPTH, DEPTH_BACKGROUND, LAYER, gLayers and 
+                  gNLayers
+   V3.18 19.10.26 Added KEYFRAME, gNFrames, gKeyFrames, gNKeyFrames and
+                  RESORT_MOVES
+   V3.19 19.10.26 Added gRotations and gNRotations
+   V3.23 19.10.26 Added HASH and HASHSIZE
+   V3.25 19.10.26 gRotations replaced by the combined gRotation
 
 *************************************************************************/
 
@@ -87,6 +108,9 @@
 */
 #include "bioplib/MathType.h"
 #include "bioplib/SysDefs.h"
+#ifdef SUPPORT_PNG
+#include "writepng.h"
+#endif
 
 /************************************************************************/
 /* Conditional compilation flags
@@ -102,16 +126,53 @@
 */
 #define OUTPUT_MTV  0         /* MTV format (default)                   */
 #define OUTPUT_PNG  1         /* PNG format                             */
+#define OUTPUT_PPM  2         /* Binary PPM (P6)                        */
+#define OUTPUT_PAM  3         /* PAM (P7) with alpha                    */
+#define OUTPUT_RAW  4         /* Headerless RGB                         */
+#define OUTPUT_RGBA 5         /* Headerless RGBA                        */
+#define OUTPUT_Y4M  6         /* YUV4MPEG2 stream                       */
+#define OUTPUT_QOI  7         /* QOI lossless                           */
+#define OUTPUT_DZI  8         /* Deep Zoom Image tile pyramid           */
+#define OUTPUT_XYZ  9         /* XYZ (z/x/y.png) tile pyramid           */
+
+#define DZ_TILESIZE 256       /* Tile size for DZI and XYZ              */
+
+/************************************************************************/
+/* Auxiliary framebuffer planes (flags to InitGraphics())
+*/
+#define AUX_ALPHA   0x01      /* Coverage of the molecule               */
+#define AUX_GBUFFER 0x02      /* Front sphere and depth                 */
+#define AUX_ATOMID  0x04      /* Front sphere only                      */
+#define AUX_DEPTH   0x08      /* Depth only                             */
+
+/************************************************************************/
+/* Framebuffer layouts
+*/
+#define FB_LINEAR   0         /* Row-major (default)                    */
+#define FB_MORTON   1         /* Morton-order tiles                     */
+#define FB_TILESHIFT 6        /* log2 of the Morton tile size           */
+#define FB_TILESIZE (1<<FB_TILESHIFT)
 
 /************************************************************************/
 /* Defines
 */
-#define SIZE  512             /* Display size (square) 256              */
+#define SIZE  512             /* Default molecule size (square)         */
 #define XSIZE 800             /* Screen width          320              */
 #define YSIZE 600             /* Screen height         256              */
 #define MAXATNAM 8            /* Max atom name array size               */
 #define BORDER_NEIGHBOUR    1 /* Number of neighbouring pixels to test  */
 #define DEF_BORDERWIDTH     0 /* Default Border width in pixels = 2x+1  */
+#define Y4M_FPS    25         /* Default YUV4MPEG2 frame rate           */
+#define MAXPREVIEW 32         /* Preview levels are 0..MAXPREVIEW-1     */
+#define MAXOUTPUTS  8         /* Extra output sizes (-o)                */
+#define AA_FRINGE  0.5        /* Half a pixel; anti-aliased edge width  */
+#define AA_MAXRIM   8         /* Sphere edges considered at one pixel   */
+#define MAXLAYERS   8         /* Layers merged by depth (-x)            */
+#define DEPTH_BACKGROUND (-1.0e30) /* Depth where there is no molecule  */
+#define MAXKEYFRAMES 64       /* Animation keyframes                    */
+#define MAXKEYROTATE 8        /* Rotations in one keyframe              */
+#define RESORT_MOVES 4        /* Moves per sphere before a full re-sort */
+#define HASHSIZE   32         /* Bytes in a SHA-256 content hash        */
 
 /************************************************************************/
 /* Structure type definitions
@@ -126,7 +187,8 @@ typedef struct
          hr, hg, hb,
          shine,
          metallic;
-   int   highlight;
+   int   highlight,
+         atom;                /* Number of the atom in the PDB file     */
    BOOL  set;
 }  SPHERE;
 
@@ -167,6 +229,42 @@ typedef struct _radii
         resnam[MAXATNAM];
 }  RADII;
 
+typedef struct
+{
+   char  file[160];           /* Output file (blank for stdout)         */
+   int   size,                /* Longer side in pixels                  */
+         format;              /* OUTPUT_xxx                             */
+}  OUTSIZE;
+
+typedef struct
+{
+   char  image[160],          /* Layer image (PAM or PPM)               */
+         depth[160];          /* Its depths (PFM)                       */
+}  LAYER;
+
+typedef struct
+{
+   REAL  angle[MAXKEYROTATE], /* Rotations over the keyframe (radians)  */
+         scale,               /* Scale reached (0 if not changed)       */
+         centre[3];           /* Centre reached (screen coordinates)    */
+   int   frame,               /* Frame at which the keyframe is reached */
+         nrotate,             /* Number of rotations                    */
+         centreAtom;          /* Atom to centre on (-1 if not changed)  */
+   char  axis[MAXKEYROTATE];  /* Axis of each rotation                  */
+}  KEYFRAME;
+
+typedef struct
+{
+   unsigned long state[8],    /* SHA-256 state, 32 bits in each         */
+                 nbits[2];    /* Bits hashed (low and high words)       */
+   unsigned char block[64];   /* Part of a block waiting to be hashed   */
+   int           nblock;      /* Bytes in block                         */
+}  HASH;
+
+typedef struct _rawstream RAWSTREAM;  /* Defined in rawimage.c          */
+typedef struct _y4mstream Y4MSTREAM;  /* Defined in rawimage.c          */
+struct iovec;                         /* From <sys/uio.h>               */
+
 /************************************************************************/
 /* Global variables
 */
@@ -178,10 +276,28 @@ REAL   gScale     = 0.9,   /* Scaling factor                            */
 VEC3F  gMidPoint;          /* Mid point of structure for centering      */
 int    gSize = SIZE,       /* Display size                              */
        gScreen[2],         /* Screen size                               */
-       gBorderWidth = DEF_BORDERWIDTH; /* Border width for HIGHLIGHT    */
+       gRender[2],         /* Size of the rendered (quad-tree) area     */
+       gOrigin[2],         /* Top left of the image in the render area  */
+       gBorderWidth = DEF_BORDERWIDTH, /* Border width for HIGHLIGHT    */
+       gFBLayout = FB_LINEAR, /* Framebuffer layout                     */
+       gNThreads = 1,      /* Worker threads                            */
+       gBandRows = 0,      /* Rows per band; 0 renders in one go        */
+       gNOutputs = 0,      /* Number of extra output sizes              */
+       gNLayers  = 0,      /* Number of layers to merge                 */
+       gNFrames  = 0,      /* Animation frames; 0 for a single image    */
+       gNKeyFrames = 0;    /* Number of animation keyframes             */
+OUTSIZE gOutputs[MAXOUTPUTS]; /* Extra output sizes                     */
+LAYER  gLayers[MAXLAYERS]; /* Layers to merge by depth                  */
+KEYFRAME gKeyFrames[MAXKEYFRAMES]; /* Animation keyframes               */
+REAL   gRotation[3][3] =  /* All rotations from the control file       */
+          {{1.0, 0.0, 0.0}, {0.0, 1.0, 0.0}, {0.0, 0.0, 1.0}};
+BOOL   gAntiAlias = FALSE; /* Anti-alias sphere edges                   */
 SLAB   gSlab;              /* Slabbing                                  */
 BOUNDS gBounds;            /* User specified boundary of image          */
 RADII  *gRadii = NULL;     /* Linked list of atom radii                 */
+#ifdef SUPPORT_PNG
+blPNGOPTIONS gPNGOptions = {-1, -1, -1, 1}; /* PNG compression options  */
+#endif
 #else          /*----------------------- Externals ---------------------*/
 extern LIGHT  gLight;
 extern DCUE   gDepthCue;
@@ -191,10 +307,27 @@ extern VEC3F  gMidPoint;
 extern char   gOutFile[160];
 extern int    gSize,
               gScreen[2],
-              gBorderWidth;
+              gRender[2],
+              gOrigin[2],
+              gBorderWidth,
+              gFBLayout,
+              gNThreads,
+              gBandRows,
+              gNOutputs,
+              gNLayers,
+              gNFrames,
+              gNKeyFrames;
+extern OUTSIZE gOutputs[MAXOUTPUTS];
+extern LAYER  gLayers[MAXLAYERS];
+extern KEYFRAME gKeyFrames[MAXKEYFRAMES];
+extern REAL   gRotation[3][3];
+extern BOOL   gAntiAlias;
 extern SLAB   gSlab;
 extern BOUNDS gBounds;
 extern RADII  *gRadii;
+#ifdef SUPPORT_PNG
+extern blPNGOPTIONS gPNGOptions;
+#endif
 #endif         /*-------------------------------------------------------*/
 
 
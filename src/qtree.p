@@ -1,13 +1,24 @@
 int main(int argc, char **argv)
 ;
+void SetRenderSize(int width, int height, int resolution)
+;
 void MapSpheres(PDB *pdb, SPHERE *spheres, int NSphere)
 ;
+void MapSphere(SPHERE *sphere, REAL x, REAL y, REAL z)
+;
 SPHERE *CreateSphereList(PDB *pdb, int NAtom)
 ;
 BOOL SpaceFill(SPHERE *AllSpheres, int NSphere)
 ;
+BOOL SpaceFillRows(SPHERE **SrtSph, int NSphere, int top, int nrows)
+;
+BOOL SpaceFillPreview(SPHERE **SrtSph, int NSphere, int depth)
+;
+BOOL SpaceFillRegion(SPHERE **SrtSph, int NSphere, int x0, int y0, 
+                     int x1, int y1)
+;
 void SplitPic(int x0, int y0, int x1, int y1, SPHERE **spheres,
-              int NSphere)
+              int NSphere, int depth)
 ;
 SPHERE **UpdateSphereList(REAL   x0, 
                           REAL   y0, 
@@ -19,10 +30,17 @@ SPHERE **UpdateSphereList(REAL   x0,
 ;
 SPHERE **SortSpheresOnX(SPHERE *AllSpheres, int NSphere)
 ;
+BOOL ResortSpheresOnX(SPHERE **sp, int NSphere)
+;
 void ColourPixel(int xi, int yi, SPHERE **spheres, int NSphere)
 ;
 int FindSphere(REAL x, REAL y, SPHERE **spheres, int NSphere, REAL *MaxZ)
 ;
+BOOL AntiAliasPixel(int xi, int yi, SPHERE **spheres, int NSphere)
+;
+void PreviewBlock(int x0, int y0, int x1, int y1, SPHERE **spheres,
+                  int NSphere)
+;
 int FarLeftSearch(SPHERE **spheres, int NSphere, REAL x)
 ;
 int FarRightSearch(SPHERE **spheres, int NSphere, REAL x)
@@ -35,12 +53,28 @@ void onbreak(void *func)
 ;
 void ShadePixel(REAL x, REAL y, REAL z, SPHERE *sphere)
 ;
+void ShadeColour(REAL x, REAL y, REAL z, SPHERE *sphere, REAL *rr, 
+                 REAL *gg, REAL *bb)
+;
 SPHERE *SlabSphereList(SPHERE *spheres, int *Natom)
 ;
 BOOL ParseCmdLine(int argc, char **argv, char *infile, char *outfile, 
                   BOOL *DoControl, char *ControlFile, BOOL *DoBallStick, 
                   BOOL *DoResolution, int *resolution, BOOL *quiet,
-                  int *screenx, int *screeny, int *outFormat)
+                  int *screenx, int *screeny, int *outFormat,
+                  int *fbLayout, int *nThreads, int *bandRows,
+                  char *checkpoint, int *window, 
+                  unsigned long *previews, char *previewFile,
+                  char *gbuffer, BOOL *reshade, char *idMap,
+                  char *idTable, char *depthFile, char *receptor,
+                  BOOL *trajectory, char *manifest, char *socketName,
+                  char *cacheDir, int *cacheSize)
+;
+int ParseFormat(char *name)
+;
+int FormatFromName(char *name)
+;
+BOOL NeedAlpha(int outFormat)
 ;
 void UsageExit(BOOL ShowHelp)
 ;
@@ -0,0 +1,798 @@
+/*************************************************************************
+
+   Program:    QTree
+   File:       rawimage.c
+
+   Version:    V3.20
+   Date:       19.10.26
+   Function:   Bulk writers for uncompressed image formats
+
+   Copyright:  (c) SciTech Software 2026
+   Author:     Prof. Andrew C. R. Martin
+   EMail:      andrew@bioinf.org.uk
+
+**************************************************************************
+
+   This program is not in the public domain.
+
+   It may not be copied or made available to third parties, but may be
+   freely used by non-profit-making organisations who have obtained it
+   directly from the author or by FTP.
+
+   You are requested to send EMail to the author to say that you are
+   using this code so that you may be informed of future updates.
+
+   The code may not be made available on other FTP sites without express
+   permission from the author.
+
+   The code may be modified as required, but any modifications must be
+   documented so that the person responsible can be identified. If
+   someone else breaks this code, the author doesn't want to be blamed
+   for code that does not work! You may not distribute any
+   modifications, but are encouraged to send them to the author so
+   that they may be incorporated into future versions of the code.
+
+   The code may not be sold commercially or used for commercial purposes
+   without prior permission from the author.
+
+**************************************************************************
+
+   Description:
+   ============
+   Writes MTV, PPM, PAM, raw RGB, raw RGBA and YUV4MPEG2 images. These
+   are all simply a header followed by uncompressed pixels, so the rows
+   are handed to the operating system in large batches with writev()
+   rather than going a byte at a time through stdio. With the linear
+   framebuffer layout, RGB rows are written straight from the
+   framebuffer without being copied.
+
+**************************************************************************
+
+   Usage:
+   ======
+
+**************************************************************************
+
+   Notes:
+   ======
+   A blank filename means standard output, so all these formats may be
+   piped straight into other programs such as ffmpeg.
+
+   The other formats may also be written a band of rows at a time 
+   with OpenRawStream(), WriteRawRows() and CloseRawStream().
+
+   YUV4MPEG2 streams may contain any number of frames. Open the stream
+   with OpenY4MStream(), call WriteY4MFrame() after each frame has been
+   rendered and finish with CloseY4MStream().
+
+   Frames rendered by another process are passed back through a pipe.
+   That process opens its end with OpenY4MPipe(), which writes frames
+   without the header, and each frame is read from the pipe and added
+   to the stream with CopyY4MFrame().
+
+**************************************************************************
+
+   Revision History:
+   =================
+   V3.2  19.10.26 Original
+   V3.7  19.10.26 Added RAWSTREAM so images may be written in bands and
+                  resumed
+   V3.18 19.10.26 Added OpenY4MPipe() and CopyY4MFrame() so frames may be
+                  made by other processes
+   V3.20 19.10.26 Added ReadBlock()
+
+*************************************************************************/
+/* Includes
+*/
+#define _XOPEN_SOURCE 600
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include "bioplib/MathType.h"
+#include "bioplib/SysDefs.h"
+
+#include "qtree.h"
+#include "graphics.p"
+#include "rawimage.p"
+
+/************************************************************************/
+/* Defines
+*/
+#define ROW_BATCH    64       /* Rows gathered for each writev() call   */
+#define MAXHEADER    160      /* Maximum size of an image header        */
+
+struct _rawstream
+{
+   char          header[MAXHEADER];
+   unsigned char *batch,      /* ROW_BATCH rows for writev()            */
+                 *abuf;       /* One row of coverage                    */
+   long          offset;      /* Bytes written to the file so far       */
+   int           fd,
+                 format,
+                 width,
+                 height,
+                 bpp;
+   BOOL          withAlpha;
+};
+
+struct _y4mstream
+{
+   unsigned char *frame;      /* YUV 4:2:0 planes for one frame         */
+   unsigned char *rgb[2];     /* Row buffers used during conversion     */
+   int           fd,
+                 width,
+                 height;
+};
+
+
+/************************************************************************/
+/*>int OpenOutputFile(char *FileName)
+   ----------------------------------
+   Input:   char  *FileName    File to create (blank for stdout)
+   Returns: int                File descriptor (-1 on failure)
+
+   19.10.26 Original    By: ACRM
+*/
+int OpenOutputFile(char *FileName)
+{
+   if(FileName[0] == '\0')
+      return(STDOUT_FILENO);
+
+   return(open(FileName, O_WRONLY | O_CREAT | O_TRUNC, 0666));
+}
+
+
+/************************************************************************/
+/*>BOOL CloseOutputFile(int fd)
+   ----------------------------
+   Input:   int   fd           File descriptor from OpenOutputFile()
+   Returns: BOOL               Success?
+
+   19.10.26 Original    By: ACRM
+*/
+BOOL CloseOutputFile(int fd)
+{
+   if(fd == STDOUT_FILENO)
+      return(TRUE);
+
+   return(close(fd) == 0);
+}
+
+
+/************************************************************************/
+/*>BOOL WriteVector(int fd, struct iovec *iov, int niov)
+   -----------------------------------------------------
+   Input:   int          fd      File descriptor
+            struct iovec *iov    Blocks to write (modified)
+            int          niov    Number of blocks
+   Returns: BOOL                 Success?
+
+   writev() the blocks, carrying on after interrupts and partial writes
+   (which are normal when writing to a pipe).
+
+   19.10.26 Original    By: ACRM
+*/
+BOOL WriteVector(int fd, struct iovec *iov, int niov)
+{
+   ssize_t nout;
+
+   while(niov)
+   {
+      if((nout = writev(fd, iov, niov)) < 0)
+      {
+         if(errno == EINTR)
+            continue;
+         return(FALSE);
+      }
+
+      /* Skip over the blocks which have been written completely       */
+      while(niov && (size_t)nout >= iov->iov_len)
+      {
+         nout -= iov->iov_len;
+         iov++;
+         niov--;
+      }
+
+      /* And step into a block which has been partly written           */
+      if(niov)
+      {
+         iov->iov_base  = (char *)iov->iov_base + nout;
+         iov->iov_len  -= nout;
+      }
+   }
+
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>BOOL ReadBlock(int fd, unsigned char *buffer, size_t nbytes)
+   ------------------------------------------------------------
+   Input:   int           fd       File descriptor
+            size_t        nbytes   Bytes to read
+   Output:  unsigned char *buffer  The bytes read
+   Returns: BOOL                   Were they all read?
+
+   read() a block, carrying on after interrupts and partial reads.
+   Fails if the file or pipe ends first.
+
+   19.10.26 Original    By: ACRM
+*/
+BOOL ReadBlock(int fd, unsigned char *buffer, size_t nbytes)
+{
+   ssize_t nin;
+
+   while(nbytes)
+   {
+      if((nin = read(fd, buffer, nbytes)) < 0)
+      {
+         if(errno == EINTR)
+            continue;
+         return(FALSE);
+      }
+      if(nin == 0)
+         return(FALSE);
+
+      buffer += nin;
+      nbytes -= nin;
+   }
+
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>RAWSTREAM *OpenRawStream(char *FileName, int format, int xsize, 
+                            int ysize, long offset)
+   ----------------------------------------------------------------
+   Input:   char      *FileName    File to write (blank for stdout)
+            int       format       OUTPUT_MTV, OUTPUT_PPM, OUTPUT_PAM,
+                                   OUTPUT_RAW or OUTPUT_RGBA
+            int       xsize        Image width
+            int       ysize        Image height
+            long      offset       0 to start a new file, otherwise
+                                   the number of bytes already written
+                                   to an existing file
+   Returns: RAWSTREAM *            The stream (NULL on failure)
+
+   Start writing an uncompressed image and write its header. Rows are 
+   then added with WriteRawRows(). If offset is given, the file is cut
+   back to that length and writing carries on from there so that an 
+   interrupted banded render may be resumed.
+
+   19.10.26 Original (extracted from WriteRawImage())    By: ACRM
+*/
+RAWSTREAM *OpenRawStream(char *FileName, int format, int xsize, int ysize,
+                         long offset)
+{
+   RAWSTREAM *stream;
+
+   if((stream = (RAWSTREAM *)malloc(sizeof(RAWSTREAM))) == NULL)
+      return(NULL);
+
+   stream->format    = format;
+   stream->width     = xsize;
+   stream->height    = ysize;
+   stream->withAlpha = ((format == OUTPUT_PAM) || (format == OUTPUT_RGBA));
+   stream->bpp       = stream->withAlpha ? 4 : 3;
+   stream->offset    = 0;
+   stream->batch     = NULL;
+   stream->abuf      = NULL;
+
+   /* Build the header                                                  */
+   switch(format)
+   {
+   case OUTPUT_MTV:
+      sprintf(stream->header, "%d %d\n", xsize, ysize);
+      break;
+   case OUTPUT_PPM:
+      sprintf(stream->header, "P6\n%d %d\n255\n", xsize, ysize);
+      break;
+   case OUTPUT_PAM:
+      sprintf(stream->header, "P7\nWIDTH %d\nHEIGHT %d\nDEPTH 4\n\
+MAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n", xsize, ysize);
+      break;
+   default:
+      stream->header[0] = '\0';
+      break;
+   }
+
+   /* The batch buffer is needed unless we can write in place           */
+   if(stream->withAlpha || !FramebufferIsLinear())
+   {
+      if((stream->batch = (unsigned char *)malloc((size_t)ROW_BATCH * 
+                                                  stream->bpp * xsize))
+         == NULL)
+      {
+         free(stream);
+         return(NULL);
+      }
+   }
+   if(stream->withAlpha)
+   {
+      if((stream->abuf = (unsigned char *)malloc((size_t)xsize)) == NULL)
+      {
+         if(stream->batch != NULL) free(stream->batch);
+         free(stream);
+         return(NULL);
+      }
+   }
+
+   if(offset > 0)
+   {
+      /* Carry on from the end of the last complete row written         */
+      if((FileName[0] == '\0') ||
+         ((stream->fd = open(FileName, O_WRONLY)) < 0))
+      {
+         stream->fd = (-1);
+         CloseRawStream(stream);
+         return(NULL);
+      }
+      if((ftruncate(stream->fd, (off_t)offset) != 0) ||
+         (lseek(stream->fd, (off_t)offset, SEEK_SET) != (off_t)offset))
+      {
+         CloseRawStream(stream);
+         return(NULL);
+      }
+      stream->offset = offset;
+   }
+   else
+   {
+      if((stream->fd = OpenOutputFile(FileName)) < 0)
+      {
+         stream->fd = (-1);
+         CloseRawStream(stream);
+         return(NULL);
+      }
+   }
+   
+   return(stream);
+}
+
+
+/************************************************************************/
+/*>BOOL WriteRawRows(RAWSTREAM *stream, int y0, int y1)
+   ----------------------------------------------------
+   Input:   RAWSTREAM *stream      Stream from OpenRawStream()
+            int       y0           First row to write
+            int       y1           Row after the last row to write
+   Returns: BOOL                   Success?
+
+   Write rows y0 to y1-1 of the framebuffer. Rows are gathered 
+   ROW_BATCH at a time and written with a single writev(). RGB rows in
+   a linear framebuffer are written in place; otherwise they are
+   de-swizzled or interleaved with the coverage plane into a batch
+   buffer first. The header is written along with the first batch.
+
+   19.10.26 Original (extracted from WriteRawImage())    By: ACRM
+*/
+BOOL WriteRawRows(RAWSTREAM *stream, int y0, int y1)
+{
+   struct iovec  iov[ROW_BATCH+1];
+   unsigned char *slot,
+                 *rgb,
+                 *alpha;
+   int           niov  = 0,
+                 bpp   = stream->bpp,
+                 xsize = stream->width,
+                 x, y;
+   BOOL          retval = TRUE;
+
+   if((stream->offset == 0) && stream->header[0])
+   {
+      iov[niov].iov_base = stream->header;
+      iov[niov].iov_len  = strlen(stream->header);
+      stream->offset    += iov[niov].iov_len;
+      niov++;
+   }
+
+   for(y=y0; y<y1 && retval; y++)
+   {
+      slot = (stream->batch == NULL) ? NULL :
+             stream->batch + (size_t)((y-y0) % ROW_BATCH) * bpp * xsize;
+
+      if(stream->withAlpha)
+      {
+         /* Unpack RGB into the slot, then spread it out to RGBA
+            backwards so that it can be done in place
+         */
+         rgb   = GetRGBRow(y, slot);
+         if(rgb != slot)
+            memcpy(slot, rgb, 3 * xsize);
+         alpha = GetAlphaRow(y, stream->abuf);
+         for(x=xsize-1; x>=0; x--)
+         {
+            slot[4*x+3] = (alpha == NULL) ? 255 : alpha[x];
+            slot[4*x+2] = slot[3*x+2];
+            slot[4*x+1] = slot[3*x+1];
+            slot[4*x]   = slot[3*x];
+         }
+         iov[niov].iov_base = slot;
+      }
+      else
+      {
+         iov[niov].iov_base = GetRGBRow(y, slot);
+      }
+      iov[niov].iov_len  = (size_t)bpp * xsize;
+      stream->offset    += iov[niov].iov_len;
+      niov++;
+
+      /* Flush at the end of a batch                                    */
+      if(((y-y0) % ROW_BATCH == ROW_BATCH-1) || (y == y1-1))
+      {
+         retval = WriteVector(stream->fd, iov, niov);
+         niov   = 0;
+      }
+   }
+
+   return(retval);
+}
+
+
+/************************************************************************/
+/*>long RawStreamOffset(RAWSTREAM *stream)
+   ---------------------------------------
+   Input:   RAWSTREAM *stream      Stream from OpenRawStream()
+   Returns: long                   Bytes written to the file so far
+
+   19.10.26 Original    By: ACRM
+*/
+long RawStreamOffset(RAWSTREAM *stream)
+{
+   return(stream->offset);
+}
+
+
+/************************************************************************/
+/*>BOOL SyncRawStream(RAWSTREAM *stream)
+   -------------------------------------
+   Input:   RAWSTREAM *stream      Stream from OpenRawStream()
+   Returns: BOOL                   Success?
+
+   Make sure everything written so far is on disk. Used before writing
+   a checkpoint.
+
+   19.10.26 Original    By: ACRM
+*/
+BOOL SyncRawStream(RAWSTREAM *stream)
+{
+   if(stream->fd == STDOUT_FILENO)
+      return(TRUE);
+   return(fsync(stream->fd) == 0);
+}
+
+
+/************************************************************************/
+/*>BOOL CloseRawStream(RAWSTREAM *stream)
+   --------------------------------------
+   Input:   RAWSTREAM *stream      Stream from OpenRawStream()
+   Returns: BOOL                   Success?
+
+   Close the file and free the stream.
+
+   19.10.26 Original    By: ACRM
+*/
+BOOL CloseRawStream(RAWSTREAM *stream)
+{
+   BOOL retval = TRUE;
+   
+   if(stream->fd >= 0)
+      retval = CloseOutputFile(stream->fd);
+   if(stream->batch != NULL) free(stream->batch);
+   if(stream->abuf  != NULL) free(stream->abuf);
+   free(stream);
+
+   return(retval);
+}
+
+
+/************************************************************************/
+/*>BOOL WriteRawImage(char *FileName, int format, int xsize, int ysize)
+   --------------------------------------------------------------------
+   Input:   char  *FileName    File to write (blank for stdout)
+            int   format       OUTPUT_MTV, OUTPUT_PPM, OUTPUT_PAM,
+                               OUTPUT_RAW or OUTPUT_RGBA
+            int   xsize        Image width
+            int   ysize        Image height
+   Returns: BOOL               Success?
+
+   Write the framebuffer as an uncompressed image.
+
+   19.10.26 Original    By: ACRM
+   19.10.26 Now uses OpenRawStream() and WriteRawRows()
+*/
+BOOL WriteRawImage(char *FileName, int format, int xsize, int ysize)
+{
+   RAWSTREAM *stream;
+   BOOL      retval;
+
+   if((stream = OpenRawStream(FileName, format, xsize, ysize, 0L))
+      == NULL)
+      return(FALSE);
+
+   retval = WriteRawRows(stream, 0, ysize);
+   if(!CloseRawStream(stream))
+      retval = FALSE;
+
+   return(retval);
+}
+
+
+/************************************************************************/
+/*>static Y4MSTREAM *NewY4MStream(int fd, int xsize, int ysize)
+   -------------------------------------------------------------
+   Input:   int       fd           File descriptor to write to (-1 if
+                                   it could not be opened)
+            int       xsize        Frame width
+            int       ysize        Frame height
+   Returns: Y4MSTREAM *            The stream (NULL on failure)
+
+   Allocate a stream and its buffers. The descriptor is closed on 
+   failure.
+
+   19.10.26 Original (split from OpenY4MStream())    By: ACRM
+*/
+static Y4MSTREAM *NewY4MStream(int fd, int xsize, int ysize)
+{
+   Y4MSTREAM    *stream;
+   size_t       nbytes;
+
+   if((stream = (Y4MSTREAM *)malloc(sizeof(Y4MSTREAM))) == NULL)
+   {
+      if(fd >= 0)
+         CloseOutputFile(fd);
+      return(NULL);
+   }
+
+   stream->width  = xsize;
+   stream->height = ysize;
+   nbytes         = (size_t)xsize * ysize +
+                    2 * (size_t)((xsize+1)/2) * ((ysize+1)/2);
+   stream->frame  = (unsigned char *)malloc(nbytes);
+   stream->rgb[0] = (unsigned char *)malloc(3 * (size_t)xsize);
+   stream->rgb[1] = (unsigned char *)malloc(3 * (size_t)xsize);
+   stream->fd     = fd;
+
+   if((fd >= 0) && (stream->frame != NULL) &&
+      (stream->rgb[0] != NULL) && (stream->rgb[1] != NULL))
+      return(stream);
+
+   CloseY4MStream(stream);
+   return(NULL);
+}
+
+
+/************************************************************************/
+/*>Y4MSTREAM *OpenY4MStream(char *FileName, int xsize, int ysize,
+                            int fps)
+   ---------------------------------------------------------------
+   Input:   char      *FileName    File to write (blank for stdout)
+            int       xsize        Frame width
+            int       ysize        Frame height
+            int       fps          Frame rate
+   Returns: Y4MSTREAM *            The stream (NULL on failure)
+
+   Start a YUV4MPEG2 stream and write its header. Frames are 4:2:0 with
+   full-range JPEG (BT.601) colour.
+
+   19.10.26 Original    By: ACRM
+   19.10.26 Allocation moved to NewY4MStream()
+*/
+Y4MSTREAM *OpenY4MStream(char *FileName, int xsize, int ysize, int fps)
+{
+   Y4MSTREAM    *stream;
+   char         header[MAXHEADER];
+   struct iovec iov;
+
+   if((stream = NewY4MStream(OpenOutputFile(FileName), xsize, ysize))
+      == NULL)
+      return(NULL);
+
+   sprintf(header, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg \
+XCOLORRANGE=FULL\n", xsize, ysize, fps);
+   iov.iov_base = header;
+   iov.iov_len  = strlen(header);
+   if(WriteVector(stream->fd, &iov, 1))
+      return(stream);
+
+   CloseY4MStream(stream);
+   return(NULL);
+}
+
+
+/************************************************************************/
+/*>Y4MSTREAM *OpenY4MPipe(int fd, int xsize, int ysize)
+   ----------------------------------------------------
+   Input:   int       fd           Write end of a pipe
+            int       xsize        Frame width
+            int       ysize        Frame height
+   Returns: Y4MSTREAM *            The stream (NULL on failure)
+
+   Start writing frames to a pipe to be read by CopyY4MFrame() in the
+   process writing the real stream. No header is written. 
+   CloseY4MStream() closes the pipe.
+
+   19.10.26 Original    By: ACRM
+*/
+Y4MSTREAM *OpenY4MPipe(int fd, int xsize, int ysize)
+{
+   return(NewY4MStream(fd, xsize, ysize));
+}
+
+
+/************************************************************************/
+/*>BOOL CopyY4MFrame(Y4MSTREAM *stream, int fd)
+   --------------------------------------------
+   Input:   Y4MSTREAM *stream      Stream from OpenY4MStream()
+            int       fd           Read end of a pipe written with
+                                   OpenY4MPipe()
+   Returns: BOOL                   Success?
+
+   Read one frame from the pipe and append it to the stream. Fails if
+   the pipe ends before a whole frame has been read.
+
+   19.10.26 Original    By: ACRM
+   19.10.26 Uses ReadBlock()
+*/
+BOOL CopyY4MFrame(Y4MSTREAM *stream, int fd)
+{
+   struct iovec  iov[2];
+   unsigned char tag[6];
+   size_t        nbytes;
+
+   nbytes = (size_t)stream->width * stream->height +
+            2 * (size_t)((stream->width+1)/2) * ((stream->height+1)/2);
+
+   /* The FRAME tag then the frame                                      */
+   if(!ReadBlock(fd, tag, 6) || !ReadBlock(fd, stream->frame, nbytes))
+      return(FALSE);
+
+   iov[0].iov_base = "FRAME\n";
+   iov[0].iov_len  = 6;
+   iov[1].iov_base = stream->frame;
+   iov[1].iov_len  = nbytes;
+   return(WriteVector(stream->fd, iov, 2));
+}
+
+
+/************************************************************************/
+/*>BOOL WriteY4MFrame(Y4MSTREAM *stream)
+   -------------------------------------
+   Input:   Y4MSTREAM *stream      Stream from OpenY4MStream()
+   Returns: BOOL                   Success?
+
+   Convert the framebuffer to YUV 4:2:0 and append it to the stream as
+   one frame. Chroma is taken from the mean colour of each 2x2 block.
+
+   19.10.26 Original    By: ACRM
+*/
+BOOL WriteY4MFrame(Y4MSTREAM *stream)
+{
+   struct iovec  iov[2];
+   unsigned char *yp,
+                 *up,
+                 *vp,
+                 *row[2];
+   int           x, y, i, j, n,
+                 cw, ch,
+                 r, g, b;
+
+   cw = (stream->width  + 1) / 2;
+   ch = (stream->height + 1) / 2;
+   yp = stream->frame;
+   up = yp + (size_t)stream->width * stream->height;
+   vp = up + (size_t)cw * ch;
+
+   for(y=0; y<stream->height; y+=2)
+   {
+      row[0] = GetRGBRow(y, stream->rgb[0]);
+      row[1] = (y+1 < stream->height) ?
+               GetRGBRow(y+1, stream->rgb[1]) : row[0];
+
+      /* Luma                                                           */
+      for(j=0; j<2 && y+j<stream->height; j++)
+      {
+         for(x=0; x<stream->width; x++)
+         {
+            r = row[j][3*x];
+            g = row[j][3*x+1];
+            b = row[j][3*x+2];
+            *(yp++) = (unsigned char)((19595*r + 38470*g + 7471*b +
+                                       32768) >> 16);
+         }
+      }
+
+      /* Chroma                                                         */
+      for(x=0; x<stream->width; x+=2)
+      {
+         r = g = b = n = 0;
+         for(j=0; j<2; j++)
+         {
+            for(i=x; i<x+2 && i<stream->width; i++)
+            {
+               r += row[j][3*i];
+               g += row[j][3*i+1];
+               b += row[j][3*i+2];
+               n++;
+            }
+         }
+         r /= n;
+         g /= n;
+         b /= n;
+         *(up++) = (unsigned char)((-11059*r - 21709*g + 32768*b +
+                                    (128<<16) + 32768) >> 16);
+         *(vp++) = (unsigned char)((32768*r - 27439*g - 5329*b +
+                                    (128<<16) + 32768) >> 16);
+      }
+   }
+
+   iov[0].iov_base = "FRAME\n";
+   iov[0].iov_len  = 6;
+   iov[1].iov_base = stream->frame;
+   iov[1].iov_len  = (size_t)stream->width * stream->height +
+                     2 * (size_t)cw * ch;
+
+   return(WriteVector(stream->fd, iov, 2));
+}
+
+
+/************************************************************************/
+/*>BOOL CloseY4MStream(Y4MSTREAM *stream)
+   --------------------------------------
+   Input:   Y4MSTREAM *stream      Stream from OpenY4MStream()
+   Returns: BOOL                   Success?
+
+   Close the output and free the stream
+
+   19.10.26 Original    By: ACRM
+*/
+BOOL CloseY4MStream(Y4MSTREAM *stream)
+{
+   BOOL retval = TRUE;
+
+   if(stream == NULL)
+      return(FALSE);
+
+   if(stream->fd >= 0)
+      retval = CloseOutputFile(stream->fd);
+   if(stream->frame  != NULL) free(stream->frame);
+   if(stream->rgb[0] != NULL) free(stream->rgb[0]);
+   if(stream->rgb[1] != NULL) free(stream->rgb[1]);
+   free(stream);
+
+   return(retval);
+}
+
+
+/************************************************************************/
+/*>BOOL WriteY4MFile(char *FileName, int xsize, int ysize)
+   -------------------------------------------------------
+   Input:   char  *FileName    File to write (blank for stdout)
+            int   xsize        Image width
+            int   ysize        Image height
+   Returns: BOOL               Success?
+
+   Write the framebuffer as a single-frame YUV4MPEG2 stream
+
+   19.10.26 Original    By: ACRM
+*/
+BOOL WriteY4MFile(char *FileName, int xsize, int ysize)
+{
+   Y4MSTREAM *stream;
+   BOOL      retval;
+
+   if((stream = OpenY4MStream(FileName, xsize, ysize, Y4M_FPS)) == NULL)
+      return(FALSE);
+
+   retval = WriteY4MFrame(stream);
+   if(!CloseY4MStream(stream))
+      retval = FALSE;
+
+   return(retval);
+}
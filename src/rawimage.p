@@ -0,0 +1,33 @@
+int OpenOutputFile(char *FileName)
+;
+BOOL CloseOutputFile(int fd)
+;
+BOOL WriteVector(int fd, struct iovec *iov, int niov)
+;
+BOOL ReadBlock(int fd, unsigned char *buffer, size_t nbytes)
+;
+RAWSTREAM *OpenRawStream(char *FileName, int format, int xsize, int ysize,
+                         long offset)
+;
+BOOL WriteRawRows(RAWSTREAM *stream, int y0, int y1)
+;
+long RawStreamOffset(RAWSTREAM *stream)
+;
+BOOL SyncRawStream(RAWSTREAM *stream)
+;
+BOOL CloseRawStream(RAWSTREAM *stream)
+;
+BOOL WriteRawImage(char *FileName, int format, int xsize, int ysize)
+;
+Y4MSTREAM *OpenY4MStream(char *FileName, int xsize, int ysize, int fps)
+;
+Y4MSTREAM *OpenY4MPipe(int fd, int xsize, int ysize)
+;
+BOOL CopyY4MFrame(Y4MSTREAM *stream, int fd)
+;
+BOOL WriteY4MFrame(Y4MSTREAM *stream)
+;
+BOOL CloseY4MStream(Y4MSTREAM *stream)
+;
+BOOL WriteY4MFile(char *FileName, int xsize, int ysize)
+;
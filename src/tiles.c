@@ -0,0 +1,587 @@
+/*************************************************************************
+
+   Program:    QTree
+   File:       tiles.c   
+
+   Version:    V3.8
+   Date:       19.10.26
+   Function:   Deep zoom (DZI and XYZ) tile pyramids     
+
+   Copyright:  (c) SciTech Software 2026
+   Author:     Prof. Andrew C. R. Martin
+   EMail:      andrew@bioinf.org.uk
+
+**************************************************************************
+
+   This program is not in the public domain.
+
+   It may not be copied or made available to third parties, but may be
+   freely used by non-profit-making organisations who have obtained it
+   directly from the author or by FTP.
+
+   You are requested to send EMail to the author to say that you are
+   using this code so that you may be informed of future updates.
+
+   The code may not be made available on other FTP sites without express
+   permission from the author.
+
+   The code may be modified as required, but any modifications must be
+   documented so that the person responsible can be identified. If
+   someone else breaks this code, the author doesn't want to be blamed
+   for code that does not work! You may not distribute any
+   modifications, but are encouraged to send them to the author so
+   that they may be incorporated into future versions of the code.
+
+   The code may not be sold commercially or used for commercial purposes
+   without prior permission from the author.
+
+**************************************************************************
+
+   Description:
+   ============
+   Writes the image as a pyramid of 256x256 PNG tiles for deep-zoom web
+   viewers, either as a Deep Zoom Image (a .dzi descriptor and a
+   _files directory with one directory per level) or as an XYZ
+   directory tree (z/x/y.png).
+
+**************************************************************************
+
+   Usage:
+   ======
+
+**************************************************************************
+
+   Notes:
+   ======
+   The full size image is rendered a row of tiles at a time using the
+   banded renderer, so only one row of tiles is held in memory. Each
+   coarser level is made by averaging 2x2 blocks of the level above as 
+   the rows come through; each level keeps one row of tiles. Tiles 
+   at the edges are cropped to the image rather than padded.
+
+   Tiles which contain no part of the molecule are not written; viewers
+   simply show their own background there. A coarse tile is kept if
+   any of the tiles it was made from were kept.
+
+   The quad tree itself runs on one thread, but the tiles in each row
+   are compressed and written on gNThreads threads (-t).
+
+**************************************************************************
+
+   Revision History:
+   =================
+   V3.8  19.10.26 Original
+
+*************************************************************************/
+/* Includes
+*/
+#define _XOPEN_SOURCE 600
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "bioplib/macros.h"
+#include "bioplib/MathType.h"
+#include "bioplib/SysDefs.h"
+#include "bioplib/pdb.h"
+
+#include "qtree.h"
+#include "qtree.p"
+#include "graphics.p"
+#include "bands.p"
+#include "tiles.p"
+
+/************************************************************************/
+/* Defines and types
+*/
+#define MAXDIR  448            /* Longest tile directory name           */
+#define MAXPATH 512            /* Longest tile filename                 */
+
+typedef struct                 /* One level of the pyramid              */
+{
+   unsigned char *rgb;         /* One row of tiles (packed RGB)         */
+   BOOL          *used;        /* Tiles containing part of the molecule */
+   int           width,        /* Size of the level in pixels           */
+                 height,
+                 ntx,          /* Size of the level in tiles            */
+                 nty;
+}  PYRLEVEL;
+
+typedef struct                 /* A tile to be written                  */
+{
+   unsigned char *rgb;         /* Top left pixel                        */
+   int           width,
+                 height,
+                 stride;       /* Bytes between rows                    */
+   char          path[MAXPATH];
+}  TILEJOB;
+
+typedef struct                 /* Shared by the tile writing threads    */
+{
+   pthread_mutex_t lock;
+   TILEJOB         *jobs;
+   blPNGOPTIONS    options;
+   int             njobs,
+                   next;       /* Next job to be taken                  */
+   BOOL            ok;
+}  TILEQUEUE;
+
+/************************************************************************/
+/* Variables global to this file only
+*/
+static PYRLEVEL *sLevels    = NULL;   /* The levels                     */
+static TILEJOB  *sJobs      = NULL;   /* One row of tiles to be written */
+static int      sMaxLevel   = 0,      /* The full size image            */
+                sMinLevel   = 0,      /* The coarsest level written     */
+                sFormat     = OUTPUT_DZI;
+static char     sTileDir[MAXDIR];    /* Top of the tile directories    */
+
+/************************************************************************/
+/* Prototypes
+*/
+static BOOL MakeDir(char *path);
+static BOOL WriteDZIDescriptor(char *FileName);
+static BOOL WriteTileRow(int level, unsigned char *rgb, int stride,
+                         int nrows, int tileRow, BOOL *used);
+static void *TileThread(void *arg);
+static BOOL ReduceTileRow(int level, unsigned char *rgb, int stride,
+                          int nrows, int tileRow, BOOL *used);
+
+
+/************************************************************************/
+/*>BOOL RenderTiles(SPHERE *AllSpheres, int NSphere, char *outFile, 
+                    int outFormat)
+   ---------------------------------------------------------------
+   Input:   SPHERE  *AllSpheres   Array of spheres
+            int     NSphere       Number of spheres
+            char    *outFile      For DZI, the .dzi file (the tiles go
+                                  in <name>_files); for XYZ, the 
+                                  directory for the tiles
+            int     outFormat     OUTPUT_DZI or OUTPUT_XYZ
+   Returns: BOOL                  Success?
+
+   Renders the image a row of tiles at a time and writes the tile
+   pyramid. Used instead of SpaceFill(). InitGraphics() must have been 
+   called with gBandRows set to DZ_TILESIZE and with the coverage 
+   plane.
+
+   19.10.26 Original    By: ACRM
+*/
+BOOL RenderTiles(SPHERE *AllSpheres, int NSphere, char *outFile, 
+                 int outFormat)
+{
+   SPHERE        **SrtSph = NULL;
+   BOOL          *used    = NULL,
+                 ok       = FALSE;
+   unsigned char *alpha;
+   char          *chp;
+   int           level, size, ntx, nty,
+                 tx, ty, x, y, xend,
+                 nrows;
+
+   if(!outFile[0] || (strlen(outFile) > MAXDIR - 8))
+   {
+      fprintf(stderr,"A (short) output name must be given for tiled \
+output.\n");
+      return(FALSE);
+   }
+   sFormat = outFormat;
+
+   /* Find the number of levels. Level n is at most 2^n pixels across
+      and the full image is sMaxLevel. XYZ starts from the level which
+      just fits into one tile
+   */
+   size = MAX(gScreen[0], gScreen[1]);
+   for(sMaxLevel=0; (1<<sMaxLevel) < size; sMaxLevel++);
+   sMinLevel = 0;
+   if(outFormat == OUTPUT_XYZ)
+   {
+      for(size=DZ_TILESIZE; size>1; size/=2)
+         sMinLevel++;
+      sMinLevel = MIN(sMinLevel, sMaxLevel);
+   }
+
+   ntx = (gScreen[0] + DZ_TILESIZE - 1) / DZ_TILESIZE;
+   nty = (gScreen[1] + DZ_TILESIZE - 1) / DZ_TILESIZE;
+   
+   /* Work out the directory names and write the DZI descriptor         */
+   strcpy(sTileDir, outFile);
+   if(outFormat == OUTPUT_DZI)
+   {
+      if(((chp = strrchr(sTileDir, '.')) != NULL) && !strcmp(chp, ".dzi"))
+         *chp = '\0';
+      strcat(sTileDir, ".dzi");
+      if(!WriteDZIDescriptor(sTileDir))
+      {
+         fprintf(stderr,"Unable to write %s\n", sTileDir);
+         return(FALSE);
+      }
+      strcpy(sTileDir + strlen(sTileDir) - 4, "_files");
+   }
+   if(!MakeDir(sTileDir))
+      return(FALSE);
+
+   /* Allocate the levels. The full size level comes straight from the
+      framebuffer so has no buffer of its own
+   */
+   if(((sLevels = (PYRLEVEL *)calloc(sMaxLevel+1, sizeof(PYRLEVEL)))
+       == NULL) ||
+      ((sJobs = (TILEJOB *)malloc(ntx * sizeof(TILEJOB))) == NULL) ||
+      ((used = (BOOL *)malloc(ntx * sizeof(BOOL))) == NULL))
+      goto cleanup;
+   
+   for(level=sMaxLevel; level>=sMinLevel; level--)
+   {
+      PYRLEVEL *lev = sLevels + level;
+      int      shift = sMaxLevel - level;
+      
+      lev->width  = (gScreen[0] + (1<<shift) - 1) >> shift;
+      lev->height = (gScreen[1] + (1<<shift) - 1) >> shift;
+      lev->ntx    = (lev->width  + DZ_TILESIZE - 1) / DZ_TILESIZE;
+      lev->nty    = (lev->height + DZ_TILESIZE - 1) / DZ_TILESIZE;
+      if(level < sMaxLevel)
+      {
+         if(((lev->rgb = (unsigned char *)malloc((size_t)3 * lev->width *
+                                                 DZ_TILESIZE)) == NULL) ||
+            ((lev->used = (BOOL *)calloc(lev->ntx, sizeof(BOOL))) == NULL))
+            goto cleanup;
+      }
+   }
+
+   /* Sort the spheres once for all the rows of tiles                   */
+   if((SrtSph = SortSpheresOnX(AllSpheres, NSphere)) == NULL)
+      goto cleanup;
+
+   for(ty=0; ty<nty; ty++)
+   {
+      nrows = MIN(DZ_TILESIZE, gScreen[1] - ty*DZ_TILESIZE);
+      if(!RenderBand(SrtSph, NSphere, ty*DZ_TILESIZE, nrows))
+         goto cleanup;
+
+      /* Find which tiles have something in them                        */
+      for(tx=0; tx<ntx; tx++)
+         used[tx] = FALSE;
+      for(y=ty*DZ_TILESIZE; y<ty*DZ_TILESIZE+nrows; y++)
+      {
+         alpha = GetAlphaRow(y, NULL);
+         for(tx=0; tx<ntx; tx++)
+         {
+            if(used[tx]) 
+               continue;
+            xend = MIN((tx+1)*DZ_TILESIZE, gScreen[0]);
+            for(x=tx*DZ_TILESIZE; x<xend; x++)
+            {
+               if(alpha[x])
+               {
+                  used[tx] = TRUE;
+                  break;
+               }
+            }
+         }
+      }
+      
+      if(!ReduceTileRow(sMaxLevel, GetRGBRow(ty*DZ_TILESIZE, NULL), 
+                        3*gScreen[0], nrows, ty, used))
+         goto cleanup;
+   }
+   ok = TRUE;
+
+cleanup:
+   if(!ok)
+      fprintf(stderr,"Tiled output failed.\n");
+
+   if(sLevels != NULL)
+   {
+      for(level=0; level<=sMaxLevel; level++)
+      {
+         if(sLevels[level].rgb  != NULL) free(sLevels[level].rgb);
+         if(sLevels[level].used != NULL) free(sLevels[level].used);
+      }
+      free(sLevels);
+      sLevels = NULL;
+   }
+   if(sJobs  != NULL) free(sJobs);
+   if(used   != NULL) free(used);
+   if(SrtSph != NULL) free(SrtSph);
+   sJobs = NULL;
+   
+   return(ok);
+}
+
+
+/************************************************************************/
+/*>static BOOL ReduceTileRow(int level, unsigned char *rgb, int stride,
+                             int nrows, int tileRow, BOOL *used)
+   --------------------------------------------------------------------
+   Input:   int           level     Level of this row of tiles
+            unsigned char *rgb      The row of tiles
+            int           stride    Bytes between rows
+            int           nrows     Rows in this row of tiles
+            int           tileRow   Which row of tiles this is
+            BOOL          *used     Tiles with something in them
+   Returns: BOOL                    Success?
+
+   Writes a finished row of tiles and averages it down into the next
+   coarser level. Two rows of tiles make one at the coarser level so,
+   when that is complete (or this is the bottom of the image), it is
+   passed on in the same way.
+
+   19.10.26 Original    By: ACRM
+*/
+static BOOL ReduceTileRow(int level, unsigned char *rgb, int stride,
+                          int nrows, int tileRow, BOOL *used)
+{
+   PYRLEVEL      *src = sLevels + level,
+                 *dst;
+   unsigned char *s0, *s1, *d;
+   int           x, y, c,
+                 x1, 
+                 outRows,
+                 offset;
+
+   if(!WriteTileRow(level, rgb, stride, nrows, tileRow, used))
+      return(FALSE);
+   if(level == sMinLevel)
+      return(TRUE);
+
+   /* Average 2x2 blocks into the coarser level. At an odd edge the last
+      row or column is used twice
+   */
+   dst     = sLevels + level - 1;
+   offset  = (tileRow % 2) * (DZ_TILESIZE / 2);
+   outRows = (nrows + 1) / 2;
+   for(y=0; y<outRows; y++)
+   {
+      s0 = rgb + (size_t)(2*y) * stride;
+      s1 = (2*y+1 < nrows) ? s0 + stride : s0;
+      d  = dst->rgb + (size_t)(offset + y) * 3 * dst->width;
+      
+      for(x=0; x<dst->width; x++)
+      {
+         x1 = (2*x+1 < src->width) ? 3 : 0;
+         for(c=0; c<3; c++)
+         {
+            d[3*x+c] = (unsigned char)((s0[6*x+c] + s0[6*x+x1+c] +
+                                        s1[6*x+c] + s1[6*x+x1+c] + 2) 
+                                       / 4);
+         }
+      }
+   }
+   for(x=0; x<src->ntx; x++)
+   {
+      if(used[x])
+         dst->used[x/2] = TRUE;
+   }
+
+   /* Pass on the coarser row if it is complete                         */
+   if((tileRow % 2) || (tileRow == src->nty - 1))
+   {
+      if(!ReduceTileRow(level-1, dst->rgb, 3 * dst->width, 
+                        offset + outRows, tileRow / 2, dst->used))
+         return(FALSE);
+      for(x=0; x<dst->ntx; x++)
+         dst->used[x] = FALSE;
+   }
+   
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>static BOOL WriteTileRow(int level, unsigned char *rgb, int stride, 
+                            int nrows, int tileRow, BOOL *used)
+   -------------------------------------------------------------------
+   Input:   int           level     Level of this row of tiles
+            unsigned char *rgb      The row of tiles
+            int           stride    Bytes between rows
+            int           nrows     Rows in this row of tiles
+            int           tileRow   Which row of tiles this is
+            BOOL          *used     Tiles with something in them
+   Returns: BOOL                    Success?
+
+   Writes the tiles in a row which contain part of the molecule as
+   PNG files, on gNThreads threads.
+
+   19.10.26 Original    By: ACRM
+*/
+static BOOL WriteTileRow(int level, unsigned char *rgb, int stride,
+                         int nrows, int tileRow, BOOL *used)
+{
+   PYRLEVEL  *lev = sLevels + level;
+   TILEQUEUE queue;
+   pthread_t *threads;
+   char      *chp;
+   int       tx, i, nthreads;
+
+   /* Make the list of tiles and any directories needed                 */
+   queue.jobs  = sJobs;
+   queue.njobs = 0;
+   queue.next  = 0;
+   queue.ok    = TRUE;
+   
+   chp = sJobs[0].path;
+   if(sFormat == OUTPUT_DZI)
+      sprintf(chp, "%s/%d", sTileDir, level);
+   else
+      sprintf(chp, "%s/%d", sTileDir, level - sMinLevel);
+   if((tileRow == 0) && !MakeDir(chp))
+      return(FALSE);
+   
+   for(tx=0; tx<lev->ntx; tx++)
+   {
+      TILEJOB *job;
+      
+      if(!used[tx])
+         continue;
+      
+      job         = sJobs + queue.njobs++;
+      job->rgb    = rgb + 3 * tx * DZ_TILESIZE;
+      job->width  = MIN(DZ_TILESIZE, lev->width - tx*DZ_TILESIZE);
+      job->height = nrows;
+      job->stride = stride;
+      if(sFormat == OUTPUT_DZI)
+      {
+         sprintf(job->path, "%s/%d/%d_%d.png", sTileDir, level, tx, 
+                 tileRow);
+      }
+      else
+      {
+         sprintf(job->path, "%s/%d/%d", sTileDir, level - sMinLevel, tx);
+         if(!MakeDir(job->path))
+            return(FALSE);
+         sprintf(job->path + strlen(job->path), "/%d.png", tileRow);
+      }
+   }
+   if(queue.njobs == 0)
+      return(TRUE);
+
+   queue.options         = gPNGOptions;
+   queue.options.threads = 1;
+   nthreads = MIN(gNThreads, queue.njobs);
+
+   /* Write them, on this thread if there are no others or if threads
+      can't be started
+   */
+   if((nthreads < 2) || 
+      ((threads = (pthread_t *)malloc(nthreads * sizeof(pthread_t))) 
+       == NULL))
+   {
+      pthread_mutex_init(&queue.lock, NULL);
+      TileThread((void *)&queue);
+      pthread_mutex_destroy(&queue.lock);
+      return(queue.ok);
+   }
+   
+   pthread_mutex_init(&queue.lock, NULL);
+   for(i=0; i<nthreads; i++)
+   {
+      if(pthread_create(&(threads[i]), NULL, TileThread, 
+                        (void *)&queue) != 0)
+         break;
+   }
+   if(i == 0)
+      TileThread((void *)&queue);
+   nthreads = i;
+   for(i=0; i<nthreads; i++)
+      pthread_join(threads[i], NULL);
+   pthread_mutex_destroy(&queue.lock);
+   free(threads);
+
+   return(queue.ok);
+}
+
+
+/************************************************************************/
+/*>static void *TileThread(void *arg)
+   ----------------------------------
+   Input:   void  *arg     The TILEQUEUE
+   Returns: void  *        NULL
+
+   Takes tiles from the queue and writes them until there are none 
+   left.
+
+   19.10.26 Original    By: ACRM
+*/
+static void *TileThread(void *arg)
+{
+   TILEQUEUE *queue = (TILEQUEUE *)arg;
+   TILEJOB   *job;
+   
+   for(;;)
+   {
+      pthread_mutex_lock(&queue->lock);
+      job = (queue->next < queue->njobs) ? queue->jobs + queue->next++ 
+                                         : NULL;
+      pthread_mutex_unlock(&queue->lock);
+      if(job == NULL)
+         break;
+      
+      if(!blSavePNGBufferToFile(job->rgb, job->width, job->height, 
+                                job->stride, job->path, &queue->options))
+      {
+         pthread_mutex_lock(&queue->lock);
+         if(queue->ok)
+            fprintf(stderr,"Unable to write tile: %s\n", job->path);
+         queue->ok = FALSE;
+         pthread_mutex_unlock(&queue->lock);
+      }
+   }
+   
+   return(NULL);
+}
+
+
+/************************************************************************/
+/*>static BOOL WriteDZIDescriptor(char *FileName)
+   ----------------------------------------------
+   Input:   char  *FileName    The .dzi file
+   Returns: BOOL               Success?
+
+   Writes the XML file describing a Deep Zoom Image.
+
+   19.10.26 Original    By: ACRM
+*/
+static BOOL WriteDZIDescriptor(char *FileName)
+{
+   FILE *fp;
+   BOOL ok;
+   
+   if((fp = fopen(FileName, "w")) == NULL)
+      return(FALSE);
+
+   fprintf(fp, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+   fprintf(fp, "<Image xmlns=\"http://schemas.microsoft.com/deepzoom/\
+2008\"\n");
+   fprintf(fp, "       TileSize=\"%d\" Overlap=\"0\" Format=\"png\">\n",
+           DZ_TILESIZE);
+   fprintf(fp, "   <Size Width=\"%d\" Height=\"%d\"/>\n", 
+           gScreen[0], gScreen[1]);
+   fprintf(fp, "</Image>\n");
+
+   ok = !ferror(fp);
+   ok = (fclose(fp) == 0) && ok;
+   return(ok);
+}
+
+
+/************************************************************************/
+/*>static BOOL MakeDir(char *path)
+   -------------------------------
+   Input:   char  *path     Directory to create
+   Returns: BOOL            Success (or it was already there)?
+
+   19.10.26 Original    By: ACRM
+*/
+static BOOL MakeDir(char *path)
+{
+   if((mkdir(path, 0777) == 0) || (errno == EEXIST))
+      return(TRUE);
+   fprintf(stderr,"Unable to create directory: %s\n", path);
+   return(FALSE);
+}
+
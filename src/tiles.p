@@ -0,0 +1,3 @@
+BOOL RenderTiles(SPHERE *AllSpheres, int NSphere, char *outFile, 
+                 int outFormat)
+;
@@ -0,0 +1,631 @@
+/*************************************************************************
+
+   Program:    QTree
+   File:       trajectory.c
+
+   Version:    V3.25
+   Date:       19.10.26
+   Function:   Render each model of a trajectory as a frame
+
+   Copyright:  (c) SciTech Software 2026
+   Author:     Prof. Andrew C. R. Martin
+   EMail:      andrew@bioinf.org.uk
+
+**************************************************************************
+
+   This program is not in the public domain.
+
+   It may not be copied or made available to third parties, but may be
+   freely used by non-profit-making organisations who have obtained it
+   directly from the author or by FTP.
+
+   You are requested to send EMail to the author to say that you are
+   using this code so that you may be informed of future updates.
+
+   The code may not be made available on other FTP sites without express
+   permission from the author.
+
+   The code may be modified as required, but any modifications must be
+   documented so that the person responsible can be identified. If
+   someone else breaks this code, the author doesn't want to be blamed
+   for code that does not work! You may not distribute any
+   modifications, but are encouraged to send them to the author so
+   that they may be incorporated into future versions of the code.
+
+   The code may not be sold commercially or used for commercial purposes
+   without prior permission from the author.
+
+**************************************************************************
+
+   Description:
+   ============
+   Renders a frame for each model of a multi-model PDB file such as an
+   MD trajectory or NMR ensemble. The first model is read, coloured and
+   mapped to the screen as usual. The atoms are the same in every model
+   so only the coordinates of the others are read; they are rotated by
+   the control file and placed on the screen in the same way as the
+   first, keeping its colours, radii, scale and centre.
+
+**************************************************************************
+
+   Usage:
+   ======
+   The first model is read with ReadAtoms() and HandleControl() and
+   MapSpheres() are run on it. RenderTrajectory() is then called with
+   the atoms and the spheres in place of SpaceFill().
+
+**************************************************************************
+
+   Notes:
+   ======
+   Models are separated by MODEL and ENDMDL records; a file without
+   them is a single model. Every model must have the same atoms in the
+   same order as the first and alternate positions are not allowed.
+
+   The file is scanned once to find where each model starts. Frames
+   are rendered by the gNThreads workers from frames.c and each worker
+   opens the file itself so that they do not share a file position.
+   While a worker renders one model, a reader thread reads the model
+   it will want next (the one after, or gNThreads on for Y4M streams)
+   into a second buffer. No more than two models for each worker are
+   held at a time however long the trajectory. The PDB file must be a
+   file rather than a pipe.
+
+   SLAB is applied to the first model only.
+
+**************************************************************************
+
+   Revision History:
+   =================
+   V3.19 19.10.26 Original
+   V3.20 19.10.26 Each worker reads the next model on a second thread
+                  while it renders
+   V3.25 19.10.26 The first model is an array from ReadAtoms()
+                  Models rotated by the combined gRotation
+
+*************************************************************************/
+/* Includes
+*/
+#define _XOPEN_SOURCE 600
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "bioplib/macros.h"
+#include "bioplib/MathType.h"
+#include "bioplib/SysDefs.h"
+#include "bioplib/pdb.h"
+
+#include "qtree.h"
+#include "qtree.p"
+#include "graphics.p"
+#include "frames.p"
+#include "trajectory.p"
+
+/************************************************************************/
+/* Defines
+*/
+#define MAXBUFF 160              /* Longest PDB record read             */
+
+/************************************************************************/
+/* Shared by a worker and its reader thread. The reader takes the model
+   in want, reads it into coords and sets model. Only the reader uses
+   coords while busy.
+*/
+typedef struct
+{
+   pthread_mutex_t lock;
+   pthread_cond_t  cond;
+   REAL            *coords;      /* x,y,z of each atom                  */
+   int             want,         /* Model to read next (-1 if none)     */
+                   model;        /* Model in coords (-1 if none)        */
+   BOOL            busy,
+                   ok,           /* Was model read?                     */
+                   quit;
+}  READAHEAD;
+
+/************************************************************************/
+/* Variables global to this file only
+*/
+static char   *sFileName = NULL; /* The trajectory                      */
+static FILE   *sFp       = NULL; /* Opened by each worker               */
+static long   *sModels   = NULL; /* File position of each model         */
+static PDB    *sPDB      = NULL; /* Atoms of the first model            */
+static PDB    **sAtoms   = NULL; /* Index into sPDB                     */
+static int    sNAtom     = 0;
+static SPHERE *sSpheres  = NULL; /* Spheres of the current frame        */
+static SPHERE **sSrtSph  = NULL; /* sSpheres sorted on x                */
+static int    sNSphere   = 0;
+static int    sNModels   = 0;
+static REAL   *sCoords   = NULL; /* Model being rendered                */
+static int    sLastFrame = (-1); /* Frame rendered before               */
+static BOOL   sReading   = FALSE;/* Reader thread running?              */
+static pthread_t sReader;
+static READAHEAD sAhead;
+
+/************************************************************************/
+/* Prototypes
+*/
+static int  ScanTrajectory(FILE *fp);
+static BOOL TrajectoryFrame(int frame);
+static BOOL NextModel(int model);
+static BOOL StartReader(void);
+static void StopReader(void);
+static void *ReaderThread(void *arg);
+static BOOL ReadModel(int model, REAL *coords);
+static BOOL IsAtom(char *buffer);
+static BOOL IsModelEnd(char *buffer);
+
+
+/************************************************************************/
+/*>BOOL RenderTrajectory(char *fileName, PDB *pdb, int NAtom,
+                         SPHERE *spheres, int NSphere, char *outFile,
+                         int outFormat)
+   -------------------------------------------------------------------
+   Input:   char   *fileName   The trajectory PDB file
+            PDB    *pdb        Atoms of the first model, after the
+                               control file. Coordinates are changed
+            int    NAtom       Number of atoms
+            SPHERE *spheres    Mapped spheres of the first model (after
+                               SLAB)
+            int    NSphere     Number of spheres
+            char   *outFile    Output filename containing %d, or the
+                               stream (blank for stdout) for Y4M
+            int    outFormat   Output format
+   Returns: BOOL               Success?
+
+   Renders and writes a frame for each model. Frames are numbered from
+   1 to match the models.
+
+   19.10.26 Original    By: ACRM
+   19.10.26 Stops the reader thread
+*/
+BOOL RenderTrajectory(char *fileName, PDB *pdb, int NAtom,
+                      SPHERE *spheres, int NSphere, char *outFile,
+                      int outFormat)
+{
+   FILE *fp;
+   PDB  *p;
+   int  i,
+        NModels;
+   BOOL ok;
+
+   if(NSphere == 0)
+   {
+      fprintf(stderr,"No atoms to render\n");
+      return(FALSE);
+   }
+   if((fp = fopen(fileName, "r")) == NULL)
+   {
+      fprintf(stderr,"Unable to read trajectory: %s\n", fileName);
+      return(FALSE);
+   }
+
+   sNAtom  = NAtom;
+   NModels = ScanTrajectory(fp);
+   fclose(fp);
+   if(NModels == 0)
+      return(FALSE);
+
+   if(((sAtoms  = (PDB **)malloc(NAtom * sizeof(PDB *))) == NULL) ||
+      ((sCoords = (REAL *)malloc(3 * NAtom * sizeof(REAL))) == NULL))
+   {
+      fprintf(stderr,"No memory for trajectory\n");
+      if(sAtoms != NULL) free(sAtoms);
+      free(sModels);
+      sAtoms  = NULL;
+      sModels = NULL;
+      return(FALSE);
+   }
+   for(p=pdb, i=0; (p!=NULL) && (i<NAtom); NEXT(p), i++)
+      sAtoms[i] = p;
+
+   sFileName = fileName;
+   sPDB      = pdb;
+   sSpheres  = spheres;
+   sNSphere  = NSphere;
+   sNModels  = NModels;
+
+   ok = RenderFrames(NModels, 1, outFile, outFormat, TrajectoryFrame);
+
+   StopReader();
+   if(sFp     != NULL) fclose(sFp);
+   if(sSrtSph != NULL) free(sSrtSph);
+   free(sCoords);
+   free(sAtoms);
+   free(sModels);
+   sFp     = NULL;
+   sSrtSph = NULL;
+   sCoords = NULL;
+   sAtoms  = NULL;
+   sModels = NULL;
+   return(ok);
+}
+
+
+/************************************************************************/
+/*>static int ScanTrajectory(FILE *fp)
+   -----------------------------------
+   Input:   FILE   *fp         The trajectory, at the start
+   Returns: int                Number of models (0 on error)
+
+   Reads through the file once to find where each model starts (in
+   sModels) and checks that each has sNAtom atoms.
+
+   19.10.26 Original    By: ACRM
+*/
+static int ScanTrajectory(FILE *fp)
+{
+   char buffer[MAXBUFF];
+   long start    = 0L;
+   int  NModels  = 0,
+        maxModels = 0,
+        natom    = (-1);
+
+   while(fgets(buffer, MAXBUFF, fp))
+   {
+      /* Only whole lines are records                                   */
+      if(strchr(buffer, '\n') == NULL)
+      {
+         while(fgets(buffer, MAXBUFF, fp) && !strchr(buffer, '\n'));
+         continue;
+      }
+
+      if(IsAtom(buffer))
+      {
+         /* The first atom of a model                                   */
+         if(natom < 0)
+         {
+            if(NModels >= maxModels)
+            {
+               maxModels = 2 * maxModels + 64;
+               if((sModels = (long *)realloc(sModels,
+                                             maxModels * sizeof(long)))
+                  == NULL)
+               {
+                  fprintf(stderr,"No memory for trajectory\n");
+                  return(0);
+               }
+            }
+            sModels[NModels++] = start;
+            natom              = 0;
+         }
+         natom++;
+      }
+      else if(!strncmp(buffer, "MODEL ", 6) || IsModelEnd(buffer))
+      {
+         if((natom >= 0) && (natom != sNAtom))
+            break;
+         natom = (-1);
+         start = ftell(fp);
+      }
+   }
+
+   if((natom >= 0) && (natom != sNAtom))
+   {
+      fprintf(stderr,"Model %d of the trajectory has %d atoms rather \
+than %d\n", NModels, natom, sNAtom);
+      NModels = 0;
+   }
+   else if(NModels == 0)
+   {
+      fprintf(stderr,"No models in the trajectory\n");
+   }
+
+   if(NModels == 0)
+   {
+      free(sModels);
+      sModels = NULL;
+   }
+   return(NModels);
+}
+
+
+/************************************************************************/
+/*>static BOOL TrajectoryFrame(int frame)
+   --------------------------------------
+   Input:   int    frame       Frame number (from 0)
+   Returns: BOOL               Success?
+
+   Reads the model for this frame, moves the spheres there and renders
+   them into the framebuffer.
+
+   19.10.26 Original    By: ACRM
+   19.10.26 Model taken from the reader thread
+   19.10.26 Rotated by the combined gRotation
+*/
+static BOOL TrajectoryFrame(int frame)
+{
+   PDB  *p;
+   REAL *coords;
+   int  i;
+
+   if(!NextModel(frame))
+      return(FALSE);
+
+   for(i=0, coords=sCoords; i<sNAtom; i++, coords+=3)
+   {
+      sAtoms[i]->x = coords[0];
+      sAtoms[i]->y = coords[1];
+      sAtoms[i]->z = coords[2];
+   }
+
+   /* Rotate as the first model was by the control file                 */
+   blRotatePDB(sPDB, gRotation);
+
+   for(i=0; i<sNSphere; i++)
+   {
+      p = sAtoms[sSpheres[i].atom];
+      MapSphere(&(sSpheres[i]), p->x, p->y, p->z);
+   }
+
+   /* The atoms have moved a little since this process's last frame    */
+   if((sSrtSph == NULL) || !ResortSpheresOnX(sSrtSph, sNSphere))
+   {
+      if(sSrtSph != NULL)
+         free(sSrtSph);
+      if((sSrtSph = SortSpheresOnX(sSpheres, sNSphere)) == NULL)
+         return(FALSE);
+   }
+
+   SetBand(0);
+   return(SpaceFillRows(sSrtSph, sNSphere, 0, gScreen[1]));
+}
+
+
+/************************************************************************/
+/*>static BOOL NextModel(int model)
+   --------------------------------
+   Input:   int    model       Model number (from 0)
+   Returns: BOOL               Success?
+
+   Puts the coordinates of a model in sCoords, normally from the reader
+   thread, and asks the reader for the model this worker will want
+   next. Without a reader, the model is read here.
+
+   19.10.26 Original    By: ACRM
+*/
+static BOOL NextModel(int model)
+{
+   REAL *coords;
+   int  next;
+   BOOL ok;
+
+   if(!sReading && !StartReader())
+      return(ReadModel(model, sCoords));
+
+   pthread_mutex_lock(&(sAhead.lock));
+
+   /* Wait for the model, asking for it if it has not been read ahead   */
+   while(sAhead.busy || (sAhead.model != model))
+   {
+      if(!sAhead.busy && (sAhead.want < 0))
+      {
+         sAhead.want = model;
+         pthread_cond_broadcast(&(sAhead.cond));
+      }
+      pthread_cond_wait(&(sAhead.cond), &(sAhead.lock));
+   }
+
+   /* Swap buffers with the reader                                      */
+   coords        = sCoords;
+   sCoords       = sAhead.coords;
+   sAhead.coords = coords;
+   sAhead.model  = (-1);
+   ok            = sAhead.ok;
+
+   /* A worker moves through the models in even steps                   */
+   next = model + (((sLastFrame >= 0) && (model > sLastFrame)) ?
+                   model - sLastFrame : 1);
+   sLastFrame = model;
+   if(next < sNModels)
+   {
+      sAhead.want = next;
+      pthread_cond_broadcast(&(sAhead.cond));
+   }
+
+   pthread_mutex_unlock(&(sAhead.lock));
+   return(ok);
+}
+
+
+/************************************************************************/
+/*>static BOOL StartReader(void)
+   -----------------------------
+   Returns: BOOL               Was the reader thread started?
+
+   Starts this process's reader thread with a second coordinate buffer.
+
+   19.10.26 Original    By: ACRM
+*/
+static BOOL StartReader(void)
+{
+   if((sAhead.coords = (REAL *)malloc(3 * sNAtom * sizeof(REAL))) == NULL)
+      return(FALSE);
+
+   sAhead.want  = (-1);
+   sAhead.model = (-1);
+   sAhead.busy  = FALSE;
+   sAhead.ok    = FALSE;
+   sAhead.quit  = FALSE;
+   pthread_mutex_init(&(sAhead.lock), NULL);
+   pthread_cond_init(&(sAhead.cond), NULL);
+
+   if(pthread_create(&sReader, NULL, ReaderThread, NULL) != 0)
+   {
+      pthread_mutex_destroy(&(sAhead.lock));
+      pthread_cond_destroy(&(sAhead.cond));
+      free(sAhead.coords);
+      sAhead.coords = NULL;
+      return(FALSE);
+   }
+
+   sReading = TRUE;
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>static void StopReader(void)
+   ----------------------------
+   Stops the reader thread once it has finished any model it is
+   reading.
+
+   19.10.26 Original    By: ACRM
+*/
+static void StopReader(void)
+{
+   if(!sReading)
+      return;
+
+   pthread_mutex_lock(&(sAhead.lock));
+   sAhead.quit = TRUE;
+   pthread_cond_broadcast(&(sAhead.cond));
+   pthread_mutex_unlock(&(sAhead.lock));
+   pthread_join(sReader, NULL);
+
+   pthread_mutex_destroy(&(sAhead.lock));
+   pthread_cond_destroy(&(sAhead.cond));
+   free(sAhead.coords);
+   sAhead.coords = NULL;
+   sReading      = FALSE;
+   sLastFrame    = (-1);
+}
+
+
+/************************************************************************/
+/*>static void *ReaderThread(void *arg)
+   ------------------------------------
+   Input:   void   *arg        Not used
+   Returns: void   *           NULL
+
+   Reads each model asked for in sAhead.want into sAhead.coords.
+
+   19.10.26 Original    By: ACRM
+*/
+static void *ReaderThread(void *arg)
+{
+   REAL *coords;
+   int  model;
+   BOOL ok;
+
+   pthread_mutex_lock(&(sAhead.lock));
+   for(;;)
+   {
+      while((sAhead.want < 0) && !sAhead.quit)
+         pthread_cond_wait(&(sAhead.cond), &(sAhead.lock));
+      if(sAhead.quit)
+         break;
+
+      model       = sAhead.want;
+      coords      = sAhead.coords;
+      sAhead.want = (-1);
+      sAhead.busy = TRUE;
+      pthread_mutex_unlock(&(sAhead.lock));
+
+      ok = ReadModel(model, coords);
+
+      pthread_mutex_lock(&(sAhead.lock));
+      sAhead.model = model;
+      sAhead.ok    = ok;
+      sAhead.busy  = FALSE;
+      pthread_cond_broadcast(&(sAhead.cond));
+   }
+   pthread_mutex_unlock(&(sAhead.lock));
+
+   return(NULL);
+}
+
+
+/************************************************************************/
+/*>static BOOL ReadModel(int model, REAL *coords)
+   ----------------------------------------------
+   Input:   int    model       Model number (from 0)
+   Output:  REAL   *coords     x, y and z of each atom
+   Returns: BOOL               Success?
+
+   Reads the coordinates of a model. The file is opened on first use by
+   each process.
+
+   19.10.26 Original    By: ACRM
+   19.10.26 Reads into a coordinate buffer rather than sPDB
+*/
+static BOOL ReadModel(int model, REAL *coords)
+{
+   char buffer[MAXBUFF],
+        field[9];
+   int  natom = 0,
+        i;
+
+   if((sFp == NULL) && ((sFp = fopen(sFileName, "r")) == NULL))
+   {
+      fprintf(stderr,"Unable to read trajectory: %s\n", sFileName);
+      return(FALSE);
+   }
+   if(fseek(sFp, sModels[model], SEEK_SET) != 0)
+   {
+      fprintf(stderr,"Unable to find model %d in the trajectory\n",
+              model+1);
+      return(FALSE);
+   }
+
+   while((natom < sNAtom) && fgets(buffer, MAXBUFF, sFp))
+   {
+      if(IsModelEnd(buffer))
+         break;
+      if(!IsAtom(buffer))
+         continue;
+
+      /* Columns 31-54 hold x, y and z                                  */
+      if(strlen(buffer) < 54)
+         break;
+      for(i=0; i<3; i++)
+      {
+         strncpy(field, buffer+30+8*i, 8);
+         field[8] = '\0';
+         *(coords++) = (REAL)atof(field);
+      }
+      natom++;
+   }
+
+   if(natom != sNAtom)
+   {
+      fprintf(stderr,"Unable to read model %d of the trajectory\n",
+              model+1);
+      return(FALSE);
+   }
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>static BOOL IsAtom(char *buffer)
+   --------------------------------
+   Input:   char   *buffer     A line of a PDB file
+   Returns: BOOL               Is it an ATOM or HETATM record?
+
+   19.10.26 Original    By: ACRM
+*/
+static BOOL IsAtom(char *buffer)
+{
+   return(!strncmp(buffer, "ATOM  ", 6) || !strncmp(buffer, "HETATM", 6));
+}
+
+
+/************************************************************************/
+/*>static BOOL IsModelEnd(char *buffer)
+   ------------------------------------
+   Input:   char   *buffer     A line of a PDB file
+   Returns: BOOL               Is it an ENDMDL or END record?
+
+   19.10.26 Original    By: ACRM
+*/
+static BOOL IsModelEnd(char *buffer)
+{
+   return(!strncmp(buffer, "ENDMDL", 6) ||
+          (!strncmp(buffer, "END", 3) &&
+           ((buffer[3] == ' ') || (buffer[3] == '\n') ||
+            (buffer[3] == '\r') || (buffer[3] == '\0'))));
+}
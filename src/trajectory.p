@@ -0,0 +1,4 @@
+BOOL RenderTrajectory(char *fileName, PDB *pdb, int NAtom,
+                      SPHERE *spheres, int NSphere, char *outFile,
+                      int outFormat)
+;
@@ -3,11 +3,11 @@
    Program:    QTree
    File:       writepng.h
    
-   Version:    V3.0
-   Date:       19.09.19
+   Version:    V3.8
+   Date:       19.10.26
    Function:   Write a PNG image
    
-   Copyright:  (c) SciTech Software 2019
+   Copyright:  (c) SciTech Software 2019-2026
    Author:     Prof. Andrew C. R. Martin
    EMail:      andrew@bioinf.org.uk
                
@@ -56,11 +56,29 @@
    Revision History:
    =================
    V3.0  19.08.19 Original
+   V3.3  19.10.26 Rows written with png_write_row() rather than copied.
+                  Added blSavePNGRowsToFile() and compression options
+   V3.4  19.10.26 Added multi-threaded encoder
+   V3.7  19.10.26 Added blPNGSTREAM for writing in bands with resume
+   V3.8  19.10.26 Added blSavePNGBufferToFile()
 
 *************************************************************************/
 
+#define _XOPEN_SOURCE 600
+
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <pthread.h>
 #include "writepng.h"
 
+/************************************************************************/
+/* Defines
+*/
+#define blPNG_COMPRESSION_BUFFER 262144 /* zlib output buffer size      */
+#define blPNG_BAND_BYTES        1048576 /* Filtered bytes per band when 
+                                           compressing in parallel      */
+
 /************************************************************************/
 /*>blPNGPIXEL *blPNGPixelAt(blPNGIMAGE *bitmap, int x, int y)
    -----------------------------------------------------------
@@ -75,27 +93,44 @@ blPNGPIXEL *blPNGPixelAt(blPNGIMAGE *bitmap, int x, int y)
 }
     
 /************************************************************************/
-/*>BOOL blSavePNGToFile(blPNGIMAGE *bitmap, const char *path)
-   -----------------------------------------------------------
+/*>static BOOL WritePNGRows(blPNGROWFUNC getRow, 
+                            const unsigned char *rgb, size_t stride,
+                            size_t width, size_t height, const char *path,
+                            blPNGOPTIONS *options)
+   -----------------------------------------------------------------------
 *//**
-   Writes an image containing a linearized bitmap to a PNG file.
+   Common code for writing a PNG. Rows are handed to libpng one at a
+   time with png_write_row() so no copy of the image is made. They come
+   either from getRow() or, if that is NULL, straight from the packed
+   RGB in rgb, stride bytes apart. Only one row buffer is allocated 
+   here (and only when getRow() is used); libpng itself keeps a couple 
+   of rows for filtering.
    If path is a blank string, then writes to stdout.
    Returns TRUE on success, FALSE on failure.
 
--  19.08.19 Original   By: ACRM
+-  19.10.26 Original (based on old blSavePNGToFile())   By: ACRM
+-  19.10.26 Takes a packed RGB buffer and stride rather than a bitmap
 */
-BOOL blSavePNGToFile(blPNGIMAGE *image, const char *path)
+static BOOL WritePNGRows(blPNGROWFUNC getRow, const unsigned char *rgb,
+                         size_t stride, size_t width, size_t height, 
+                         const char *path, blPNGOPTIONS *options)
 {
-    FILE        *fp           = stdout;
-    png_structp pngPtr        = NULL;
-    png_infop   infoPtr       = NULL;
-    png_byte    **rowPointers = NULL;
-    BOOL        retval        = FALSE;
-    size_t      x, y;
+    FILE          *fp      = stdout;
+    png_structp   pngPtr   = NULL;
+    png_infop     infoPtr  = NULL;
+    unsigned char *buffer  = NULL;
+    volatile BOOL retval   = FALSE;
+    size_t        y;
 
     int pixelSize = 3;
     int depth     = 8;
 
+    if(getRow != NULL)
+    {
+       if((buffer = (unsigned char *)malloc(width * pixelSize))==NULL)
+          return(FALSE);
+    }
+
     if(path[0])
        fp = fopen(path, "wb");
 
@@ -112,69 +147,1115 @@ BOOL blSavePNGToFile(blPNGIMAGE *image, const char *path)
 
              /* Set image attributes                                     */
              png_set_IHDR(pngPtr, infoPtr,
-                          image->width, image->height,
+                          width, height,
                           depth,
                           PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE,
                           PNG_COMPRESSION_TYPE_DEFAULT,
                           PNG_FILTER_TYPE_DEFAULT);
-             
-             /* Initialize rows of PNG                                   */
-             rowPointers = png_malloc(pngPtr,
-                                      image->height *
-                                      sizeof(png_byte *));
 
-             for(y=0; y < image->height; y++)
+             /* Set compression options                                  */
+             if(options != NULL)
              {
-                png_byte *row = 
-                   png_malloc(pngPtr,
-                              sizeof(uint8_t) * image->width * pixelSize);
-                rowPointers[y] = row;
-
-                for(x=0; x < image->width; x++)
-                {
-                   blPNGPIXEL *pixel = blPNGPixelAt(image, x, y);
-                   *row++ = pixel->red;
-                   *row++ = pixel->green;
-                   *row++ = pixel->blue;
-                }
+                if(options->level >= 0)
+                   png_set_compression_level(pngPtr, options->level);
+                if(options->strategy >= 0)
+                   png_set_compression_strategy(pngPtr, 
+                                                options->strategy);
+                if(options->filters >= 0)
+                   png_set_filter(pngPtr, PNG_FILTER_TYPE_BASE,
+                                  options->filters);
              }
+             png_set_compression_buffer_size(pngPtr, 
+                                             blPNG_COMPRESSION_BUFFER);
              
-             /* Write the image data to "fp"                             */
+             /* Write the header and then the image data row by row      */
              png_init_io(pngPtr, fp);
-             png_set_rows(pngPtr, infoPtr, rowPointers);
-             png_write_png(pngPtr, infoPtr,
-                           PNG_TRANSFORM_IDENTITY, NULL);
-             
-             retval = TRUE;
-             for(y=0; y < image->height; y++)
-                png_free(pngPtr, rowPointers[y]);
+             png_write_info(pngPtr, infoPtr);
 
-             png_free(pngPtr, rowPointers);
-          }
-          else
-          {
-             retval = FALSE;
+             for(y=0; y < height; y++)
+             {
+                if(getRow != NULL)
+                   png_write_row(pngPtr, getRow((int)y, buffer));
+                else
+                   png_write_row(pngPtr, (png_const_bytep)(rgb + y*stride));
+             }
+
+             png_write_end(pngPtr, NULL);
+             retval = TRUE;
           }
        }
-       else
-       {
-          retval = FALSE;
-       }
        
     png_failure:
        png_destroy_write_struct(&pngPtr, &infoPtr);
 
        if(fp != stdout)
           fclose(fp);
+       else
+          fflush(fp);
     }
-    else
-    {
-       retval = FALSE;
-    }
+    
+    if(buffer != NULL)
+       free(buffer);
     
     return(retval);
 }
 
+
+/************************************************************************/
+/*>static void FilterRow(unsigned char *prev, unsigned char *cur,
+                         size_t rowBytes, int allowed,
+                         unsigned char **best, unsigned char **trial)
+   --------------------------------------------------------------------
+*//**
+   Apply a PNG row filter to one row of 8-bit RGB. prev is the previous
+   (unfiltered) row or a row of zeros for the first row of the image.
+   If more than one filter is allowed, each is tried and the one giving
+   the smallest sum of absolute (signed) differences is kept - the same
+   heuristic libpng uses. On return *best holds the filter type byte
+   followed by the filtered row; *best and *trial (each rowBytes+1 
+   bytes) may have been swapped.
+
+-  19.10.26 Original   By: ACRM
+*/
+static void FilterRow(unsigned char *prev, unsigned char *cur,
+                      size_t rowBytes, int allowed,
+                      unsigned char **best, unsigned char **trial)
+{
+   static int flags[5] = {PNG_FILTER_NONE, PNG_FILTER_SUB, PNG_FILTER_UP,
+                          PNG_FILTER_AVG,  PNG_FILTER_PAETH};
+   unsigned long sum, 
+                 bestSum = 0;
+   unsigned char *out,
+                 *tmp;
+   size_t        i;
+   int           f, a, b, c, p, pa, pb, pc,
+                 nTried    = 0;
+   BOOL          onlyOne;
+
+   onlyOne = ((allowed & (allowed - 1)) == 0);
+
+   for(f=0; f<5; f++)
+   {
+      if(!(allowed & flags[f]))
+         continue;
+
+      out    = (nTried ? *trial : *best);
+      out[0] = (unsigned char)f;
+      out++;
+      
+      switch(f)
+      {
+      case 0:
+         memcpy(out, cur, rowBytes);
+         break;
+      case 1:
+         memcpy(out, cur, 3);
+         for(i=3; i<rowBytes; i++)
+            out[i] = (unsigned char)(cur[i] - cur[i-3]);
+         break;
+      case 2:
+         for(i=0; i<rowBytes; i++)
+            out[i] = (unsigned char)(cur[i] - prev[i]);
+         break;
+      case 3:
+         for(i=0; i<3; i++)
+            out[i] = (unsigned char)(cur[i] - (prev[i] >> 1));
+         for(; i<rowBytes; i++)
+            out[i] = (unsigned char)(cur[i] - ((cur[i-3] + prev[i]) >> 1));
+         break;
+      case 4:
+         for(i=0; i<3; i++)
+            out[i] = (unsigned char)(cur[i] - prev[i]);
+         for(; i<rowBytes; i++)
+         {
+            a  = cur[i-3];
+            b  = prev[i];
+            c  = prev[i-3];
+            pa = abs(b - c);            /* |p-a| where p = a+b-c         */
+            pb = abs(a - c);            /* |p-b|                         */
+            pc = abs(a + b - 2*c);      /* |p-c|                         */
+            if(pa <= pb && pa <= pc)
+               p = a;
+            else if(pb <= pc)
+               p = b;
+            else
+               p = c;
+            out[i] = (unsigned char)(cur[i] - p);
+         }
+         break;
+      }
+      
+      if(onlyOne)
+         return;
+
+      /* Sum of absolute values treating the bytes as signed             */
+      for(i=0, sum=0; i<rowBytes; i++)
+         sum += (out[i] < 128) ? out[i] : (256 - out[i]);
+
+      if(nTried == 0)
+      {
+         bestSum = sum;
+      }
+      else if(sum < bestSum)
+      {
+         bestSum = sum;
+         tmp     = *best;
+         *best   = *trial;
+         *trial  = tmp;
+      }
+      nTried++;
+   }
+}
+
+
+/************************************************************************/
+/* Data for the multi-threaded encoder 
+*/
+typedef struct
+{
+   unsigned char *data;     /* Raw deflate output for this band         */
+   size_t        len,       /* Bytes of data used                       */
+                 size;      /* Bytes of data allocated                  */
+   uLong         adler;     /* Adler-32 of the filtered rows            */
+   z_off_t       rawLen;    /* Length of the filtered rows              */
+   int           status;    /* 0: pending, 1: done, -1: failed          */
+}  PNGBAND;
+
+typedef struct
+{
+   blPNGROWFUNC    getRow;
+   blPNGOPTIONS    *options;
+   PNGBAND         *bands;
+   size_t          width,
+                   height,
+                   bandRows;
+   int             nBands,
+                   nextBand,   /* Next band to be compressed            */
+                   nWritten,   /* Bands written to the file so far      */
+                   window;     /* Max bands compressed ahead of writing */
+   BOOL            abort;
+   pthread_mutex_t mutex;
+   pthread_cond_t  cond;
+}  PNGENCODER;
+
+
+/************************************************************************/
+/*>static BOOL CompressBand(PNGENCODER *enc, int band)
+   ---------------------------------------------------
+*//**
+   Filter and deflate one band of rows as raw deflate data. The band
+   ends with a sync flush (or finishes the stream if it is the last) so
+   that the bands may simply be concatenated. The deflate window is 
+   primed with the filtered rows which precede the band so compression
+   is almost as good as a single stream.
+   Returns FALSE if memory could not be allocated.
+
+-  19.10.26 Original   By: ACRM
+*/
+static BOOL CompressBand(PNGENCODER *enc, int band)
+{
+   PNGBAND       *b        = enc->bands + band;
+   size_t        rowBytes  = 3 * enc->width,
+                 y0, y1, yStart, y, dictLen = 0, nDict;
+   unsigned char *raw[2]   = {NULL, NULL},
+                 *filt[2]  = {NULL, NULL},
+                 *zero     = NULL,
+                 *dict     = NULL,
+                 *prev,
+                 *cur;
+   int           allowed   = PNG_ALL_FILTERS,
+                 level     = Z_DEFAULT_COMPRESSION,
+                 strategy,
+                 flush,
+                 flevel;
+   BOOL          last      = (band == enc->nBands - 1),
+                 ok        = FALSE;
+   z_stream      strm;
+   
+   y0 = band * enc->bandRows;
+   y1 = y0 + enc->bandRows;
+   if(y1 > enc->height)
+      y1 = enc->height;
+   
+   if(enc->options->filters >= 0)
+      allowed = enc->options->filters;
+   if(enc->options->level >= 0)
+      level   = enc->options->level;
+   /* As libpng, use Z_FILTERED unless rows are unfiltered              */
+   strategy   = (allowed == PNG_FILTER_NONE) ? Z_DEFAULT_STRATEGY 
+                                             : Z_FILTERED;
+   if(enc->options->strategy >= 0)
+      strategy = enc->options->strategy;
+
+   /* Number of preceding rows needed to fill the 32K window            */
+   nDict  = (32768 + rowBytes) / (rowBytes + 1);
+   if(nDict > y0)
+      nDict = y0;
+   yStart = y0 - nDict;
+
+   memset(&strm, 0, sizeof(z_stream));
+   if(deflateInit2(&strm, level, Z_DEFLATED, -15, 8, strategy) != Z_OK)
+      return(FALSE);
+
+   if(((raw[0]  = (unsigned char *)malloc(rowBytes))     == NULL) ||
+      ((raw[1]  = (unsigned char *)malloc(rowBytes))     == NULL) ||
+      ((filt[0] = (unsigned char *)malloc(rowBytes + 1)) == NULL) ||
+      ((filt[1] = (unsigned char *)malloc(rowBytes + 1)) == NULL) ||
+      ((zero    = (unsigned char *)calloc(rowBytes, 1))  == NULL) ||
+      ((nDict != 0) &&
+       ((dict   = (unsigned char *)malloc(nDict * (rowBytes + 1))) 
+        == NULL)))
+      goto cleanup;
+
+   /* Output buffer with room for the zlib header and Adler-32 trailer  */
+   b->size = deflateBound(&strm, (uLong)((y1 - y0) * (rowBytes + 1))) 
+             + 64;
+   if((b->data = (unsigned char *)malloc(b->size)) == NULL)
+      goto cleanup;
+   b->len    = 0;
+   b->adler  = adler32(0L, NULL, 0);
+   b->rawLen = 0;
+
+   /* The first band carries the zlib header                            */
+   if(band == 0)
+   {
+      flevel = (level == Z_DEFAULT_COMPRESSION) ? 2 :
+               (level < 2) ? 0 : (level < 6) ? 1 : (level == 6) ? 2 : 3;
+      b->data[0] = 0x78;
+      b->data[1] = (unsigned char)(flevel << 6);
+      b->data[1] += (unsigned char)(31 - ((0x78 * 256 + b->data[1]) % 31));
+      b->len     = 2;
+   }
+
+   prev = (yStart == 0) ? zero : enc->getRow((int)yStart - 1, 
+                                             raw[(yStart - 1) & 1]);
+   
+   for(y=yStart; y<y1; y++)
+   {
+      if(enc->abort)
+         goto cleanup;
+      
+      cur = enc->getRow((int)y, raw[y & 1]);
+      FilterRow(prev, cur, rowBytes, allowed, &(filt[0]), &(filt[1]));
+      prev = cur;
+
+      if(y < y0)
+      {
+         /* Preceding row - just part of the dictionary                 */
+         memcpy(dict + dictLen, filt[0], rowBytes + 1);
+         dictLen += rowBytes + 1;
+         if(y == y0 - 1)
+         {
+            if(dictLen > 32768)
+               deflateSetDictionary(&strm, dict + dictLen - 32768, 32768);
+            else
+               deflateSetDictionary(&strm, dict, (uInt)dictLen);
+         }
+         continue;
+      }
+      
+      b->adler   = adler32(b->adler, filt[0], (uInt)(rowBytes + 1));
+      b->rawLen += rowBytes + 1;
+
+      flush = (y < y1 - 1) ? Z_NO_FLUSH : (last ? Z_FINISH : Z_SYNC_FLUSH);
+      strm.next_in  = filt[0];
+      strm.avail_in = (uInt)(rowBytes + 1);
+      do
+      {
+         if(b->size - b->len < 1024)
+         {
+            unsigned char *newData;
+            if((newData = (unsigned char *)realloc(b->data, 2 * b->size))
+               == NULL)
+               goto cleanup;
+            b->data  = newData;
+            b->size *= 2;
+         }
+         /* Always keep 4 bytes spare for the Adler-32 trailer          */
+         strm.next_out  = b->data + b->len;
+         strm.avail_out = (uInt)(b->size - b->len - 4);
+         deflate(&strm, flush);
+         b->len = b->size - 4 - strm.avail_out;
+      }  while(strm.avail_out == 0);
+   }
+   ok = TRUE;
+
+cleanup:
+   deflateEnd(&strm);
+   if(raw[0]  != NULL) free(raw[0]);
+   if(raw[1]  != NULL) free(raw[1]);
+   if(filt[0] != NULL) free(filt[0]);
+   if(filt[1] != NULL) free(filt[1]);
+   if(zero    != NULL) free(zero);
+   if(dict    != NULL) free(dict);
+   
+   return(ok);
+}
+
+
+/************************************************************************/
+/*>static void *EncoderThread(void *arg)
+   -------------------------------------
+*//**
+   Worker thread for the parallel encoder. Takes the next band to be
+   compressed until there are none left. It waits rather than getting
+   more than enc->window bands ahead of the writer so that the memory
+   used stays bounded.
+
+-  19.10.26 Original   By: ACRM
+*/
+static void *EncoderThread(void *arg)
+{
+   PNGENCODER *enc = (PNGENCODER *)arg;
+   int        band;
+   BOOL       ok;
+   
+   for(;;)
+   {
+      pthread_mutex_lock(&(enc->mutex));
+      while(!enc->abort && (enc->nextBand < enc->nBands) &&
+            (enc->nextBand >= enc->nWritten + enc->window))
+         pthread_cond_wait(&(enc->cond), &(enc->mutex));
+      if(enc->abort || (enc->nextBand >= enc->nBands))
+      {
+         pthread_mutex_unlock(&(enc->mutex));
+         break;
+      }
+      band = enc->nextBand++;
+      pthread_mutex_unlock(&(enc->mutex));
+
+      ok = CompressBand(enc, band);
+
+      pthread_mutex_lock(&(enc->mutex));
+      enc->bands[band].status = ok ? 1 : -1;
+      if(!ok)
+         enc->abort = TRUE;
+      pthread_cond_broadcast(&(enc->cond));
+      pthread_mutex_unlock(&(enc->mutex));
+   }
+   
+   return(NULL);
+}
+
+
+/************************************************************************/
+/*>static BOOL WritePNGChunk(FILE *fp, const char *type, 
+                             unsigned char *data, size_t len)
+   ----------------------------------------------------------
+*//**
+   Write a PNG chunk with its length and CRC.
+   Returns FALSE on a write error.
+
+-  19.10.26 Original   By: ACRM
+*/
+static BOOL WritePNGChunk(FILE *fp, const char *type, unsigned char *data,
+                          size_t len)
+{
+   unsigned char word[4];
+   uLong         crc;
+
+   crc = crc32(0L, NULL, 0);
+   crc = crc32(crc, (const Bytef *)type, 4);
+   if(len)
+      crc = crc32(crc, data, (uInt)len);
+
+   png_save_uint_32(word, (png_uint_32)len);
+   if((fwrite(word, 1, 4, fp) != 4) || (fwrite(type, 1, 4, fp) != 4))
+      return(FALSE);
+   if(len && (fwrite(data, 1, len, fp) != len))
+      return(FALSE);
+   png_save_uint_32(word, (png_uint_32)crc);
+   return(fwrite(word, 1, 4, fp) == 4);
+}
+
+
+/************************************************************************/
+/*>static BOOL WritePNGRowsMT(blPNGROWFUNC getRow, size_t width, 
+                              size_t height, const char *path,
+                              blPNGOPTIONS *options)
+   -------------------------------------------------------------
+*//**
+   Parallel version of WritePNGRows(). The image is split into bands of
+   rows which are filtered and deflated on options->threads threads.
+   Each band ends on a sync flush so the raw deflate data may simply be
+   concatenated into one zlib stream; the Adler-32 checksums of the 
+   bands are combined with adler32_combine(). Each band is written as
+   an IDAT chunk as soon as it and all those before it are done.
+   getRow() must be safe to call from several threads at once.
+   If path is a blank string, then writes to stdout.
+   Returns TRUE on success, FALSE on failure.
+
+-  19.10.26 Original   By: ACRM
+*/
+static BOOL WritePNGRowsMT(blPNGROWFUNC getRow, size_t width, 
+                           size_t height, const char *path,
+                           blPNGOPTIONS *options)
+{
+   static unsigned char signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+   FILE          *fp      = stdout;
+   PNGENCODER    enc;
+   PNGBAND       *b;
+   pthread_t     *threads = NULL;
+   unsigned char ihdr[13];
+   uLong         adler;
+   size_t        rowBytes = 3 * width;
+   int           nThreads = options->threads,
+                 nStarted = 0,
+                 i;
+   BOOL          retval   = FALSE;
+
+   enc.getRow   = getRow;
+   enc.options  = options;
+   enc.width    = width;
+   enc.height   = height;
+   enc.bandRows = blPNG_BAND_BYTES / (rowBytes + 1);
+   if(enc.bandRows < 1)
+      enc.bandRows = 1;
+   enc.nBands   = (int)((height + enc.bandRows - 1) / enc.bandRows);
+   enc.nextBand = 0;
+   enc.nWritten = 0;
+   enc.window   = 4 * nThreads;
+   enc.abort    = FALSE;
+
+   if((enc.bands = (PNGBAND *)calloc(enc.nBands, sizeof(PNGBAND)))==NULL)
+      return(FALSE);
+   if((threads = (pthread_t *)malloc(nThreads * sizeof(pthread_t)))==NULL)
+   {
+      free(enc.bands);
+      return(FALSE);
+   }
+
+   if(path[0] && ((fp = fopen(path, "wb")) == NULL))
+   {
+      free(enc.bands);
+      free(threads);
+      return(FALSE);
+   }
+
+   pthread_mutex_init(&(enc.mutex), NULL);
+   pthread_cond_init(&(enc.cond), NULL);
+   
+   for(nStarted=0; nStarted<nThreads; nStarted++)
+   {
+      if(pthread_create(&(threads[nStarted]), NULL, EncoderThread, 
+                        (void *)&enc) != 0)
+         break;
+   }
+   if(nStarted == 0)
+      goto cleanup;
+
+   /* Signature and header                                              */
+   png_save_uint_32(ihdr,     (png_uint_32)width);
+   png_save_uint_32(ihdr + 4, (png_uint_32)height);
+   ihdr[8]  = 8;                       /* Bit depth                     */
+   ihdr[9]  = PNG_COLOR_TYPE_RGB;
+   ihdr[10] = PNG_COMPRESSION_TYPE_BASE;
+   ihdr[11] = PNG_FILTER_TYPE_BASE;
+   ihdr[12] = PNG_INTERLACE_NONE;
+   if((fwrite(signature, 1, 8, fp) != 8) ||
+      !WritePNGChunk(fp, "IHDR", ihdr, 13))
+      goto cleanup;
+
+   /* Write the bands in order as they are completed                    */
+   adler = adler32(0L, NULL, 0);
+   for(i=0; i<enc.nBands; i++)
+   {
+      b = enc.bands + i;
+      
+      pthread_mutex_lock(&(enc.mutex));
+      while(b->status == 0 && !enc.abort)
+         pthread_cond_wait(&(enc.cond), &(enc.mutex));
+      pthread_mutex_unlock(&(enc.mutex));
+      if(b->status != 1)
+         goto cleanup;
+
+      adler = adler32_combine(adler, b->adler, b->rawLen);
+      if(i == enc.nBands - 1)
+      {
+         png_save_uint_32(b->data + b->len, (png_uint_32)adler);
+         b->len += 4;
+      }
+
+      if(!WritePNGChunk(fp, "IDAT", b->data, b->len))
+         goto cleanup;
+      free(b->data);
+      b->data = NULL;
+      
+      pthread_mutex_lock(&(enc.mutex));
+      enc.nWritten++;
+      pthread_cond_broadcast(&(enc.cond));
+      pthread_mutex_unlock(&(enc.mutex));
+   }
+
+   retval = WritePNGChunk(fp, "IEND", NULL, 0);
+
+cleanup:
+   pthread_mutex_lock(&(enc.mutex));
+   if(!retval)
+      enc.abort = TRUE;
+   pthread_cond_broadcast(&(enc.cond));
+   pthread_mutex_unlock(&(enc.mutex));
+   
+   for(i=0; i<nStarted; i++)
+      pthread_join(threads[i], NULL);
+
+   pthread_cond_destroy(&(enc.cond));
+   pthread_mutex_destroy(&(enc.mutex));
+
+   for(i=0; i<enc.nBands; i++)
+   {
+      if(enc.bands[i].data != NULL)
+         free(enc.bands[i].data);
+   }
+   free(enc.bands);
+   free(threads);
+
+   if(fp != stdout)
+   {
+      if(fclose(fp) != 0)
+         retval = FALSE;
+   }
+   else
+   {
+      fflush(fp);
+   }
+   
+   return(retval);
+}
+
+
+/************************************************************************/
+/* A PNG being written a band of rows at a time 
+*/
+struct _blpngstream
+{
+   FILE          *fp;
+   unsigned char *prev,        /* Last (unfiltered) row written          */
+                 *raw[2],      /* Row buffers for getRow()               */
+                 *filt[2],     /* Filtered row and trial filter          */
+                 *dict,        /* Last 32K of filtered data              */
+                 *out,         /* Compressed data for the next IDAT      */
+                 *state;       /* Serialized state for checkpoints       */
+   size_t        width,
+                 height,
+                 row,          /* Next row to be written                 */
+                 dictLen;
+   long          offset;       /* Bytes written to the file              */
+   uLong         adler;        /* Adler-32 of all filtered data so far   */
+   int           allowed,      /* Filters which may be used              */
+                 level,
+                 strategy;
+};
+
+
+/************************************************************************/
+/*>static BOOL PutStreamChunk(blPNGSTREAM *stream, const char *type,
+                              unsigned char *data, size_t len)
+   -----------------------------------------------------------------
+*//**
+   Write a chunk to a PNG stream and keep track of the file offset.
+
+-  19.10.26 Original   By: ACRM
+*/
+static BOOL PutStreamChunk(blPNGSTREAM *stream, const char *type,
+                           unsigned char *data, size_t len)
+{
+   if(!WritePNGChunk(stream->fp, type, data, len))
+      return(FALSE);
+   stream->offset += (long)(len + 12);
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>blPNGSTREAM *blOpenPNGStream(const char *path, size_t width, 
+                                size_t height, blPNGOPTIONS *options,
+                                const unsigned char *state, 
+                                size_t stateLen)
+   ---------------------------------------------------------------
+*//**
+   Start writing a PNG a band of rows at a time with blWritePNGRows().
+   options may be NULL to use the defaults; options->threads is 
+   ignored. If state is NULL, a new file is started (stdout if path is
+   blank). Otherwise state is the data returned by 
+   blGetPNGStreamState() when the file was last synchronized and the
+   file is cut back to that point so writing may carry on.
+   Returns NULL on failure.
+
+-  19.10.26 Original   By: ACRM
+*/
+blPNGSTREAM *blOpenPNGStream(const char *path, size_t width, 
+                             size_t height, blPNGOPTIONS *options,
+                             const unsigned char *state, size_t stateLen)
+{
+   static unsigned char signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+   blPNGSTREAM   *stream;
+   unsigned char ihdr[13];
+   size_t        rowBytes = 3 * width;
+   BOOL          ok       = FALSE;
+   
+   if((stream = (blPNGSTREAM *)calloc(1, sizeof(blPNGSTREAM))) == NULL)
+      return(NULL);
+
+   stream->width    = width;
+   stream->height   = height;
+   stream->adler    = adler32(0L, NULL, 0);
+   stream->allowed  = PNG_ALL_FILTERS;
+   stream->level    = Z_DEFAULT_COMPRESSION;
+   if(options != NULL)
+   {
+      if(options->filters >= 0)
+         stream->allowed = options->filters;
+      if(options->level >= 0)
+         stream->level   = options->level;
+   }
+   stream->strategy = (stream->allowed == PNG_FILTER_NONE) ? 
+                      Z_DEFAULT_STRATEGY : Z_FILTERED;
+   if((options != NULL) && (options->strategy >= 0))
+      stream->strategy = options->strategy;
+
+   if(((stream->prev    = (unsigned char *)calloc(rowBytes, 1))==NULL) ||
+      ((stream->raw[0]  = (unsigned char *)malloc(rowBytes))   ==NULL) ||
+      ((stream->raw[1]  = (unsigned char *)malloc(rowBytes))   ==NULL) ||
+      ((stream->filt[0] = (unsigned char *)malloc(rowBytes+1)) ==NULL) ||
+      ((stream->filt[1] = (unsigned char *)malloc(rowBytes+1)) ==NULL) ||
+      ((stream->dict    = (unsigned char *)malloc(32768))      ==NULL) ||
+      ((stream->out     = (unsigned char *)
+                          malloc(blPNG_COMPRESSION_BUFFER))    ==NULL) ||
+      ((stream->state   = (unsigned char *)malloc(20 + rowBytes + 32768))
+                                                               ==NULL))
+      goto cleanup;
+
+   if(state == NULL)
+   {
+      /* New file - write the signature and header                      */
+      stream->fp = stdout;
+      if(path[0] && ((stream->fp = fopen(path, "wb")) == NULL))
+         goto cleanup;
+      
+      png_save_uint_32(ihdr,     (png_uint_32)width);
+      png_save_uint_32(ihdr + 4, (png_uint_32)height);
+      ihdr[8]  = 8;                       /* Bit depth                  */
+      ihdr[9]  = PNG_COLOR_TYPE_RGB;
+      ihdr[10] = PNG_COMPRESSION_TYPE_BASE;
+      ihdr[11] = PNG_FILTER_TYPE_BASE;
+      ihdr[12] = PNG_INTERLACE_NONE;
+      if(fwrite(signature, 1, 8, stream->fp) != 8)
+         goto cleanup;
+      stream->offset = 8;
+      if(!PutStreamChunk(stream, "IHDR", ihdr, 13))
+         goto cleanup;
+   }
+   else
+   {
+      /* Resume - restore the state and cut the file back               */
+      if((stateLen < 20 + rowBytes) || (path[0] == '\0'))
+         goto cleanup;
+      stream->offset  = (long)png_get_uint_32(state);
+      stream->offset  = ((stream->offset << 16) << 16) | 
+                        (long)png_get_uint_32(state + 4);
+      stream->row     = png_get_uint_32(state + 8);
+      stream->adler   = png_get_uint_32(state + 12);
+      stream->dictLen = png_get_uint_32(state + 16);
+      if((stream->dictLen > 32768) || (stream->row >= height) ||
+         (stateLen != 20 + rowBytes + stream->dictLen))
+         goto cleanup;
+      memcpy(stream->prev, state + 20, rowBytes);
+      memcpy(stream->dict, state + 20 + rowBytes, stream->dictLen);
+
+      if((stream->fp = fopen(path, "r+b")) == NULL)
+         goto cleanup;
+      if((ftruncate(fileno(stream->fp), (off_t)stream->offset) != 0) ||
+         (fseek(stream->fp, stream->offset, SEEK_SET) != 0))
+         goto cleanup;
+   }
+   ok = TRUE;
+
+cleanup:
+   if(!ok)
+   {
+      blClosePNGStream(stream);
+      stream = NULL;
+   }
+   return(stream);
+}
+
+
+/************************************************************************/
+/*>BOOL blWritePNGRows(blPNGSTREAM *stream, blPNGROWFUNC getRow, 
+                       size_t y0, size_t y1)
+   -------------------------------------------------------------
+*//**
+   Filter and compress rows y0 to y1-1, which must follow on from the
+   rows already written, and write them as IDAT chunks. The compressed
+   data for each call is a separate raw deflate block sequence ending
+   on a sync flush (so the file may be resumed from this point) with
+   the deflate window primed from the data before it. After the last 
+   row of the image the zlib stream is finished and IEND is written.
+   Returns FALSE on failure.
+
+-  19.10.26 Original   By: ACRM
+*/
+BOOL blWritePNGRows(blPNGSTREAM *stream, blPNGROWFUNC getRow, size_t y0,
+                    size_t y1)
+{
+   size_t        rowBytes = 3 * stream->width,
+                 outLen   = 0,
+                 y, n, shift;
+   unsigned char *prev    = stream->prev,
+                 *cur;
+   int           flevel,
+                 flush;
+   BOOL          last     = (y1 >= stream->height),
+                 ok       = FALSE;
+   z_stream      strm;
+
+   if((y0 != stream->row) || (y1 <= y0) || (y1 > stream->height))
+      return(FALSE);
+
+   memset(&strm, 0, sizeof(z_stream));
+   if(deflateInit2(&strm, stream->level, Z_DEFLATED, -15, 8, 
+                   stream->strategy) != Z_OK)
+      return(FALSE);
+   if(stream->dictLen)
+      deflateSetDictionary(&strm, stream->dict, (uInt)stream->dictLen);
+
+   /* The zlib header starts the first IDAT                             */
+   if(y0 == 0)
+   {
+      flevel = (stream->level == Z_DEFAULT_COMPRESSION) ? 2 :
+               (stream->level < 2) ? 0 : (stream->level < 6) ? 1 : 
+               (stream->level == 6) ? 2 : 3;
+      stream->out[0] = 0x78;
+      stream->out[1] = (unsigned char)(flevel << 6);
+      stream->out[1] += (unsigned char)(31 - 
+                                        ((0x78 * 256 + stream->out[1]) 
+                                         % 31));
+      outLen = 2;
+   }
+
+   for(y=y0; y<y1; y++)
+   {
+      cur = getRow((int)y, stream->raw[y & 1]);
+      FilterRow(prev, cur, rowBytes, stream->allowed, 
+                &(stream->filt[0]), &(stream->filt[1]));
+      prev = cur;
+      n    = rowBytes + 1;
+
+      stream->adler = adler32(stream->adler, stream->filt[0], (uInt)n);
+
+      /* Keep the last 32K of filtered data to prime the next call      */
+      if(n >= 32768)
+      {
+         memcpy(stream->dict, stream->filt[0] + n - 32768, 32768);
+         stream->dictLen = 32768;
+      }
+      else
+      {
+         if(stream->dictLen + n > 32768)
+         {
+            shift = stream->dictLen + n - 32768;
+            memmove(stream->dict, stream->dict + shift, 
+                    stream->dictLen - shift);
+            stream->dictLen -= shift;
+         }
+         memcpy(stream->dict + stream->dictLen, stream->filt[0], n);
+         stream->dictLen += n;
+      }
+
+      /* Compress, writing an IDAT each time the buffer fills. 4 bytes
+         are kept spare for the Adler-32 at the end
+      */
+      flush = (y < y1 - 1) ? Z_NO_FLUSH : (last ? Z_FINISH : Z_SYNC_FLUSH);
+      strm.next_in  = stream->filt[0];
+      strm.avail_in = (uInt)n;
+      do
+      {
+         strm.next_out  = stream->out + outLen;
+         strm.avail_out = (uInt)(blPNG_COMPRESSION_BUFFER - 4 - outLen);
+         deflate(&strm, flush);
+         outLen = blPNG_COMPRESSION_BUFFER - 4 - strm.avail_out;
+         if(strm.avail_out == 0)
+         {
+            if(!PutStreamChunk(stream, "IDAT", stream->out, outLen))
+               goto cleanup;
+            outLen = 0;
+         }
+      }  while(strm.avail_out == 0);
+   }
+
+   /* Save the last row for filtering the next                          */
+   if(prev != stream->prev)
+      memcpy(stream->prev, prev, rowBytes);
+   stream->row = y1;
+
+   if(last)
+   {
+      png_save_uint_32(stream->out + outLen, (png_uint_32)stream->adler);
+      outLen += 4;
+   }
+   if(outLen && !PutStreamChunk(stream, "IDAT", stream->out, outLen))
+      goto cleanup;
+   if(last && !PutStreamChunk(stream, "IEND", NULL, 0))
+      goto cleanup;
+   ok = TRUE;
+   
+cleanup:
+   deflateEnd(&strm);
+   return(ok);
+}
+
+
+/************************************************************************/
+/*>size_t blGetPNGStreamState(blPNGSTREAM *stream, 
+                              unsigned char **state)
+   -------------------------------------------------
+*//**
+   Obtain the state of the stream so that, after blSyncPNGStream(), it 
+   may be saved and later passed to blOpenPNGStream() to carry on 
+   writing from this point. *state is set to point to the data, which
+   belongs to the stream. Returns the length of the data.
+
+-  19.10.26 Original   By: ACRM
+*/
+size_t blGetPNGStreamState(blPNGSTREAM *stream, unsigned char **state)
+{
+   size_t rowBytes = 3 * stream->width;
+   
+   png_save_uint_32(stream->state,      
+                    (png_uint_32)((stream->offset >> 16) >> 16));
+   png_save_uint_32(stream->state + 4,  
+                    (png_uint_32)(stream->offset & 0xffffffffL));
+   png_save_uint_32(stream->state + 8,  (png_uint_32)stream->row);
+   png_save_uint_32(stream->state + 12, (png_uint_32)stream->adler);
+   png_save_uint_32(stream->state + 16, (png_uint_32)stream->dictLen);
+   memcpy(stream->state + 20, stream->prev, rowBytes);
+   memcpy(stream->state + 20 + rowBytes, stream->dict, stream->dictLen);
+   
+   *state = stream->state;
+   return(20 + rowBytes + stream->dictLen);
+}
+
+
+/************************************************************************/
+/*>BOOL blSyncPNGStream(blPNGSTREAM *stream)
+   -----------------------------------------
+*//**
+   Make sure everything written so far is on disk.
+   Returns FALSE on failure.
+
+-  19.10.26 Original   By: ACRM
+*/
+BOOL blSyncPNGStream(blPNGSTREAM *stream)
+{
+   if(fflush(stream->fp) != 0)
+      return(FALSE);
+   if(stream->fp == stdout)
+      return(TRUE);
+   return(fsync(fileno(stream->fp)) == 0);
+}
+
+
+/************************************************************************/
+/*>BOOL blClosePNGStream(blPNGSTREAM *stream)
+   ------------------------------------------
+*//**
+   Close the file and free the stream. Returns FALSE if the file could
+   not be closed or the image was not complete.
+
+-  19.10.26 Original   By: ACRM
+*/
+BOOL blClosePNGStream(blPNGSTREAM *stream)
+{
+   BOOL retval = (stream->row == stream->height);
+   
+   if(stream->fp != NULL)
+   {
+      if(stream->fp == stdout)
+         fflush(stdout);
+      else if(fclose(stream->fp) != 0)
+         retval = FALSE;
+   }
+   
+   if(stream->prev    != NULL) free(stream->prev);
+   if(stream->raw[0]  != NULL) free(stream->raw[0]);
+   if(stream->raw[1]  != NULL) free(stream->raw[1]);
+   if(stream->filt[0] != NULL) free(stream->filt[0]);
+   if(stream->filt[1] != NULL) free(stream->filt[1]);
+   if(stream->dict    != NULL) free(stream->dict);
+   if(stream->out     != NULL) free(stream->out);
+   if(stream->state   != NULL) free(stream->state);
+   free(stream);
+   
+   return(retval);
+}
+
+
+/************************************************************************/
+/*>BOOL blSavePNGToFile(blPNGIMAGE *bitmap, const char *path)
+   -----------------------------------------------------------
+*//**
+   Writes an image containing a linearized bitmap to a PNG file.
+   If path is a blank string, then writes to stdout.
+   Returns TRUE on success, FALSE on failure.
+
+-  19.08.19 Original   By: ACRM
+-  19.10.26 Rows are written straight from the bitmap rather than being
+            copied first
+*/
+BOOL blSavePNGToFile(blPNGIMAGE *image, const char *path)
+{
+   return(WritePNGRows(NULL, (unsigned char *)image->pixels, 
+                       image->width * sizeof(blPNGPIXEL), image->width, 
+                       image->height, path, NULL));
+}
+
+
+/************************************************************************/
+/*>BOOL blSavePNGBufferToFile(const unsigned char *rgb, size_t width,
+                              size_t height, size_t stride, 
+                              const char *path, blPNGOPTIONS *options)
+   -------------------------------------------------------------------
+*//**
+   Writes a PNG file from packed RGB rows which are stride bytes apart,
+   so part of a larger image may be written without copying it.
+   If path is a blank string, then writes to stdout. options may be 
+   NULL to use the libpng defaults; options->threads is ignored. This
+   is safe to call from several threads at once.
+   Returns TRUE on success, FALSE on failure.
+
+-  19.10.26 Original   By: ACRM
+*/
+BOOL blSavePNGBufferToFile(const unsigned char *rgb, size_t width,
+                           size_t height, size_t stride, const char *path,
+                           blPNGOPTIONS *options)
+{
+   return(WritePNGRows(NULL, rgb, stride, width, height, path, options));
+}
+
+
+/************************************************************************/
+/*>BOOL blSavePNGRowsToFile(blPNGROWFUNC getRow, size_t width, 
+                            size_t height, const char *path,
+                            blPNGOPTIONS *options)
+   ---------------------------------------------------------------
+*//**
+   Writes a PNG file where the rows of packed RGB are supplied one at a
+   time by getRow(). No copy of the image is held, so the memory used 
+   is a few rows whatever the size of the image.
+   If path is a blank string, then writes to stdout. options may be 
+   NULL to use the libpng defaults. If options->threads is more than 1,
+   the rows are compressed in parallel by WritePNGRowsMT() and getRow()
+   must then be safe to call from several threads.
+   Returns TRUE on success, FALSE on failure.
+
+-  19.10.26 Original   By: ACRM
+-  19.10.26 Added parallel encoder
+*/
+BOOL blSavePNGRowsToFile(blPNGROWFUNC getRow, size_t width, size_t height,
+                         const char *path, blPNGOPTIONS *options)
+{
+   if((options != NULL) && (options->threads > 1) && (height > 1))
+      return(WritePNGRowsMT(getRow, width, height, path, options));
+   return(WritePNGRows(getRow, NULL, 0, width, height, path, options));
+}
+
+
+/************************************************************************/
+/*>void blDefaultPNGOptions(blPNGOPTIONS *options)
+   -----------------------------------------------
+*//**
+   Set all compression options to the library defaults
+
+-  19.10.26 Original   By: ACRM
+*/
+void blDefaultPNGOptions(blPNGOPTIONS *options)
+{
+   options->level    = -1;
+   options->strategy = -1;
+   options->filters  = -1;
+   options->threads  = 1;
+}
+
+
+/************************************************************************/
+/*>BOOL blParsePNGOptions(char *spec, blPNGOPTIONS *options)
+   ---------------------------------------------------------
+*//**
+   Parse compression options of the form
+      level[,strategy[,filter]]
+   where level is 0-9, strategy is one of default, filtered, huffman,
+   rle or fixed and filter is one of none, sub, up, avg, paeth or all.
+   Any field may be left empty to keep the current value.
+   Returns FALSE if the specification is not understood.
+
+-  19.10.26 Original   By: ACRM
+*/
+BOOL blParsePNGOptions(char *spec, blPNGOPTIONS *options)
+{
+   static char *strategies[] = {"default", "filtered", "huffman", "rle",
+                                "fixed",   NULL};
+   static int  strategyVals[] = {Z_DEFAULT_STRATEGY, Z_FILTERED,
+                                 Z_HUFFMAN_ONLY,     Z_RLE,
+                                 Z_FIXED};
+   static char *filters[]    = {"none", "sub", "up", "avg", "paeth",
+                                "all",  NULL};
+   static int  filterVals[]  = {PNG_FILTER_NONE, PNG_FILTER_SUB,
+                                PNG_FILTER_UP,   PNG_FILTER_AVG,
+                                PNG_FILTER_PAETH, PNG_ALL_FILTERS};
+   char  field[3][32],
+         *chp;
+   int   i, n;
+   
+   /* Split into the (up to) three comma-separated fields               */
+   for(n=0; n<3; n++)
+   {
+      for(i=0; *spec && *spec!=',' && i<31; i++)
+         field[n][i] = tolower(*(spec++));
+      field[n][i] = '\0';
+      if(*spec == ',')
+         spec++;
+   }
+   if(*spec)
+      return(FALSE);
+
+   /* Compression level                                                 */
+   if(field[0][0])
+   {
+      options->level = (int)strtol(field[0], &chp, 10);
+      if(*chp || options->level < 0 || options->level > 9)
+         return(FALSE);
+   }
+
+   /* Strategy                                                          */
+   if(field[1][0])
+   {
+      for(i=0; strategies[i]!=NULL; i++)
+      {
+         if(!strcmp(field[1], strategies[i]))
+            break;
+      }
+      if(strategies[i] == NULL)
+         return(FALSE);
+      options->strategy = strategyVals[i];
+   }
+
+   /* Filter                                                            */
+   if(field[2][0])
+   {
+      for(i=0; filters[i]!=NULL; i++)
+      {
+         if(!strcmp(field[2], filters[i]))
+            break;
+      }
+      if(filters[i] == NULL)
+         return(FALSE);
+      options->filters = filterVals[i];
+   }
+
+   return(TRUE);
+}
+
 #ifdef DEMO
 /* Given a value and the maximum value, returns an integer
    between 0 and 255 proportional to value/maxval 
@@ -3,11 +3,11 @@
    Program:    QTree
    File:       qtree.c
    
-   Version:    V3.0
-   Date:       19.08.19
+   Version:    V3.8
+   Date:       19.10.26
    Function:   Use quad-tree algorithm to display a molecule
    
-   Copyright:  (c) SciTech Software 1993-2019
+   Copyright:  (c) SciTech Software 1993-2026
    Author:     Prof. Andrew C. R. Martin
    EMail:      andrew@bioinf.org.uk
                
@@ -72,11 +72,19 @@
    Revision History:
    =================
    V3.0  19.08.19 Added PNG support
+   V3.3  19.10.26 Added streaming writer and compression options
+   V3.4  19.10.26 Added threads to blPNGOPTIONS
+   V3.7  19.10.26 Added blPNGSTREAM
+   V3.8  19.10.26 Added blSavePNGBufferToFile()
 
 *************************************************************************/
+#ifndef _WRITEPNG_H
+#define _WRITEPNG_H
+
 /* Includes
 */
 #include <png.h>
+#include <zlib.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -98,9 +106,42 @@ typedef struct  /* An image                                              */
    size_t width;
    size_t height;
 }  blPNGIMAGE;
+
+typedef struct  /* Compression settings; -1 means the library default    */
+{
+   int level,          /* zlib level 0-9                                 */
+       strategy,       /* zlib strategy (Z_FILTERED, Z_RLE, ...)         */
+       filters,        /* PNG row filters (PNG_FILTER_NONE, ...)         */
+       threads;        /* Encoding threads; <2 uses a single thread       */
+}  blPNGOPTIONS;
+
+/* Supplies one row of packed RGB. It may either fill buffer and return 
+   it, or return a pointer to a row held elsewhere
+*/
+typedef unsigned char *(*blPNGROWFUNC)(int y, unsigned char *buffer);
+
+/* A PNG written a band of rows at a time                                */
+typedef struct _blpngstream blPNGSTREAM;
     
 /************************************************************************/
 /* Prototypes
 */
 blPNGPIXEL *blPNGPixelAt(blPNGIMAGE *bitmap, int x, int y);
 BOOL blSavePNGToFile(blPNGIMAGE *bitmap, const char *path);
+BOOL blSavePNGBufferToFile(const unsigned char *rgb, size_t width,
+                           size_t height, size_t stride, const char *path,
+                           blPNGOPTIONS *options);
+BOOL blSavePNGRowsToFile(blPNGROWFUNC getRow, size_t width, size_t height,
+                         const char *path, blPNGOPTIONS *options);
+void blDefaultPNGOptions(blPNGOPTIONS *options);
+BOOL blParsePNGOptions(char *spec, blPNGOPTIONS *options);
+blPNGSTREAM *blOpenPNGStream(const char *path, size_t width, 
+                             size_t height, blPNGOPTIONS *options,
+                             const unsigned char *state, size_t stateLen);
+BOOL blWritePNGRows(blPNGSTREAM *stream, blPNGROWFUNC getRow, size_t y0,
+                    size_t y1);
+size_t blGetPNGStreamState(blPNGSTREAM *stream, unsigned char **state);
+BOOL blSyncPNGStream(blPNGSTREAM *stream);
+BOOL blClosePNGStream(blPNGSTREAM *stream);
+
+#endif